@@ -70,7 +70,8 @@ const uchar POINT_OUT_OF_FOV					=	 4;				/**< Point visibility state: out of fi
 
 //! Chamfer distances types
 enum CC_CHAMFER_DISTANCE_TYPE { CHAMFER_111			=	0,			/**< Chamfer distance <1-1-1> **/
-								CHAMFER_345			=	1			/**< Chamfer distance <3-4-5> **/
+								CHAMFER_345			=	1,			/**< Chamfer distance <3-4-5> **/
+								EUCLIDEAN_EDT		=	2			/**< Exact Euclidean distance transform (sparse, see SparseEuclideanDistanceTransform) **/
 };
 
 //! Types of local models (no model, least square best fitting plan, Delaunay 2D1/2 triangulation, height function)
@@ -118,6 +118,15 @@ public:
 		**/
 		virtual void addPoint(const CCVector3 &P);
 
+		//! Adds several 3D points to the database
+		/** Contrary to ChunkedPointCloud::addPoint, the database is enlarged
+			if necessary (only the points: scalar fields are not updated).
+			\param points points coordinates (count x 3 values)
+			\param count number of points
+			\return false if there's not enough memory
+		**/
+		virtual bool addPoints(const PointCoordinateType* points, unsigned count);
+
         //! Invalidates bounding box
         /** Bounding box will be recomputed next time a request is made to 'getBoundingBox'.
         **/
@@ -218,6 +227,17 @@ public:
 		//! Returns cloud capacity (i.e. reserved size)
 		inline virtual unsigned capacity() const { return m_points->capacity(); }
 
+		//! Returns the points coordinates table
+		inline GenericChunkedArray<3,PointCoordinateType>* pointsTable() const { return m_points; }
+
+		//! Replaces the points coordinates table
+		/** Warning: the other features (scalar fields, etc.) are not resized.
+			Therefore this method should be called before adding any of them.
+			\param points new points table (can't be 0)
+			\param validBB whether the table min and max values are up-to-date (see GenericChunkedArray::computeMinAndMax)
+		**/
+		void setPointsTable(GenericChunkedArray<3,PointCoordinateType>* points, bool validBB=false);
+
 protected:
 
 		//! Swaps two points (and their associated scalar values!)
@@ -369,6 +369,14 @@ public:
 		{
 		}
 
+		//! Copy operator
+		IndexAndCode& operator=(const IndexAndCode& ic)
+		{
+			theIndex = ic.theIndex;
+			theCode = ic.theCode;
+			return *this;
+		}
+
 		//! Code-based comparison operator
 		/** \param a first IndexAndCode structure
 			\param b second IndexAndCode structure
@@ -407,10 +415,17 @@ public:
 	    unsigned index;
 	    //! Set of points lying inside this cell
         ReferenceCloud* points;
+	    //! Whether 'points' belongs to the cell (and should be deleted with it)
+	    bool ownsPoints;
 
         //! Default constructor
         octreeCell(DgmOctree* parentOctree);
 
+        //! Constructor with an external set of points
+        /** The set of points is not owned by the cell (see DgmOctreeCellReferenceCloud).
+        **/
+        octreeCell(DgmOctree* parentOctree, ReferenceCloud* points);
+
         //! Default destructor
         virtual ~octreeCell();
 	};
@@ -459,6 +474,19 @@ public:
 	**/
 	int build(const CCVector3& octreeMin, const CCVector3& octreeMax, const CCVector3* pointsMinFilter=0, const CCVector3* pointsMaxFilter=0, GenericProgressCallback* progressCb=0);
 
+	//! Restores the structure from precomputed cell codes
+	/** The codes must have been generated with the same octree and points limits (for
+		instance by a previous call to 'build' for the same cloud) and sorted by code.
+		\param octreeMin the lower limits for the octree cells along X, Y and Z
+		\param octreeMax the upper limits for the octree cells along X, Y and Z
+		\param pointsMin the lower limits of the projected points along X, Y and Z
+		\param pointsMax the upper limits of the projected points along X, Y and Z
+		\param codes (sorted) points indexes and their cell codes
+		\param count number of codes
+		\return the number of points projected in the octree (or -1 if an error occurred)
+	**/
+	int buildFromCellCodes(const CCVector3& octreeMin, const CCVector3& octreeMax, const CCVector3& pointsMin, const CCVector3& pointsMax, const IndexAndCode* codes, unsigned count);
+
 	/**** GETTERS ****/
 
 	//! Returns the number of points projected into the octree
@@ -476,6 +504,12 @@ public:
 	**/
 	inline const CCVector3& getOctreeMaxs() const {return m_dimMax;}
 
+	//! Returns the lower boundaries of the set of points projected in the octree
+	inline const CCVector3& getPointsMins() const {return m_pointsMin;}
+
+	//! Returns the higher boundaries of the set of points projected in the octree
+	inline const CCVector3& getPointsMaxs() const {return m_pointsMax;}
+
 	//! Returns the octree bounding box
 	/**	Method to request the octree bounding box limits
 		\param bbMin lower bounding-box limits (Xmin,Ymin,Zmin)
@@ -809,6 +843,63 @@ public:
 	**/
 	void diff(uchar octreeLevel, const cellsContainer &codesA, const cellsContainer &codesB, int &diffA, int &diffB, int &cellsA, int &cellsB) const;
 
+	//! Builds a lookup table to retrieve the cells of a given level in constant time
+	/** Once built, the table is used instead of the binary search by all
+		the methods that look for a cell by its code (DgmOctree::getCellIndex,
+		and therefore the neighbours searches). It is a dense table of cell
+		starts (indexed by truncated cell codes) for low levels and an open
+		addressing hash table otherwise. Its memory footprint is bounded: it
+		is never bigger than the octree structure (m_thePointsAndTheirCellCodes)
+		itself, in which case the method fails and the binary search is kept.
+		The same bound applies to all the tables together: if necessary, the
+		tables of the other levels are released first (they will be rebuilt
+		on demand). Tables are also released when the octree is cleared or
+		rebuilt.
+		Warning: not thread-safe (the table must be built before launching
+		parallel queries).
+		\param level the level of subdivision
+		\return whether a table is available for this level
+	**/
+	bool buildCellIndexLookupTable(uchar level);
+
+	//! Releases all the cells lookup tables (see DgmOctree::buildCellIndexLookupTable)
+	void releaseCellIndexLookupTables();
+
+	//! Returns whether a cells lookup table is available for a given level (see DgmOctree::buildCellIndexLookupTable)
+	inline bool hasCellIndexLookupTable(uchar level) const {assert(level<=MAX_OCTREE_LEVEL);return !m_cellIndexLookupTables[level].isEmpty();};
+
+	//! Returns the range of a cell (i.e. of its points) in the octree structure
+	/** Uses the cells lookup table if available (see DgmOctree::buildCellIndexLookupTable)
+		or a binary search otherwise.
+		\param truncatedCellCode the octree truncated cell code
+		\param level the level of subdivision
+		\param[out] first index of the first point of the cell
+		\param[out] last index following the last point of the cell
+		\return false if the cell doesn't exist
+	**/
+	bool getCellRange(OctreeCellCodeType truncatedCellCode, uchar level, unsigned& first, unsigned& last) const;
+
+	//! Builds a copy of the points coordinates sorted as the octree structure (i.e. in Morton order)
+	/** The neighbours searches then read the coordinates of the points of a
+		same cell in contiguous memory instead of reading them randomly in the
+		associated cloud (PointDescriptor::point will point to this copy).
+		The copy is automatically released when the octree is cleared or
+		rebuilt, but it must be rebuilt (or released) if the points move.
+		Warning: not thread-safe.
+		\param maxMemory maximum memory (in bytes) the copy can use (0 = no limit)
+		\return false if the copy would use more than 'maxMemory' or if there's not enough memory (the mode is then off)
+	**/
+	bool buildSortedPointsCopy(size_t maxMemory=0);
+
+	//! Releases the sorted copy of the points coordinates (see DgmOctree::buildSortedPointsCopy)
+	void releaseSortedPointsCopy();
+
+	//! Returns whether the octree uses a sorted copy of the points coordinates (see DgmOctree::buildSortedPointsCopy)
+	inline bool hasSortedPointsCopy() const {return !m_sortedPoints.empty();};
+
+	//! Returns the memory used by the sorted copy of the points coordinates (in bytes)
+	inline size_t getSortedPointsCopyMemory() const {return m_sortedPoints.capacity()*sizeof(CCVector3);};
+
 	//! Returns the number of cells for a given level of subdivision
 	inline const unsigned& getCellNumber(uchar level) const {assert(level<=MAX_OCTREE_LEVEL);return m_cellCount[level];};
 
@@ -841,6 +932,10 @@ public:
 		(if no points lies in it) or to 1 (if some points lie in it, e.g. if it is indeed a
 		cell of this octree). This version of the algorithm can be applied by considering only
 		a specified list of octree cells (ignoring the others).
+		Adjacent cells are merged with a union-find structure built over the (sorted) cell codes
+		(neighbour cells are retrieved through a hash table). Components are labeled (starting
+		from 1) by ascending (Z,Y,X) position of their first cell. With ENABLE_MT_OCTREE, cells
+		are merged in parallel (lock-free).
 		\param cellCodes the cell codes to consider for the CC computation
 		\param level the level of subidivision at which to perform the algorithm
 		\param sixConnexity indicates if the CC's 3D connexity should be 6 (26 otherwise)
@@ -1027,6 +1122,82 @@ protected:
 		uchar level;
 	};
 
+	//! Cells lookup table for a given level of subdivision (see DgmOctree::buildCellIndexLookupTable)
+	struct CellIndexLookupTable
+	{
+		//! Hash table entry
+		struct Entry
+		{
+			//! Truncated cell code (INVALID_CELL_CODE for empty slots)
+			OctreeCellCodeType truncatedCode;
+			//! Index of the first point of the cell
+			unsigned first;
+			//! Index following the last point of the cell
+			unsigned last;
+		};
+
+		//! Dense table: index of the first point of each cell (indexed by truncated code, plus one last entry)
+		/** Cell 'c' points are in [cellStarts[c] ; cellStarts[c+1]) (empty range if the cell doesn't exist).
+		**/
+		std::vector<unsigned> cellStarts;
+		//! Hash table (open addressing with linear probing, power-of-2 size)
+		std::vector<Entry> entries;
+		//! Hash table size minus one
+		unsigned mask;
+
+		//! Default constructor
+		CellIndexLookupTable() : mask(0) {}
+
+		//! Returns whether the table is empty
+		inline bool isEmpty() const { return cellStarts.empty() && entries.empty(); }
+
+		//! Hashes a truncated cell code
+		static inline unsigned Hash(OctreeCellCodeType truncatedCode)
+		{
+			unsigned h = static_cast<unsigned>(truncatedCode ^ (truncatedCode >> 29)) * 2654435761u;
+			return h ^ (h >> 16);
+		}
+
+		//! Looks for a cell
+		/** \return false if the cell doesn't exist
+		**/
+		inline bool find(OctreeCellCodeType truncatedCode, unsigned& first, unsigned& last) const
+		{
+			if (!cellStarts.empty())
+			{
+				if (truncatedCode+1 >= cellStarts.size())
+					return false;
+				first = cellStarts[truncatedCode];
+				last = cellStarts[truncatedCode+1];
+				return (first != last);
+			}
+
+			for (unsigned i = (Hash(truncatedCode) & mask); ; i = ((i+1) & mask))
+			{
+				const Entry& e = entries[i];
+				if (e.truncatedCode == truncatedCode)
+				{
+					first = e.first;
+					last = e.last;
+					return true;
+				}
+				if (e.truncatedCode == INVALID_CELL_CODE)
+					return false;
+			}
+		}
+
+		//! Returns the memory used by the table (in bytes)
+		inline size_t memory() const { return cellStarts.capacity()*sizeof(unsigned) + entries.capacity()*sizeof(Entry); }
+
+		//! Releases memory
+		void clear()
+		{
+			std::vector<unsigned>().swap(cellStarts);
+			std::vector<Entry>().swap(entries);
+			mask = 0;
+		}
+	};
+
 	/********************************/
 	/**         ATTRIBUTES         **/
 	/********************************/
@@ -1063,6 +1234,12 @@ protected:
 	//! Std. dev. of cell population per level of subdivision
 	double m_stdDevCellPopulation[MAX_OCTREE_LEVEL+1];
 
+	//! Cells lookup tables per level of subdivision (see DgmOctree::buildCellIndexLookupTable)
+	CellIndexLookupTable m_cellIndexLookupTables[MAX_OCTREE_LEVEL+1];
+
+	//! Copy of the points coordinates sorted as m_thePointsAndTheirCellCodes (see DgmOctree::buildSortedPointsCopy)
+	std::vector<CCVector3> m_sortedPoints;
+
 	//! Dump cloud
 	ReferenceCloud* m_dumpCloud;
 
@@ -1079,6 +1256,12 @@ protected:
 	//! Updates the tables containing octree limits and boundaries
 	void updateMinAndMaxTables();
 
+	//! Returns the coordinates of a point of the octree structure
+	/** Reads the sorted copy of the coordinates if any (see DgmOctree::buildSortedPointsCopy).
+		\param p iterator on m_thePointsAndTheirCellCodes
+	**/
+	inline const CCVector3* getStructurePoint(cellsContainer::const_iterator p) const;
+
 	//! Updates the tables containing the octree cells length for each level of subdivision
 	void updateCellSizeTable();
 
@@ -1120,7 +1303,9 @@ protected:
 #endif
 
 	//! Returns the index of a given cell represented by its code
-	/** The index is found thanks to a binary search. The index of an existing cell
+	/** The index is found thanks to the cells lookup table of the corresponding
+		level if any (see DgmOctree::buildCellIndexLookupTable), or thanks to a
+		binary search otherwise. The index of an existing cell
 		is between 0 and the number of points projected in the octree minus 1. If
 		the cell code cannot be found in the octree structure, then the method returns
 		an index equal to the number of projected points (m_numberOfProjectedPoints).
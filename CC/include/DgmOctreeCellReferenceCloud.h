@@ -0,0 +1,101 @@
+//##########################################################################
+//#                                                                        #
+//#                               CCLIB                                    #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU Library General Public License as       #
+//#  published by the Free Software Foundation; version 2 of the License.  #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: EDF R&D / TELECOM ParisTech (ENST-TSI)             #
+//#                                                                        #
+//##########################################################################
+
+#ifndef DGM_OCTREE_CELL_REFERENCE_CLOUD_HEADER
+#define DGM_OCTREE_CELL_REFERENCE_CLOUD_HEADER
+
+#include "ReferenceCloud.h"
+#include "DgmOctree.h"
+
+namespace CCLib
+{
+
+//! A non-owning ReferenceCloud on a range of DgmOctree::m_thePointsAndTheirCellCodes
+/** The points of an octree cell (at any level) are stored contiguously in
+	the octree structure: this cloud directly reads their indexes from it
+	(no copy, no allocation). It can be moved from one cell to another with
+	DgmOctreeCellReferenceCloud::setRange. Its content can't be modified
+	(addPointIndex, setPointIndex, etc. fail).
+**/
+#ifdef CC_USE_AS_DLL
+#include "CloudCompareDll.h"
+
+class CC_DLL_API DgmOctreeCellReferenceCloud : public ReferenceCloud
+#else
+class DgmOctreeCellReferenceCloud : public ReferenceCloud
+#endif
+{
+public:
+
+	//! Default constructor
+	/** \param associatedCloud the cloud on which the octree is built
+	**/
+	DgmOctreeCellReferenceCloud(GenericIndexedCloudPersist* associatedCloud);
+
+	//! Sets the range of points
+	/** \param first first element of the range (in DgmOctree::m_thePointsAndTheirCellCodes)
+		\param count number of elements
+	**/
+	inline void setRange(const DgmOctree::IndexAndCode* first, unsigned count) {m_first = first; m_count = count; m_globalIterator = 0; m_validBB = false;}
+
+	//**** inherited form GenericCloud ****//
+	inline virtual unsigned size() const {return m_count;}
+	virtual void forEach(genericPointAction& anAction);
+	inline virtual const CCVector3* getNextPoint() {assert(m_theAssociatedCloud); return (m_globalIterator < m_count ? m_theAssociatedCloud->getPoint(m_first[m_globalIterator++].theIndex) : 0);}
+	inline virtual void setPointScalarValue(unsigned pointIndex, ScalarType value) {assert(m_theAssociatedCloud && pointIndex<m_count); m_theAssociatedCloud->setPointScalarValue(m_first[pointIndex].theIndex,value);}
+	inline virtual ScalarType getPointScalarValue(unsigned pointIndex) const {assert(m_theAssociatedCloud && pointIndex<m_count); return m_theAssociatedCloud->getPointScalarValue(m_first[pointIndex].theIndex);}
+
+	//**** inherited form GenericIndexedCloud ****//
+	inline virtual const CCVector3* getPoint(unsigned index) {assert(m_theAssociatedCloud && index < m_count); return m_theAssociatedCloud->getPoint(m_first[index].theIndex);}
+	inline virtual void getPoint(unsigned index, CCVector3& P) const {assert(m_theAssociatedCloud && index < m_count); m_theAssociatedCloud->getPoint(m_first[index].theIndex,P);}
+
+	//**** inherited form GenericIndexedCloudPersist ****//
+	inline virtual const CCVector3* getPointPersistentPtr(unsigned index) {assert(m_theAssociatedCloud && index < m_count); return m_theAssociatedCloud->getPointPersistentPtr(m_first[index].theIndex);}
+
+	//**** inherited form ReferenceCloud ****//
+	inline virtual unsigned getPointGlobalIndex(unsigned localIndex) const {assert(localIndex < m_count); return m_first[localIndex].theIndex;}
+	virtual const CCVector3* getCurrentPointCoordinates() const;
+	inline virtual unsigned getCurrentPointGlobalIndex() const {assert(m_globalIterator < m_count); return m_first[m_globalIterator].theIndex;}
+	inline virtual ScalarType getCurrentPointScalarValue() const {assert(m_theAssociatedCloud && m_globalIterator < m_count); return m_theAssociatedCloud->getPointScalarValue(m_first[m_globalIterator].theIndex);}
+	inline virtual void setCurrentPointScalarValue(ScalarType value) {assert(m_theAssociatedCloud && m_globalIterator < m_count); m_theAssociatedCloud->setPointScalarValue(m_first[m_globalIterator].theIndex,value);}
+	inline virtual void clear(bool /*releaseMemory*/) {setRange(0,0);}
+
+	//the following methods are not supported (the indexes belong to the octree)
+	inline virtual bool addPointIndex(unsigned /*globalIndex*/) {assert(false); return false;}
+	inline virtual bool addPointIndex(unsigned /*firstIndex*/, unsigned /*lastIndex*/) {assert(false); return false;}
+	inline virtual void setPointIndex(unsigned /*localIndex*/, unsigned /*globalIndex*/) {assert(false);}
+	inline virtual bool reserve(unsigned n) {return n <= m_count;}
+	inline virtual bool resize(unsigned /*n*/) {assert(false); return false;}
+	inline virtual void swap(unsigned /*i*/, unsigned /*j*/) {assert(false);}
+	inline virtual void removePointGlobalIndex(unsigned /*localIndex*/) {assert(false);}
+	inline virtual void setAssociatedCloud(GenericIndexedCloudPersist* /*cloud*/) {assert(false);}
+
+protected:
+
+	//inherited from ReferenceCloud
+	virtual void computeBB();
+
+	//! First element of the range
+	const DgmOctree::IndexAndCode* m_first;
+
+	//! Number of elements
+	unsigned m_count;
+};
+
+}
+
+#endif //DGM_OCTREE_CELL_REFERENCE_CLOUD_HEADER
@@ -243,7 +243,10 @@ public:
 	/** This methods uses a 3D grid to perfrom the Chamfer Distance propagation.
 		Therefore, the greater the octree level (used to determine the grid step) is, the finer
 		is the result, but more memory (and time) will be needed.
-		\param cType the Chamfer Distance type (1-1-1, 3-4-5, etc.)
+		With EUCLIDEAN_EDT, the exact Euclidean distance (between cell centers) is computed
+		only for the cells of the compared cloud, without allocating the whole 3D grid (see
+		SparseEuclideanDistanceTransform). It is more accurate and generally faster.
+		\param cType the Chamfer Distance type (1-1-1, 3-4-5 or exact Euclidean)
 		\param comparedCloud the compared cloud
 		\param referenceCloud the reference cloud
 		\param octreeLevel the octree level at which to perform the Chamfer Distance propagation
@@ -268,6 +271,19 @@ public:
 
 protected:
 
+	//! Computes the exact Euclidean distance transform between two (synchronized) octrees
+	/** This method is used by computeChamferDistanceBetweenTwoClouds (EUCLIDEAN_EDT mode).
+		The distances are directly stored as the scalar values of the points of octreeA.
+		\param octreeA the octree of the compared cloud
+		\param octreeB the octree of the reference cloud
+		\param octreeLevel the octree level at which to perform the distance transform
+		\param minIndexes the min cell indexes of the (common) grid
+		\param boxSize the size of the (common) grid
+		\param progressCb the client method can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
+		\return the max distance (in cells) or a negative value if an error occured
+	**/
+	static int computeSparseEDTBetweenTwoOctrees(DgmOctree* octreeA, DgmOctree* octreeB, uchar octreeLevel, const int* minIndexes, const unsigned short* boxSize, GenericProgressCallback* progressCb=0);
+
 	//! Projects a mesh into a grid structure
 	/** This method is used by computePointCloud2MeshDistance.
 		\param theIntersection a specific structure to store the result of the intersection
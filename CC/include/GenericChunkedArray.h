@@ -35,6 +35,7 @@ static const unsigned ELEMENT_INDEX_BIT_MASK = MAX_NUMBER_OF_ELEMENTS_PER_CHUNK-
 #include <stdlib.h>
 #include <string.h>
 #include <vector>
+#include <algorithm>
 
 //! A generic array structure split in several small chunks to avoid the 'biggest contigous memory chunk' limit
 /** This very useful structure can be used to store n-uplets (n starting from 1) of scalar types (int, float, etc.)
@@ -96,11 +97,7 @@ public:
 		if (releaseMemory)
 		{
 			while (!m_theChunks.empty())
-			{
-				delete[] m_theChunks.back();
-				m_theChunks.pop_back();
-			}
-			m_perChunkCount.clear();
+				releaseLastChunk();
 			m_maxCount=0;
 		}
 
@@ -177,6 +174,7 @@ public:
 			{
 				m_theChunks.push_back(0);
 				m_perChunkCount.push_back(0);
+				m_chunkOwners.push_back(0);
 			}
 
 			//the number of new elements that we want to reserve
@@ -188,20 +186,18 @@ public:
 				newNumberOfElementsForThisChunk = freeSpaceInThisChunk;
 
 			//let's reallocate the chunk
-			void* newTable = realloc(m_theChunks.back(),(m_perChunkCount.back()+newNumberOfElementsForThisChunk)*N*sizeof(ElementType));
-			//not enough memory?!
-			if (!newTable)
+			if (!reallocLastChunk(m_perChunkCount.back()+newNumberOfElementsForThisChunk))
 			{
 				//we cancel last insertion if it's an empty chunk
 				if (m_perChunkCount.back()==0)
 				{
 					m_perChunkCount.pop_back();
 					m_theChunks.pop_back();
+					m_chunkOwners.pop_back();
 				}
 				return false;
 			}
 			//otherwise we update current structure
-			m_theChunks.back() = (ElementType*)newTable;
 			m_perChunkCount.back() += newNumberOfElementsForThisChunk;
 			m_maxCount += newNumberOfElementsForThisChunk;
 		}
@@ -258,9 +254,7 @@ public:
 				{
 					//simply remove the chunk
 					m_maxCount -= numberOfElementsForThisChunk;
-					delete m_theChunks.back();
-					m_theChunks.pop_back();
-					m_perChunkCount.pop_back();
+					releaseLastChunk();
 				}
 				//otherwise
 				else
@@ -268,11 +262,9 @@ public:
 					//we resize the chunk
 					numberOfElementsForThisChunk -= spaceToFree;
 					assert(numberOfElementsForThisChunk>0);
-					void* newTable = realloc(m_theChunks.back(),numberOfElementsForThisChunk*N*sizeof(ElementType));
 					//if 'realloc' failed?!
-					if (!newTable)
+					if (!reallocLastChunk(numberOfElementsForThisChunk))
 						return false;
-					m_theChunks.back() = (ElementType*)newTable;
 					m_perChunkCount.back() = numberOfElementsForThisChunk;
 					m_maxCount -= spaceToFree;
 				}
@@ -441,6 +433,154 @@ public:
 	//! Returns the begining of a given chunk (pointer)
 	inline ElementType* chunkStartPtr(unsigned index) const { assert(index < m_theChunks.size()); return m_theChunks[index]; }
 
+	//! Returns whether a given chunk is stored in external memory (see adoptChunk)
+	inline bool isChunkExternal(unsigned index) const { assert(index < m_theChunks.size()); return m_chunkOwners[index] != 0; }
+
+	//! Appends an already filled chunk to the array (without copy)
+	/** The array must be empty or its last chunk must be full (i.e. its
+		capacity must be a multiple of MAX_NUMBER_OF_ELEMENTS_PER_CHUNK).
+		If an owner is specified, the chunk memory is considered as external:
+		the owner is linked (and released when the chunk is not used anymore)
+		and the chunk is only copied if it has to be reallocated. Otherwise
+		the array takes ownership of the memory (which must then have been
+		allocated with 'malloc').
+		WARNING: the array size (see currentSize) is updated as well.
+		\param data chunk data (count x N elements)
+		\param count number of elements in the chunk (should be MAX_NUMBER_OF_ELEMENTS_PER_CHUNK, except for the last chunk)
+		\param owner [optional] external memory owner
+		\return success
+	**/
+	bool adoptChunk(ElementType* data, unsigned count, CCShareable* owner=0)
+	{
+		if (!data || count == 0 || count > MAX_NUMBER_OF_ELEMENTS_PER_CHUNK)
+			return false;
+		//we can only append chunks after full ones
+		if (m_count != m_maxCount || (!m_perChunkCount.empty() && m_perChunkCount.back() != MAX_NUMBER_OF_ELEMENTS_PER_CHUNK))
+			return false;
+
+		try
+		{
+			m_theChunks.reserve(m_theChunks.size()+1);
+			m_perChunkCount.reserve(m_perChunkCount.size()+1);
+			m_chunkOwners.reserve(m_chunkOwners.size()+1);
+		}
+		catch(std::bad_alloc)
+		{
+			//not enough memory
+			return false;
+		}
+		m_theChunks.push_back(data);
+		m_perChunkCount.push_back(count);
+		m_chunkOwners.push_back(owner);
+
+		if (owner)
+			owner->link();
+		m_maxCount += count;
+		m_count = m_maxCount;
+
+		return true;
+	}
+
+	//! Appends several elements at once (copy)
+	/** The array is enlarged if necessary. The elements are copied chunk by chunk.
+		\param data elements (count x N values)
+		\param count number of elements
+		\return success (false if there's not enough memory)
+	**/
+	bool addElements(const ElementType* data, unsigned count)
+	{
+		if (count == 0)
+			return true;
+		if (m_count+count > m_maxCount && !reserve(m_count+count))
+			return false;
+
+		unsigned index = m_count;
+		while (count != 0)
+		{
+			unsigned chunkIndex = (index >> CHUNK_INDEX_BIT_DEC);
+			unsigned indexInChunk = (index & ELEMENT_INDEX_BIT_MASK);
+			unsigned copyCount = std::min<unsigned>(count,m_perChunkCount[chunkIndex]-indexInChunk);
+			memcpy(m_theChunks[chunkIndex]+indexInChunk*(unsigned)N,data,copyCount*N*sizeof(ElementType));
+			data += copyCount*(unsigned)N;
+			index += copyCount;
+			count -= copyCount;
+		}
+		m_count = index;
+
+		return true;
+	}
+
+	//! Appends the elements of another array (copy)
+	/** \param other array to append
+		\return success (false if there's not enough memory)
+	**/
+	bool append(const GenericChunkedArray<N,ElementType>& other)
+	{
+		if (other.m_count == 0)
+			return true;
+		if (m_count+other.m_count > m_maxCount && !reserve(m_count+other.m_count))
+			return false;
+
+		unsigned remaining = other.m_count;
+		for (unsigned i=0; remaining!=0; ++i)
+		{
+			unsigned count = std::min<unsigned>(remaining,other.m_perChunkCount[i]);
+			addElements(other.m_theChunks[i],count); //can't fail (see above)
+			remaining -= count;
+		}
+
+		return true;
+	}
+
+	//! Moves the chunks of another array at the end of this one (without copy)
+	/** Only possible if this array is empty or if its size is a multiple of
+		MAX_NUMBER_OF_ELEMENTS_PER_CHUNK (any reserved but unused memory
+		is released first). The other array is emptied in the process (its
+		chunks, external or not, now belong to this array). Min and max values
+		are not updated (see computeMinAndMax).
+		\param other array to empty
+		\return whether the chunks could be moved (nothing is changed otherwise)
+	**/
+	bool stealChunks(GenericChunkedArray<N,ElementType>& other)
+	{
+		if (&other == this || (m_count & ELEMENT_INDEX_BIT_MASK) != 0)
+			return false;
+		if (other.m_count == 0)
+			return true;
+
+		unsigned fullChunks = (m_count >> CHUNK_INDEX_BIT_DEC);
+		try
+		{
+			m_theChunks.reserve(fullChunks+other.m_theChunks.size());
+			m_perChunkCount.reserve(fullChunks+other.m_perChunkCount.size());
+			m_chunkOwners.reserve(fullChunks+other.m_chunkOwners.size());
+		}
+		catch(std::bad_alloc)
+		{
+			//not enough memory
+			return false;
+		}
+
+		//release the reserved (empty) chunks
+		while (m_theChunks.size() > fullChunks)
+			releaseLastChunk();
+
+		m_theChunks.insert(m_theChunks.end(),other.m_theChunks.begin(),other.m_theChunks.end());
+		m_perChunkCount.insert(m_perChunkCount.end(),other.m_perChunkCount.begin(),other.m_perChunkCount.end());
+		m_chunkOwners.insert(m_chunkOwners.end(),other.m_chunkOwners.begin(),other.m_chunkOwners.end());
+		m_count += other.m_count;
+		m_maxCount = m_count - other.m_count + other.m_maxCount;
+
+		//the other array doesn't own the chunks anymore
+		other.m_theChunks.clear();
+		other.m_perChunkCount.clear();
+		other.m_chunkOwners.clear();
+		other.m_maxCount = 0;
+		other.clear(false);
+
+		return true;
+	}
+
 	//! Copy array data to another one
 	/** \param dest destination array (will be resize if necessary)
 		\return success
@@ -472,10 +612,7 @@ protected:
 	virtual ~GenericChunkedArray()
 	{
 		while (!m_theChunks.empty())
-		{
-			delete[] m_theChunks.back();
-			m_theChunks.pop_back();
-		}
+			releaseLastChunk();
 	}
 
 	//! Minimum values stored in array (along each dimension)
@@ -488,6 +625,8 @@ protected:
 	std::vector<ElementType*> m_theChunks;
 	//! Elements per chunk
 	std::vector<unsigned> m_perChunkCount;
+	//! Chunks external owners (0 if the chunk memory belongs to the array)
+	std::vector<CCShareable*> m_chunkOwners;
 	//! Total number of elements
 	unsigned m_count;
 	//! Max total number of elements
@@ -495,6 +634,45 @@ protected:
 
 	//! Iterator
 	unsigned m_iterator;
+
+	//! Reallocates the last chunk
+	/** External chunks are copied (and detached from their owner).
+	**/
+	bool reallocLastChunk(unsigned newCount)
+	{
+		assert(!m_theChunks.empty());
+		if (m_chunkOwners.back())
+		{
+			void* newTable = malloc(newCount*N*sizeof(ElementType));
+			if (!newTable)
+				return false;
+			memcpy(newTable,m_theChunks.back(),std::min<unsigned>(newCount,m_perChunkCount.back())*N*sizeof(ElementType));
+			m_chunkOwners.back()->release();
+			m_chunkOwners.back() = 0;
+			m_theChunks.back() = (ElementType*)newTable;
+		}
+		else
+		{
+			void* newTable = realloc(m_theChunks.back(),newCount*N*sizeof(ElementType));
+			if (!newTable)
+				return false;
+			m_theChunks.back() = (ElementType*)newTable;
+		}
+		return true;
+	}
+
+	//! Releases the last chunk
+	void releaseLastChunk()
+	{
+		assert(!m_theChunks.empty());
+		if (m_chunkOwners.back())
+			m_chunkOwners.back()->release();
+		else
+			free(m_theChunks.back());
+		m_theChunks.pop_back();
+		m_perChunkCount.pop_back();
+		m_chunkOwners.pop_back();
+	}
 };
 
 //! Specialization of GenericChunkedArray for the case where N=1 (speed up)
@@ -552,11 +730,7 @@ public:
 		if (releaseMemory)
 		{
 			while (!m_theChunks.empty())
-			{
-				delete[] m_theChunks.back();
-				m_theChunks.pop_back();
-			}
-			m_perChunkCount.clear();
+				releaseLastChunk();
 			m_maxCount=0;
 		}
 
@@ -631,6 +805,7 @@ public:
 			{
 				m_theChunks.push_back(0);
 				m_perChunkCount.push_back(0);
+				m_chunkOwners.push_back(0);
 			}
 
 			//the number of new elements that we want to reserve
@@ -642,20 +817,18 @@ public:
 				newNumberOfElementsForThisChunk = freeSpaceInThisChunk;
 
 			//let's reallocate the chunk
-			void* newTable = realloc(m_theChunks.back(),(m_perChunkCount.back()+newNumberOfElementsForThisChunk)*sizeof(ElementType));
-			//not enough memory?!
-			if (!newTable)
+			if (!reallocLastChunk(m_perChunkCount.back()+newNumberOfElementsForThisChunk))
 			{
 				//we cancel last insertion if it's an empty chunk
 				if (m_perChunkCount.back()==0)
 				{
 					m_perChunkCount.pop_back();
 					m_theChunks.pop_back();
+					m_chunkOwners.pop_back();
 				}
 				return false;
 			}
 			//otherwise we update current structure
-			m_theChunks.back() = (ElementType*)newTable;
 			m_perChunkCount.back() += newNumberOfElementsForThisChunk;
 			m_maxCount += newNumberOfElementsForThisChunk;
 		}
@@ -712,9 +885,7 @@ public:
 				{
 					//simply remove the chunk
 					m_maxCount -= numberOfElementsForThisChunk;
-					delete m_theChunks.back();
-					m_theChunks.pop_back();
-					m_perChunkCount.pop_back();
+					releaseLastChunk();
 				}
 				//otherwise
 				else
@@ -722,11 +893,9 @@ public:
 					//we resize the chunk
 					numberOfElementsForThisChunk -= spaceToFree;
 					assert(numberOfElementsForThisChunk>0);
-					void* newTable = realloc(m_theChunks.back(),numberOfElementsForThisChunk*sizeof(ElementType));
 					//if 'realloc' failed?!
-					if (!newTable)
+					if (!reallocLastChunk(numberOfElementsForThisChunk))
 						return false;
-					m_theChunks.back() = (ElementType*)newTable;
 					m_perChunkCount.back() = numberOfElementsForThisChunk;
 					m_maxCount -= spaceToFree;
 				}
@@ -900,6 +1069,154 @@ public:
 	//! Returns the begining of a given chunk (pointer)
 	inline ElementType* chunkStartPtr(unsigned index) const { assert(index < m_theChunks.size()); return m_theChunks[index]; }
 
+	//! Returns whether a given chunk is stored in external memory (see adoptChunk)
+	inline bool isChunkExternal(unsigned index) const { assert(index < m_theChunks.size()); return m_chunkOwners[index] != 0; }
+
+	//! Appends an already filled chunk to the array (without copy)
+	/** The array must be empty or its last chunk must be full (i.e. its
+		capacity must be a multiple of MAX_NUMBER_OF_ELEMENTS_PER_CHUNK).
+		If an owner is specified, the chunk memory is considered as external:
+		the owner is linked (and released when the chunk is not used anymore)
+		and the chunk is only copied if it has to be reallocated. Otherwise
+		the array takes ownership of the memory (which must then have been
+		allocated with 'malloc').
+		WARNING: the array size (see currentSize) is updated as well.
+		\param data chunk data (count x N elements)
+		\param count number of elements in the chunk (should be MAX_NUMBER_OF_ELEMENTS_PER_CHUNK, except for the last chunk)
+		\param owner [optional] external memory owner
+		\return success
+	**/
+	bool adoptChunk(ElementType* data, unsigned count, CCShareable* owner=0)
+	{
+		if (!data || count == 0 || count > MAX_NUMBER_OF_ELEMENTS_PER_CHUNK)
+			return false;
+		//we can only append chunks after full ones
+		if (m_count != m_maxCount || (!m_perChunkCount.empty() && m_perChunkCount.back() != MAX_NUMBER_OF_ELEMENTS_PER_CHUNK))
+			return false;
+
+		try
+		{
+			m_theChunks.reserve(m_theChunks.size()+1);
+			m_perChunkCount.reserve(m_perChunkCount.size()+1);
+			m_chunkOwners.reserve(m_chunkOwners.size()+1);
+		}
+		catch(std::bad_alloc)
+		{
+			//not enough memory
+			return false;
+		}
+		m_theChunks.push_back(data);
+		m_perChunkCount.push_back(count);
+		m_chunkOwners.push_back(owner);
+
+		if (owner)
+			owner->link();
+		m_maxCount += count;
+		m_count = m_maxCount;
+
+		return true;
+	}
+
+	//! Appends several elements at once (copy)
+	/** The array is enlarged if necessary. The elements are copied chunk by chunk.
+		\param data elements (count x N values)
+		\param count number of elements
+		\return success (false if there's not enough memory)
+	**/
+	bool addElements(const ElementType* data, unsigned count)
+	{
+		if (count == 0)
+			return true;
+		if (m_count+count > m_maxCount && !reserve(m_count+count))
+			return false;
+
+		unsigned index = m_count;
+		while (count != 0)
+		{
+			unsigned chunkIndex = (index >> CHUNK_INDEX_BIT_DEC);
+			unsigned indexInChunk = (index & ELEMENT_INDEX_BIT_MASK);
+			unsigned copyCount = std::min<unsigned>(count,m_perChunkCount[chunkIndex]-indexInChunk);
+			memcpy(m_theChunks[chunkIndex]+indexInChunk,data,copyCount*sizeof(ElementType));
+			data += copyCount;
+			index += copyCount;
+			count -= copyCount;
+		}
+		m_count = index;
+
+		return true;
+	}
+
+	//! Appends the elements of another array (copy)
+	/** \param other array to append
+		\return success (false if there's not enough memory)
+	**/
+	bool append(const GenericChunkedArray<1,ElementType>& other)
+	{
+		if (other.m_count == 0)
+			return true;
+		if (m_count+other.m_count > m_maxCount && !reserve(m_count+other.m_count))
+			return false;
+
+		unsigned remaining = other.m_count;
+		for (unsigned i=0; remaining!=0; ++i)
+		{
+			unsigned count = std::min<unsigned>(remaining,other.m_perChunkCount[i]);
+			addElements(other.m_theChunks[i],count); //can't fail (see above)
+			remaining -= count;
+		}
+
+		return true;
+	}
+
+	//! Moves the chunks of another array at the end of this one (without copy)
+	/** Only possible if this array is empty or if its size is a multiple of
+		MAX_NUMBER_OF_ELEMENTS_PER_CHUNK (any reserved but unused memory
+		is released first). The other array is emptied in the process (its
+		chunks, external or not, now belong to this array). Min and max values
+		are not updated (see computeMinAndMax).
+		\param other array to empty
+		\return whether the chunks could be moved (nothing is changed otherwise)
+	**/
+	bool stealChunks(GenericChunkedArray<1,ElementType>& other)
+	{
+		if (&other == this || (m_count & ELEMENT_INDEX_BIT_MASK) != 0)
+			return false;
+		if (other.m_count == 0)
+			return true;
+
+		unsigned fullChunks = (m_count >> CHUNK_INDEX_BIT_DEC);
+		try
+		{
+			m_theChunks.reserve(fullChunks+other.m_theChunks.size());
+			m_perChunkCount.reserve(fullChunks+other.m_perChunkCount.size());
+			m_chunkOwners.reserve(fullChunks+other.m_chunkOwners.size());
+		}
+		catch(std::bad_alloc)
+		{
+			//not enough memory
+			return false;
+		}
+
+		//release the reserved (empty) chunks
+		while (m_theChunks.size() > fullChunks)
+			releaseLastChunk();
+
+		m_theChunks.insert(m_theChunks.end(),other.m_theChunks.begin(),other.m_theChunks.end());
+		m_perChunkCount.insert(m_perChunkCount.end(),other.m_perChunkCount.begin(),other.m_perChunkCount.end());
+		m_chunkOwners.insert(m_chunkOwners.end(),other.m_chunkOwners.begin(),other.m_chunkOwners.end());
+		m_count += other.m_count;
+		m_maxCount = m_count - other.m_count + other.m_maxCount;
+
+		//the other array doesn't own the chunks anymore
+		other.m_theChunks.clear();
+		other.m_perChunkCount.clear();
+		other.m_chunkOwners.clear();
+		other.m_maxCount = 0;
+		other.clear(false);
+
+		return true;
+	}
+
 	//! Copy array data to another one
 	/** \param dest destination array (will be resized if necessary)
 		\return success
@@ -931,10 +1248,7 @@ protected:
 	virtual ~GenericChunkedArray()
 	{
 		while (!m_theChunks.empty())
-		{
-			delete[] m_theChunks.back();
-			m_theChunks.pop_back();
-		}
+			releaseLastChunk();
 	}
 
 	//! Minimum values stored in array (along each dimension)
@@ -947,6 +1261,8 @@ protected:
 	std::vector<ElementType*> m_theChunks;
 	//! Elements per chunk
 	std::vector<unsigned> m_perChunkCount;
+	//! Chunks external owners (0 if the chunk memory belongs to the array)
+	std::vector<CCShareable*> m_chunkOwners;
 	//! Total number of elements
 	unsigned m_count;
 	//! Max total number of elements
@@ -954,6 +1270,45 @@ protected:
 
 	//! Iterator
 	unsigned m_iterator;
+
+	//! Reallocates the last chunk
+	/** External chunks are copied (and detached from their owner).
+	**/
+	bool reallocLastChunk(unsigned newCount)
+	{
+		assert(!m_theChunks.empty());
+		if (m_chunkOwners.back())
+		{
+			void* newTable = malloc(newCount*sizeof(ElementType));
+			if (!newTable)
+				return false;
+			memcpy(newTable,m_theChunks.back(),std::min<unsigned>(newCount,m_perChunkCount.back())*sizeof(ElementType));
+			m_chunkOwners.back()->release();
+			m_chunkOwners.back() = 0;
+			m_theChunks.back() = (ElementType*)newTable;
+		}
+		else
+		{
+			void* newTable = realloc(m_theChunks.back(),newCount*sizeof(ElementType));
+			if (!newTable)
+				return false;
+			m_theChunks.back() = (ElementType*)newTable;
+		}
+		return true;
+	}
+
+	//! Releases the last chunk
+	void releaseLastChunk()
+	{
+		assert(!m_theChunks.empty());
+		if (m_chunkOwners.back())
+			m_chunkOwners.back()->release();
+		else
+			free(m_theChunks.back());
+		m_theChunks.pop_back();
+		m_perChunkCount.pop_back();
+		m_chunkOwners.pop_back();
+	}
 };
 
 #endif //GENERIC_CHUNKED_ARRAY_HEADER
@@ -31,6 +31,7 @@ class GenericIndexedMesh;
 class GenericProgressCallback;
 class ReferenceCloud;
 class Polyline;
+class DgmOctree;
 
 //! Manual segmentation algorithms (inside/outside a polyline, etc.)
 
@@ -47,18 +48,26 @@ public:
 	//! Extracts the points that fall inside/outside of a 2D polyline once projected on the screen
 	/** The camera parameters of the screen must be transmitted to this method,
 		as well as the polyline (generally drawn on the screen by a user)
-		expressed in the screen coordinates.
+		expressed in the screen coordinates. The points are projected by batches
+		and tested against a rasterized version of the polyline first (the exact
+		test is only performed near its border). If an octree is provided, whole
+		octree cells which projection falls entirely inside or outside of the
+		polyline are accepted or rejected at once. The points are processed by
+		blocks (in parallel if ENABLE_MT_OCTREE is defined). The extracted points
+		are always referenced in the cloud order.
 		\param aCloud the cloud to segment
 		\param poly the polyline
 		\param keepInside if true (resp. false), the points falling inside (resp. outside) the polyline will be extracted
-		\param viewMat the optional 4x4 visualization matrix (OpenGL style)
+		\param viewMat the optional 4x4 visualization matrix (OpenGL style, affine: no perspective division)
+		\param octree the optional octree of the cloud (ignored if it hasn't been computed on all the cloud points)
 		\return a cloud structure containing references to the extracted points (references to - no duplication)
 	**/
-	static ReferenceCloud* segment(GenericIndexedCloudPersist* aCloud, const Polyline* poly, bool keepInside, const float* viewMat=0);
+	static ReferenceCloud* segment(GenericIndexedCloudPersist* aCloud, const Polyline* poly, bool keepInside, const float* viewMat=0, const DgmOctree* octree=0);
 
 	//! Extracts the points which associated scalar value fall inside a specified interval
 	/** All the points with an associated scalar value comprised between minDist and maxDist
-		will be extracted.
+		will be extracted. The points are tested by blocks (in parallel if ENABLE_MT_OCTREE
+		is defined): the selection is counted first, then allocated at once and filled.
 		Warning: be sure to activate an OUTPUT scalar field on the input cloud
 		\param aCloud the cloud to segment
 		\param minDist the lower boundary
@@ -909,6 +909,353 @@ namespace CCLib
 		Scalar* eigenValues;
 	};
 
+	//! Symmetric 3*3 matrix (fixed size, stack allocated)
+	/** Dedicated to covariance matrices: its eigen values and vectors are
+		computed in closed form (see computeEigenValuesAndVectors), which is
+		much faster than the generic Jacobi method of MatrixTpl.
+	**/
+	template <typename Scalar> class SymmetricMatrix3Tpl
+	{
+	public:
+
+		//! Default constructor (null matrix)
+		SymmetricMatrix3Tpl()
+		{
+			memset(m_values,0,sizeof(Scalar)*9);
+			memset(eigenValues,0,sizeof(Scalar)*3);
+		}
+
+		//! Matrix values
+		/** Only the upper part is used (the lower part is kept for convenience).
+			After a call to computeEigenValuesAndVectors, the columns of
+			eigenVectors are the eigen vectors.
+		**/
+		Scalar m_values[3][3];
+
+		//! Eigen vectors (as columns, see computeEigenValuesAndVectors)
+		Scalar eigenVectors[3][3];
+
+		//! Eigen values (absolute values, see computeEigenValuesAndVectors)
+		Scalar eigenValues[3];
+
+		//! Sets the (symmetric) matrix values
+		void set(Scalar xx, Scalar yy, Scalar zz, Scalar xy, Scalar xz, Scalar yz)
+		{
+			m_values[0][0] = xx; m_values[1][1] = yy; m_values[2][2] = zz;
+			m_values[0][1] = m_values[1][0] = xy;
+			m_values[0][2] = m_values[2][0] = xz;
+			m_values[1][2] = m_values[2][1] = yz;
+		}
+
+		//! Converts this matrix to a (generic) square matrix
+		MatrixTpl<Scalar> toSquareMatrix() const
+		{
+			MatrixTpl<Scalar> mat(3);
+			for (unsigned l=0;l<3;++l)
+				for (unsigned c=0;c<3;++c)
+					mat.m_values[l][c] = m_values[l][c];
+			return mat;
+		}
+
+		//! Computes eigen values and vectors
+		/** Eigen values are the roots of the characteristic polynomial (trigonometric
+			solution). The eigen vector of the best separated eigen value is computed
+			first (cross product of two rows of A-lambda.I), the second one in the
+			orthogonal complement of the first and the last one by cross product.
+			Falls back to the Jacobi method (see MatrixTpl::computeJacobianEigenValuesAndVectors)
+			if an eigen vector can't be determined reliably.
+			As with the Jacobi method, only the absolute eigen values are kept.
+			\return success
+		**/
+		bool computeEigenValuesAndVectors()
+		{
+			//we scale the matrix so as to avoid overflows/underflows
+			Scalar maxAbs = 0;
+			for (unsigned l=0;l<3;++l)
+				for (unsigned c=l;c<3;++c)
+					maxAbs = std::max(maxAbs,static_cast<Scalar>(fabs(m_values[l][c])));
+			if (maxAbs != maxAbs) //NaN
+				return false;
+
+			if (maxAbs == 0)
+			{
+				//null matrix
+				setIdentityEigenVectors(0,0,0);
+				return true;
+			}
+
+			Scalar invMaxAbs = static_cast<Scalar>(1) / maxAbs;
+			Scalar a00 = m_values[0][0] * invMaxAbs;
+			Scalar a01 = m_values[0][1] * invMaxAbs;
+			Scalar a02 = m_values[0][2] * invMaxAbs;
+			Scalar a11 = m_values[1][1] * invMaxAbs;
+			Scalar a12 = m_values[1][2] * invMaxAbs;
+			Scalar a22 = m_values[2][2] * invMaxAbs;
+
+			Scalar norm = a01*a01 + a02*a02 + a12*a12;
+			if (norm == 0)
+			{
+				//diagonal matrix
+				setIdentityEigenVectors(a00*maxAbs,a11*maxAbs,a22*maxAbs);
+				return true;
+			}
+
+			//eigen values (in increasing order)
+			Scalar q = (a00 + a11 + a22) / 3;
+			Scalar b00 = a00 - q;
+			Scalar b11 = a11 - q;
+			Scalar b22 = a22 - q;
+			Scalar p = sqrt((b00*b00 + b11*b11 + b22*b22 + 2*norm) / 6);
+			Scalar c00 = b11*b22 - a12*a12;
+			Scalar c01 = a01*b22 - a12*a02;
+			Scalar c02 = a01*a12 - b11*a02;
+			Scalar halfDet = (b00*c00 - a01*c01 + a02*c02) / (2*p*p*p);
+			halfDet = std::min(std::max(halfDet,static_cast<Scalar>(-1)),static_cast<Scalar>(1));
+			Scalar angle = acos(halfDet) / 3;
+			static const Scalar s_twoThirdsPi = static_cast<Scalar>(2.09439510239319549);
+			Scalar beta2 = cos(angle) * 2;
+			Scalar beta0 = cos(angle + s_twoThirdsPi) * 2;
+			Scalar beta1 = -(beta0 + beta2);
+			Scalar evals[3] = {	q + p*beta0,
+								q + p*beta1,
+								q + p*beta2 };
+
+			//eigen vectors (computed with B = (A-q.I)/p, which has the same eigen vectors
+			//and the eigen values 'beta', so that close eigen values can still be separated)
+			Scalar invP = static_cast<Scalar>(1) / p;
+			const Scalar B[6] = { b00*invP, a01*invP, a02*invP, b11*invP, a12*invP, b22*invP };
+			Scalar evecs[3][3];
+			bool success = true;
+			if (halfDet >= 0)
+			{
+				//the largest eigen value is the best separated one
+				success = ComputeEigenVector0(B,beta2,evecs[2]);
+				ComputeEigenVector1(B,evecs[2],beta1,evecs[1]);
+				Cross(evecs[1],evecs[2],evecs[0]);
+			}
+			else
+			{
+				//the smallest eigen value is the best separated one
+				success = ComputeEigenVector0(B,beta0,evecs[0]);
+				ComputeEigenVector1(B,evecs[0],beta1,evecs[1]);
+				Cross(evecs[0],evecs[1],evecs[2]);
+			}
+
+			if (!success)
+				return computeJacobianEigenValuesAndVectors();
+
+			for (unsigned i=0;i<3;++i)
+			{
+				eigenValues[i] = static_cast<Scalar>(fabs(evals[i] * maxAbs));
+				for (unsigned j=0;j<3;++j)
+					eigenVectors[j][i] = evecs[i][j];
+			}
+
+			return true;
+		}
+
+		//! Sorts the eigenvectors in the decreasing order of their associated eigenvalues
+		void sortEigenValuesAndVectors()
+		{
+			for (unsigned i=0;i<2;i++)
+			{
+				unsigned k=i;
+				for (unsigned j=i+1;j<3;j++)
+					if (eigenValues[j] > eigenValues[k])
+						k=j;
+
+				if (k!=i)
+				{
+					std::swap(eigenValues[i],eigenValues[k]);
+					for (unsigned j=0;j<3;j++)
+						std::swap(eigenVectors[j][i],eigenVectors[j][k]);
+				}
+			}
+		}
+
+		//! Returns the biggest eigenvalue and its associated eigenvector
+		Scalar getMaxEigenValueAndVector(Scalar maxEigenVector[]) const
+		{
+			unsigned maxIndex = (eigenValues[1] > eigenValues[0] ? 1 : 0);
+			if (eigenValues[2] > eigenValues[maxIndex])
+				maxIndex = 2;
+			return getEigenValueAndVector(maxIndex,maxEigenVector);
+		}
+
+		//! Returns the smallest eigenvalue and its associated eigenvector
+		Scalar getMinEigenValueAndVector(Scalar minEigenVector[]) const
+		{
+			unsigned minIndex = (eigenValues[1] < eigenValues[0] ? 1 : 0);
+			if (eigenValues[2] < eigenValues[minIndex])
+				minIndex = 2;
+			return getEigenValueAndVector(minIndex,minEigenVector);
+		}
+
+		//! Returns the given eigenvalue and its associated eigenvector
+		Scalar getEigenValueAndVector(unsigned index, Scalar* eigenVector = 0) const
+		{
+			assert(index < 3);
+			if (eigenVector)
+				for (unsigned i=0;i<3;++i)
+					eigenVector[i] = eigenVectors[i][index];
+			return eigenValues[index];
+		}
+
+	protected:
+
+		//! Sets the eigen values and the identity as eigen vectors
+		void setIdentityEigenVectors(Scalar e0, Scalar e1, Scalar e2)
+		{
+			eigenValues[0] = static_cast<Scalar>(fabs(e0));
+			eigenValues[1] = static_cast<Scalar>(fabs(e1));
+			eigenValues[2] = static_cast<Scalar>(fabs(e2));
+			memset(eigenVectors,0,sizeof(Scalar)*9);
+			eigenVectors[0][0] = eigenVectors[1][1] = eigenVectors[2][2] = 1;
+		}
+
+		//! Fallback: generic Jacobi method
+		bool computeJacobianEigenValuesAndVectors()
+		{
+			MatrixTpl<Scalar> eig = toSquareMatrix().computeJacobianEigenValuesAndVectors();
+			if (!eig.isValid())
+				return false;
+			for (unsigned i=0;i<3;++i)
+				eigenValues[i] = eig.getEigenValueAndVector(i);
+			for (unsigned l=0;l<3;++l)
+				for (unsigned c=0;c<3;++c)
+					eigenVectors[l][c] = eig.m_values[l][c];
+			return true;
+		}
+
+		//! Cross product
+		static inline void Cross(const Scalar u[3], const Scalar v[3], Scalar w[3])
+		{
+			w[0] = u[1]*v[2] - u[2]*v[1];
+			w[1] = u[2]*v[0] - u[0]*v[2];
+			w[2] = u[0]*v[1] - u[1]*v[0];
+		}
+
+		//! Computes the eigen vector of a simple eigen value
+		/** A = [a00, a01, a02, a11, a12, a22] (normalized matrix: |aij| <= sqrt(6))
+			\return false if the eigen value is (numerically) not simple
+		**/
+		static bool ComputeEigenVector0(const Scalar A[6], Scalar eval, Scalar evec[3])
+		{
+			//rows of A-eval.I
+			const Scalar r0[3] = { A[0]-eval, A[1], A[2] };
+			const Scalar r1[3] = { A[1], A[3]-eval, A[4] };
+			const Scalar r2[3] = { A[2], A[4], A[5]-eval };
+
+			Scalar r0xr1[3], r0xr2[3], r1xr2[3];
+			Cross(r0,r1,r0xr1);
+			Cross(r0,r2,r0xr2);
+			Cross(r1,r2,r1xr2);
+			Scalar d0 = r0xr1[0]*r0xr1[0] + r0xr1[1]*r0xr1[1] + r0xr1[2]*r0xr1[2];
+			Scalar d1 = r0xr2[0]*r0xr2[0] + r0xr2[1]*r0xr2[1] + r0xr2[2]*r0xr2[2];
+			Scalar d2 = r1xr2[0]*r1xr2[0] + r1xr2[1]*r1xr2[1] + r1xr2[2]*r1xr2[2];
+
+			const Scalar* best = r0xr1;
+			Scalar dmax = d0;
+			if (d1 > dmax)
+			{
+				best = r0xr2;
+				dmax = d1;
+			}
+			if (d2 > dmax)
+			{
+				best = r1xr2;
+				dmax = d2;
+			}
+
+			//the matrix is normalized: a tiny cross product means that A-eval.I has rank < 2
+			static const Scalar s_minSquareNorm = static_cast<Scalar>(sizeof(Scalar) > 4 ? 1.0e-20 : 1.0e-10);
+			if (!(dmax > s_minSquareNorm))
+				return false;
+
+			Scalar invNorm = static_cast<Scalar>(1) / sqrt(dmax);
+			evec[0] = best[0] * invNorm;
+			evec[1] = best[1] * invNorm;
+			evec[2] = best[2] * invNorm;
+			return true;
+		}
+
+		//! Computes the eigen vector of 'eval' in the orthogonal complement of evec0
+		static void ComputeEigenVector1(const Scalar A[6], const Scalar evec0[3], Scalar eval, Scalar evec1[3])
+		{
+			//orthonormal basis (U,V) of the orthogonal complement of evec0
+			Scalar U[3], V[3];
+			if (fabs(evec0[0]) > fabs(evec0[1]))
+			{
+				Scalar invLength = static_cast<Scalar>(1) / sqrt(evec0[0]*evec0[0] + evec0[2]*evec0[2]);
+				U[0] = -evec0[2] * invLength;
+				U[1] = 0;
+				U[2] = evec0[0] * invLength;
+			}
+			else
+			{
+				Scalar invLength = static_cast<Scalar>(1) / sqrt(evec0[1]*evec0[1] + evec0[2]*evec0[2]);
+				U[0] = 0;
+				U[1] = evec0[2] * invLength;
+				U[2] = -evec0[1] * invLength;
+			}
+			Cross(evec0,U,V);
+
+			//2*2 restriction of A-eval.I to (U,V)
+			Scalar AU[3] = {	A[0]*U[0] + A[1]*U[1] + A[2]*U[2],
+								A[1]*U[0] + A[3]*U[1] + A[4]*U[2],
+								A[2]*U[0] + A[4]*U[1] + A[5]*U[2] };
+			Scalar AV[3] = {	A[0]*V[0] + A[1]*V[1] + A[2]*V[2],
+								A[1]*V[0] + A[3]*V[1] + A[4]*V[2],
+								A[2]*V[0] + A[4]*V[1] + A[5]*V[2] };
+			Scalar m00 = U[0]*AU[0] + U[1]*AU[1] + U[2]*AU[2] - eval;
+			Scalar m01 = U[0]*AV[0] + U[1]*AV[1] + U[2]*AV[2];
+			Scalar m11 = V[0]*AV[0] + V[1]*AV[1] + V[2]*AV[2] - eval;
+
+			//its null space gives the eigen vector (any vector if it is null)
+			Scalar s = 0, t = 0;
+			Scalar absM00 = fabs(m00), absM01 = fabs(m01), absM11 = fabs(m11);
+			if (absM00 >= absM11)
+			{
+				if (absM00 >= absM01 && absM00 > 0)
+				{
+					m01 /= m00;
+					t = static_cast<Scalar>(1) / sqrt(1 + m01*m01);
+					s = m01 * t;
+				}
+				else if (absM01 > 0)
+				{
+					m00 /= m01;
+					s = static_cast<Scalar>(1) / sqrt(1 + m00*m00);
+					t = m00 * s;
+				}
+				else
+				{
+					s = 1;
+				}
+			}
+			else
+			{
+				if (absM11 >= absM01)
+				{
+					m01 /= m11;
+					s = static_cast<Scalar>(1) / sqrt(1 + m01*m01);
+					t = m01 * s;
+				}
+				else
+				{
+					m11 /= m01;
+					t = static_cast<Scalar>(1) / sqrt(1 + m11*m11);
+					s = m11 * t;
+				}
+			}
+
+			//evec1 = s.U - t.V
+			evec1[0] = s*U[0] - t*V[0];
+			evec1[1] = s*U[1] - t*V[1];
+			evec1[2] = s*U[2] - t*V[2];
+		}
+	};
+
 	//! Default CC square matrix type (PointCoordinateType)
 	typedef MatrixTpl<PointCoordinateType> SquareMatrix;
 
@@ -918,6 +1265,9 @@ namespace CCLib
 	//! Double square matrix type
 	typedef MatrixTpl<double> SquareMatrixd;
 
+	//! Double symmetric 3*3 matrix type
+	typedef SymmetricMatrix3Tpl<double> SymmetricMatrix3d;
+
 } //namespace CCLib
 
 #endif //MATRIX_HEADER
@@ -25,6 +25,7 @@
 
 #include "CCToolbox.h"
 #include "GenericChunkedArray.h"
+#include "CCTypes.h"
 
 //system
 #include <vector>
@@ -66,16 +67,22 @@ public:
 		handled by generating another random number between 0 and 1.
 		If this number is less than Nf, then Ni=Ni+1. The number of points
 		sampled on the triangle will simply be Ni.
+		Random numbers only depend on the triangle index and on the sample
+		rank, so that the result is reproducible (whatever the number of
+		threads). The points are counted first, so that the output arrays
+		are allocated only once.
 		\param theMesh the mesh to be sampled
 		\param samplingDensity the sampling surface density
 		\param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
 		\param[out] triIndices triangle index for each samples point (output only - optional)
+		\param[out] barycentricCoords barycentric coordinates of each sampled point in its triangle, to interpolate per-vertex features such as colors or normals (output only - optional)
 		\return the sampled points
 	**/
 	static SimpleCloud* samplePointsOnMesh(GenericMesh* theMesh,
 											double samplingDensity,
                                             GenericProgressCallback* progressCb=0,
-											GenericChunkedArray<1,unsigned>* triIndices=0);
+											GenericChunkedArray<1,unsigned>* triIndices=0,
+											GenericChunkedArray<3,PointCoordinateType>* barycentricCoords=0);
 
 	//! Samples points on a mesh
 	/** See the other version of this method. Instead of specifying a
@@ -85,12 +92,14 @@ public:
 		\param numberOfPoints the desired number of points on the whole mesh
 		\param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
 		\param[out] triIndices triangle index for each samples point (output only - optional)
+		\param[out] barycentricCoords barycentric coordinates of each sampled point in its triangle, to interpolate per-vertex features such as colors or normals (output only - optional)
 		\return the sampled points
 	**/
 	static SimpleCloud* samplePointsOnMesh(GenericMesh* theMesh,
 											unsigned numberOfPoints,
                                             GenericProgressCallback* progressCb=0,
-											GenericChunkedArray<1,unsigned>* triIndices=0);
+											GenericChunkedArray<1,unsigned>* triIndices=0,
+											GenericChunkedArray<3,PointCoordinateType>* barycentricCoords=0);
 
 protected:
 
@@ -101,13 +110,15 @@ protected:
 		\param theoricNumberOfPoints the approximated number of points that will be sampled
 		\param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
 		\param[out] triIndices triangle index for each samples point (output only - optional)
+		\param[out] barycentricCoords barycentric coordinates of each sampled point in its triangle, to interpolate per-vertex features such as colors or normals (output only - optional)
 		\return the sampled points
 	**/
 	static SimpleCloud* samplePointsOnMesh(GenericMesh* theMesh,
                                             double samplingDensity,
                                             unsigned theoricNumberOfPoints,
                                             GenericProgressCallback* progressCb=0,
-											GenericChunkedArray<1,unsigned>* triIndices=0);
+											GenericChunkedArray<1,unsigned>* triIndices=0,
+											GenericChunkedArray<3,PointCoordinateType>* barycentricCoords=0);
 };
 
 }
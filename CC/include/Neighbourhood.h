@@ -143,6 +143,12 @@ class Neighbourhood
 		//! Computes the covariance matrix
 		CCLib::SquareMatrixd computeCovarianceMatrix();
 
+		//! Computes the covariance matrix (fixed size version)
+		/** \param[out] covMat covariance matrix
+			\return false if the neighbourhood is empty
+		**/
+		bool computeCovarianceMatrix(CCLib::SymmetricMatrix3d& covMat);
+
 		//! Returns the largest radius (i.e. the distance to the farthest point to the centroid)
 		PointCoordinateType computeLargestRadius();
 
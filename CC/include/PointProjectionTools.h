@@ -26,7 +26,8 @@
 //! Triangulation types
 enum CC_TRIANGULATION_TYPES {GENERIC							=		1,		/**< Default triangulation (Delaunay 2D in XY plane) **/
 								GENERIC_BEST_LS_PLANE			=		2,		/**< Delaunay 2D in best least square fitting plane **/
-								GENERIC_EMPTY					=		3		/**<Empty triangulation (to be filled by user) **/
+								GENERIC_EMPTY					=		3,		/**<Empty triangulation (to be filled by user) **/
+								GENERIC_TILED					=		4		/**< Delaunay 2D in XY plane computed per tile (see PointProjectionTools::computeTiledTriangulation) **/
 };
 
 namespace CCLib
@@ -111,6 +112,29 @@ public:
 	**/
 	static GenericIndexedMesh* computeTriangulation(GenericIndexedCloudPersist* theCloud, CC_TRIANGULATION_TYPES type=GENERIC);
 
+	//! Default maximum number of points per tile (see computeTiledTriangulation)
+	static const unsigned DEFAULT_MAX_POINTS_PER_TILE = 1000000;
+
+	//! Computes a 2.5D Delaunay triangulation (in the XY plane) tile by tile
+	/** The points (projected in the XY plane) are dispatched in a regular grid
+		of tiles. Each tile is triangulated with its neighbourhood (the overlap
+		is automatically increased until the triangles inside the tile are
+		guaranteed to be the same as the global triangulation ones). Tiles are
+		processed in parallel if ENABLE_MT_OCTREE is defined (each tile uses its
+		own instance of the 'Triangle' library). Points with the same XY position
+		are merged (only the first one is used). The ties between cocircular
+		points (e.g. on regular grids) are broken consistently, so that the
+		resulting mesh is the same as the one obtained with
+		computeTriangulation(GENERIC). Its vertices are the cloud points. No
+		global triangulation is computed: if the tiles can't be validated or
+		don't match along their borders, an error is returned.
+		\param theCloud a point cloud
+		\param maxPointsPerTile (approximate) maximum number of points per tile
+		\param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
+		\return a mesh (or 0 if an error occurred)
+	**/
+	static GenericIndexedMesh* computeTiledTriangulation(GenericIndexedCloudPersist* theCloud, unsigned maxPointsPerTile=DEFAULT_MAX_POINTS_PER_TILE, GenericProgressCallback* progressCb=0);
+
 };
 
 }
@@ -174,6 +174,12 @@ protected:
 	//! Generic3dPoint references container type
 	typedef GenericChunkedArray<1,unsigned> ReferencesContainer;
 
+	//! Constructor with a custom references container
+	/** \param associatedCloud associated cloud
+		\param indexes references container (may be 0 if the derived class doesn't use it)
+	**/
+	ReferenceCloud(GenericIndexedCloudPersist* associatedCloud, ReferencesContainer* indexes);
+
 	//! Point references container
 	ReferencesContainer* m_theIndexes;
 
@@ -0,0 +1,145 @@
+//##########################################################################
+//#                                                                        #
+//#                               CCLIB                                    #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU Library General Public License as       #
+//#  published by the Free Software Foundation; version 2 of the License.  #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: EDF R&D / TELECOM ParisTech (ENST-TSI)             #
+//#                                                                        #
+//##########################################################################
+
+#ifndef SPARSE_EUCLIDEAN_DISTANCE_TRANSFORM_HEADER
+#define SPARSE_EUCLIDEAN_DISTANCE_TRANSFORM_HEADER
+
+#include "CCConst.h"
+#include "DgmOctree.h" //for ENABLE_MT_OCTREE
+
+//system
+#include <vector>
+
+namespace CCLib
+{
+
+class GenericProgressCallback;
+
+//! Exact Euclidean distance transform on a sparse 3D grid
+/** The distances to the 'zero' cells are only computed for a set of 'query'
+	cells. Neither the zeros nor the result are stored as a dense grid: the
+	zeros are stored row by row (along X) and the grid is processed slice by
+	slice (one slice per X value holding at least one query), with the separable
+	algorithm of Felzenszwalb and Huttenlocher ("Distance Transforms of Sampled
+	Functions", 2004). Slices are independent and are processed in parallel (if
+	ENABLE_MT_OCTREE is defined).
+	Memory consumption: O(number of zeros + number of queries) plus one Y*Z slice
+	per thread (instead of X*Y*Z for ChamferDistanceTransform).
+**/
+#ifdef CC_USE_AS_DLL
+#include "CloudCompareDll.h"
+class CC_DLL_API SparseEuclideanDistanceTransform
+#else
+class SparseEuclideanDistanceTransform
+#endif
+{
+
+public:
+
+	//! Default constructor
+	/** \param Di the grid size along the X dimension
+		\param Dj the grid size along the Y dimension
+		\param Dk the grid size along the Z dimension
+	**/
+	SparseEuclideanDistanceTransform(unsigned Di, unsigned Dj, unsigned Dk);
+
+	//! Sets a cell as a "zero"
+	/** \param cellPos the cell position (as a 3-size array)
+		\return false if there's not enough memory
+	**/
+	bool setZero(const int cellPos[]);
+
+	//! Adds a query cell
+	/** \param cellPos the cell position (as a 3-size array)
+		\return the query index (to retrieve the result with getSquareDistance) or -1 if there's not enough memory
+	**/
+	int addQuery(const int cellPos[]);
+
+	//! Computes the (squared) distances of all query cells to the nearest "zero" cell
+	/** \param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
+		\return max squared distance (in cells) or -1 if an error occured (no zero, not enough memory, etc.)
+	**/
+	double propagateDistance(GenericProgressCallback* progressCb=0);
+
+	//! Returns the squared distance (in cells) of a query cell to the nearest "zero" cell
+	/** This method should be called after the distances had been propagated
+		(see SparseEuclideanDistanceTransform::propagateDistance).
+		\param queryIndex query index (see addQuery)
+	**/
+	inline float getSquareDistance(unsigned queryIndex) const { return m_queryResults[queryIndex]; }
+
+protected:
+
+	//! Cell position
+	struct CellPos
+	{
+		unsigned i,j,k;
+	};
+
+	//! Slice processing buffers
+	struct SliceBuffers
+	{
+		std::vector<float> slice;
+		std::vector<float> lineIn;
+		std::vector<float> lineOut;
+		std::vector<unsigned> v;
+		std::vector<double> z;
+
+		//! Allocates the buffers
+		bool init(unsigned Dj, unsigned Dk);
+	};
+
+	//! Slice processing job (for parallel processing)
+	struct SliceJob;
+
+	//! Computes the distances of all the queries of a given slice (i.e. X value)
+	void processSlice(unsigned i, SliceBuffers& buffers);
+
+#ifdef ENABLE_MT_OCTREE
+	//! Multi-threaded version of processSlice
+	static void ProcessSlice_MT(SliceJob& job);
+#endif
+
+	//! Grid dimension along the X dimension
+	unsigned m_gridX;
+	//! Grid dimension along the Y dimension
+	unsigned m_gridY;
+	//! Grid dimension along the Z dimension
+	unsigned m_gridZ;
+
+	//! Zero cells
+	std::vector<CellPos> m_zeros;
+	//! Query cells
+	std::vector<CellPos> m_queries;
+	//! Queries results (squared distances)
+	std::vector<float> m_queryResults;
+
+	//! Zeros X coordinates sorted by row (see m_rowStart)
+	std::vector<unsigned> m_rowZeros;
+	//! Index of the first zero of each row (Y*Z+1 values)
+	std::vector<unsigned> m_rowStart;
+	//! Number of zeros in each Z plane
+	std::vector<unsigned> m_planeZeroCount;
+	//! Queries indexes sorted by X, then Y (see m_sliceStart)
+	std::vector<unsigned> m_sortedQueries;
+	//! Index of the first (sorted) query of each X slice (X+1 values)
+	std::vector<unsigned> m_sliceStart;
+};
+
+}
+
+#endif //SPARSE_EUCLIDEAN_DISTANCE_TRANSFORM_HEADER
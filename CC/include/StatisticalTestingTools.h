@@ -109,6 +109,7 @@ public:
 		\param pTrust the Chi2 Test confidence probability
 		\param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
 		\param _theOctree the cloud octree if it has already be computed
+		\param noClassCompression whether the Chi2 classes are fixed (fast, approximate test) or compressed so as to respect n.pi>=5 (see computeAdaptativeChi2Dist)
 		\return the distance threshold for filtering (or -1 if someting went wrong during the process)
 	**/
 	static double testCloudWithStatisticalModel(const GenericDistribution* distrib,
@@ -116,7 +117,8 @@ public:
                                                 unsigned numberOfNeighbours,
                                                 double pTrust,
                                                 GenericProgressCallback* progressCb=0,
-                                                DgmOctree* _theOctree=0);
+                                                DgmOctree* _theOctree=0,
+                                                bool noClassCompression=true);
 
 protected:
 
@@ -125,8 +127,11 @@ protected:
 		- (GenericDistribution*) the theoretical noise distribution
 		- (int) the size of a neighbourhood for local analysis
 		- (int) the number of classes for the Chi2 distance computation
-		- (unsigned*) a pre-allocated array (of a size equal to the number of classes)for computation acceleration
-		- (bool) specifies whether negative values should be included in computation
+		- (double*) the theoretical probabilities of the classes (if the histogram bounds are fixed, 0 otherwise)
+		- (ScalarType*) the histogram min value (optional)
+		- (ScalarType*) the histogram max value (optional)
+		- (bool) whether classes compression should be skipped
+		Thread-safe: the working buffers are local to each call.
 		\param cell structure describing the cell on which processing is applied
 		\param additionalParameters see method description
 	**/
@@ -109,7 +109,12 @@ public:
 	inline GenericIndexedCloudPersist* associatedCloud() const { return m_associatedCloud; }
 
 	//! Builds KD-tree
-	/** \param maxRMS maximum RMS per cell (LS plane fitting)
+	/** Cells are recursively split (at the median, along their largest dimension)
+		until their points fit the LS plane well enough. The plane of each cell is
+		deduced from the running moments of its points (updated during the partition
+		of its parent), and big subtrees are built in parallel (if ENABLE_MT_OCTREE
+		is defined).
+		\param maxRMS maximum RMS per cell (LS plane fitting)
 		\param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
 	**/
 	bool build(double maxRMS, GenericProgressCallback* progressCb=0);
@@ -126,9 +131,6 @@ public:
 
 protected:
 
-	//! Recursive split process
-	BaseNode* split(ReferenceCloud* subset);
-
 	//! Root node
 	BaseNode* m_root;
 
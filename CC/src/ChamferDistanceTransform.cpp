@@ -242,6 +242,10 @@ int ChamferDistanceTransform::propagateDistance(CC_CHAMFER_DISTANCE_TYPE type, G
 		propagateDistance(0,0,0,1,forwardNeighbours345,normProgress);
 		maxDist = propagateDistance(m_gridX-1,m_gridY-1,m_gridZ-1,-1,backwardNeighbours345,normProgress);
 		break;
+	default:
+		//not handled by this class (see SparseEuclideanDistanceTransform)
+		assert(false);
+		break;
 	}
 
 	if (normProgress)
@@ -40,6 +40,20 @@ ChunkedPointCloud::~ChunkedPointCloud()
 	m_points->release();
 }
 
+void ChunkedPointCloud::setPointsTable(GenericChunkedArray<3,PointCoordinateType>* points, bool validBB/*=false*/)
+{
+	assert(points);
+	if (!points || points == m_points)
+		return;
+
+	points->link();
+	m_points->release();
+	m_points = points;
+
+	m_validBB = validBB;
+	placeIteratorAtBegining();
+}
+
 void ChunkedPointCloud::clear()
 {
 	m_points->clear();
@@ -145,6 +159,14 @@ void ChunkedPointCloud::addPoint(const CCVector3 &P)
 	m_validBB = false;
 }
 
+bool ChunkedPointCloud::addPoints(const PointCoordinateType* points, unsigned count)
+{
+	if (!m_points->addElements(points,count))
+		return false;
+	m_validBB = false;
+	return true;
+}
+
 void ChunkedPointCloud::applyTransformation(PointProjectionTools::Transformation& trans)
 {
     unsigned count = size();
@@ -19,6 +19,7 @@
 
 //local
 #include "ReferenceCloud.h"
+#include "DgmOctreeCellReferenceCloud.h"
 #include "GenericProgressCallback.h"
 #include "GenericIndexedCloudPersist.h"
 #include "CCMiscTools.h"
@@ -145,6 +146,11 @@ void getPointsInTreeCell(octreeTreeCell* cell, CCLib::DgmOctree::NeighboursSet&
 
 using namespace CCLib;
 
+inline const CCVector3* DgmOctree::getStructurePoint(cellsContainer::const_iterator p) const
+{
+	return m_sortedPoints.empty() ? m_theAssociatedCloud->getPointPersistentPtr(p->theIndex) : &m_sortedPoints[p-m_thePointsAndTheirCellCodes.begin()];
+}
+
 DgmOctree::DgmOctree(GenericIndexedCloudPersist* aCloud)
 {
     assert(aCloud);
@@ -206,6 +212,49 @@ int DgmOctree::build(const CCVector3& octreeMin, const CCVector3& octreeMax, con
     return genericBuild(progressCb);
 }
 
+int DgmOctree::buildFromCellCodes(const CCVector3& octreeMin, const CCVector3& octreeMax, const CCVector3& pointsMin, const CCVector3& pointsMax, const IndexAndCode* codes, unsigned count)
+{
+	clear();
+
+	if (!m_theAssociatedCloud || (count != 0 && !codes))
+		return -1;
+
+	unsigned n = m_theAssociatedCloud->size();
+	if (count > n)
+		return -1;
+
+	try
+	{
+		m_thePointsAndTheirCellCodes.resize(count);
+	}
+	catch (.../*const std::bad_alloc&*/) //out of memory
+	{
+		return -1;
+	}
+
+	for (unsigned i=0; i<count; ++i)
+	{
+		//we check that the indexes are valid and the codes sorted
+		if (codes[i].theIndex >= n || (i != 0 && codes[i].theCode < codes[i-1].theCode))
+		{
+			clear();
+			return -1;
+		}
+		m_thePointsAndTheirCellCodes[i] = codes[i];
+	}
+
+	m_dimMin = octreeMin;
+	m_dimMax = octreeMax;
+	m_pointsMin = pointsMin;
+	m_pointsMax = pointsMax;
+	m_numberOfProjectedPoints = count;
+
+	updateCellSizeTable();
+	updateCellCountTable();
+
+	return (int)m_numberOfProjectedPoints;
+}
+
 int DgmOctree::genericBuild(GenericProgressCallback* progressCb)
 {
     unsigned n = m_theAssociatedCloud->size();
@@ -460,11 +509,170 @@ void DgmOctree::updateCellSizeTable()
 
 void DgmOctree::updateCellCountTable()
 {
+	//the octree structure has changed: the cells lookup tables and the sorted points are deprecated
+	releaseCellIndexLookupTables();
+	releaseSortedPointsCopy();
+
 	//level 0 is just the octree bounding-box
 	for (uchar i=0; i<=MAX_OCTREE_LEVEL; ++i)
 		computeCellsStatistics(i);
 }
 
+void DgmOctree::releaseCellIndexLookupTables()
+{
+	for (uchar i=0; i<=MAX_OCTREE_LEVEL; ++i)
+		m_cellIndexLookupTables[i].clear();
+}
+
+bool DgmOctree::buildCellIndexLookupTable(uchar level)
+{
+	assert(level<=MAX_OCTREE_LEVEL);
+
+	CellIndexLookupTable& lookupTable = m_cellIndexLookupTables[level];
+	if (!lookupTable.isEmpty())
+		return true; //already built
+	if (m_thePointsAndTheirCellCodes.empty())
+		return false;
+
+	//binary shift for cell code truncation
+	uchar bitDec = GET_BIT_SHIFT(level);
+
+	//the table can't be bigger than the octree structure itself
+	const size_t maxMemory = m_thePointsAndTheirCellCodes.size() * sizeof(IndexAndCode);
+	//hash table size (power of 2, at most half full)
+	size_t hashSize = 16;
+	while (hashSize < 2*(size_t)m_cellCount[level])
+		hashSize <<= 1;
+	//dense table size (only for low levels)
+	size_t denseSize = ((size_t)(3*level+1) < 8*sizeof(size_t) ? ((size_t)1 << (3*level)) + 1 : 0);
+	bool denseTable = (denseSize != 0 && denseSize*sizeof(unsigned) <= std::min(maxMemory,hashSize*sizeof(CellIndexLookupTable::Entry)));
+	size_t tableMemory = 0;
+	if (denseTable)
+		tableMemory = denseSize*sizeof(unsigned);
+	else if (hashSize*sizeof(CellIndexLookupTable::Entry) <= maxMemory)
+		tableMemory = hashSize*sizeof(CellIndexLookupTable::Entry);
+	else
+		return false; //too many cells
+
+	//the same bound applies to all the tables: we release the other ones if necessary
+	{
+		size_t totalMemory = tableMemory;
+		for (uchar i=0; i<=MAX_OCTREE_LEVEL; ++i)
+			totalMemory += m_cellIndexLookupTables[i].memory();
+		if (totalMemory > maxMemory)
+			releaseCellIndexLookupTables();
+	}
+
+	try
+	{
+		if (denseTable)
+		{
+			lookupTable.cellStarts.resize(denseSize);
+
+			//each cell starts at the first point with a greater or equal code
+			size_t nextCode = 0;
+			unsigned index = 0;
+			for (cellsContainer::const_iterator p = m_thePointsAndTheirCellCodes.begin(); p != m_thePointsAndTheirCellCodes.end(); ++p,++index)
+			{
+				size_t truncatedCode = (size_t)(p->theCode >> bitDec);
+				while (nextCode <= truncatedCode)
+					lookupTable.cellStarts[nextCode++] = index;
+			}
+			while (nextCode < denseSize)
+				lookupTable.cellStarts[nextCode++] = index;
+		}
+		else
+		{
+			CellIndexLookupTable::Entry emptyEntry;
+			emptyEntry.truncatedCode = INVALID_CELL_CODE;
+			emptyEntry.first = emptyEntry.last = 0;
+			lookupTable.entries.resize(hashSize,emptyEntry);
+			lookupTable.mask = static_cast<unsigned>(hashSize-1);
+
+			unsigned count = static_cast<unsigned>(m_thePointsAndTheirCellCodes.size());
+			unsigned first = 0;
+			OctreeCellCodeType truncatedCode = (m_thePointsAndTheirCellCodes[0].theCode >> bitDec);
+			for (unsigned i=1; i<=count; ++i)
+			{
+				OctreeCellCodeType currentCode = (i < count ? (m_thePointsAndTheirCellCodes[i].theCode >> bitDec) : INVALID_CELL_CODE);
+				if (currentCode != truncatedCode)
+				{
+					//new cell: we insert the previous one
+					unsigned j = (CellIndexLookupTable::Hash(truncatedCode) & lookupTable.mask);
+					while (lookupTable.entries[j].truncatedCode != INVALID_CELL_CODE)
+						j = ((j+1) & lookupTable.mask);
+					lookupTable.entries[j].truncatedCode = truncatedCode;
+					lookupTable.entries[j].first = first;
+					lookupTable.entries[j].last = i;
+
+					first = i;
+					truncatedCode = currentCode;
+				}
+			}
+		}
+	}
+	catch (.../*const std::bad_alloc&*/) //out of memory
+	{
+		lookupTable.clear();
+		return false;
+	}
+
+	return true;
+}
+
+void DgmOctree::releaseSortedPointsCopy()
+{
+	std::vector<CCVector3>().swap(m_sortedPoints);
+}
+
+bool DgmOctree::buildSortedPointsCopy(size_t maxMemory/*=0*/)
+{
+	releaseSortedPointsCopy();
+
+	if (m_thePointsAndTheirCellCodes.empty())
+		return false;
+	if (maxMemory != 0 && m_thePointsAndTheirCellCodes.size()*sizeof(CCVector3) > maxMemory)
+		return false;
+
+	try
+	{
+		m_sortedPoints.resize(m_thePointsAndTheirCellCodes.size());
+	}
+	catch (.../*const std::bad_alloc&*/) //out of memory
+	{
+		return false;
+	}
+
+	std::vector<CCVector3>::iterator P = m_sortedPoints.begin();
+	for (cellsContainer::const_iterator p = m_thePointsAndTheirCellCodes.begin(); p != m_thePointsAndTheirCellCodes.end(); ++p,++P)
+		*P = *m_theAssociatedCloud->getPointPersistentPtr(p->theIndex);
+
+	return true;
+}
+
+bool DgmOctree::getCellRange(OctreeCellCodeType truncatedCellCode, uchar level, unsigned& first, unsigned& last) const
+{
+	assert(level<=MAX_OCTREE_LEVEL);
+
+	const CellIndexLookupTable& lookupTable = m_cellIndexLookupTables[level];
+	if (!lookupTable.isEmpty())
+		return lookupTable.find(truncatedCellCode,first,last);
+
+	if (m_numberOfProjectedPoints == 0)
+		return false;
+
+	uchar bitDec = GET_BIT_SHIFT(level);
+	first = getCellIndex(truncatedCellCode,bitDec,true);
+	if (first >= m_numberOfProjectedPoints)
+		return false;
+
+	last = first+1;
+	while (last < m_numberOfProjectedPoints && (m_thePointsAndTheirCellCodes[last].theCode >> bitDec) == truncatedCellCode)
+		++last;
+
+	return true;
+}
+
 void DgmOctree::computeCellsStatistics(uchar level)
 {
 	assert(level<=MAX_OCTREE_LEVEL);
@@ -702,6 +910,15 @@ unsigned DgmOctree::getCellIndex(OctreeCellCodeType cellCode, uchar bitDec, bool
 {
     //query cell index
     OctreeCellCodeType maskedCode = (isCodeTruncated ? cellCode : cellCode >> bitDec);
+
+	//lookup table available for this level?
+	const CellIndexLookupTable& lookupTable = m_cellIndexLookupTables[MAX_OCTREE_LEVEL-bitDec/3];
+	if (!lookupTable.isEmpty())
+	{
+		unsigned first,last;
+		return (lookupTable.find(maskedCode,first,last) ? first : m_numberOfProjectedPoints);
+	}
+
     //first cell index
     OctreeCellCodeType tempCode = (m_thePointsAndTheirCellCodes[0].theCode >> bitDec);
 
@@ -768,6 +985,14 @@ unsigned DgmOctree::getCellIndex(OctreeCellCodeType truncatedCellCode, uchar bit
     assert(end>=begin);
     assert(end<m_numberOfProjectedPoints);
 
+	//lookup table available for this level?
+	const CellIndexLookupTable& lookupTable = m_cellIndexLookupTables[MAX_OCTREE_LEVEL-bitDec/3];
+	if (!lookupTable.isEmpty())
+	{
+		unsigned first,last;
+		return (lookupTable.find(truncatedCellCode,first,last) ? first : m_numberOfProjectedPoints);
+	}
+
 #ifdef COMPUTE_NN_SEARCH_STATISTICS
 	s_binarySearchCount += 1;
 #endif
@@ -835,6 +1060,14 @@ unsigned DgmOctree::getCellIndex(OctreeCellCodeType truncatedCellCode, uchar bit
     assert(end>=begin);
     assert(end<m_numberOfProjectedPoints);
 
+	//lookup table available for this level?
+	const CellIndexLookupTable& lookupTable = m_cellIndexLookupTables[MAX_OCTREE_LEVEL-bitDec/3];
+	if (!lookupTable.isEmpty())
+	{
+		unsigned first,last;
+		return (lookupTable.find(truncatedCellCode,first,last) ? first : m_numberOfProjectedPoints);
+	}
+
    //if query cell code is lower than or equal to the first octree cell code, then it's
     //either the good one or there's no match
     OctreeCellCodeType middleCode = (m_thePointsAndTheirCellCodes[begin].theCode >> bitDec);
@@ -1236,7 +1469,7 @@ void DgmOctree::getPointsInNeighbourCellsAround(NearestNeighboursSearchStruct &n
                         {
                             if (!getOnlyPointsWithValidScalar || ScalarField::ValidValue(m_theAssociatedCloud->getPointScalarValue(p->theIndex)))
                             {
-								PointDescriptor newPoint(m_theAssociatedCloud->getPointPersistentPtr(p->theIndex),p->theIndex);
+								PointDescriptor newPoint(getStructurePoint(p),p->theIndex);
 								nNSS.pointsInNeighbourhood.push_back(newPoint);
 							}
                         }
@@ -1271,7 +1504,7 @@ void DgmOctree::getPointsInNeighbourCellsAround(NearestNeighboursSearchStruct &n
                         {
                             if (!getOnlyPointsWithValidScalar || ScalarField::ValidValue(m_theAssociatedCloud->getPointScalarValue(p->theIndex)))
                             {
-								PointDescriptor newPoint(m_theAssociatedCloud->getPointPersistentPtr(p->theIndex),p->theIndex);
+								PointDescriptor newPoint(getStructurePoint(p),p->theIndex);
 								nNSS.pointsInNeighbourhood.push_back(newPoint);
 							}
                         }
@@ -1303,7 +1536,7 @@ void DgmOctree::getPointsInNeighbourCellsAround(NearestNeighboursSearchStruct &n
                         {
                             if (!getOnlyPointsWithValidScalar || ScalarField::ValidValue(m_theAssociatedCloud->getPointScalarValue(p->theIndex)))
                             {
-								PointDescriptor newPoint(m_theAssociatedCloud->getPointPersistentPtr(p->theIndex),p->theIndex);
+								PointDescriptor newPoint(getStructurePoint(p),p->theIndex);
 								nNSS.pointsInNeighbourhood.push_back(newPoint);
 							}
                         }
@@ -1345,7 +1578,7 @@ void DgmOctree::getPointsInNeighbourCellsAround(NearestNeighboursSphericalSearch
 
 			for (cellsContainer::const_iterator p = m_thePointsAndTheirCellCodes.begin()+index; (p != m_thePointsAndTheirCellCodes.end()) && ((p->theCode >> bitDec) == nNSS.truncatedCellCode); ++p)
 			{
-				PointDescriptor newPoint(m_theAssociatedCloud->getPointPersistentPtr(p->theIndex),p->theIndex);
+				PointDescriptor newPoint(getStructurePoint(p),p->theIndex);
 				nNSS.pointsInSphericalNeighbourhood.push_back(newPoint);
 			}
 		}
@@ -1400,7 +1633,7 @@ void DgmOctree::getPointsInNeighbourCellsAround(NearestNeighboursSphericalSearch
 
 						for (cellsContainer::const_iterator p = m_thePointsAndTheirCellCodes.begin()+index; (p != m_thePointsAndTheirCellCodes.end()) && ((p->theCode >> bitDec) == c2); ++p)
                         {
-							PointDescriptor newPoint(m_theAssociatedCloud->getPointPersistentPtr(p->theIndex),p->theIndex);
+							PointDescriptor newPoint(getStructurePoint(p),p->theIndex);
                             nNSS.pointsInSphericalNeighbourhood.push_back(newPoint);
                         }
 
@@ -1440,7 +1673,7 @@ void DgmOctree::getPointsInNeighbourCellsAround(NearestNeighboursSphericalSearch
 
 						for (cellsContainer::const_iterator p = m_thePointsAndTheirCellCodes.begin()+index; (p != m_thePointsAndTheirCellCodes.end()) && ((p->theCode >> bitDec) == c2); ++p)
                         {
-							PointDescriptor newPoint(m_theAssociatedCloud->getPointPersistentPtr(p->theIndex),p->theIndex);
+							PointDescriptor newPoint(getStructurePoint(p),p->theIndex);
                             nNSS.pointsInSphericalNeighbourhood.push_back(newPoint);
                         }
 
@@ -1480,7 +1713,7 @@ void DgmOctree::getPointsInNeighbourCellsAround(NearestNeighboursSphericalSearch
 
 						for (cellsContainer::const_iterator p = m_thePointsAndTheirCellCodes.begin()+index; (p != m_thePointsAndTheirCellCodes.end()) && ((p->theCode >> bitDec) == c2); ++p)
                         {
-							PointDescriptor newPoint(m_theAssociatedCloud->getPointPersistentPtr(p->theIndex),p->theIndex);
+							PointDescriptor newPoint(getStructurePoint(p),p->theIndex);
                             nNSS.pointsInSphericalNeighbourhood.push_back(newPoint);
                         }
 
@@ -1520,7 +1753,7 @@ void DgmOctree::getPointsInNeighbourCellsAround(NearestNeighboursSphericalSearch
 
 						for (cellsContainer::const_iterator p = m_thePointsAndTheirCellCodes.begin()+index; (p != m_thePointsAndTheirCellCodes.end()) && ((p->theCode >> bitDec) == c2); ++p)
                         {
-							PointDescriptor newPoint(m_theAssociatedCloud->getPointPersistentPtr(p->theIndex),p->theIndex);
+							PointDescriptor newPoint(getStructurePoint(p),p->theIndex);
                             nNSS.pointsInSphericalNeighbourhood.push_back(newPoint);
                         }
 
@@ -1559,7 +1792,7 @@ void DgmOctree::getPointsInNeighbourCellsAround(NearestNeighboursSphericalSearch
 
 						for (cellsContainer::const_iterator p = m_thePointsAndTheirCellCodes.begin()+index; (p != m_thePointsAndTheirCellCodes.end()) && ((p->theCode >> bitDec) == c1); ++p)
 						{
-							PointDescriptor newPoint(m_theAssociatedCloud->getPointPersistentPtr(p->theIndex),p->theIndex);
+							PointDescriptor newPoint(getStructurePoint(p),p->theIndex);
 							nNSS.pointsInSphericalNeighbourhood.push_back(newPoint);
 						}
 
@@ -1598,7 +1831,7 @@ void DgmOctree::getPointsInNeighbourCellsAround(NearestNeighboursSphericalSearch
 
 						for (cellsContainer::const_iterator p = m_thePointsAndTheirCellCodes.begin()+index; (p != m_thePointsAndTheirCellCodes.end()) && ((p->theCode >> bitDec) == c1); ++p)
 						{
-							PointDescriptor newPoint(m_theAssociatedCloud->getPointPersistentPtr(p->theIndex),p->theIndex);
+							PointDescriptor newPoint(getStructurePoint(p),p->theIndex);
 							nNSS.pointsInSphericalNeighbourhood.push_back(newPoint);
 						}
 
@@ -1733,7 +1966,7 @@ ScalarType DgmOctree::findTheNearestNeighborStartingFromCell(NearestNeighboursSe
             while (m<m_numberOfProjectedPoints && (p->theCode >> bitDec) == code)
             {
                 //square distance to query point
-                ScalarType dist2 = (*m_theAssociatedCloud->getPointPersistentPtr(p->theIndex) - nNSS.queryPoint).norm2();
+                ScalarType dist2 = (*getStructurePoint(p) - nNSS.queryPoint).norm2();
                 //we keep track of the closest one
                 if (dist2 < minSquareDist || minSquareDist < 0)
                 {
@@ -1812,7 +2045,7 @@ unsigned DgmOctree::findNearestNeighborsStartingFromCell(NearestNeighboursSearch
 			{
 				if (!getOnlyPointsWithValidScalar || ScalarField::ValidValue(m_theAssociatedCloud->getPointScalarValue(p->theIndex)))
 				{
-					PointDescriptor newPoint(m_theAssociatedCloud->getPointPersistentPtr(p->theIndex),p->theIndex);
+					PointDescriptor newPoint(getStructurePoint(p),p->theIndex);
 					nNSS.pointsInNeighbourhood.push_back(newPoint);
 					++p;
 				}
@@ -2259,7 +2492,7 @@ int DgmOctree::getPointsInSphericalNeighbourhood(const CCVector3& sphereCenter,
 					if (uniquePointCell)
 					{
 						//we test the point directly!
-						const CCVector3* P = m_theAssociatedCloud->getPointPersistentPtr(p->theIndex);
+						const CCVector3* P = getStructurePoint(p);
 						PointCoordinateType d2 = (*P - sphereCenter).norm2();
 
 						if (d2<=squareRadius)
@@ -2336,7 +2569,7 @@ int DgmOctree::getPointsInSphericalNeighbourhood(const CCVector3& sphereCenter,
 				else
 				{
 					//otherwise we have to test the point
-					const CCVector3* P = m_theAssociatedCloud->getPointPersistentPtr(p->theIndex);
+					const CCVector3* P = getStructurePoint(p);
 					PointCoordinateType d2 = (*P - sphereCenter).norm2();
 
 					if (d2<=squareRadius)
@@ -2860,405 +3093,530 @@ int DgmOctree::extractCCs(uchar level, bool sixConnexity, GenericProgressCallbac
     return extractCCs(cellCodes, level, sixConnexity, progressCb);
 }
 
-int DgmOctree::extractCCs(const cellCodesContainer& cellCodes, uchar level, bool sixConnexity, GenericProgressCallback* progressCb) const
+/*** CONNECTED COMPONENTS LABELING ***/
+
+//! Finds the root of a cell in the union-find forest (with path halving)
+/** Parents always have a smaller index than their children.
+**/
+static inline unsigned FindCCRoot(unsigned* parents, unsigned i)
 {
-    size_t numberOfCells = cellCodes.size();
-	if (numberOfCells == 0) //no cells!
-        return -1;
+	while (parents[i] != i)
+	{
+		parents[i] = parents[parents[i]];
+		i = parents[i];
+	}
+	return i;
+}
 
-	//filled octree cells
-	std::vector<IndexAndCode> ccCells;
-	try
+//! Merges the components of two cells (the root with the smallest index is kept)
+static inline void MergeCCs(unsigned* parents, unsigned i, unsigned j)
+{
+	unsigned ri = FindCCRoot(parents,i);
+	unsigned rj = FindCCRoot(parents,j);
+	if (ri < rj)
+		parents[rj] = ri;
+	else if (rj < ri)
+		parents[ri] = rj;
+}
+
+//! Max number of 'forward' neighbours of a cell (26-connexity)
+static const unsigned MAX_CC_FORWARD_NEIGHBOURS = 13;
+
+//! Returns the relative positions of the 'forward' neighbours of a cell
+/** Only half of the neighbourhood is considered, so that each pair of
+	adjacent cells is tested only once.
+	\return number of neighbours (3 for 6-connexity, 13 for 26-connexity)
+**/
+static unsigned GetCCForwardShifts(bool sixConnexity, int shifts[][3])
+{
+	unsigned count = 0;
+	if (sixConnexity)
 	{
-		ccCells.resize(numberOfCells);
+		for (unsigned char k=0; k<3; ++k)
+		{
+			shifts[count][0] = shifts[count][1] = shifts[count][2] = 0;
+			shifts[count][k] = 1;
+			++count;
+		}
 	}
-	catch (std::bad_alloc)
+	else
 	{
-		//not enough memory
-		return -2;
+		for (int dz=0; dz<=1; ++dz)
+			for (int dy=(dz>0 ? -1 : 0); dy<=1; ++dy)
+				for (int dx=(dz>0 || dy>0 ? -1 : 1); dx<=1; ++dx)
+				{
+					shifts[count][0] = dx;
+					shifts[count][1] = dy;
+					shifts[count][2] = dz;
+					++count;
+				}
 	}
+	assert(count <= MAX_CC_FORWARD_NEIGHBOURS);
+
+	return count;
+}
 
-    //we compute the position of each cell (grid coordinates)
-    int indexMin[3],indexMax[3];
+//! Returns the truncated code of a cell shifted by one position along one dimension
+/** Works directly on the interleaved (Morton) code, without decoding the cell position.
+	\param code truncated cell code
+	\param dimMask mask of the bits corresponding to the dimension (for the current level)
+	\param delta shift (+1 or -1)
+	\param shiftedCode output code
+	\return false if the shifted cell is outside the octree
+**/
+static inline bool ShiftCellCode(	DgmOctree::OctreeCellCodeType code,
+									DgmOctree::OctreeCellCodeType dimMask,
+									int delta,
+									DgmOctree::OctreeCellCodeType& shiftedCode)
+{
+	DgmOctree::OctreeCellCodeType c = (code & dimMask);
+	if (delta > 0)
 	{
-		//binary shift for cell code truncation
-		uchar bitDec = GET_BIT_SHIFT(level);
+		if (c == dimMask) //last cell along this dimension
+			return false;
+		c = ((c | ~dimMask) + 1) & dimMask;
+	}
+	else
+	{
+		if (c == 0) //first cell along this dimension
+			return false;
+		c = (c - 1) & dimMask;
+	}
+	shiftedCode = (code & ~dimMask) | c;
+	return true;
+}
 
-		for (size_t i=0; i<numberOfCells; i++)
-		{
-			ccCells[i].theCode = (cellCodes[i] >> bitDec);
+//! Hash table of cell codes (open addressing, linear probing)
+/** Used to find in constant time the index of a cell (relatively to
+	a sorted list of codes) from its (truncated) code.
+**/
+class ccCellCodesHashTable
+{
+public:
 
-			int pos[3];
-			getCellPos(ccCells[i].theCode,level,pos,true);
+	//! Default constructor
+	ccCellCodesHashTable()
+		: m_mask(0)
+		, m_bitDec(0)
+	{
+	}
 
-			//we look for the actual min and max dimensions of the input cells set
-			//(which may not be the whole set of octree cells!)
-			if (i != 0)
-			{
-				for (unsigned char k=0; k<3; k++)
-				{
-					if (pos[k] < indexMin[k])
-						indexMin[k] = pos[k];
-					else if (pos[k] > indexMax[k])
-						indexMax[k] = pos[k];
-				}
-			}
-			else
-			{
-				indexMin[0] = indexMax[0] = pos[0];
-				indexMin[1] = indexMax[1] = pos[1];
-				indexMin[2] = indexMax[2] = pos[2];
-			}
+	//! Fills the table with a set of (unique) codes
+	/** The table size is the smallest power of 2 greater than twice the number of codes.
+		\param codes cell codes
+		\param count number of codes
+		\return false if not enough memory
+	**/
+	bool init(const DgmOctree::OctreeCellCodeType* codes, unsigned count)
+	{
+		unsigned char bits = 1;
+		while (bits < 31 && (static_cast<unsigned>(1) << bits) < 2*count)
+			++bits;
+		m_mask = (static_cast<unsigned>(1) << bits)-1;
+		m_bitDec = (bits > 3 ? 35-bits : 31); //see 'hash'
 
-			//Warning: the cells will have to be sorted inside a slice afterwards!
-			ccCells[i].theIndex = (	static_cast<unsigned>(pos[0])				)
-								+ (	static_cast<unsigned>(pos[1]) << level		)
-								+ (	static_cast<unsigned>(pos[2]) << (2*level)	);
+		try
+		{
+			m_slots.resize(m_mask+1,DgmOctree::IndexAndCode(0,DgmOctree::INVALID_CELL_CODE));
+		}
+		catch (std::bad_alloc)
+		{
+			return false;
 		}
+
+		for (unsigned i=0; i<count; ++i)
+		{
+			unsigned h = hash(codes[i]);
+			while (m_slots[h].theCode != DgmOctree::INVALID_CELL_CODE)
+				h = ((h+1) & m_mask);
+			m_slots[h].theIndex = i;
+			m_slots[h].theCode = codes[i];
+		}
+
+		return true;
 	}
 
-    //we deduce the size of the grid that totally include input cells
-    int gridSize[3];
+	//! Returns the index of a given code (or -1 if the code is not in the table)
+	inline int find(DgmOctree::OctreeCellCodeType code) const
 	{
-		for (unsigned char k=0; k<3; k++)
+		unsigned h = hash(code);
+		while (true)
 		{
-			gridSize[k] = indexMax[k] - indexMin[k] + 1;
+			const DgmOctree::IndexAndCode& slot = m_slots[h];
+			if (slot.theCode == code)
+				return static_cast<int>(slot.theIndex);
+			if (slot.theCode == DgmOctree::INVALID_CELL_CODE)
+				return -1;
+			h = ((h+1) & m_mask);
 		}
 	}
 
-    //we sort the cells
-    std::sort(ccCells.begin(),ccCells.end(),IndexAndCode::indexComp); //ascending index code order
-
-    const int& di = gridSize[0];
-    const int& dj = gridSize[1];
-    const int& step = gridSize[2];
-
-    //instrumentation pour la recherche des 4 ou 8 voisins en 2D (donc en 3D --> 6 ou 26 voisins)
-    uchar neighborsInCurrentSlice=0, neighborsInPrecedingSlice=0;
-    int currentSliceNeighborsShifts[4], precedingSliceNeighborsShifts[9]; //maximum size to simplify code...
-
-	if (sixConnexity) //6-connexity
-    {
-        neighborsInCurrentSlice = 2;
-        currentSliceNeighborsShifts[0] = -(di+2);
-        currentSliceNeighborsShifts[1] = -1;
-
-        neighborsInPrecedingSlice = 1;
-        precedingSliceNeighborsShifts[0] = 0;
-    }
-    else //26-connexity
-    {
-        neighborsInCurrentSlice = 4;
-        currentSliceNeighborsShifts[0] = -1-(di+2);
-        currentSliceNeighborsShifts[1] = -(di+2);
-        currentSliceNeighborsShifts[2] = 1-(di+2);
-        currentSliceNeighborsShifts[3] = -1;
-
-        neighborsInPrecedingSlice = 9;
-        precedingSliceNeighborsShifts[0] = -1-(di+2);
-        precedingSliceNeighborsShifts[1] = -(di+2);
-        precedingSliceNeighborsShifts[2] = 1-(di+2);
-        precedingSliceNeighborsShifts[3] = -1;
-        precedingSliceNeighborsShifts[4] = 0;
-        precedingSliceNeighborsShifts[5] = 1;
-        precedingSliceNeighborsShifts[6] = -1+(di+2);
-        precedingSliceNeighborsShifts[7] = (di+2);
-        precedingSliceNeighborsShifts[8] = 1+(di+2);
-    }
+protected:
 
-	//shared structures (to avoid repeated allocations)
-    std::vector<int> neighboursVal, neighboursMin;
-	try
+	//! Hash function
+	/** Sibling cells (i.e. 8 consecutive codes) are kept contiguous (so that
+		neighbour cells are often in the same cache line) while the blocks of
+		siblings themselves are scattered (Fibonacci hashing).
+	**/
+	inline unsigned hash(DgmOctree::OctreeCellCodeType code) const
 	{
-		neighboursVal.reserve(neighborsInCurrentSlice+neighborsInPrecedingSlice);
-		neighboursMin.reserve(neighborsInCurrentSlice+neighborsInPrecedingSlice);
+		DgmOctree::OctreeCellCodeType block = (code >> 3);
+		unsigned key = static_cast<unsigned>(block) ^ static_cast<unsigned>((block >> 16) >> 16); //64 bits codes are folded
+		return ((((key * 2654435769U) >> m_bitDec) << 3) | static_cast<unsigned>(code & 7)) & m_mask;
 	}
-	catch(std::bad_alloc)
+
+	//! Slots
+	std::vector<DgmOctree::IndexAndCode> m_slots;
+	//! Mask (table size - 1)
+	unsigned m_mask;
+	//! Binary shift applied to the hash product
+	unsigned char m_bitDec;
+};
+
+//! Returns the indexes of the existing 'forward' neighbours of a given cell
+/** \param code truncated code of the query cell
+	\param table hash table of all the cells to consider
+	\param dimMasks masks of the bits corresponding to each dimension (see ShiftCellCode)
+	\param shifts relative positions of the neighbours (see GetCCForwardShifts)
+	\param shiftCount number of relative positions
+	\param neighbours output neighbours indexes
+	\return number of neighbours found
+**/
+static unsigned GetCCForwardNeighbours(	DgmOctree::OctreeCellCodeType code,
+										const ccCellCodesHashTable& table,
+										const DgmOctree::OctreeCellCodeType dimMasks[],
+										const int shifts[][3],
+										unsigned shiftCount,
+										unsigned neighbours[])
+{
+	unsigned count = 0;
+	for (unsigned n=0; n<shiftCount; ++n)
 	{
-		//not enough memory
-		return -2;
+		DgmOctree::OctreeCellCodeType nCode = code;
+		bool inside = true;
+		for (unsigned char k=0; k<3 && inside; ++k)
+			if (shifts[n][k] != 0)
+				inside = ShiftCellCode(nCode,dimMasks[k],shifts[n][k],nCode);
+		if (!inside)
+			continue;
+
+		int nIndex = table.find(nCode);
+		if (nIndex >= 0)
+			neighbours[count++] = static_cast<unsigned>(nIndex);
 	}
 
-    //temporary virtual 'slices'
-    int sliceSize = (di+2)*(dj+2); //add a margin to avoid "boundary effects"
-    int *slice = new int[sliceSize];
-    if (!slice) //Not enough memory
-        return -2;
+	return count;
+}
 
-    int *oldSlice = new int[sliceSize];
-    if (!oldSlice) //Not enough memory
-    {
-        delete[] slice;
-        return -2;
-    }
+#ifdef ENABLE_MT_OCTREE
 
-    //equivalence table between 'on the fly' labels
-    int* equivalentLabels = new int[numberOfCells+2];
-    if (!equivalentLabels) //Not enough memory
-    {
-        delete[] slice;
-        delete[] oldSlice;
-        return -2;
-    }
-    memset(equivalentLabels,0,sizeof(int)*(numberOfCells+2));
+#include <QtCore/QtCore>
 
-    //equivalence between a cell index and its label
-    int* cellIndexToLabel = new int[numberOfCells];
-    if (!cellIndexToLabel) //Not enough memory
-    {
-        delete[] slice;
-        delete[] oldSlice;
-        delete[] equivalentLabels;
-        return -2;
-    }
-    memset(cellIndexToLabel,0,sizeof(int)*numberOfCells);
+/*** MULTI THREADING WRAPPER (CONNECTED COMPONENTS) ***/
 
-    //progress notification
-	NormalizedProgress* nprogress = 0;
-    if (progressCb)
-    {
-        progressCb->reset();
-		nprogress = new NormalizedProgress(progressCb,step);
-        progressCb->setMethodTitle("Components Labeling");
-        char buffer[256];
-		sprintf(buffer,"Box: [%i*%i*%i]",gridSize[0],gridSize[1],gridSize[2]);
-        progressCb->setInfo(buffer);
-        progressCb->start();
-    }
-
-    //preceding slice is empty by default
-    memset(oldSlice,0,sizeof(int)*sliceSize);
+//! Range of cells processed by a single job
+struct ccLinkJobDesc
+{
+	unsigned first,last;
+};
 
-    //current label
-    size_t currentLabel = 1;
+static const DgmOctree::OctreeCellCodeType* s_ccCodes_MT = 0;
+static const ccCellCodesHashTable* s_ccTable_MT = 0;
+static const DgmOctree::OctreeCellCodeType* s_ccDimMasks_MT = 0;
+static const int (*s_ccShifts_MT)[3] = 0;
+static unsigned s_ccShiftCount_MT = 0;
+static QAtomicInt* s_ccParents_MT = 0;
 
-    //on parcours chaque tranche
+//! Lock-free version of FindCCRoot
+static inline int FindCCRoot_MT(QAtomicInt* parents, int i)
+{
+	while (true)
 	{
-		unsigned counter = 0;
-		const unsigned gridCoordMask = (1 << level)-1;
-		std::vector<IndexAndCode>::const_iterator _ccCells = ccCells.begin();
-
-		for (int k = indexMin[2]; k < indexMin[2]+step; k++)
-		{
-			//on initialise la tranche "courante"
-			memset(slice,0,sizeof(int)*sliceSize);
-
-			//pour chaque cellule de la tranche
-			while (counter<numberOfCells && (int)(_ccCells->theIndex >> (level<<1)) == k)
-			{
-				int iind = int(_ccCells->theIndex & gridCoordMask);
-				int jind = int((_ccCells->theIndex >> level) & gridCoordMask);
-				int cellIndex = (iind-indexMin[0]+1) + (jind-indexMin[1]+1)*(di+2);
-				++_ccCells;
-
-				//on regarde si la cellule a des voisins
-				//dans la tranche
-				int* _slice = slice + cellIndex;
-				{
-					for (uchar n=0; n<neighborsInCurrentSlice; n++)
-					{
-						assert(cellIndex+currentSliceNeighborsShifts[n]<sliceSize);
-						const int& neighborLabel = _slice[currentSliceNeighborsShifts[n]];
-						if (neighborLabel>1)
-							neighboursVal.push_back(neighborLabel);
-					}
-				}
-
-				//et dans la tranche precedente
-				int* _oldSlice = oldSlice + cellIndex;
-				{
-					for (uchar n=0; n<neighborsInPrecedingSlice; n++)
-					{
-						assert(cellIndex+precedingSliceNeighborsShifts[n]<sliceSize);
-						const int& neighborLabel = _oldSlice[precedingSliceNeighborsShifts[n]];
-						if (neighborLabel>1)
-							neighboursVal.push_back(neighborLabel);
-					}
-				}
-
-				//number of neighbors for current cell
-				uchar p = (uchar)neighboursVal.size();
+		int p = parents[i];
+		if (p == i)
+			return i;
+		int gp = parents[p];
+		if (gp != p)
+			parents[i].testAndSetRelaxed(p,gp); //path halving (may fail, no matter)
+		i = gp;
+	}
+}
 
-				if (p==0) //no neighbor
-				{
-					*_slice = (int)(++currentLabel); //we create a new label
-				}
-				else if (p==1) //1 neighbor
-				{
-					*_slice = neighboursVal.back(); //we'll use its label
-					neighboursVal.pop_back();
-				}
-				else //more than 1 neighbor?
-				{
-					//we get the smallest label
-					std::sort(neighboursVal.begin(),neighboursVal.end());
-					int smallestLabel = neighboursVal[0];
+//! Lock-free version of MergeCCs
+/** A root is only linked to a root with a smaller index, and only
+	if it's still a root (CAS), so that concurrent merges are safe.
+**/
+static inline void MergeCCs_MT(QAtomicInt* parents, int i, int j)
+{
+	while (true)
+	{
+		int ri = FindCCRoot_MT(parents,i);
+		int rj = FindCCRoot_MT(parents,j);
+		if (ri == rj)
+			return;
+		if (ri < rj)
+			std::swap(ri,rj);
+		//we link 'ri' (the greatest) to 'rj'
+		if (parents[ri].testAndSetOrdered(ri,rj))
+			return;
+	}
+}
 
-					//s'ils ne sont pas tous pareils
-					if (smallestLabel != neighboursVal.back())
-					{
-						int lastLabel = 0;
-						neighboursMin.clear();
-						//we get the smallest equivalent label for each neighbor's branch
-						{
-							for (uchar n=0; n<p; n++)
-							{
-								// ... on part de son indice de CC
-								int label = neighboursVal[n];
-								//s'il n'est pas egal a celui du voisin d'avant
-								if (label != lastLabel)
-								{
-									//on met a jour la notion "d'avant"
-									assert(label<(int)numberOfCells+2);
-									lastLabel = label;
-
-									//on cherche a quoi il est vraiment equivalent
-									while (equivalentLabels[label] > 1)
-									{
-										label = equivalentLabels[label];
-										assert(label<(int)numberOfCells+2);
-									}
-
-									neighboursMin.push_back(label);
-								}
-							}
-						}
+void LinkCCCells_MT(const ccLinkJobDesc& desc)
+{
+	unsigned neighbours[MAX_CC_FORWARD_NEIGHBOURS];
+	for (unsigned i=desc.first; i<desc.last; ++i)
+	{
+		unsigned count = GetCCForwardNeighbours(s_ccCodes_MT[i],*s_ccTable_MT,s_ccDimMasks_MT,s_ccShifts_MT,s_ccShiftCount_MT,neighbours);
+		for (unsigned n=0; n<count; ++n)
+			MergeCCs_MT(s_ccParents_MT,static_cast<int>(i),static_cast<int>(neighbours[n]));
+	}
+}
 
-						//get the smallest one
-						std::sort(neighboursMin.begin(),neighboursMin.end());
-						smallestLabel = neighboursMin[0];
+#endif
 
-						//update the equivalence table by the way
-						//for all other branches
-						lastLabel = smallestLabel;
-						{
-							for (uchar n=1; n<neighboursMin.size(); n++)
-							{
-								int label = neighboursMin[n];
-								assert(label<(int)numberOfCells+2);
-								//we don't process it if it's the same label as the precedent neighbor
-								if (label != lastLabel)
-								{
-									equivalentLabels[label] = smallestLabel;
-									lastLabel = label;
-								}
-							}
-						}
-					}
+int DgmOctree::extractCCs(const cellCodesContainer& cellCodes, uchar level, bool sixConnexity, GenericProgressCallback* progressCb) const
+{
+	size_t numberOfCells = cellCodes.size();
+	if (numberOfCells == 0) //no cells!
+		return -1;
 
-					//update current cell label
-					*_slice = smallestLabel;
-					neighboursVal.clear();
-				}
+	//truncated cell codes (sorted) and union-find forest
+	cellCodesContainer codes;
+	std::vector<unsigned> parents;
+	try
+	{
+		codes.resize(numberOfCells);
+		parents.resize(numberOfCells);
+	}
+	catch (std::bad_alloc)
+	{
+		//not enough memory
+		return -2;
+	}
 
-				cellIndexToLabel[counter++] = *_slice;
-			}
+	//binary shift for cell code truncation
+	uchar bitDec = GET_BIT_SHIFT(level);
+	{
+		bool sorted = true;
+		for (size_t i=0; i<numberOfCells; ++i)
+		{
+			codes[i] = (cellCodes[i] >> bitDec);
+			if (i != 0 && codes[i] < codes[i-1])
+				sorted = false;
+			parents[i] = static_cast<unsigned>(i);
+		}
+		//cell codes should generally be sorted already (e.g. see getCellCodes)
+		if (!sorted)
+			std::sort(codes.begin(),codes.end());
+	}
 
-			if (counter==numberOfCells)
-				break;
+	//'forward' neighbours (each pair of adjacent cells is tested only once)
+	int shifts[MAX_CC_FORWARD_NEIGHBOURS][3];
+	unsigned shiftCount = GetCCForwardShifts(sixConnexity,shifts);
 
-			std::swap(slice,oldSlice);
+	//bits corresponding to each dimension in the truncated codes
+	OctreeCellCodeType dimMasks[3] = {0,0,0};
+	for (uchar k=0; k<level; ++k)
+		dimMasks[0] |= (static_cast<OctreeCellCodeType>(1) << (3*k));
+	dimMasks[1] = (dimMasks[0] << 1);
+	dimMasks[2] = (dimMasks[0] << 2);
 
-			if (nprogress)
-				nprogress->oneStep();
-		}
-	}
+	const unsigned cellCount = static_cast<unsigned>(numberOfCells);
 
-    //on libere un peu la memoire
-    delete[] slice;
-    delete[] oldSlice;
+	//hash table for constant time neighbour cells lookup
+	ccCellCodesHashTable table;
+	if (!table.init(&(codes[0]),cellCount))
+		return -2;
 
-    if (progressCb)
+	//progress notification
+	NormalizedProgress* nprogress = 0;
+	if (progressCb)
 	{
-		progressCb->stop();
-        if (nprogress)
-			delete nprogress;
-		nprogress=0;
+		progressCb->reset();
+		progressCb->setMethodTitle("Components Labeling");
+		char buffer[256];
+		sprintf(buffer,"Cells: %u\nConnexity: %i",cellCount,sixConnexity ? 6 : 26);
+		progressCb->setInfo(buffer);
+		progressCb->start();
 	}
 
-    if (currentLabel<2) //No CC found !!!
-    {
-        delete[] cellIndexToLabel;
-        delete[] equivalentLabels;
-        return -3;
-    }
+	//we merge the components of all adjacent cells (union-find)
+	bool canceled = false;
+#ifdef ENABLE_MT_OCTREE
+	{
+		QAtomicInt* atomicParents = new QAtomicInt[cellCount];
+		if (!atomicParents)
+			return -2;
+		for (unsigned i=0; i<cellCount; ++i)
+			atomicParents[i] = static_cast<int>(i);
+
+		//jobs
+		static const unsigned CC_CELLS_PER_JOB = 4096;
+		std::vector<ccLinkJobDesc> jobs;
+		try
+		{
+			jobs.reserve(cellCount/CC_CELLS_PER_JOB+1);
+		}
+		catch (std::bad_alloc)
+		{
+			delete[] atomicParents;
+			return -2;
+		}
+		for (unsigned i=0; i<cellCount; i+=CC_CELLS_PER_JOB)
+		{
+			ccLinkJobDesc job;
+			job.first = i;
+			job.last = std::min(i+CC_CELLS_PER_JOB,cellCount);
+			jobs.push_back(job);
+		}
 
-    //path compression (http://en.wikipedia.org/wiki/Union_find)
-    assert(currentLabel<numberOfCells+2);
+		//static wrap
+		s_ccCodes_MT = &(codes[0]);
+		s_ccTable_MT = &table;
+		s_ccDimMasks_MT = dimMasks;
+		s_ccShifts_MT = shifts;
+		s_ccShiftCount_MT = shiftCount;
+		s_ccParents_MT = atomicParents;
+
+		QtConcurrent::blockingMap(jobs, LinkCCCells_MT);
+
+		s_ccCodes_MT = 0;
+		s_ccTable_MT = 0;
+		s_ccDimMasks_MT = 0;
+		s_ccShifts_MT = 0;
+		s_ccParents_MT = 0;
+
+		for (unsigned i=0; i<cellCount; ++i)
+			parents[i] = static_cast<unsigned>(static_cast<int>(atomicParents[i]));
+		delete[] atomicParents;
+	}
+#else
 	{
-		for (size_t i=2; i<=currentLabel; i++)
+		if (progressCb)
+			nprogress = new NormalizedProgress(progressCb,cellCount);
+
+		unsigned neighbours[MAX_CC_FORWARD_NEIGHBOURS];
+		for (unsigned i=0; i<cellCount; ++i)
 		{
-			int label = equivalentLabels[i];
-			assert(label<(int)numberOfCells+2);
-			while (equivalentLabels[label] > 1) //il faut donc que equivalentLabels[0]==0 !!!
+			unsigned count = GetCCForwardNeighbours(codes[i],table,dimMasks,shifts,shiftCount,neighbours);
+			for (unsigned n=0; n<count; ++n)
+				MergeCCs(&(parents[0]),i,neighbours[n]);
+
+			if (nprogress && !nprogress->oneStep())
 			{
-				label = equivalentLabels[label];
-				assert(label<(int)numberOfCells+2);
+				canceled = true;
+				break;
 			}
-			equivalentLabels[i] = label;
 		}
-	}
 
-    //update leafs
-	{
-		for (size_t i=0; i<numberOfCells; i++)
+		if (nprogress)
 		{
-			int label = cellIndexToLabel[i];
-			assert(label<(int)numberOfCells+2);
-			if (equivalentLabels[label]>1)
-				cellIndexToLabel[i] = equivalentLabels[label];
+			delete nprogress;
+			nprogress = 0;
 		}
 	}
+#endif
 
-    //hack: we use "equivalentLabels" to count how many components will have to be created
-	int numberOfComponents = 0;
+	if (progressCb)
+		progressCb->stop();
+
+	if (canceled)
+		return -1;
+
+	//path compression: as a parent always has a smaller index than
+	//its children, a single forward pass is sufficient
+	for (unsigned i=0; i<cellCount; ++i)
+		parents[i] = parents[parents[i]];
+
+	//components are numbered in the same order as the former slice-by-slice
+	//algorithm, i.e. by ascending (z,y,x) position of their first cell
+	std::vector<IndexAndCode> components;
 	{
-		memset(equivalentLabels,0,(numberOfCells+2)*sizeof(int));
+		//smallest (z,y,x) key of each component (stored in its root slot)
+		cellCodesContainer minKeys;
+		try
+		{
+			minKeys.resize(numberOfCells,static_cast<OctreeCellCodeType>(INVALID_CELL_CODE));
+		}
+		catch (std::bad_alloc)
+		{
+			return -2;
+		}
 
-		for (size_t i=0; i<numberOfCells; i++)
+		for (unsigned i=0; i<cellCount; ++i)
 		{
-			assert(cellIndexToLabel[i]>1 && cellIndexToLabel[i]<(int)numberOfCells+2);
-			equivalentLabels[cellIndexToLabel[i]]=1;
+			int pos[3];
+			getCellPos(codes[i],level,pos,true);
+			OctreeCellCodeType key =	(	static_cast<OctreeCellCodeType>(pos[0])					)
+									+	(	static_cast<OctreeCellCodeType>(pos[1]) << level		)
+									+	(	static_cast<OctreeCellCodeType>(pos[2]) << (2*level)	);
+			OctreeCellCodeType& minKey = minKeys[parents[i]];
+			if (key < minKey)
+				minKey = key;
 		}
 
-		//we create (following) indexes for each components
-		for (size_t i=2; i<numberOfCells+2; i++)
-			if (equivalentLabels[i]==1)
-				equivalentLabels[i]=++numberOfComponents; //labels start at '1'
+		try
+		{
+			for (unsigned i=0; i<cellCount; ++i)
+				if (parents[i] == i)
+					components.push_back(IndexAndCode(i,minKeys[i]));
+		}
+		catch (std::bad_alloc)
+		{
+			return -2;
+		}
+	}
+
+	if (components.empty()) //No CC found !!!
+		return -3;
+
+	std::sort(components.begin(),components.end(),IndexAndCode::codeComp);
+
+	//we store each component's label in its root cell slot (labels start at '1')
+	std::vector<ScalarType> rootLabels;
+	try
+	{
+		rootLabels.resize(numberOfCells,0);
+	}
+	catch (std::bad_alloc)
+	{
+		return -2;
 	}
-    assert(equivalentLabels[0]==0);
-    assert(equivalentLabels[1]==0);
+	for (size_t i=0; i<components.size(); ++i)
+		rootLabels[components[i].theIndex] = static_cast<ScalarType>(i+1);
+
+	unsigned numberOfComponents = static_cast<unsigned>(components.size());
+	components.clear();
 
-    //we flag each component's points with its label
+	//we flag each component's points with its label
 	{
 		if (progressCb)
 		{
 			progressCb->reset();
-			nprogress = new NormalizedProgress(progressCb,(unsigned)numberOfCells);
+			nprogress = new NormalizedProgress(progressCb,cellCount);
 			char buffer[256];
-			sprintf(buffer,"Components: %i",numberOfComponents);
+			sprintf(buffer,"Components: %u",numberOfComponents);
 			progressCb->setMethodTitle("Connected Components Extraction");
 			progressCb->setInfo(buffer);
 			progressCb->start();
 		}
 
-		for (size_t i=0; i<numberOfCells; i++)
+		//cells are sorted the same way as the octree structure: we only
+		//have to look for each cell after the previous one
+		unsigned begin = 0;
+		for (unsigned i=0; i<cellCount && begin<m_numberOfProjectedPoints; ++i)
 		{
-			assert(cellIndexToLabel[i]<(int)numberOfCells+2);
-
-			const int& label = equivalentLabels[cellIndexToLabel[i]];
-			assert(label>0);
-			ReferenceCloud* Y = getPointsInCell(ccCells[i].theCode,level,true);
-			assert(Y);
-			if (Y)
+			unsigned index = getCellIndex(codes[i],bitDec,begin,m_numberOfProjectedPoints-1);
+			assert(index < m_numberOfProjectedPoints);
+			if (index < m_numberOfProjectedPoints)
 			{
-				Y->placeIteratorAtBegining();
-				ScalarType d = static_cast<ScalarType>(label);
-				for (unsigned j=0; j<Y->size(); ++j)
-				{
-					Y->setCurrentPointScalarValue(d);
-					Y->forwardIterator();
-				}
+				ScalarType d = rootLabels[parents[i]];
+				assert(d > 0);
+				cellsContainer::const_iterator p = m_thePointsAndTheirCellCodes.begin()+index;
+				for (; p!=m_thePointsAndTheirCellCodes.end() && (p->theCode >> bitDec) == codes[i]; ++p)
+					m_theAssociatedCloud->setPointScalarValue(p->theIndex,d);
+				begin = static_cast<unsigned>(p-m_thePointsAndTheirCellCodes.begin());
 			}
 
 			if (nprogress)
@@ -3274,12 +3632,7 @@ int DgmOctree::extractCCs(const cellCodesContainer& cellCodes, uchar level, bool
 		}
 	}
 
-	if (cellIndexToLabel)
-		delete[] cellIndexToLabel;
-	if (equivalentLabels)
-		delete[] equivalentLabels;
-
-    return 0;
+	return 0;
 }
 
 #ifdef ENABLE_SANKARANARAYANAN_NN_SEARCH
@@ -3317,7 +3670,7 @@ void DgmOctree::prepareCellForNNSearch(OctreeCellCodeType truncatedCellCode, int
         //on recupere les points dans la cellule
         for (p = m_thePointsAndTheirCellCodes.begin()+cd.firstPointIndex; (p != m_thePointsAndTheirCellCodes.end()) && ((p->theCode >> bitDec) == cd.truncatedCode); ++p)
         {
-            PointDescriptor newPoint(m_theAssociatedCloud->getPointPersistentPtr(p->theIndex),p->theIndex);
+            PointDescriptor newPoint(getStructurePoint(p),p->theIndex);
             thePoints.push_back(newPoint);
         }
 
@@ -3502,7 +3855,7 @@ void DgmOctree::prepareCellForNNSearch(OctreeCellCodeType truncatedCellCode, int
                     cellDescription& cd = cellsToVisit.back();
                     for (p = m_thePointsAndTheirCellCodes.begin()+cd.firstPointIndex; (p != m_thePointsAndTheirCellCodes.end()) && ((p->theCode >> bitDec) == cd.truncatedCode); ++p)
                     {
-                        PointDescriptor newPoint(m_theAssociatedCloud->getPointPersistentPtr(p->theIndex),p->theIndex);
+                        PointDescriptor newPoint(getStructurePoint(p),p->theIndex);
                         thePoints.push_back(newPoint);
                     }
 
@@ -3547,7 +3900,7 @@ void DgmOctree::prepareCellForNNSearch(OctreeCellCodeType truncatedCellCode, int
                     cellDescription& cd = cellsToVisit.back();
                     for (p = m_thePointsAndTheirCellCodes.begin()+cd.firstPointIndex; (p != m_thePointsAndTheirCellCodes.end()) && ((p->theCode >> bitDec) == cd.truncatedCode); ++p)
                     {
-                        PointDescriptor newPoint(m_theAssociatedCloud->getPointPersistentPtr(p->theIndex),p->theIndex);
+                        PointDescriptor newPoint(getStructurePoint(p),p->theIndex);
                         thePoints.push_back(newPoint);
                     }
 
@@ -3635,14 +3988,26 @@ DgmOctree::octreeCell::octreeCell(DgmOctree* _parentOctree)
     , truncatedCode(0)
     , index(0)
     , points(0)
+    , ownsPoints(true)
 {
     assert(parentOctree && parentOctree->m_theAssociatedCloud);
     points = new ReferenceCloud(parentOctree->m_theAssociatedCloud);
 }
 
+DgmOctree::octreeCell::octreeCell(DgmOctree* _parentOctree, ReferenceCloud* _points)
+    : parentOctree(_parentOctree)
+    , level(0)
+    , truncatedCode(0)
+    , index(0)
+    , points(_points)
+    , ownsPoints(false)
+{
+    assert(parentOctree && points);
+}
+
 DgmOctree::octreeCell::~octreeCell()
 {
-    if (points)
+    if (points && ownsPoints)
         delete points;
 }
 
@@ -3655,13 +4020,13 @@ unsigned DgmOctree::executeFunctionForAllCellsAtLevel(uchar level,
     if (m_thePointsAndTheirCellCodes.empty())
         return 0;
 
-	//we get the maximum cell population for this level
-	unsigned maxCellPopulation=m_maxCellPopulation[level];
+	//constant time cell lookup for the neighbours searches (if possible)
+	buildCellIndexLookupTable(level);
 
     //cell descriptor (initialize it with first cell/point)
-    octreeCell cell(this);
-	if (!cell.points->reserve(maxCellPopulation)) //not enough memory
-		return 0;
+	//(the cell points are directly read in m_thePointsAndTheirCellCodes)
+	DgmOctreeCellReferenceCloud cellPoints(m_theAssociatedCloud);
+    octreeCell cell(this,&cellPoints);
 	cell.level=level;
     cell.index = 0;
 
@@ -3673,7 +4038,6 @@ unsigned DgmOctree::executeFunctionForAllCellsAtLevel(uchar level,
 
 	//init with first cell
     cell.truncatedCode = (p->theCode >> bitDec);
-	cell.points->addPointIndex(p->theIndex); //can't fail (see above)
 	++p;
 
 	//number of cells for this level
@@ -3710,14 +4074,14 @@ unsigned DgmOctree::executeFunctionForAllCellsAtLevel(uchar level,
         if (nextCode != cell.truncatedCode)
         {
             //if not, we call the user function on the precedent cell
+			cellPoints.setRange(&m_thePointsAndTheirCellCodes[cell.index],static_cast<unsigned>(p-m_thePointsAndTheirCellCodes.begin())-cell.index);
             result = (*func)(cell,additionalParameters);
 
 			if (!result)
 				break;
 
 			//and we start a new cell
-            cell.index+=cell.points->size();
-            cell.points->clear(false);
+            cell.index+=cellPoints.size();
 			cell.truncatedCode = nextCode;
 
 			if (nprogress && !nprogress->oneStep())
@@ -3727,13 +4091,14 @@ unsigned DgmOctree::executeFunctionForAllCellsAtLevel(uchar level,
 				break;
 			}
         }
-
-        cell.points->addPointIndex(p->theIndex); //can't fail (see above)
     }
 
     //don't forget last cell!
 	if (result)
+	{
+		cellPoints.setRange(&m_thePointsAndTheirCellCodes[cell.index],static_cast<unsigned>(m_thePointsAndTheirCellCodes.size())-cell.index);
 		result = (*func)(cell,additionalParameters);
+	}
 
 #ifdef COMPUTE_NN_SEARCH_STATISTICS
 	FILE* fp=fopen("octree_log.txt","at");
@@ -3772,13 +4137,10 @@ unsigned DgmOctree::executeFunctionForAllCellsAtStartingLevel(uchar startingLeve
     if (m_thePointsAndTheirCellCodes.empty())
         return 0;
 
-	//we get the maximum cell population for this level
-	unsigned maxCellPopulation=m_maxCellPopulation[startingLevel];
-
 	//cell descriptor
-    octreeCell cell(this);
-	if (!cell.points->reserve(maxCellPopulation)) //not enough memory
-		return 0;
+	//(the cell points are directly read in m_thePointsAndTheirCellCodes)
+	DgmOctreeCellReferenceCloud cellPoints(m_theAssociatedCloud);
+    octreeCell cell(this,&cellPoints);
 	cell.level = startingLevel;
 	cell.index = 0;
 
@@ -3971,16 +4333,8 @@ unsigned DgmOctree::executeFunctionForAllCellsAtStartingLevel(uchar startingLeve
         }
 
 		//we can now really 'add' the points to the cell descriptor
-        cell.points->clear(false);
-		//DGM: already done earlier
-		/*if (!cell.points->reserve(elements)) //not enough memory
-		{
-			result=false;
-			break;
-		}
-		//*/
-		for (unsigned i=0;i<elements;++i)
-			cell.points->addPointIndex((startingElement++)->theIndex);
+		cellPoints.setRange(&(*startingElement),elements);
+		startingElement += elements;
 
 		//call user method on current cell
 		result = (*func)(cell,additionalParameters);
@@ -4054,25 +4408,15 @@ void LaunchOctreeCellFunc_MT(const octreeCellDesc& desc)
 
 	const DgmOctree::cellsContainer& pointsAndCodes = s_octree_MT->pointsAndTheirCellCodes();
 
-    //cell descriptor
-    DgmOctree::octreeCell* cell = new DgmOctree::octreeCell(s_octree_MT);
-	cell->level = desc.level;
-	cell->index = desc.i1;
-	cell->truncatedCode = desc.truncatedCode;
-	if (cell->points->reserve(desc.i2-desc.i1+1))
-	{
-		for (unsigned i=desc.i1; i<=desc.i2; ++i)
-			cell->points->addPointIndex(pointsAndCodes[i].theIndex);
+    //cell descriptor (on the stack: the cell points are directly read in the octree structure)
+	DgmOctreeCellReferenceCloud cellPoints(s_octree_MT->associatedCloud());
+	cellPoints.setRange(&pointsAndCodes[desc.i1],desc.i2-desc.i1+1);
+    DgmOctree::octreeCell cell(s_octree_MT,&cellPoints);
+	cell.level = desc.level;
+	cell.index = desc.i1;
+	cell.truncatedCode = desc.truncatedCode;
 
-		s_cellFunc_MT_success &= (*s_func_MT)(*cell,s_userParams_MT);
-	}
-	else
-	{
-		s_cellFunc_MT_success = false;
-	}
-
-	delete cell;
-	cell=0;
+	s_cellFunc_MT_success &= (*s_func_MT)(cell,s_userParams_MT);
 }
 
 unsigned DgmOctree::executeFunctionForAllCellsAtLevel_MT(uchar level,
@@ -4084,6 +4428,10 @@ unsigned DgmOctree::executeFunctionForAllCellsAtLevel_MT(uchar level,
     if (m_thePointsAndTheirCellCodes.empty())
         return 0;
 
+	//constant time cell lookup for the neighbours searches (if possible)
+	//(must be built before the threads are launched)
+	buildCellIndexLookupTable(level);
+
 	const unsigned cellsNumber = getCellNumber(level);
 
 	//cells that will be processed by QtConcurrent::map
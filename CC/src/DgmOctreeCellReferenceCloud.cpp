@@ -0,0 +1,76 @@
+//##########################################################################
+//#                                                                        #
+//#                               CCLIB                                    #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU Library General Public License as       #
+//#  published by the Free Software Foundation; version 2 of the License.  #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: EDF R&D / TELECOM ParisTech (ENST-TSI)             #
+//#                                                                        #
+//##########################################################################
+
+#include "DgmOctreeCellReferenceCloud.h"
+
+//system
+#include <assert.h>
+
+using namespace CCLib;
+
+DgmOctreeCellReferenceCloud::DgmOctreeCellReferenceCloud(GenericIndexedCloudPersist* associatedCloud)
+	: ReferenceCloud(associatedCloud,0) //no indexes container
+	, m_first(0)
+	, m_count(0)
+{
+}
+
+const CCVector3* DgmOctreeCellReferenceCloud::getCurrentPointCoordinates() const
+{
+	assert(m_theAssociatedCloud && m_globalIterator < m_count);
+	return m_theAssociatedCloud->getPointPersistentPtr(m_first[m_globalIterator].theIndex);
+}
+
+void DgmOctreeCellReferenceCloud::forEach(genericPointAction& anAction)
+{
+	assert(m_theAssociatedCloud);
+
+	ScalarType d,d2;
+	for (unsigned i=0;i<m_count;++i)
+	{
+		unsigned index = m_first[i].theIndex;
+		d2 = d = m_theAssociatedCloud->getPointScalarValue(index);
+		anAction(*m_theAssociatedCloud->getPointPersistentPtr(index),d2);
+		if (d!=d2)
+			m_theAssociatedCloud->setPointScalarValue(index,d2);
+	}
+}
+
+void DgmOctreeCellReferenceCloud::computeBB()
+{
+	assert(m_theAssociatedCloud);
+
+	//empty cloud?!
+	if (m_count == 0)
+	{
+		m_bbMins[0]=m_bbMaxs[0]=0.0;
+		m_bbMins[1]=m_bbMaxs[1]=0.0;
+		m_bbMins[2]=m_bbMaxs[2]=0.0;
+		return;
+	}
+
+	//initialize BBox with first point
+	const CCVector3* P = m_theAssociatedCloud->getPointPersistentPtr(m_first[0].theIndex);
+	m_bbMins[0]=m_bbMaxs[0]=P->x;
+	m_bbMins[1]=m_bbMaxs[1]=P->y;
+	m_bbMins[2]=m_bbMaxs[2]=P->z;
+
+	for (unsigned i=1;i<m_count;++i)
+		updateBBWithPoint(m_theAssociatedCloud->getPointPersistentPtr(m_first[i].theIndex));
+
+	m_validBB = true;
+}
@@ -27,6 +27,7 @@
 #include "GenericIndexedMesh.h"
 #include "GenericProgressCallback.h"
 #include "ChamferDistanceTransform.h"
+#include "SparseEuclideanDistanceTransform.h"
 #include "FastMarchingForPropagation.h"
 #include "ScalarFieldTools.h"
 #include "CCConst.h"
@@ -2337,6 +2338,69 @@ int DistanceComputationTools::diff(GenericIndexedCloudPersist* comparedCloud,
 	return 0;
 }
 
+int DistanceComputationTools::computeSparseEDTBetweenTwoOctrees(DgmOctree* octreeA, DgmOctree* octreeB, uchar octreeLevel, const int* minIndexes, const unsigned short* boxSize, GenericProgressCallback* progressCb)
+{
+	assert(octreeA && octreeB);
+
+	SparseEuclideanDistanceTransform edt(boxSize[0],boxSize[1],boxSize[2]);
+
+	//the cells of octree B are the 'zeros'
+	{
+		DgmOctree::cellCodesContainer theCodes;
+		octreeB->getCellCodes(octreeLevel,theCodes,true);
+
+		int pos[3];
+		for (DgmOctree::cellCodesContainer::const_iterator it=theCodes.begin(); it!=theCodes.end(); ++it)
+		{
+			octreeB->getCellPos(*it,octreeLevel,pos,true);
+			pos[0] -= minIndexes[0];
+			pos[1] -= minIndexes[1];
+			pos[2] -= minIndexes[2];
+			if (!edt.setZero(pos))
+				return -4;
+		}
+	}
+
+	//the cells of octree A are the queries
+	DgmOctree::cellIndexesContainer theIndexes;
+	if (!octreeA->getCellIndexes(octreeLevel,theIndexes))
+	{
+		//not enough memory
+		return -5;
+	}
+	{
+		int pos[3];
+		for (size_t n=0; n<theIndexes.size(); ++n)
+		{
+			octreeA->getCellPos(octreeA->getCellCode(theIndexes[n]),octreeLevel,pos,false);
+			pos[0] -= minIndexes[0];
+			pos[1] -= minIndexes[1];
+			pos[2] -= minIndexes[2];
+			if (edt.addQuery(pos) < 0)
+				return -5;
+		}
+	}
+
+	double maxSquareDist = edt.propagateDistance(progressCb);
+	if (maxSquareDist < 0)
+		return -4;
+
+	//we assign the distances to the points of each cell of octree A
+	PointCoordinateType cellSize = octreeA->getCellSize(octreeLevel);
+
+	ReferenceCloud Yk(octreeA->associatedCloud());
+	for (size_t n=0; n<theIndexes.size(); ++n)
+	{
+		ScalarType d = (ScalarType)(sqrt(edt.getSquareDistance((unsigned)n))*cellSize);
+
+		octreeA->getPointsInCellByCellIndex(&Yk,theIndexes[n],octreeLevel);
+		for (unsigned j=0;j<Yk.size();++j)
+			Yk.setPointScalarValue(j,d);
+	}
+
+	return (int)sqrt(maxSquareDist);
+}
+
 int DistanceComputationTools::computeChamferDistanceBetweenTwoClouds(CC_CHAMFER_DISTANCE_TYPE cType, GenericIndexedCloudPersist* comparedCloud, GenericIndexedCloudPersist* referenceCloud, uchar octreeLevel, GenericProgressCallback* progressCb, DgmOctree* compOctree, DgmOctree* refOctree)
 {
 	if (!comparedCloud || !referenceCloud)
@@ -2351,8 +2415,8 @@ int DistanceComputationTools::computeChamferDistanceBetweenTwoClouds(CC_CHAMFER_
 
 	const int* minIndexesA = octreeA->getMinFillIndexes(octreeLevel);
 	const int* maxIndexesA = octreeA->getMaxFillIndexes(octreeLevel);
-	const int* minIndexesB = octreeA->getMinFillIndexes(octreeLevel);
-	const int* maxIndexesB = octreeA->getMaxFillIndexes(octreeLevel);
+	const int* minIndexesB = octreeB->getMinFillIndexes(octreeLevel);
+	const int* maxIndexesB = octreeB->getMaxFillIndexes(octreeLevel);
 
 	int minIndexes[3],maxIndexes[3];
 	minIndexes[0]=std::min(minIndexesA[0],minIndexesB[0]);
@@ -2369,6 +2433,20 @@ int DistanceComputationTools::computeChamferDistanceBetweenTwoClouds(CC_CHAMFER_
 
 	//Console::print("BoxSize = (%i,%i,%i)\n",boxSize[0],boxSize[1],boxSize[2]);
 
+	//exact Euclidean distance transform: only evaluated at the (non empty) cells of octree A
+	if (cType == EUCLIDEAN_EDT)
+	{
+		comparedCloud->enableScalarField();
+		int result = computeSparseEDTBetweenTwoOctrees(octreeA,octreeB,octreeLevel,minIndexes,boxSize,progressCb);
+
+		if (!compOctree)
+			delete octreeA;
+		if (!refOctree)
+			delete octreeB;
+
+		return result;
+	}
+
 	//puis on projette les cellules de l'octree B dans un grille 3D (DistanceGrid)
 	ChamferDistanceTransform* dg = new ChamferDistanceTransform(boxSize[0],boxSize[1],boxSize[2]);
 	if (!dg->init())
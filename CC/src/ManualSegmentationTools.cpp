@@ -18,7 +18,6 @@
 #include "ManualSegmentationTools.h"
 
 //local
-#include "Matrix.h"
 #include "CCTypes.h"
 #include "GenericProgressCallback.h"
 #include "GenericIndexedCloudPersist.h"
@@ -26,47 +25,560 @@
 #include "GenericIndexedMesh.h"
 #include "SimpleMesh.h"
 #include "Polyline.h"
+#include "DgmOctree.h"
 
 //system
 #include <string.h>
 #include <assert.h>
+#include <vector>
+#include <algorithm>
 
 using namespace CCLib;
 
-ReferenceCloud* ManualSegmentationTools::segment(GenericIndexedCloudPersist* aCloud, const Polyline* poly, bool keepInside, const float* viewMat)
+//! Polygon rasterized on a regular grid (for fast point-in-polygon tests)
+/** Each grid cell is either entirely inside the polygon, entirely outside
+	or crossed by its border (in which case the exact test is performed, see
+	ManualSegmentationTools::isPointInsidePoly). Grid cells are classified
+	conservatively (the border cells are dilated by one cell).
+**/
+class PolygonRaster
+{
+public:
+
+	//! Grid cell classification
+	enum CellType { CELL_OUTSIDE = 0, CELL_INSIDE = 1, CELL_BOUNDARY = 2 };
+
+	//! Grid resolution (along each dimension)
+	static const int RESOLUTION = 512;
+
+	//! Default constructor
+	PolygonRaster()
+		: m_invStepX(0)
+		, m_invStepY(0)
+	{
+	}
+
+	//! Rasterizes a polyline (considered as a closed 2D polygon)
+	/** \return false if there's not enough memory
+	**/
+	bool init(const Polyline* poly)
+	{
+		unsigned vertCount = poly->size();
+		if (vertCount < 2)
+			return true; //no point will be inside
+
+		try
+		{
+			m_vertices.resize(vertCount);
+			m_cells.resize(RESOLUTION*RESOLUTION,CELL_OUTSIDE);
+		}
+		catch(std::bad_alloc)
+		{
+			//not enough memory
+			return false;
+		}
+
+		for (unsigned i=0; i<vertCount; ++i)
+		{
+			CCVector3 P;
+			poly->getPoint(i,P);
+			m_vertices[i] = CCVector2(P.x,P.y);
+			if (i == 0)
+			{
+				m_min = m_max = m_vertices[0];
+			}
+			else
+			{
+				m_min.x = std::min(m_min.x,P.x);
+				m_min.y = std::min(m_min.y,P.y);
+				m_max.x = std::max(m_max.x,P.x);
+				m_max.y = std::max(m_max.y,P.y);
+			}
+		}
+
+		PointCoordinateType stepX = (m_max.x-m_min.x)/RESOLUTION;
+		PointCoordinateType stepY = (m_max.y-m_min.y)/RESOLUTION;
+		m_invStepX = (stepX > 0 ? 1/stepX : 0);
+		m_invStepY = (stepY > 0 ? 1/stepY : 0);
+
+		//cells crossed by the polygon border
+		for (unsigned i=1; i<=vertCount; ++i)
+		{
+			const CCVector2& A = m_vertices[i-1];
+			const CCVector2& B = m_vertices[i%vertCount];
+
+			PointCoordinateType yMin = std::min(A.y,B.y);
+			PointCoordinateType yMax = std::max(A.y,B.y);
+			int j1 = rowOf(yMax);
+			for (int j=rowOf(yMin); j<=j1; ++j)
+			{
+				//edge extent inside this row
+				PointCoordinateType xa = A.x;
+				PointCoordinateType xb = B.x;
+				if (A.y != B.y)
+				{
+					PointCoordinateType yLow = std::max(yMin,m_min.y+stepY*j);
+					PointCoordinateType yHigh = std::min(yMax,m_min.y+stepY*(j+1));
+					xa = A.x + (yLow-A.y)*(B.x-A.x)/(B.y-A.y);
+					xb = A.x + (yHigh-A.y)*(B.x-A.x)/(B.y-A.y);
+				}
+				int i0 = std::max(colOf(std::min(xa,xb))-1,0);
+				int i1 = std::min(colOf(std::max(xa,xb))+1,RESOLUTION-1);
+				for (int jj=std::max(j-1,0); jj<=std::min(j+1,RESOLUTION-1); ++jj)
+					memset(&m_cells[jj*RESOLUTION+i0],CELL_BOUNDARY,i1-i0+1);
+			}
+		}
+
+		//inside cells: scanline through the center of each row
+		std::vector<PointCoordinateType> crossings;
+		for (int j=0; j<RESOLUTION; ++j)
+		{
+			PointCoordinateType yc = m_min.y + stepY*(static_cast<PointCoordinateType>(j)+static_cast<PointCoordinateType>(0.5));
+
+			crossings.clear();
+			for (unsigned i=1; i<=vertCount; ++i)
+			{
+				const CCVector2& A = m_vertices[i-1];
+				const CCVector2& B = m_vertices[i%vertCount];
+				if (((B.y<=yc) && (yc<A.y)) || ((A.y<=yc) && (yc<B.y)))
+				{
+					try
+					{
+						crossings.push_back(B.x + (yc-B.y)*(A.x-B.x)/(A.y-B.y));
+					}
+					catch(std::bad_alloc)
+					{
+						//not enough memory
+						return false;
+					}
+				}
+			}
+			std::sort(crossings.begin(),crossings.end());
+
+			unsigned char* cell = &m_cells[j*RESOLUTION];
+			size_t c = 0;
+			for (int i=0; i<RESOLUTION; ++i, ++cell)
+			{
+				PointCoordinateType xc = m_min.x + stepX*(static_cast<PointCoordinateType>(i)+static_cast<PointCoordinateType>(0.5));
+				while (c < crossings.size() && crossings[c] < xc)
+					++c;
+				if (*cell != CELL_BOUNDARY && (c & 1))
+					*cell = CELL_INSIDE;
+			}
+		}
+
+		return true;
+	}
+
+	//! Tests whether a point is inside the polygon (same result as ManualSegmentationTools::isPointInsidePoly)
+	inline bool isInside(PointCoordinateType x, PointCoordinateType y) const
+	{
+		//outside of the polygon bounding-box (or NaN)
+		if (m_vertices.empty() || !(x >= m_min.x && x <= m_max.x && y >= m_min.y && y <= m_max.y))
+			return false;
+
+		unsigned char type = m_cells[rowOf(y)*RESOLUTION+colOf(x)];
+		return (type == CELL_BOUNDARY ? isInsideExact(x,y) : type == CELL_INSIDE);
+	}
+
+	//! Classifies a 2D box
+	/** \return CELL_INSIDE or CELL_OUTSIDE if the box is entirely inside or outside the polygon, CELL_BOUNDARY otherwise
+	**/
+	CellType classifyBox(const CCVector2& boxMin, const CCVector2& boxMax) const
+	{
+		if (m_vertices.empty() || boxMax.x < m_min.x || boxMin.x > m_max.x || boxMax.y < m_min.y || boxMin.y > m_max.y)
+			return CELL_OUTSIDE;
+
+		int i0 = colOf(boxMin.x), i1 = colOf(boxMax.x);
+		int j0 = rowOf(boxMin.y), j1 = rowOf(boxMax.y);
+		//we don't want to spend too much time on big boxes
+		static const int s_maxTestedCells = 1024;
+		if ((i1-i0+1)*(j1-j0+1) > s_maxTestedCells)
+			return CELL_BOUNDARY;
+
+		bool hasInside = false;
+		bool hasOutside = (boxMin.x < m_min.x || boxMax.x > m_max.x || boxMin.y < m_min.y || boxMax.y > m_max.y);
+		for (int j=j0; j<=j1; ++j)
+		{
+			const unsigned char* cell = &m_cells[j*RESOLUTION+i0];
+			for (int i=i0; i<=i1; ++i, ++cell)
+			{
+				if (*cell == CELL_BOUNDARY)
+					return CELL_BOUNDARY;
+				if (*cell == CELL_INSIDE)
+					hasInside = true;
+				else
+					hasOutside = true;
+				if (hasInside && hasOutside)
+					return CELL_BOUNDARY;
+			}
+		}
+
+		return (hasInside ? CELL_INSIDE : CELL_OUTSIDE);
+	}
+
+protected:
+
+	//! Returns the grid column of a given abscissa (clamped)
+	inline int colOf(PointCoordinateType x) const
+	{
+		PointCoordinateType i = (x-m_min.x)*m_invStepX;
+		return (i <= 0 ? 0 : (i >= RESOLUTION-1 ? RESOLUTION-1 : static_cast<int>(i)));
+	}
+
+	//! Returns the grid row of a given ordinate (clamped)
+	inline int rowOf(PointCoordinateType y) const
+	{
+		PointCoordinateType j = (y-m_min.y)*m_invStepY;
+		return (j <= 0 ? 0 : (j >= RESOLUTION-1 ? RESOLUTION-1 : static_cast<int>(j)));
+	}
+
+	//! Exact point in polygon test (same as ManualSegmentationTools::isPointInsidePoly)
+	bool isInsideExact(PointCoordinateType x, PointCoordinateType y) const
+	{
+		bool inside = false;
+
+		unsigned vertCount = static_cast<unsigned>(m_vertices.size());
+		for (unsigned i=1; i<=vertCount; ++i)
+		{
+			const CCVector2& A = m_vertices[i-1];
+			const CCVector2& B = m_vertices[i%vertCount];
+
+			if (((B.y<=y) && (y<A.y)) ||
+				((A.y<=y) && (y<B.y)))
+			{
+				PointCoordinateType ABy = A.y-B.y;
+				PointCoordinateType t = (x-B.x)*ABy-(A.x-B.x)*(y-B.y);
+				if (ABy<0)
+					t=-t;
+				if (t<0)
+					inside = !inside;
+			}
+		}
+
+		return inside;
+	}
+
+	//! Polygon vertices
+	std::vector<CCVector2> m_vertices;
+	//! Grid cells (see CellType)
+	std::vector<unsigned char> m_cells;
+	//! Polygon bounding-box min corner
+	CCVector2 m_min;
+	//! Polygon bounding-box max corner
+	CCVector2 m_max;
+	//! Inverse of the grid step along X
+	PointCoordinateType m_invStepX;
+	//! Inverse of the grid step along Y
+	PointCoordinateType m_invStepY;
+};
+
+//! Polygon segmentation parameters (shared by all jobs)
+struct polySegmentContext
+{
+	//! Cloud to segment
+	GenericIndexedCloudPersist* cloud;
+	//! Rasterized polygon
+	const PolygonRaster* raster;
+	//! Projection matrix (OpenGL style, or 0 if none)
+	const float* viewMat;
+	//! Whether inside points are kept
+	bool keepInside;
+	//! Octree (optional)
+	const DgmOctree* octree;
+	//! Octree level
+	uchar level;
+	//! Octree cells first point indexes (at 'level')
+	const DgmOctree::cellIndexesContainer* cellIndexes;
+};
+
+//! Range of points (or of octree cells) tested by a single polygon segmentation job
+struct polySegmentJobDesc
+{
+	//! First point (or cell) index
+	unsigned first;
+	//! Last point (or cell) index (excluded)
+	unsigned last;
+	//! Selected points indexes
+	std::vector<unsigned> selection;
+	//! Whether an error occurred (not enough memory)
+	bool error;
+};
+
+//! Projects and tests a set of points (by batches)
+/** The points are either [first ; first+count[ or, if 'codes' is not null,
+	the indexes of codes[0 ; count[.
+**/
+static void SegmentPointsByPolygon(	const polySegmentContext& context,
+									const DgmOctree::IndexAndCode* codes,
+									unsigned first,
+									unsigned count,
+									std::vector<unsigned>& selection)
+{
+	static const unsigned s_batchSize = 256;
+	PointCoordinateType X[s_batchSize], Y[s_batchSize], Z[s_batchSize];
+	unsigned indexes[s_batchSize];
+
+	const float* M = context.viewMat;
+	for (unsigned b=0; b<count; b+=s_batchSize)
+	{
+		unsigned n = std::min(s_batchSize,count-b);
+
+		//gather
+		for (unsigned k=0; k<n; ++k)
+		{
+			indexes[k] = (codes ? codes[b+k].theIndex : first+b+k);
+			const CCVector3* P = context.cloud->getPointPersistentPtr(indexes[k]);
+			X[k] = P->x;
+			Y[k] = P->y;
+			Z[k] = P->z;
+		}
+
+		//project (in screen space)
+		if (M)
+		{
+			for (unsigned k=0; k<n; ++k)
+			{
+				PointCoordinateType x = M[0]*X[k] + M[4]*Y[k] + M[8]*Z[k] + M[12];
+				PointCoordinateType y = M[1]*X[k] + M[5]*Y[k] + M[9]*Z[k] + M[13];
+				X[k] = x;
+				Y[k] = y;
+			}
+		}
+
+		//test
+		for (unsigned k=0; k<n; ++k)
+			if (context.raster->isInside(X[k],Y[k]) == context.keepInside)
+				selection.push_back(indexes[k]);
+	}
+}
+
+//! Tests a range of points (or of octree cells)
+static void SegmentRangeByPolygon(const polySegmentContext& context, polySegmentJobDesc& job)
+{
+	try
+	{
+		if (!context.octree)
+		{
+			SegmentPointsByPolygon(context,0,job.first,job.last-job.first,job.selection);
+			return;
+		}
+
+		const DgmOctree::cellsContainer& codes = context.octree->pointsAndTheirCellCodes();
+		const DgmOctree::cellIndexesContainer& cellIndexes = *context.cellIndexes;
+		uchar bitDec = GET_BIT_SHIFT(context.level);
+		const float* M = context.viewMat;
+
+		for (unsigned c=job.first; c<job.last; ++c)
+		{
+			unsigned start = cellIndexes[c];
+			unsigned end = (c+1 < cellIndexes.size() ? cellIndexes[c+1] : static_cast<unsigned>(codes.size()));
+
+			//projected cell bounding-box
+			PointCoordinateType cellMin[3], cellMax[3];
+			context.octree->computeCellLimits(codes[start].theCode >> bitDec,context.level,cellMin,cellMax,true);
+			CCVector2 boxMin, boxMax;
+			for (unsigned k=0; k<8; ++k)
+			{
+				CCVector3 P(k & 1 ? cellMax[0] : cellMin[0], k & 2 ? cellMax[1] : cellMin[1], k & 4 ? cellMax[2] : cellMin[2]);
+				CCVector2 Q(P.x,P.y);
+				if (M)
+				{
+					Q.x = M[0]*P.x + M[4]*P.y + M[8]*P.z + M[12];
+					Q.y = M[1]*P.x + M[5]*P.y + M[9]*P.z + M[13];
+				}
+				if (k == 0)
+				{
+					boxMin = boxMax = Q;
+				}
+				else
+				{
+					boxMin.x = std::min(boxMin.x,Q.x);
+					boxMin.y = std::min(boxMin.y,Q.y);
+					boxMax.x = std::max(boxMax.x,Q.x);
+					boxMax.y = std::max(boxMax.y,Q.y);
+				}
+			}
+
+			PolygonRaster::CellType type = context.raster->classifyBox(boxMin,boxMax);
+			if (type == PolygonRaster::CELL_BOUNDARY)
+			{
+				SegmentPointsByPolygon(context,&codes[start],0,end-start,job.selection);
+			}
+			else if ((type == PolygonRaster::CELL_INSIDE) == context.keepInside)
+			{
+				//the whole cell is selected
+				for (unsigned i=start; i<end; ++i)
+					job.selection.push_back(codes[i].theIndex);
+			}
+		}
+	}
+	catch(std::bad_alloc)
+	{
+		//not enough memory
+		job.error = true;
+	}
+}
+
+#ifdef ENABLE_MT_OCTREE
+
+#include <QtCore/QtCore>
+
+/*** MULTI THREADING WRAPPER ***/
+
+static const polySegmentContext* s_polySegContext_MT = 0;
+
+void SegmentRangeByPolygon_MT(polySegmentJobDesc& job)
+{
+	SegmentRangeByPolygon(*s_polySegContext_MT,job);
+}
+
+#endif
+
+ReferenceCloud* ManualSegmentationTools::segment(GenericIndexedCloudPersist* aCloud, const Polyline* poly, bool keepInside, const float* viewMat, const DgmOctree* octree)
 {
     assert(poly && aCloud);
 
-	CCLib::SquareMatrix* trans = (viewMat ? new CCLib::SquareMatrix(viewMat) : 0);
+	PolygonRaster raster;
+	if (!raster.init(poly))
+		return 0; //not enough memory
 
 	ReferenceCloud* Y = new ReferenceCloud(aCloud);
 
-	//we check for each point if it falls inside the polyline
-	unsigned count = aCloud->size();
-	for (unsigned i=0; i<count; ++i)
+	unsigned pointCount = aCloud->size();
+	if (pointCount == 0)
+		return Y;
+
+	polySegmentContext context;
+	context.cloud = aCloud;
+	context.raster = &raster;
+	context.viewMat = viewMat;
+	context.keepInside = keepInside;
+	context.octree = 0;
+	context.level = 0;
+	context.cellIndexes = 0;
+
+	//the octree can only be used if it has been computed on all the points
+	DgmOctree::cellIndexesContainer cellIndexes;
+	if (octree && octree->associatedCloud() == aCloud && octree->getNumberOfProjectedPoints() == pointCount)
 	{
-		CCVector3 P;
-		aCloud->getPoint(i,P);
-
-		//we project the point in screen space first if necessary
-		if (trans)
-			trans->apply(P.u);
+		static const unsigned s_pointsPerCell = 128;
+		context.level = octree->findBestLevelForAGivenPopulationPerCell(s_pointsPerCell);
+		if (octree->getCellIndexes(context.level,cellIndexes))
+		{
+			context.octree = octree;
+			context.cellIndexes = &cellIndexes;
+		}
+	}
 
-		bool pointInside = isPointInsidePoly(CCVector2(P.x,P.y),poly);
-		if ((keepInside && pointInside) || (!keepInside && !pointInside))
+	//jobs (about the same number of points for each)
+	static const unsigned s_jobSize = (1<<16);
+	std::vector<polySegmentJobDesc> jobs;
+	try
+	{
+		polySegmentJobDesc job;
+		job.error = false;
+		if (context.octree)
 		{
-			if (!Y->addPointIndex(i))
+			unsigned cellCount = static_cast<unsigned>(cellIndexes.size());
+			job.first = 0;
+			for (unsigned c=1; c<=cellCount; ++c)
 			{
-				//not engouh memory
-				delete Y;
-				Y=0;
-				break;
+				unsigned cellStart = (c < cellCount ? cellIndexes[c] : pointCount);
+				if (cellStart-cellIndexes[job.first] >= s_jobSize || c == cellCount)
+				{
+					job.last = c;
+					jobs.push_back(job);
+					job.first = c;
+				}
+			}
+		}
+		else
+		{
+			for (job.first=0; job.first<pointCount; job.first+=s_jobSize)
+			{
+				job.last = std::min(job.first+s_jobSize,pointCount);
+				jobs.push_back(job);
 			}
 		}
 	}
+	catch(std::bad_alloc)
+	{
+		//not enough memory
+		delete Y;
+		return 0;
+	}
+
+#ifdef ENABLE_MT_OCTREE
+	s_polySegContext_MT = &context;
+	QtConcurrent::blockingMap(jobs, SegmentRangeByPolygon_MT);
+	s_polySegContext_MT = 0;
+#else
+	for (size_t k=0; k<jobs.size(); ++k)
+		SegmentRangeByPolygon(context,jobs[k]);
+#endif
+
+	//we concatenate the jobs selections
+	unsigned selectedCount = 0;
+	for (size_t k=0; k<jobs.size(); ++k)
+	{
+		if (jobs[k].error)
+		{
+			//not enough memory
+			delete Y;
+			return 0;
+		}
+		selectedCount += static_cast<unsigned>(jobs[k].selection.size());
+	}
+
+	if (selectedCount == 0)
+		return Y;
 
-	if (trans)
-        delete trans;
+	if (!Y->resize(selectedCount))
+	{
+		//not enough memory
+		delete Y;
+		return 0;
+	}
+
+	if (context.octree)
+	{
+		//the cells points are in the octree (Morton) order: we restore the cloud order
+		std::vector<bool> selected;
+		try
+		{
+			selected.resize(pointCount,false);
+		}
+		catch(std::bad_alloc)
+		{
+			//not enough memory
+			delete Y;
+			return 0;
+		}
+		for (size_t k=0; k<jobs.size(); ++k)
+		{
+			std::vector<unsigned>& selection = jobs[k].selection;
+			for (size_t i=0; i<selection.size(); ++i)
+				selected[selection[i]] = true;
+			std::vector<unsigned>().swap(selection);
+		}
+		unsigned outIndex = 0;
+		for (unsigned i=0; i<pointCount; ++i)
+			if (selected[i])
+				Y->setPointIndex(outIndex++,i);
+		assert(outIndex == selectedCount);
+	}
+	else
+	{
+		unsigned outIndex = 0;
+		for (size_t k=0; k<jobs.size(); ++k)
+		{
+			std::vector<unsigned>& selection = jobs[k].selection;
+			for (size_t i=0; i<selection.size(); ++i)
+				Y->setPointIndex(outIndex++,selection[i]);
+			std::vector<unsigned>().swap(selection);
+		}
+	}
 
 	return Y;
 }
@@ -107,6 +619,65 @@ bool ManualSegmentationTools::isPointInsidePoly(const CCVector2& P, const Polyli
 }
 
 
+//! Range of points tested by a single scalar value segmentation job
+struct sfSegmentJobDesc
+{
+	//! First point index
+	unsigned first;
+	//! Last point index (excluded)
+	unsigned last;
+	//! Index of the first selected point in the output selection
+	unsigned outIndex;
+	//! Number of selected points
+	unsigned count;
+};
+
+//! Tests the scalar values of a range of points
+/** If 'output' is null, the selected points are only counted. Otherwise
+	their indexes are written in 'output' starting at job.outIndex.
+**/
+static void SegmentRangeByScalarValue(	const GenericIndexedCloudPersist* cloud,
+										ScalarType minVal,
+										ScalarType maxVal,
+										sfSegmentJobDesc& job,
+										ReferenceCloud* output)
+{
+	unsigned count = 0;
+	for (unsigned i=job.first; i<job.last; ++i)
+	{
+		const ScalarType val = cloud->getPointScalarValue(i);
+		//we test if its associated scalar value falls inside the specified interval
+		if (val >= minVal && val <= maxVal)
+		{
+			if (output)
+				output->setPointIndex(job.outIndex+count,i);
+			++count;
+		}
+	}
+	if (!output)
+		job.count = count;
+	else
+		assert(count == job.count);
+}
+
+#ifdef ENABLE_MT_OCTREE
+
+#include <QtCore/QtCore>
+
+/*** MULTI THREADING WRAPPER ***/
+
+static const GenericIndexedCloudPersist* s_segCloud_MT = 0;
+static ScalarType s_segMinVal_MT = 0;
+static ScalarType s_segMaxVal_MT = 0;
+static ReferenceCloud* s_segOutput_MT = 0;
+
+void SegmentRangeByScalarValue_MT(sfSegmentJobDesc& job)
+{
+	SegmentRangeByScalarValue(s_segCloud_MT,s_segMinVal_MT,s_segMaxVal_MT,job,s_segOutput_MT);
+}
+
+#endif
+
 ReferenceCloud* ManualSegmentationTools::segment(GenericIndexedCloudPersist* aCloud, ScalarType minDist, ScalarType maxDist)
 {
 	if (!aCloud)
@@ -117,23 +688,74 @@ ReferenceCloud* ManualSegmentationTools::segment(GenericIndexedCloudPersist* aCl
 
 	ReferenceCloud* Y = new ReferenceCloud(aCloud);
 
-	//for each point
-	for (unsigned i=0; i<aCloud->size(); ++i)
+	unsigned pointCount = aCloud->size();
+	if (pointCount == 0)
+		return Y;
+
+	//the points are tested by blocks: a first pass counts the selected points
+	//of each block, so that the selection can be allocated at once and filled
+	//(in parallel) by a second pass
+	static const unsigned s_jobSize = (1<<16);
+	std::vector<sfSegmentJobDesc> jobs;
+	try
 	{
-		const ScalarType dist = aCloud->getPointScalarValue(i);
-		//we test if its assocaited scalar value falls inside the specified intervale
-		if (dist >= minDist && dist <= maxDist)
-		{
-			if (!Y->addPointIndex(i))
-			{
-				//not engouh memory
-				delete Y;
-				Y=0;
-				break;
-			}
-		}
+		jobs.resize((pointCount-1)/s_jobSize+1);
+	}
+	catch(std::bad_alloc)
+	{
+		//not enough memory
+		delete Y;
+		return 0;
+	}
+	for (size_t k=0; k<jobs.size(); ++k)
+	{
+		jobs[k].first = static_cast<unsigned>(k)*s_jobSize;
+		jobs[k].last = std::min(jobs[k].first+s_jobSize,pointCount);
+		jobs[k].outIndex = 0;
+		jobs[k].count = 0;
+	}
+
+	//1st pass: count
+#ifdef ENABLE_MT_OCTREE
+	s_segCloud_MT = aCloud;
+	s_segMinVal_MT = minDist;
+	s_segMaxVal_MT = maxDist;
+	s_segOutput_MT = 0;
+	QtConcurrent::blockingMap(jobs, SegmentRangeByScalarValue_MT);
+#else
+	for (size_t k=0; k<jobs.size(); ++k)
+		SegmentRangeByScalarValue(aCloud,minDist,maxDist,jobs[k],0);
+#endif
+
+	//prefix sum
+	unsigned selectedCount = 0;
+	for (size_t k=0; k<jobs.size(); ++k)
+	{
+		jobs[k].outIndex = selectedCount;
+		selectedCount += jobs[k].count;
 	}
 
+	if (selectedCount == 0)
+		return Y;
+
+	if (!Y->resize(selectedCount))
+	{
+		//not enough memory
+		delete Y;
+		return 0;
+	}
+
+	//2nd pass: fill
+#ifdef ENABLE_MT_OCTREE
+	s_segOutput_MT = Y;
+	QtConcurrent::blockingMap(jobs, SegmentRangeByScalarValue_MT);
+	s_segCloud_MT = 0;
+	s_segOutput_MT = 0;
+#else
+	for (size_t k=0; k<jobs.size(); ++k)
+		SegmentRangeByScalarValue(aCloud,minDist,maxDist,jobs[k],Y);
+#endif
+
 	return Y;
 }
 
@@ -24,9 +24,13 @@
 #include "SimpleCloud.h"
 #include "CCConst.h"
 #include "CCGeom.h"
+#include "DgmOctree.h" //for ENABLE_MT_OCTREE
 
 //system
 #include <assert.h>
+#include <algorithm>
+#include <limits>
+#include <stdint.h> //for uint fixed-sized types
 
 using namespace CCLib;
 
@@ -64,7 +68,8 @@ double MeshSamplingTools::computeMeshArea(GenericMesh* theMesh)
 SimpleCloud* MeshSamplingTools::samplePointsOnMesh(GenericMesh* theMesh,
 													unsigned numberOfPoints,
 													GenericProgressCallback* progressCb/*=0*/,
-													GenericChunkedArray<1,unsigned>* triIndices/*=0*/)
+													GenericChunkedArray<1,unsigned>* triIndices/*=0*/,
+													GenericChunkedArray<3,PointCoordinateType>* barycentricCoords/*=0*/)
 {
 	if (!theMesh)
         return 0;
@@ -78,13 +83,14 @@ SimpleCloud* MeshSamplingTools::samplePointsOnMesh(GenericMesh* theMesh,
 	double samplingDensity = double(numberOfPoints)/Stotal;
 
     //no normal needs to be computed here
-	return samplePointsOnMesh(theMesh,samplingDensity,numberOfPoints,progressCb,triIndices);
+	return samplePointsOnMesh(theMesh,samplingDensity,numberOfPoints,progressCb,triIndices,barycentricCoords);
 }
 
 SimpleCloud* MeshSamplingTools::samplePointsOnMesh(GenericMesh* theMesh,
 													double samplingDensity,
 													GenericProgressCallback* progressCb/*=0*/,
-													GenericChunkedArray<1,unsigned>* triIndices/*=0*/)
+													GenericChunkedArray<1,unsigned>* triIndices/*=0*/,
+													GenericChunkedArray<3,PointCoordinateType>* barycentricCoords/*=0*/)
 {
 	if (!theMesh)
         return 0;
@@ -94,14 +100,200 @@ SimpleCloud* MeshSamplingTools::samplePointsOnMesh(GenericMesh* theMesh,
 
 	unsigned theoricNumberOfPoints = unsigned(Stotal * samplingDensity);
 
-	return samplePointsOnMesh(theMesh,samplingDensity,theoricNumberOfPoints,progressCb,triIndices);
+	return samplePointsOnMesh(theMesh,samplingDensity,theoricNumberOfPoints,progressCb,triIndices,barycentricCoords);
+}
+
+//! Counter-based random generator (SplitMix64 finalizer)
+/** Returns a number in [0,1[ that only depends on the triangle index and on
+	the counter value, so that the sampling is the same whatever the order in
+	which triangles are processed (and the number of threads).
+**/
+static inline double CounterBasedRandom(unsigned triIndex, unsigned counter)
+{
+	uint64_t z = ((((uint64_t)triIndex)<<32) | (uint64_t)counter) + 0x9E3779B97F4A7C15ULL;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	z ^= (z >> 31);
+	return (double)(z >> 11) * (1.0/9007199254740992.0); //53 bits mantissa
+}
+
+//! Number of triangles gathered at once (with the mesh iterator)
+static const unsigned SAMPLING_BLOCK_SIZE = 65536;
+
+//! Set of triangles to process (see MeshSamplingTools::samplePointsOnMesh)
+struct samplingBlock
+{
+	//! Triangles summits (3 per triangle)
+	const CCVector3* summits;
+	//! Index of the first triangle of the block
+	unsigned firstTriIndex;
+	//! Sampling density
+	double samplingDensity;
+	//! Per-triangle number of points (first pass) or index of the first point (second pass)
+	unsigned* pointOffsets;
+	//! Output cloud
+	SimpleCloud* sampledCloud;
+	//! Output triangle indexes (optional)
+	GenericChunkedArray<1,unsigned>* triIndices;
+	//! Output barycentric coordinates (optional)
+	GenericChunkedArray<3,PointCoordinateType>* barycentricCoords;
+};
+
+//! First pass: computes the number of points to sample on a range of triangles
+static void CountPointsToSample(const samplingBlock& block, unsigned first, unsigned last)
+{
+	for (unsigned i=first; i<last; ++i)
+	{
+		//summits (OAB)
+		const CCVector3* O = block.summits+3*i;
+
+		//we compute the (twice) the triangle area
+		CCVector3 N = (O[1]-O[0]).cross(O[2]-O[0]);
+		double S = N.norm()/2.0;
+
+		//we deduce the number of points to generate on this face
+		double fPointsToAdd = S*block.samplingDensity;
+		unsigned pointsToAdd = (unsigned)fPointsToAdd;
+
+		//we add one more point with a probability equal to the floating part
+		unsigned triIndex = block.firstTriIndex+i;
+		if (CounterBasedRandom(triIndex,0) < fPointsToAdd-(double)pointsToAdd)
+			++pointsToAdd;
+
+		block.pointOffsets[triIndex] = pointsToAdd;
+	}
+}
+
+//! Second pass: samples the points on a range of triangles
+static void SamplePoints(const samplingBlock& block, unsigned first, unsigned last)
+{
+	for (unsigned i=first; i<last; ++i)
+	{
+		unsigned triIndex = block.firstTriIndex+i;
+		unsigned firstPoint = block.pointOffsets[triIndex];
+		unsigned pointCount = block.pointOffsets[triIndex+1]-firstPoint;
+		if (pointCount == 0)
+			continue;
+
+		//summits (OAB)
+		const CCVector3* O = block.summits+3*i;
+
+		//edges (OA and OB)
+		CCVector3 u = O[1] - O[0];
+		CCVector3 v = O[2] - O[0];
+
+		for (unsigned j=0; j<pointCount; ++j)
+		{
+			//we generates random points as in:
+			//'Greg Turk. Generating random points in triangles. In A. S. Glassner, editor,Graphics Gems, pages 24-28. Academic Press, 1990.'
+			double x = CounterBasedRandom(triIndex,2*j+1);
+			double y = CounterBasedRandom(triIndex,2*j+2);
+
+			//we test if the generated point lies on the right side of (AB)
+			if (x+y>1.0)
+			{
+				x=1.0-x;
+				y=1.0-y;
+			}
+
+			unsigned pointIndex = firstPoint+j;
+
+			//this is a "persistent" pointer and we know what type of cloud is behind ;)
+			CCVector3* P = const_cast<CCVector3*>(block.sampledCloud->getPointPersistentPtr(pointIndex));
+			*P = O[0] + (PointCoordinateType)x * u + (PointCoordinateType)y * v;
+
+			if (block.triIndices)
+				block.triIndices->setValue(pointIndex,triIndex);
+			if (block.barycentricCoords)
+			{
+				PointCoordinateType w[3] = {(PointCoordinateType)(1.0-x-y), (PointCoordinateType)x, (PointCoordinateType)y};
+				block.barycentricCoords->setValue(pointIndex,w);
+			}
+		}
+	}
+}
+
+//! Sampling pass (applied to a range of triangles)
+typedef void (*SamplingPassFunc)(const samplingBlock&, unsigned, unsigned);
+
+#ifdef ENABLE_MT_OCTREE
+
+#include <QtCore/QtCore>
+
+//! Number of triangles processed by each job
+static const unsigned SAMPLING_JOB_SIZE = 4096;
+
+//! Range of triangles processed by one job
+struct samplingJobDesc
+{
+	unsigned first;
+	unsigned last;
+};
+
+static const samplingBlock* s_samplingBlock_MT = 0;
+static SamplingPassFunc s_samplingPass_MT = 0;
+
+void SamplingPass_MT(const samplingJobDesc& desc)
+{
+	s_samplingPass_MT(*s_samplingBlock_MT, desc.first, desc.last);
+}
+
+#endif
+
+//! Applies a sampling pass to all the triangles of a mesh (gathered by blocks)
+/** \return the number of processed triangles (less than the mesh size if cancelled)
+**/
+static unsigned RunSamplingPass(GenericMesh* theMesh, samplingBlock& block, std::vector<CCVector3>& summits, SamplingPassFunc pass, NormalizedProgress* normProgress)
+{
+	unsigned triCount = theMesh->size();
+
+	theMesh->placeIteratorAtBegining();
+	for (unsigned firstTri=0; firstTri<triCount; firstTri+=SAMPLING_BLOCK_SIZE)
+	{
+		unsigned count = std::min(triCount-firstTri, SAMPLING_BLOCK_SIZE);
+
+		//gather the triangles summits (the mesh iterator is sequential)
+		for (unsigned i=0; i<count; ++i)
+		{
+			const GenericTriangle* tri = theMesh->_getNextTriangle();
+			summits[3*i]   = *tri->_getA();
+			summits[3*i+1] = *tri->_getB();
+			summits[3*i+2] = *tri->_getC();
+		}
+		block.summits = &summits[0];
+		block.firstTriIndex = firstTri;
+
+#ifndef ENABLE_MT_OCTREE
+		pass(block, 0, count);
+#else
+		std::vector<samplingJobDesc> jobs;
+		for (unsigned i=0; i<count; i+=SAMPLING_JOB_SIZE)
+		{
+			samplingJobDesc desc;
+			desc.first = i;
+			desc.last = std::min(count, i+SAMPLING_JOB_SIZE);
+			jobs.push_back(desc);
+		}
+		s_samplingBlock_MT = &block;
+		s_samplingPass_MT = pass;
+		QtConcurrent::blockingMap(jobs, SamplingPass_MT);
+		s_samplingBlock_MT = 0;
+		s_samplingPass_MT = 0;
+#endif
+
+		if (normProgress && !normProgress->oneStep())
+			return firstTri+count;
+	}
+
+	return triCount;
 }
 
 SimpleCloud* MeshSamplingTools::samplePointsOnMesh(GenericMesh* theMesh,
 													double samplingDensity,
 													unsigned theoricNumberOfPoints,
 													GenericProgressCallback* progressCb,
-													GenericChunkedArray<1,unsigned>* triIndices/*=0*/)
+													GenericChunkedArray<1,unsigned>* triIndices/*=0*/,
+													GenericChunkedArray<3,PointCoordinateType>* barycentricCoords/*=0*/)
 {
 	assert(theMesh);
 	unsigned triCount = (theMesh ? theMesh->size() : 0);
@@ -111,30 +303,30 @@ SimpleCloud* MeshSamplingTools::samplePointsOnMesh(GenericMesh* theMesh,
 	if (theoricNumberOfPoints < 1)
         return 0;
 
-
-	SimpleCloud* sampledCloud = new SimpleCloud();
-	if (!sampledCloud->reserve(theoricNumberOfPoints)) //not enough memory
+	if (triIndices)
+		triIndices->clear();
+	if (barycentricCoords)
+		barycentricCoords->clear();
+
+	//per-triangle number of points, then index of the first point (prefix sum)
+	std::vector<unsigned> pointOffsets;
+	std::vector<CCVector3> summits;
+	try
 	{
-		delete sampledCloud;
-		return 0;
+		pointOffsets.resize(triCount+1,0);
+		summits.resize(3*std::min(triCount,SAMPLING_BLOCK_SIZE));
 	}
-
-	if (triIndices)
+	catch(std::bad_alloc)
 	{
-	    triIndices->clear();
-		//not enough memory? DGM TODO: we should warn the caller
-		if (!triIndices->reserve(theoricNumberOfPoints) || triIndices->capacity() < theoricNumberOfPoints)
-		{
-			delete sampledCloud;
-			triIndices->clear();
-			return 0;
-		}
+		//not enough memory
+		return 0;
 	}
 
 	NormalizedProgress* normProgress=0;
     if(progressCb)
     {
-		normProgress = new NormalizedProgress(progressCb,triCount);
+		unsigned blockCount = (triCount+SAMPLING_BLOCK_SIZE-1)/SAMPLING_BLOCK_SIZE;
+		normProgress = new NormalizedProgress(progressCb,2*blockCount); //2 passes
 		progressCb->setMethodTitle("Mesh sampling");
 		char buffer[256];
 		sprintf(buffer,"Triangles: %i\nPoints: %i",triCount,theoricNumberOfPoints);
@@ -143,79 +335,70 @@ SimpleCloud* MeshSamplingTools::samplePointsOnMesh(GenericMesh* theMesh,
 		progressCb->start();
 	}
 
-	unsigned addedPoints=0;
-
-	//for each triangle
-	theMesh->placeIteratorAtBegining();
-	for (unsigned n=0;n<triCount;++n)
-	{
-		const GenericTriangle* tri = theMesh->_getNextTriangle();
-
-		//summits (OAB)
-		const CCVector3 *O = tri->_getA();
-		const CCVector3 *A = tri->_getB();
-		const CCVector3 *B = tri->_getC();
+	samplingBlock block;
+	block.samplingDensity = samplingDensity;
+	block.pointOffsets = &pointOffsets[0];
+	block.sampledCloud = 0;
+	block.triIndices = 0;
+	block.barycentricCoords = 0;
 
-		//edges (OA and OB)
-		CCVector3 u = *A - *O;
-		CCVector3 v = *B - *O;
-
-		//we compute the (twice) the triangle area
-		CCVector3 N = u.cross(v);
-		double S = N.norm()/2.0;
+	SimpleCloud* sampledCloud = 0;
 
-		//we deduce the number of points to generate on this face
-		double fPointsToAdd = S*samplingDensity;
-		unsigned pointsToAdd = (unsigned)fPointsToAdd;
-
-        //if the face area is smaller than the surface/random point
-		if (pointsToAdd==0)
+	//first pass: number of points per triangle
+	if (RunSamplingPass(theMesh, block, summits, CountPointsToSample, normProgress) == triCount)
+	{
+		//prefix sum
+		uint64_t pointCount = 0;
+		for (unsigned i=0; i<triCount; ++i)
 		{
-			//we add a point with the same probability as its (relative) area
-			if (double(rand())/double(RAND_MAX) <= fPointsToAdd)
-                ++pointsToAdd;
+			unsigned n = pointOffsets[i];
+			pointOffsets[i] = (unsigned)pointCount;
+			pointCount += n;
 		}
 
-		if (pointsToAdd)
+		//too many points?
+		if (pointCount > 0 && pointCount < (uint64_t)std::numeric_limits<unsigned>::max())
 		{
-			if (addedPoints + pointsToAdd >= theoricNumberOfPoints)
+			pointOffsets[triCount] = (unsigned)pointCount;
+
+			//the output is allocated once and for all
+			sampledCloud = new SimpleCloud();
+			if (!sampledCloud->resize((unsigned)pointCount)
+				|| (triIndices && !triIndices->resize((unsigned)pointCount))
+				|| (barycentricCoords && !barycentricCoords->resize((unsigned)pointCount)))
 			{
-				theoricNumberOfPoints+=pointsToAdd;
-				if (!sampledCloud->reserve(theoricNumberOfPoints)
-					|| (triIndices && triIndices->capacity() < theoricNumberOfPoints && !triIndices->reserve(theoricNumberOfPoints))) //not enough memory
-				{
-					delete sampledCloud;
-					sampledCloud=0;
-					triIndices->clear();
-					break;
-				}
+				//not enough memory
+				delete sampledCloud;
+				sampledCloud=0;
 			}
-
-			for (unsigned i=0;i<pointsToAdd;++i)
+			else
 			{
-				//we generates random points as in:
-				//'Greg Turk. Generating random points in triangles. In A. S. Glassner, editor,Graphics Gems, pages 24-28. Academic Press, 1990.'
-				double x = double(rand())/(double)RAND_MAX;
-				double y = double(rand())/(double)RAND_MAX;
+				block.sampledCloud = sampledCloud;
+				block.triIndices = triIndices;
+				block.barycentricCoords = barycentricCoords;
 
-				//we test if the generated point lies on the right side of (AB)
-				if (x+y>1.0)
+				//second pass: points sampling
+				unsigned processedTriCount = RunSamplingPass(theMesh, block, summits, SamplePoints, normProgress);
+				if (processedTriCount < triCount)
 				{
-                    x=1.0-x;
-                    y=1.0-y;
-                }
-
-				CCVector3 P = (*O) + (PointCoordinateType)x * u + (PointCoordinateType)y * v;
-
-				sampledCloud->addPoint(P);
-				if (triIndices)
-					triIndices->addElement(n);
-				++addedPoints;
+					//process cancelled by user: we only keep the points already sampled
+					unsigned addedPoints = pointOffsets[processedTriCount];
+					if (addedPoints)
+					{
+						sampledCloud->resize(addedPoints);
+						if (triIndices)
+							triIndices->resize(addedPoints);
+						if (barycentricCoords)
+							barycentricCoords->resize(addedPoints);
+					}
+					else
+					{
+						delete sampledCloud;
+						sampledCloud=0;
+					}
+				}
 			}
 		}
-
-		if (normProgress && !normProgress->oneStep())
-			break;
 	}
 
 	if (normProgress)
@@ -224,21 +407,12 @@ SimpleCloud* MeshSamplingTools::samplePointsOnMesh(GenericMesh* theMesh,
 		normProgress=0;
 	}
 
-	if (sampledCloud) //can be in case of memory overflow!
+	if (!sampledCloud)
 	{
-		if (addedPoints)
-		{
-			sampledCloud->resize(addedPoints); //should always be ok as addedPoints<theoricNumberOfPoints
-			if (triIndices)
-				triIndices->resize(addedPoints);
-		}
-		else
-		{
-			delete sampledCloud;
-			sampledCloud=0;
-			if (triIndices)
-				triIndices->clear();
-		}
+		if (triIndices)
+			triIndices->clear();
+		if (barycentricCoords)
+			barycentricCoords->clear();
 	}
 
 	return sampledCloud;
@@ -134,12 +134,12 @@ void Neighbourhood::computeGravityCenter()
 	structuresValidity |= GRAVITY_CENTER;
 }
 
-CCLib::SquareMatrixd Neighbourhood::computeCovarianceMatrix()
+bool Neighbourhood::computeCovarianceMatrix(CCLib::SymmetricMatrix3d& covMat)
 {
 	assert(m_associatedCloud);
 	unsigned count = (m_associatedCloud ? m_associatedCloud->size() : 0);
 	if (!count)
-		return CCLib::SquareMatrixd();
+		return false;
 
 	//we get centroid
 	const CCVector3* G = getGravityCenter();
@@ -166,15 +166,23 @@ CCLib::SquareMatrixd Neighbourhood::computeCovarianceMatrix()
 	}
 
 	//symmetry
-	CCLib::SquareMatrixd covMat(3);
-	covMat.m_values[0][0] = mXX/(double)count;
-	covMat.m_values[1][1] = mYY/(double)count;
-	covMat.m_values[2][2] = mZZ/(double)count;
-	covMat.m_values[1][0] = covMat.m_values[0][1] = mXY/(double)count;
-	covMat.m_values[2][0] = covMat.m_values[0][2] = mXZ/(double)count;
-	covMat.m_values[2][1] = covMat.m_values[1][2] = mYZ/(double)count;
-
-	return covMat;
+	covMat.set(	mXX/(double)count,
+				mYY/(double)count,
+				mZZ/(double)count,
+				mXY/(double)count,
+				mXZ/(double)count,
+				mYZ/(double)count );
+
+	return true;
+}
+
+CCLib::SquareMatrixd Neighbourhood::computeCovarianceMatrix()
+{
+	CCLib::SymmetricMatrix3d covMat;
+	if (!computeCovarianceMatrix(covMat))
+		return CCLib::SquareMatrixd();
+
+	return covMat.toSquareMatrix();
 }
 
 PointCoordinateType Neighbourhood::computeLargestRadius()
@@ -222,10 +230,8 @@ bool Neighbourhood::computeLeastSquareBestFittingPlane()
 	if (pointCount > 3)
 	{
 		//we determine plane normal by computing the smallest eigen value of M = 1/n * S[(p-)*(p-)']
-		CCLib::SquareMatrixd eig = computeCovarianceMatrix().computeJacobianEigenValuesAndVectors();
-
-		//invalid matrix?
-		if (!eig.isValid())
+		CCLib::SymmetricMatrix3d eig;
+		if (!computeCovarianceMatrix(eig) || !eig.computeEigenValuesAndVectors())
 			return false;
 
 		//the smallest eigen vector corresponds to the "least square best fitting plane" normal
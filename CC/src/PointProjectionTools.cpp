@@ -24,9 +24,18 @@
 #include "GenericProgressCallback.h"
 #include "Neighbourhood.h"
 #include "SimpleMesh.h"
+#include "DgmOctree.h" //for ENABLE_MT_OCTREE
+
+//Triangle Lib
+#include "../triangle/triangle.h"
 
 //system
 #include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
 
 using namespace CCLib;
 
@@ -291,6 +300,951 @@ GenericIndexedMesh* PointProjectionTools::computeTriangulation(GenericIndexedClo
 	case GENERIC_EMPTY:
 		theMesh = new SimpleMesh(theCloud);
 		break;
+	case GENERIC_TILED:
+		theMesh = computeTiledTriangulation(theCloud);
+		break;
+	}
+
+	return theMesh;
+}
+
+/*** Tiled 2.5D Delaunay triangulation ***/
+
+//! Axis-aligned 2D rectangle (closed)
+struct Rect2D
+{
+	double minX, minY, maxX, maxY;
+
+	//! Returns whether a point lies inside the rectangle
+	inline bool contains(const CCVector2& P) const
+	{
+		return (P.x >= minX && P.x <= maxX && P.y >= minY && P.y <= maxY);
+	}
+};
+
+//! Tests whether a convex polygon and a rectangle intersect (separating axis theorem)
+static bool ConvexPolygonIntersectsRect(const CCVector2* V, unsigned count, const Rect2D& rect)
+{
+	assert(count != 0);
+
+	//rectangle axes
+	double minX = V[0].x, maxX = minX, minY = V[0].y, maxY = minY;
+	for (unsigned i=1; i<count; ++i)
+	{
+		if (V[i].x < minX) minX = V[i].x; else if (V[i].x > maxX) maxX = V[i].x;
+		if (V[i].y < minY) minY = V[i].y; else if (V[i].y > maxY) maxY = V[i].y;
+	}
+	if (maxX < rect.minX || minX > rect.maxX || maxY < rect.minY || minY > rect.maxY)
+		return false;
+
+	//polygon edges normals
+	double corners[4][2] = {	{rect.minX,rect.minY}, {rect.maxX,rect.minY},
+								{rect.maxX,rect.maxY}, {rect.minX,rect.maxY} };
+	for (unsigned i=0; count>1 && i<count; ++i)
+	{
+		const CCVector2& A = V[i];
+		const CCVector2& B = V[(i+1)%count];
+		double nx = -((double)B.y-(double)A.y);
+		double ny = (double)B.x-(double)A.x;
+
+		//projection of the polygon
+		double pMin = 0, pMax = 0;
+		for (unsigned j=0; j<count; ++j)
+		{
+			double p = nx*((double)V[j].x-(double)A.x) + ny*((double)V[j].y-(double)A.y);
+			if (p < pMin) pMin = p; else if (p > pMax) pMax = p;
+		}
+		//projection of the rectangle
+		double rMin = 0, rMax = 0;
+		for (unsigned j=0; j<4; ++j)
+		{
+			double p = nx*(corners[j][0]-(double)A.x) + ny*(corners[j][1]-(double)A.y);
+			if (j == 0 || p < rMin) rMin = p;
+			if (j == 0 || p > rMax) rMax = p;
+		}
+		if (rMax < pMin || rMin > pMax)
+			return false;
+	}
+
+	return true;
+}
+
+//! 2D cross product (OA x OB)
+static inline double Cross2D(const CCVector2& O, const CCVector2& A, const CCVector2& B)
+{
+	return ((double)A.x-(double)O.x)*((double)B.y-(double)O.y) - ((double)A.y-(double)O.y)*((double)B.x-(double)O.x);
+}
+
+//! Tests whether a point lies inside (or on) the circumcircle of a triangle
+/** Near-cocircular points are considered as inside (conservative test).
+**/
+static bool InCircumcircle(const CCVector2 V[3], const CCVector2& P)
+{
+	double adx = (double)V[0].x-(double)P.x, ady = (double)V[0].y-(double)P.y;
+	double bdx = (double)V[1].x-(double)P.x, bdy = (double)V[1].y-(double)P.y;
+	double cdx = (double)V[2].x-(double)P.x, cdy = (double)V[2].y-(double)P.y;
+
+	double alift = adx*adx+ady*ady;
+	double blift = bdx*bdx+bdy*bdy;
+	double clift = cdx*cdx+cdy*cdy;
+
+	double det =	alift*(bdx*cdy-cdx*bdy)
+				+	blift*(cdx*ady-adx*cdy)
+				+	clift*(adx*bdy-bdx*ady);
+	double permanent =	alift*(fabs(bdx*cdy)+fabs(cdx*bdy))
+					+	blift*(fabs(cdx*ady)+fabs(adx*cdy))
+					+	clift*(fabs(adx*bdy)+fabs(bdx*ady));
+
+	//the sign of the determinant depends on the triangle orientation
+	if (Cross2D(V[0],V[1],V[2]) < 0)
+		det = -det;
+
+	return det >= -1.0e-12*permanent;
+}
+
+//! Lexicographic order on 2D points (by index)
+struct LexicoLess2D
+{
+	const CC2DPointsContainer& points;
+
+	LexicoLess2D(const CC2DPointsContainer& _points) : points(_points) {}
+
+	inline bool operator()(unsigned a, unsigned b) const
+	{
+		const CCVector2& A = points[a];
+		const CCVector2& B = points[b];
+		return (A.x < B.x || (A.x == B.x && A.y < B.y));
+	}
+};
+
+//! Computes the convex hull of a set of 2D points (monotone chain, collinear boundary points are kept)
+/** \param points 2D points
+	\param indexes indexes of the input points (will be sorted)
+	\param[out] hull indexes of the hull vertices
+**/
+static void ConvexHull2D(const CC2DPointsContainer& points, std::vector<unsigned>& indexes, std::vector<unsigned>& hull)
+{
+	hull.clear();
+
+	std::sort(indexes.begin(), indexes.end(), LexicoLess2D(points));
+
+	size_t n = indexes.size();
+	if (n < 3)
+	{
+		hull = indexes;
+		return;
+	}
+
+	hull.resize(2*n);
+	size_t k = 0;
+	//lower hull
+	for (size_t i=0; i<n; ++i)
+	{
+		while (k >= 2 && Cross2D(points[hull[k-2]], points[hull[k-1]], points[indexes[i]]) < 0)
+			--k;
+		hull[k++] = indexes[i];
+	}
+	//upper hull
+	for (size_t i=n-1, t=k+1; i>0; --i)
+	{
+		while (k >= t && Cross2D(points[hull[k-2]], points[hull[k-1]], points[indexes[i-1]]) < 0)
+			--k;
+		hull[k++] = indexes[i-1];
+	}
+	hull.resize(k-1);
+}
+
+//! Triangle of the tiled triangulation (global vertices indexes)
+/** Vertices are rotated so that the first one has the smallest index (the
+	orientation is kept), so that the same triangle computed by two different
+	tiles is always described the same way.
+**/
+struct tileTriangle
+{
+	unsigned i1, i2, i3;
+
+	//! Default constructor
+	tileTriangle() : i1(0), i2(0), i3(0) {}
+
+	//! Constructor from the vertices indexes
+	tileTriangle(unsigned a, unsigned b, unsigned c)
+	{
+		if (a < b && a < c)
+			{ i1 = a; i2 = b; i3 = c; }
+		else if (b < c)
+			{ i1 = b; i2 = c; i3 = a; }
+		else
+			{ i1 = c; i2 = a; i3 = b; }
+	}
+
+	//! Lexicographic order
+	inline bool operator < (const tileTriangle& t) const
+	{
+		return (i1 < t.i1 || (i1 == t.i1 && (i2 < t.i2 || (i2 == t.i2 && i3 < t.i3))));
+	}
+};
+
+//! Data shared by all tiles
+struct tiledTriangulationContext
+{
+	//! 2D points (projection in the XY plane)
+	CC2DPointsContainer points;
+	//! Points indexes sorted by cell
+	/** Each tile is subdivided in cellsPerTile x cellsPerTile cells
+		(used to quickly look for the points inside a given area).
+	**/
+	std::vector<unsigned> cellIndexes;
+	//! Index (in cellIndexes) of the first point of each cell
+	std::vector<unsigned> cellOffsets;
+	//! Number of tiles along X and Y
+	unsigned tilesX, tilesY;
+	//! Number of cells along X and Y
+	unsigned cellsX, cellsY;
+	//! Number of cells per tile (along each dimension)
+	unsigned cellsPerTile;
+	//! Global bounding box
+	Rect2D bbox;
+	//! Cell dimensions
+	double cellSizeX, cellSizeY;
+	//! Initial overlap between tiles
+	double initialMargin;
+	//! Maximum overlap between tiles (see TriangulateTile)
+	double maxMargin;
+	//! Global convex hull vertices (sorted indexes)
+	std::vector<unsigned> hull;
+	//! Global convex hull (polygon)
+	std::vector<CCVector2> hullPolygon;
+
+	//! Returns the cell including a given 2D position
+	inline void getCell(double x, double y, unsigned& cx, unsigned& cy) const
+	{
+		double fx = (x-bbox.minX)/cellSizeX;
+		double fy = (y-bbox.minY)/cellSizeY;
+		cx = (fx <= 0 ? 0 : std::min(cellsX-1,(unsigned)fx));
+		cy = (fy <= 0 ? 0 : std::min(cellsY-1,(unsigned)fy));
+	}
+
+	//! Returns the tile including a given 2D position
+	inline void getTile(double x, double y, unsigned& tx, unsigned& ty) const
+	{
+		getCell(x, y, tx, ty);
+		tx /= cellsPerTile;
+		ty /= cellsPerTile;
+	}
+
+	//! Returns the tile owning a triangle (i.e. including its barycenter)
+	/** The barycenter is always computed the same way (whatever the tile
+		that computed the triangle) so that each triangle has a unique owner.
+	**/
+	inline unsigned getTriangleTile(const tileTriangle& tri) const
+	{
+		const CCVector2& A = points[tri.i1];
+		const CCVector2& B = points[tri.i2];
+		const CCVector2& C = points[tri.i3];
+		unsigned tx, ty;
+		getTile(((double)A.x+(double)B.x+(double)C.x)/3.0, ((double)A.y+(double)B.y+(double)C.y)/3.0, tx, ty);
+		return tx + ty*tilesX;
+	}
+
+	//! Returns the rectangle of a block of cells
+	inline Rect2D getCellsRect(unsigned cx0, unsigned cy0, unsigned cx1, unsigned cy1) const
+	{
+		Rect2D rect;
+		rect.minX = bbox.minX + cx0*cellSizeX;
+		rect.minY = bbox.minY + cy0*cellSizeY;
+		rect.maxX = (cx1+1 == cellsX ? bbox.maxX : bbox.minX + (cx1+1)*cellSizeX);
+		rect.maxY = (cy1+1 == cellsY ? bbox.maxY : bbox.minY + (cy1+1)*cellSizeY);
+		return rect;
+	}
+
+	//! Returns the rectangle of a tile
+	inline Rect2D getTileRect(unsigned tx, unsigned ty) const
+	{
+		return getCellsRect(	tx*cellsPerTile, ty*cellsPerTile,
+								std::min(cellsX,(tx+1)*cellsPerTile)-1, std::min(cellsY,(ty+1)*cellsPerTile)-1 );
+	}
+
+	//! Collects the (indexes of the) points inside a rectangle
+	void getPointsInside(const Rect2D& rect, std::vector<unsigned>& indexes) const
+	{
+		unsigned cx0, cy0, cx1, cy1;
+		getCell(rect.minX, rect.minY, cx0, cy0);
+		getCell(rect.maxX, rect.maxY, cx1, cy1);
+		for (unsigned cy=cy0; cy<=cy1; ++cy)
+		{
+			for (unsigned cx=cx0; cx<=cx1; ++cx)
+			{
+				unsigned c = cx + cy*cellsX;
+				for (unsigned i=cellOffsets[c]; i<cellOffsets[c+1]; ++i)
+					if (rect.contains(points[cellIndexes[i]]))
+						indexes.push_back(cellIndexes[i]);
+			}
+		}
+	}
+
+	//! Collects the points inside the circumcircle of a triangle that don't belong to a local subset
+	/** The local subset is made of the points inside a rectangle plus a (sorted) list of other points.
+		\param V triangle vertices
+		\param ux circumcircle center (X)
+		\param uy circumcircle center (Y)
+		\param r circumcircle radius (slightly over-estimated)
+		\param rect local subset rectangle
+		\param extra local subset additional points (sorted indexes)
+		\param maxCount maximum number of points to collect
+		\param[out] indexes points found
+		\return false if more than maxCount points have been found
+	**/
+	bool getPointsInCircumcircle(	const CCVector2 V[3],
+									double ux,
+									double uy,
+									double r,
+									const Rect2D& rect,
+									const std::vector<unsigned>& extra,
+									size_t maxCount,
+									std::vector<unsigned>& indexes) const
+	{
+		size_t count = 0;
+		unsigned cx0, cy0, cx1, cy1;
+		getCell(ux-r, uy-r, cx0, cy0);
+		getCell(ux+r, uy+r, cx1, cy1);
+		for (unsigned cy=cy0; cy<=cy1; ++cy)
+		{
+			//we only scan the cells intersecting the disk (in the current row)
+			Rect2D row = getCellsRect(0, cy, cellsX-1, cy);
+			double dy = (uy < row.minY ? row.minY-uy : (uy > row.maxY ? uy-row.maxY : 0));
+			if (dy > r)
+				continue;
+			double halfWidth = sqrt(r*r-dy*dy);
+			unsigned rx0, rx1, dummy;
+			getCell(ux-halfWidth, uy, rx0, dummy);
+			getCell(ux+halfWidth, uy, rx1, dummy);
+			for (unsigned cx=rx0; cx<=rx1; ++cx)
+			{
+				Rect2D cell = getCellsRect(cx, cy, cx, cy);
+				if (	cell.minX >= rect.minX && cell.maxX <= rect.maxX
+					&&	cell.minY >= rect.minY && cell.maxY <= rect.maxY)
+					continue; //cell inside the rectangle
+
+				unsigned c = cx + cy*cellsX;
+				for (unsigned i=cellOffsets[c]; i<cellOffsets[c+1]; ++i)
+				{
+					unsigned index = cellIndexes[i];
+					const CCVector2& P = points[index];
+					if (	!rect.contains(P)
+						&&	InCircumcircle(V, P)
+						&&	!std::binary_search(extra.begin(), extra.end(), index) )
+					{
+						if (++count > maxCount)
+							return false;
+						indexes.push_back(index);
+					}
+				}
+			}
+		}
+		return true;
+	}
+};
+
+//! Per-tile job
+struct tileTriangulationDesc
+{
+	//! Tile position
+	unsigned tx, ty;
+	//! Convex hull of the tile points (first stage)
+	std::vector<unsigned> hull;
+	//! Output triangles (i.e. owned by the tile)
+	std::vector<tileTriangle> triangles;
+	//! Triangles owned by other tiles and adjacent to the output ones (in the local triangulation)
+	/** Used to check that the tiles are properly stitched together.
+	**/
+	std::vector<tileTriangle> adjacentTriangles;
+	//! Number of edges of the output triangles lying on the convex hull
+	/** Used to check the total number of triangles.
+	**/
+	size_t hullEdges;
+	//! Success
+	bool success;
+};
+
+//! First stage: computes the convex hull of the points of a tile
+static void ComputeTileHull(const tiledTriangulationContext& context, tileTriangulationDesc& desc)
+{
+	desc.success = true;
+	try
+	{
+		std::vector<unsigned> tileIndexes;
+		context.getPointsInside(context.getTileRect(desc.tx, desc.ty), tileIndexes);
+		ConvexHull2D(context.points, tileIndexes, desc.hull);
+	}
+	catch(std::bad_alloc)
+	{
+		desc.success = false;
+	}
+}
+
+//! Maximum number of refinement steps before the overlap is increased (see TriangulateTile)
+static const unsigned MAX_TILE_REFINEMENT_STEPS = 4;
+//! Maximum number of points that can be added to a tile per triangle before the overlap is increased (see TriangulateTile)
+/** Not applied anymore once the maximum overlap is reached.
+**/
+static const size_t MAX_TILE_CONFLICTS_PER_TRIANGLE = 64;
+
+//! Second stage: triangulates the points of a tile (with its neighbourhood) and keeps the triangles that belong to it
+/** The tile is triangulated with the points of its neighbourhood plus the
+	global convex hull vertices (so that the local convex hull is the global
+	one). A local triangle is also a triangle of the global triangulation if
+	its circumcircle doesn't include any other point (the ties between
+	cocircular points are broken the same way by all the calls to the
+	'Triangle' library, and the points on the circle are conservatively
+	considered as inside). Points found inside the circumcircles of the local
+	triangles intersecting the tile (or adjacent to the ones it owns) are added
+	to the local set (or the overlap is increased if there are too many of
+	them) until all of them pass this test. Once the overlap has reached
+	context.maxMargin, all the conflicting points are added, whatever their
+	number. Each triangle is finally kept by the tile containing its barycenter.
+**/
+static void TriangulateTile(const tiledTriangulationContext& context, tileTriangulationDesc& desc)
+{
+	desc.success = false;
+	desc.hullEdges = 0;
+	desc.triangles.clear();
+	desc.adjacentTriangles.clear();
+
+	Rect2D core = context.getTileRect(desc.tx, desc.ty);
+	unsigned tileIndex = desc.tx + desc.ty*context.tilesX;
+
+	//nothing to do if the tile is outside the convex hull
+	if (	context.hullPolygon.size() < 3
+		||	!ConvexPolygonIntersectsRect(&context.hullPolygon[0], static_cast<unsigned>(context.hullPolygon.size()), core) )
+	{
+		desc.success = true;
+		return;
+	}
+
+	double margin = context.initialMargin;
+	std::vector<unsigned> extra;
+	std::vector<unsigned> localIndexes;
+	std::vector<unsigned> conflicts;
+	std::vector<unsigned> triangleTiles;
+	CC2DPointsContainer localPoints;
+	try
+	{
+		extra = context.hull;
+	}
+	catch(std::bad_alloc)
+	{
+		//not enough memory
+		return;
+	}
+
+	for (unsigned step=1; ; ++step)
+	{
+		//extended tile
+		Rect2D ext;
+		ext.minX = std::max(context.bbox.minX, core.minX-margin);
+		ext.minY = std::max(context.bbox.minY, core.minY-margin);
+		ext.maxX = std::min(context.bbox.maxX, core.maxX+margin);
+		ext.maxY = std::min(context.bbox.maxY, core.maxY+margin);
+		bool fullExtent = (	ext.minX <= context.bbox.minX && ext.minY <= context.bbox.minY
+						&&	ext.maxX >= context.bbox.maxX && ext.maxY >= context.bbox.maxY );
+
+		//we gather the points inside the extended tile (and the additional ones)
+		try
+		{
+			localIndexes.clear();
+			context.getPointsInside(ext, localIndexes);
+			for (size_t i=0; i<extra.size(); ++i)
+				if (!ext.contains(context.points[extra[i]]))
+					localIndexes.push_back(extra[i]);
+
+			localPoints.resize(localIndexes.size());
+			for (size_t i=0; i<localIndexes.size(); ++i)
+				localPoints[i] = context.points[localIndexes[i]];
+		}
+		catch(std::bad_alloc)
+		{
+			//not enough memory
+			return;
+		}
+
+		//local triangulation
+		int* triangleList = 0;
+		int* neighborList = 0;
+		int triangleCount = 0;
+		if (localPoints.size() >= 3)
+		{
+			triangulateio in, out;
+			memset(&in,0,sizeof(triangulateio));
+			memset(&out,0,sizeof(triangulateio));
+			in.numberofpoints = (int)localPoints.size();
+			in.pointlist = (REAL*)(&localPoints[0]);
+			bool triangulated = true;
+			try
+			{
+				triangulate ( "zQNn", &in, &out, 0 );
+			}
+			catch (...)
+			{
+				triangulated = false;
+			}
+			if (!triangulated)
+				return;
+			triangleList = out.trianglelist;
+			neighborList = out.neighborlist;
+			triangleCount = out.numberoftriangles;
+		}
+
+		//owner of each local triangle
+		try
+		{
+			triangleTiles.resize(triangleCount);
+			for (int i=0; i<triangleCount; ++i)
+			{
+				const int* tri = triangleList+3*i;
+				triangleTiles[i] = context.getTriangleTile(tileTriangle(localIndexes[tri[0]], localIndexes[tri[1]], localIndexes[tri[2]]));
+			}
+		}
+		catch(std::bad_alloc)
+		{
+			if (triangleList)
+				trifree(triangleList);
+			if (neighborList)
+				trifree(neighborList);
+			return;
+		}
+
+		//we check the local triangles intersecting the tile (and the neighbours of the ones it owns)
+		bool complete = true;
+		bool increaseMargin = false;
+		size_t maxConflicts = (margin < context.maxMargin ? MAX_TILE_CONFLICTS_PER_TRIANGLE : context.points.size());
+		conflicts.clear();
+		if (!fullExtent)
+		{
+			for (int i=0; i<triangleCount; ++i)
+			{
+				const int* tri = triangleList+3*i;
+				CCVector2 V[3];
+				V[0] = localPoints[tri[0]];
+				V[1] = localPoints[tri[1]];
+				V[2] = localPoints[tri[2]];
+
+				const int* neighbors = neighborList+3*i;
+				if (	!ConvexPolygonIntersectsRect(V, 3, core)
+					&&	(neighbors[0] < 0 || triangleTiles[neighbors[0]] != tileIndex)
+					&&	(neighbors[1] < 0 || triangleTiles[neighbors[1]] != tileIndex)
+					&&	(neighbors[2] < 0 || triangleTiles[neighbors[2]] != tileIndex) )
+					continue;
+
+				//circumcircle
+				double bx = (double)V[1].x-(double)V[0].x, by = (double)V[1].y-(double)V[0].y;
+				double cx = (double)V[2].x-(double)V[0].x, cy = (double)V[2].y-(double)V[0].y;
+				double d = 2.0*(bx*cy-by*cx);
+				if (d == 0)
+				{
+					//degenerate triangle: we can't conclude
+					complete = false;
+					increaseMargin = true;
+					continue;
+				}
+				double b2 = bx*bx+by*by, c2 = cx*cx+cy*cy;
+				double ux = (cy*b2-by*c2)/d;
+				double uy = (bx*c2-cx*b2)/d;
+				double r = sqrt(ux*ux+uy*uy);
+				r += r*1.0e-6 + 1.0e-6*(context.cellSizeX+context.cellSizeY); //to be on the safe side
+				ux += (double)V[0].x;
+				uy += (double)V[0].y;
+
+				//quick test: the disk only covers the extended tile
+				if (	(ext.minX <= context.bbox.minX || ux-r >= ext.minX)
+					&&	(ext.maxX >= context.bbox.maxX || ux+r <= ext.maxX)
+					&&	(ext.minY <= context.bbox.minY || uy-r >= ext.minY)
+					&&	(ext.maxY >= context.bbox.maxY || uy+r <= ext.maxY) )
+					continue;
+
+				//otherwise we look for the points actually included in the circumcircle
+				//(typically for the large circumcircles of the triangles close to the convex hull)
+				size_t conflictCount = conflicts.size();
+				try
+				{
+					if (!context.getPointsInCircumcircle(V, ux, uy, r, ext, extra, maxConflicts, conflicts))
+					{
+						conflicts.resize(conflictCount);
+						increaseMargin = true;
+					}
+				}
+				catch(std::bad_alloc)
+				{
+					if (triangleList)
+						trifree(triangleList);
+					if (neighborList)
+						trifree(neighborList);
+					return;
+				}
+				if (increaseMargin || conflicts.size() != conflictCount)
+					complete = false;
+			}
+		}
+
+		if (complete)
+		{
+			//we keep the triangles owned by the tile (and we remember their neighbours owned by other tiles)
+			try
+			{
+				for (int i=0; i<triangleCount; ++i)
+				{
+					if (triangleTiles[i] != tileIndex)
+						continue;
+
+					const int* tri = triangleList+3*i;
+					desc.triangles.push_back(tileTriangle(localIndexes[tri[0]], localIndexes[tri[1]], localIndexes[tri[2]]));
+
+					const int* neighbors = neighborList+3*i;
+					for (unsigned j=0; j<3; ++j)
+					{
+						if (neighbors[j] < 0)
+						{
+							//the local convex hull is the global one
+							++desc.hullEdges;
+						}
+						else if (triangleTiles[neighbors[j]] != tileIndex)
+						{
+							const int* nTri = triangleList+3*neighbors[j];
+							desc.adjacentTriangles.push_back(tileTriangle(localIndexes[nTri[0]], localIndexes[nTri[1]], localIndexes[nTri[2]]));
+						}
+					}
+				}
+				//sorted for the stitching check
+				std::sort(desc.triangles.begin(), desc.triangles.end());
+				desc.success = true;
+			}
+			catch(std::bad_alloc)
+			{
+				desc.triangles.clear();
+				desc.adjacentTriangles.clear();
+			}
+		}
+
+		if (triangleList)
+			trifree(triangleList);
+		if (neighborList)
+			trifree(neighborList);
+
+		if (complete || fullExtent)
+			return;
+
+		//we add the conflicting points to the local set
+		try
+		{
+			std::sort(conflicts.begin(), conflicts.end());
+			conflicts.erase(std::unique(conflicts.begin(), conflicts.end()), conflicts.end());
+			size_t extraCount = extra.size();
+			extra.insert(extra.end(), conflicts.begin(), conflicts.end());
+			std::inplace_merge(extra.begin(), extra.begin()+extraCount, extra.end());
+		}
+		catch(std::bad_alloc)
+		{
+			//not enough memory
+			return;
+		}
+
+		//if it takes too long, we increase the overlap (up to the maximum)
+		if (margin < context.maxMargin)
+		{
+			if (increaseMargin || step >= MAX_TILE_REFINEMENT_STEPS)
+				margin = std::min(2*margin, context.maxMargin);
+		}
+		else if (conflicts.empty())
+		{
+			//no more points to add (degenerate triangle): we can't conclude
+			return;
+		}
+	}
+}
+
+//! Checks that the tiles triangles form a valid triangulation
+/** Each tile must own the triangles expected by its neighbours (i.e. they
+	must agree on the triangles along their common borders) and the total
+	number of triangles must be the one of a triangulation of the whole set
+	(2n-2-h, with h the number of edges on the convex hull, i.e. including
+	the collinear points lying on it).
+**/
+static bool CheckTilesStitching(const tiledTriangulationContext& context, const std::vector<tileTriangulationDesc>& tiles)
+{
+	size_t triCount = 0;
+	size_t hullEdges = 0;
+	for (size_t t=0; t<tiles.size(); ++t)
+	{
+		triCount += tiles[t].triangles.size();
+		hullEdges += tiles[t].hullEdges;
+	}
+	if (triCount + 2 + hullEdges != 2*context.points.size())
+		return false;
+
+	for (size_t t=0; t<tiles.size(); ++t)
+	{
+		const std::vector<tileTriangle>& adjacentTriangles = tiles[t].adjacentTriangles;
+		for (size_t i=0; i<adjacentTriangles.size(); ++i)
+		{
+			const std::vector<tileTriangle>& ownerTriangles = tiles[context.getTriangleTile(adjacentTriangles[i])].triangles;
+			if (!std::binary_search(ownerTriangles.begin(), ownerTriangles.end(), adjacentTriangles[i]))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+#ifdef ENABLE_MT_OCTREE
+
+#include <QtCore/QtCore>
+
+static const tiledTriangulationContext* s_tiledContext_MT = 0;
+
+void ComputeTileHull_MT(tileTriangulationDesc& desc)
+{
+	ComputeTileHull(*s_tiledContext_MT, desc);
+}
+
+void TriangulateTile_MT(tileTriangulationDesc& desc)
+{
+	TriangulateTile(*s_tiledContext_MT, desc);
+}
+
+#endif
+
+GenericIndexedMesh* PointProjectionTools::computeTiledTriangulation(GenericIndexedCloudPersist* theCloud, unsigned maxPointsPerTile/*=DEFAULT_MAX_POINTS_PER_TILE*/, GenericProgressCallback* progressCb/*=0*/)
+{
+	if (!theCloud || maxPointsPerTile < 3)
+		return 0;
+
+	unsigned count = theCloud->size();
+	if (count <= maxPointsPerTile)
+		return computeTriangulation(theCloud,GENERIC);
+
+	tiledTriangulationContext context;
+
+	//2D points (points with the same XY position are merged, as the
+	//triangulation would ignore all of them but one anyway)
+	std::vector<unsigned> pointIndexes; //cloud index of each 2D point
+	try
+	{
+		CC2DPointsContainer cloudPoints(count);
+		std::vector<unsigned> sortedIndexes(count);
+		{
+			CCVector3 P;
+			for (unsigned i=0; i<count; ++i)
+			{
+				theCloud->getPoint(i,P);
+				cloudPoints[i].x = P.x;
+				cloudPoints[i].y = P.y;
+				sortedIndexes[i] = i;
+			}
+		}
+		//stable sort: the first point (in the cloud) of each duplicate set is kept
+		std::stable_sort(sortedIndexes.begin(), sortedIndexes.end(), LexicoLess2D(cloudPoints));
+
+		size_t uniqueCount = 0;
+		for (unsigned i=0; i<count; ++i)
+		{
+			const CCVector2& P = cloudPoints[sortedIndexes[i]];
+			if (uniqueCount == 0 || P.x != cloudPoints[sortedIndexes[uniqueCount-1]].x || P.y != cloudPoints[sortedIndexes[uniqueCount-1]].y)
+				sortedIndexes[uniqueCount++] = sortedIndexes[i];
+		}
+		sortedIndexes.resize(uniqueCount);
+		//we keep the cloud order
+		std::sort(sortedIndexes.begin(), sortedIndexes.end());
+
+		context.points.resize(uniqueCount);
+		for (size_t i=0; i<uniqueCount; ++i)
+			context.points[i] = cloudPoints[sortedIndexes[i]];
+		pointIndexes.swap(sortedIndexes);
+	}
+	catch(std::bad_alloc)
+	{
+		//not enough memory
+		return 0;
+	}
+	unsigned pointCount = static_cast<unsigned>(context.points.size());
+	if (pointCount < 3)
+		return 0;
+
+	//global bounding box
+	context.bbox.minX = context.bbox.maxX = context.points[0].x;
+	context.bbox.minY = context.bbox.maxY = context.points[0].y;
+	for (unsigned i=1; i<pointCount; ++i)
+	{
+		const CCVector2& P = context.points[i];
+		if (P.x < context.bbox.minX) context.bbox.minX = P.x; else if (P.x > context.bbox.maxX) context.bbox.maxX = P.x;
+		if (P.y < context.bbox.minY) context.bbox.minY = P.y; else if (P.y > context.bbox.maxY) context.bbox.maxY = P.y;
+	}
+
+	double dx = context.bbox.maxX-context.bbox.minX;
+	double dy = context.bbox.maxY-context.bbox.minY;
+	if (dx <= 0 || dy <= 0) //flat cloud: no 2D triangulation possible
+		return 0;
+
+	//grid of (roughly) square tiles, subdivided in cells of a few points
+	{
+		static const unsigned MEAN_POINTS_PER_CELL = 8;
+		double tileCount = ceil((double)pointCount/(double)maxPointsPerTile);
+		double tileSize = sqrt(dx*dy/tileCount);
+		context.tilesX = std::max<unsigned>(1,(unsigned)ceil(dx/tileSize));
+		context.tilesY = std::max<unsigned>(1,(unsigned)ceil(dy/tileSize));
+		double cellSize = sqrt(dx*dy*MEAN_POINTS_PER_CELL/(double)pointCount);
+		context.cellsPerTile = std::max<unsigned>(1,(unsigned)ceil(tileSize/cellSize));
+		context.cellsX = context.tilesX*context.cellsPerTile;
+		context.cellsY = context.tilesY*context.cellsPerTile;
+		context.cellSizeX = dx/context.cellsX;
+		context.cellSizeY = dy/context.cellsY;
+		context.initialMargin = 0.05*tileSize;
+		//beyond that, a tile would be triangulated with (more than) all its neighbours
+		context.maxMargin = tileSize;
+	}
+	unsigned tileCount = context.tilesX*context.tilesY;
+	unsigned cellCount = context.cellsX*context.cellsY;
+
+	//we sort the points by cell (counting sort)
+	std::vector<tileTriangulationDesc> tiles;
+	try
+	{
+		context.cellOffsets.resize(cellCount+1,0);
+		context.cellIndexes.resize(pointCount);
+		std::vector<unsigned> pointCells(pointCount);
+		for (unsigned i=0; i<pointCount; ++i)
+		{
+			unsigned cx, cy;
+			context.getCell(context.points[i].x, context.points[i].y, cx, cy);
+			pointCells[i] = cx + cy*context.cellsX;
+			++context.cellOffsets[pointCells[i]+1];
+		}
+		for (unsigned c=0; c<cellCount; ++c)
+			context.cellOffsets[c+1] += context.cellOffsets[c];
+		std::vector<unsigned> fillPos(context.cellOffsets.begin(),context.cellOffsets.end()-1);
+		for (unsigned i=0; i<pointCount; ++i)
+			context.cellIndexes[fillPos[pointCells[i]]++] = i;
+
+		tiles.resize(tileCount);
+		for (unsigned t=0; t<tileCount; ++t)
+		{
+			tiles[t].tx = t % context.tilesX;
+			tiles[t].ty = t / context.tilesX;
+			tiles[t].success = false;
+			tiles[t].hullEdges = 0;
+		}
+	}
+	catch(std::bad_alloc)
+	{
+		//not enough memory
+		return 0;
+	}
+
+	NormalizedProgress* nprogress = 0;
+	if (progressCb)
+	{
+		progressCb->reset();
+		progressCb->setMethodTitle("Tiled triangulation");
+		char buffer[256];
+		sprintf(buffer,"Points: %u\nTiles: %u x %u",pointCount,context.tilesX,context.tilesY);
+		progressCb->setInfo(buffer);
+		nprogress = new NormalizedProgress(progressCb,2*tileCount);
+		progressCb->start();
+	}
+
+	bool success = true;
+
+	//global convex hull (= convex hull of the tiles convex hulls)
+#ifndef ENABLE_MT_OCTREE
+	for (unsigned t=0; t<tileCount; ++t)
+	{
+		ComputeTileHull(context, tiles[t]);
+		if (nprogress && !nprogress->oneStep())
+		{
+			success = false;
+			break;
+		}
+	}
+#else
+	s_tiledContext_MT = &context;
+	QtConcurrent::blockingMap(tiles, ComputeTileHull_MT);
+#endif
+
+	if (success)
+	{
+		try
+		{
+			std::vector<unsigned> hullPoints;
+			for (unsigned t=0; t<tileCount; ++t)
+			{
+				if (!tiles[t].success)
+					throw std::bad_alloc();
+				hullPoints.insert(hullPoints.end(), tiles[t].hull.begin(), tiles[t].hull.end());
+				std::vector<unsigned>().swap(tiles[t].hull);
+			}
+			ConvexHull2D(context.points, hullPoints, context.hull);
+			context.hullPolygon.resize(context.hull.size());
+			for (size_t i=0; i<context.hull.size(); ++i)
+				context.hullPolygon[i] = context.points[context.hull[i]];
+			std::sort(context.hull.begin(), context.hull.end());
+			//collinear points may appear twice in the monotone chain
+			context.hull.erase(std::unique(context.hull.begin(), context.hull.end()), context.hull.end());
+		}
+		catch(std::bad_alloc)
+		{
+			//not enough memory
+			success = false;
+		}
+	}
+
+	//tiles triangulation
+	if (success)
+	{
+#ifndef ENABLE_MT_OCTREE
+		for (unsigned t=0; t<tileCount; ++t)
+		{
+			TriangulateTile(context, tiles[t]);
+			if (!tiles[t].success || (nprogress && !nprogress->oneStep()))
+			{
+				success = false;
+				break;
+			}
+		}
+#else
+		QtConcurrent::blockingMap(tiles, TriangulateTile_MT);
+		s_tiledContext_MT = 0;
+		for (unsigned t=0; t<tileCount && success; ++t)
+			success = tiles[t].success;
+#endif
+	}
+
+	if (nprogress)
+	{
+		delete nprogress;
+		nprogress = 0;
+	}
+	if (progressCb)
+		progressCb->stop();
+
+	//the tiles must match along their borders
+	if (!success || !CheckTilesStitching(context, tiles))
+		return 0;
+
+	//we merge the tiles triangles (the vertices are the cloud points)
+	size_t triCount = 0;
+	for (unsigned t=0; t<tileCount; ++t)
+		triCount += tiles[t].triangles.size();
+
+	SimpleMesh* theMesh = new SimpleMesh(theCloud);
+	if (triCount == 0 || !theMesh->reserve((unsigned)triCount))
+	{
+		delete theMesh;
+		return 0;
+	}
+	for (unsigned t=0; t<tileCount; ++t)
+	{
+		const std::vector<tileTriangle>& triangles = tiles[t].triangles;
+		for (size_t i=0; i<triangles.size(); ++i)
+			theMesh->addTriangle(pointIndexes[triangles[i].i1],pointIndexes[triangles[i].i2],pointIndexes[triangles[i].i3]);
+		std::vector<tileTriangle>().swap(tiles[t].triangles);
 	}
 
 	return theMesh;
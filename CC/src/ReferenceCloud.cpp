@@ -33,6 +33,16 @@ ReferenceCloud::ReferenceCloud(GenericIndexedCloudPersist* associatedCloud)
 	m_theIndexes->link();
 }
 
+ReferenceCloud::ReferenceCloud(GenericIndexedCloudPersist* associatedCloud, ReferencesContainer* indexes)
+	: m_theIndexes(indexes)
+	, m_globalIterator(0)
+	, m_validBB(false)
+	, m_theAssociatedCloud(associatedCloud)
+{
+	if (m_theIndexes)
+		m_theIndexes->link();
+}
+
 ReferenceCloud::ReferenceCloud(const ReferenceCloud& refCloud)
 	: m_theIndexes(0)
 	, m_globalIterator(0)
@@ -48,11 +58,18 @@ ReferenceCloud::ReferenceCloud(const ReferenceCloud& refCloud)
 		//we don't catch any exception so that the caller of the constructor can do it!
 		refCloud.m_theIndexes->copy(*m_theIndexes);
 	}
+	else if (!refCloud.m_theIndexes && refCloud.size() != 0 && m_theIndexes->resize(refCloud.size()))
+	{
+		//the source doesn't use a container (e.g. DgmOctreeCellReferenceCloud)
+		for (unsigned i=0; i<refCloud.size(); ++i)
+			m_theIndexes->setValue(i,refCloud.getPointGlobalIndex(i));
+	}
 }
 
 ReferenceCloud::~ReferenceCloud()
 {
-	m_theIndexes->release();
+	if (m_theIndexes)
+		m_theIndexes->release();
 }
 
 void ReferenceCloud::clear(bool releaseMemory)
@@ -213,7 +230,7 @@ bool ReferenceCloud::add(const ReferenceCloud& cloud)
 	if (!m_theIndexes || !cloud.m_theAssociatedCloud || m_theAssociatedCloud != cloud.m_theAssociatedCloud)
 		return false;
 
-	unsigned newCount = (cloud.m_theIndexes ? cloud.m_theIndexes->currentSize() : 0);
+	unsigned newCount = cloud.size();
 	if (newCount == 0)
 		return true;
 
@@ -223,8 +240,16 @@ bool ReferenceCloud::add(const ReferenceCloud& cloud)
 		return false;
 
 	//copy new indexes (warning: no duplicate check!)
-	for (unsigned i=0; i<newCount; ++i)
-		(*m_theIndexes)[count+i] = (*cloud.m_theIndexes)[i];
+	if (cloud.m_theIndexes)
+	{
+		for (unsigned i=0; i<newCount; ++i)
+			(*m_theIndexes)[count+i] = (*cloud.m_theIndexes)[i];
+	}
+	else
+	{
+		for (unsigned i=0; i<newCount; ++i)
+			(*m_theIndexes)[count+i] = cloud.getPointGlobalIndex(i);
+	}
 
 	m_validBB = false;
 	return true;
@@ -0,0 +1,387 @@
+//##########################################################################
+//#                                                                        #
+//#                               CCLIB                                    #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU Library General Public License as       #
+//#  published by the Free Software Foundation; version 2 of the License.  #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: EDF R&D / TELECOM ParisTech (ENST-TSI)             #
+//#                                                                        #
+//##########################################################################
+
+#include "SparseEuclideanDistanceTransform.h"
+
+//local
+#include "GenericProgressCallback.h"
+
+//system
+#include <algorithm>
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+
+#ifdef ENABLE_MT_OCTREE
+#include <QtCore/QtCore>
+#endif
+
+using namespace CCLib;
+
+//! 'Infinite' squared distance
+static const float EDT_INF = 1.0e20f;
+
+SparseEuclideanDistanceTransform::SparseEuclideanDistanceTransform(unsigned Di, unsigned Dj, unsigned Dk)
+	: m_gridX(Di)
+	, m_gridY(Dj)
+	, m_gridZ(Dk)
+{
+}
+
+bool SparseEuclideanDistanceTransform::setZero(const int cellPos[])
+{
+	assert(cellPos[0] >= 0 && cellPos[0] < (int)m_gridX);
+	assert(cellPos[1] >= 0 && cellPos[1] < (int)m_gridY);
+	assert(cellPos[2] >= 0 && cellPos[2] < (int)m_gridZ);
+
+	CellPos P = { (unsigned)cellPos[0], (unsigned)cellPos[1], (unsigned)cellPos[2] };
+	try
+	{
+		m_zeros.push_back(P);
+	}
+	catch(std::bad_alloc)
+	{
+		//not enough memory
+		return false;
+	}
+
+	return true;
+}
+
+int SparseEuclideanDistanceTransform::addQuery(const int cellPos[])
+{
+	assert(cellPos[0] >= 0 && cellPos[0] < (int)m_gridX);
+	assert(cellPos[1] >= 0 && cellPos[1] < (int)m_gridY);
+	assert(cellPos[2] >= 0 && cellPos[2] < (int)m_gridZ);
+
+	CellPos P = { (unsigned)cellPos[0], (unsigned)cellPos[1], (unsigned)cellPos[2] };
+	try
+	{
+		m_queries.push_back(P);
+	}
+	catch(std::bad_alloc)
+	{
+		//not enough memory
+		return -1;
+	}
+
+	return (int)m_queries.size()-1;
+}
+
+bool SparseEuclideanDistanceTransform::SliceBuffers::init(unsigned Dj, unsigned Dk)
+{
+	unsigned maxD = std::max(Dj,Dk);
+	try
+	{
+		slice.resize(Dj*Dk);
+		lineIn.resize(maxD);
+		lineOut.resize(maxD);
+		v.resize(maxD);
+		z.resize(maxD+1);
+	}
+	catch(std::bad_alloc)
+	{
+		//not enough memory
+		return false;
+	}
+
+	return true;
+}
+
+//! 1D squared distance transform of a sampled function
+/** Lower envelope of the parabolas rooted at each sample (see Felzenszwalb and
+	Huttenlocher, "Distance Transforms of Sampled Functions", 2004).
+	\param f input function (n values)
+	\param n number of samples
+	\param[out] d output (squared distances, n values)
+	\param v buffer (n values)
+	\param z buffer (n+1 values)
+**/
+static void DistanceTransform1D(const float* f, unsigned n, float* d, unsigned* v, double* z)
+{
+	unsigned k = 0;
+	v[0] = 0;
+	z[0] = -HUGE_VAL;
+	z[1] = HUGE_VAL;
+	for (unsigned q=1; q<n; ++q)
+	{
+		double fq = (double)f[q] + (double)q*(double)q;
+		double s = 0;
+		while (true)
+		{
+			unsigned p = v[k];
+			s = (fq - ((double)f[p] + (double)p*(double)p)) / (2.0*((double)q-(double)p));
+			if (s > z[k])
+				break;
+			assert(k != 0); //z[0] = -inf
+			--k;
+		}
+		++k;
+		v[k] = q;
+		z[k] = s;
+		z[k+1] = HUGE_VAL;
+	}
+
+	k = 0;
+	for (unsigned q=0; q<n; ++q)
+	{
+		while (z[k+1] < (double)q)
+			++k;
+		double dq = (double)q - (double)v[k];
+		d[q] = (float)(dq*dq + (double)f[v[k]]);
+	}
+}
+
+void SparseEuclideanDistanceTransform::processSlice(unsigned i, SliceBuffers& buffers)
+{
+	float* slice = &buffers.slice[0];
+
+	//1st pass: squared distance to the nearest zero of the same row (X)
+	//2nd pass: distance transform along Y (for each Z plane)
+	for (unsigned k=0; k<m_gridZ; ++k)
+	{
+		float* plane = slice + k*m_gridY;
+		if (m_planeZeroCount[k] == 0)
+		{
+			std::fill(plane,plane+m_gridY,EDT_INF);
+			continue;
+		}
+
+		const unsigned* rowStart = &m_rowStart[k*m_gridY];
+		for (unsigned j=0; j<m_gridY; ++j)
+		{
+			float d2 = EDT_INF;
+			if (rowStart[j] != rowStart[j+1])
+			{
+				const unsigned* first = &m_rowZeros[0] + rowStart[j];
+				const unsigned* last = &m_rowZeros[0] + rowStart[j+1];
+				const unsigned* it = std::lower_bound(first,last,i);
+				if (it != last)
+				{
+					float dx = (float)(*it - i);
+					d2 = dx*dx;
+				}
+				if (it != first)
+				{
+					float dx = (float)(i - *(it-1));
+					d2 = std::min(d2,dx*dx);
+				}
+			}
+			plane[j] = d2;
+		}
+
+		DistanceTransform1D(plane,m_gridY,&buffers.lineOut[0],&buffers.v[0],&buffers.z[0]);
+		std::copy(buffers.lineOut.begin(),buffers.lineOut.begin()+m_gridY,plane);
+	}
+
+	//3rd pass: distance transform along Z (only for the columns holding queries)
+	unsigned lastJ = m_gridY;
+	for (unsigned q=m_sliceStart[i]; q<m_sliceStart[i+1]; ++q)
+	{
+		unsigned queryIndex = m_sortedQueries[q];
+		const CellPos& P = m_queries[queryIndex];
+		assert(P.i == i);
+		if (P.j != lastJ)
+		{
+			for (unsigned k=0; k<m_gridZ; ++k)
+				buffers.lineIn[k] = slice[P.j + k*m_gridY];
+			DistanceTransform1D(&buffers.lineIn[0],m_gridZ,&buffers.lineOut[0],&buffers.v[0],&buffers.z[0]);
+			lastJ = P.j;
+		}
+		m_queryResults[queryIndex] = buffers.lineOut[P.k];
+	}
+}
+
+struct SparseEuclideanDistanceTransform::SliceJob
+{
+	SparseEuclideanDistanceTransform* edt;
+	unsigned i;
+};
+
+#ifdef ENABLE_MT_OCTREE
+
+static NormalizedProgress* s_normProgress_MT = 0;
+static bool s_cellFunc_MT_success = true;
+
+void SparseEuclideanDistanceTransform::ProcessSlice_MT(SliceJob& job)
+{
+	if (!s_cellFunc_MT_success)
+		return;
+
+	SliceBuffers buffers;
+	if (!buffers.init(job.edt->m_gridY,job.edt->m_gridZ))
+	{
+		s_cellFunc_MT_success = false;
+		return;
+	}
+
+	job.edt->processSlice(job.i,buffers);
+
+	if (s_normProgress_MT && !s_normProgress_MT->oneStep())
+		s_cellFunc_MT_success = false;
+}
+
+#endif
+
+double SparseEuclideanDistanceTransform::propagateDistance(GenericProgressCallback* progressCb/*=0*/)
+{
+	if (m_zeros.empty())
+		return -1.0;
+
+	unsigned rowCount = m_gridY*m_gridZ;
+	std::vector<SliceJob> jobs;
+	try
+	{
+		//zeros, sorted by row
+		m_rowStart.clear();
+		m_rowStart.resize(rowCount+1,0);
+		m_planeZeroCount.clear();
+		m_planeZeroCount.resize(m_gridZ,0);
+		for (size_t n=0; n<m_zeros.size(); ++n)
+		{
+			const CellPos& P = m_zeros[n];
+			++m_rowStart[P.j + P.k*m_gridY + 1];
+			++m_planeZeroCount[P.k];
+		}
+		for (unsigned r=0; r<rowCount; ++r)
+			m_rowStart[r+1] += m_rowStart[r];
+
+		m_rowZeros.resize(m_zeros.size());
+		{
+			std::vector<unsigned> fillIndexes(m_rowStart.begin(),m_rowStart.end()-1);
+			for (size_t n=0; n<m_zeros.size(); ++n)
+			{
+				const CellPos& P = m_zeros[n];
+				m_rowZeros[fillIndexes[P.j + P.k*m_gridY]++] = P.i;
+			}
+		}
+		for (unsigned r=0; r<rowCount; ++r)
+			if (m_rowStart[r+1] - m_rowStart[r] > 1)
+				std::sort(m_rowZeros.begin()+m_rowStart[r],m_rowZeros.begin()+m_rowStart[r+1]);
+
+		//queries, sorted by slice (X) then by column (Y)
+		m_sliceStart.clear();
+		m_sliceStart.resize(m_gridX+1,0);
+		for (size_t n=0; n<m_queries.size(); ++n)
+			++m_sliceStart[m_queries[n].i + 1];
+		for (unsigned i=0; i<m_gridX; ++i)
+			m_sliceStart[i+1] += m_sliceStart[i];
+
+		m_sortedQueries.resize(m_queries.size());
+		{
+			std::vector<unsigned> fillIndexes(m_sliceStart.begin(),m_sliceStart.end()-1);
+			for (size_t n=0; n<m_queries.size(); ++n)
+				m_sortedQueries[fillIndexes[m_queries[n].i]++] = (unsigned)n;
+		}
+		for (unsigned i=0; i<m_gridX; ++i)
+		{
+			for (unsigned q=m_sliceStart[i]+1; q<m_sliceStart[i+1]; ++q)
+			{
+				//insertion sort by column (the queries are generally already sorted)
+				unsigned index = m_sortedQueries[q];
+				unsigned p = q;
+				while (p > m_sliceStart[i] && m_queries[m_sortedQueries[p-1]].j > m_queries[index].j)
+				{
+					m_sortedQueries[p] = m_sortedQueries[p-1];
+					--p;
+				}
+				m_sortedQueries[p] = index;
+			}
+		}
+
+		m_queryResults.resize(m_queries.size());
+
+		//only the slices holding queries are processed
+		for (unsigned i=0; i<m_gridX; ++i)
+		{
+			if (m_sliceStart[i+1] != m_sliceStart[i])
+			{
+				SliceJob job;
+				job.edt = this;
+				job.i = i;
+				jobs.push_back(job);
+			}
+		}
+	}
+	catch(std::bad_alloc)
+	{
+		//not enough memory
+		return -1.0;
+	}
+
+	NormalizedProgress* normProgress=0;
+	if (progressCb)
+	{
+		normProgress = new NormalizedProgress(progressCb,(unsigned)jobs.size());
+		progressCb->setMethodTitle("Euclidean distance transform");
+		char buffer[256];
+		sprintf(buffer,"Box: [%u*%u*%u]",m_gridX,m_gridY,m_gridZ);
+		progressCb->setInfo(buffer);
+		progressCb->reset();
+		progressCb->start();
+	}
+
+	bool success = true;
+#ifdef ENABLE_MT_OCTREE
+	s_normProgress_MT = normProgress;
+	s_cellFunc_MT_success = true;
+
+	QtConcurrent::blockingMap(jobs, ProcessSlice_MT);
+
+	success = s_cellFunc_MT_success;
+	s_normProgress_MT = 0;
+#else
+	SliceBuffers buffers;
+	if (!buffers.init(m_gridY,m_gridZ))
+	{
+		success = false;
+	}
+	else
+	{
+		for (size_t n=0; n<jobs.size(); ++n)
+		{
+			processSlice(jobs[n].i,buffers);
+
+			if (normProgress && !normProgress->oneStep())
+			{
+				//process cancelled by user
+				success = false;
+				break;
+			}
+		}
+	}
+#endif
+
+	if (normProgress)
+		delete normProgress;
+
+	//release the temporary structures
+	std::vector<unsigned>().swap(m_rowZeros);
+	std::vector<unsigned>().swap(m_rowStart);
+	std::vector<unsigned>().swap(m_planeZeroCount);
+	std::vector<unsigned>().swap(m_sortedQueries);
+	std::vector<unsigned>().swap(m_sliceStart);
+
+	if (!success)
+		return -1.0;
+
+	float maxSquareDist = 0;
+	for (size_t n=0; n<m_queryResults.size(); ++n)
+		maxSquareDist = std::max(maxSquareDist,m_queryResults[n]);
+
+	return (double)maxSquareDist;
+}
@@ -32,7 +32,7 @@
 //system
 #include <string.h>
 #include <assert.h>
-#include <list>
+#include <vector>
 
 using namespace CCLib;
 
@@ -54,32 +54,68 @@ struct Chi2Class
 };
 
 //! An ordered list of Chi2 classes
-typedef std::list<Chi2Class> Chi2ClassList;
-
-double StatisticalTestingTools::computeAdaptativeChi2Dist(	const GenericDistribution* distrib,
-															const GenericCloud* cloud,
-															unsigned numberOfClasses,
-															unsigned &finalNumberOfClasses,
-															bool noClassCompression/*=false*/,
-															ScalarType* histoMin/*=0*/,
-															ScalarType* histoMax/*=0*/,
-															unsigned* histoValues/*=0*/,
-															double* npis/*=0*/)
+typedef std::vector<Chi2Class> Chi2ClassList;
+
+//! Computes the theoretical probability of each class of an histogram
+/** \param distrib theoretical distribution
+	\param minV histogram minimum value
+	\param dV histogram range
+	\param numberOfClasses number of classes
+	\param[out] pis probability of each class (array of size numberOfClasses)
+**/
+static void ComputeClassesProbabilities(const GenericDistribution* distrib,
+										ScalarType minV,
+										ScalarType dV,
+										unsigned numberOfClasses,
+										double* pis)
 {
-    assert(distrib && cloud);
-	unsigned n = cloud->size();
-
-	if (n==0 || !distrib->isValid())
-		return -1.0;
+	double p1 = distrib->computePfromZero(minV);
+	for (unsigned k=1; k<=numberOfClasses; ++k)
+	{
+		double p2 = distrib->computePfromZero(minV + (ScalarType)k * dV / (ScalarType)numberOfClasses);
+		pis[k-1] = p2-p1;
+		p1 = p2; //next intervale
+	}
+}
 
+//! Computes the Chi2 distance on a set of scalar values (see StatisticalTestingTools::computeAdaptativeChi2Dist)
+/** \param distrib theoretical distribution
+	\param values scalar values (invalid ones are ignored)
+	\param count number of values
+	\param numberOfClasses number of classes of the empirical distribution (>1)
+	\param noClassCompression prevent the algorithm from performing classes compression
+	\param histoMin [optional] minimum histogram value
+	\param histoMax [optional] maximum histogram value
+	\param precomputedPis [optional] theoretical probabilities of each class (only valid if both histoMin and histoMax are fixed)
+	\param[out] histo histogram array (size = numberOfClasses)
+	\param[out] pis theoretical probabilities of each class (size = numberOfClasses, unused if precomputedPis is set)
+	\param classes working buffer (to avoid reallocations)
+	\param[out] numberOfElements number of valid values
+	\param[out] finalNumberOfClasses final number of classes
+	\return the Chi2 distance (or a negative value if an error occured)
+**/
+static double ComputeChi2Dist(	const GenericDistribution* distrib,
+								const ScalarType* values,
+								unsigned count,
+								unsigned numberOfClasses,
+								bool noClassCompression,
+								const ScalarType* histoMin,
+								const ScalarType* histoMax,
+								const double* precomputedPis,
+								unsigned* histo,
+								double* pis,
+								Chi2ClassList& classes,
+								unsigned& numberOfElements,
+								unsigned& finalNumberOfClasses)
+{
 	//compute min and max (valid) values
 	ScalarType minV=0,maxV=0;
-	unsigned numberOfElements=0;
+	numberOfElements=0;
 	{
 		bool firstValidValue=true;
-		for (unsigned i=0; i<n; ++i)
+		for (unsigned i=0; i<count; ++i)
 		{
-			ScalarType V = cloud->getPointScalarValue(i);
+			ScalarType V = values[i];
 			if (ScalarField::ValidValue(V))
 			{
 				if (firstValidValue)
@@ -107,23 +143,11 @@ double StatisticalTestingTools::computeAdaptativeChi2Dist(	const GenericDistribu
     if (histoMax)
         maxV = *histoMax;
 
-	//shall we automatically compute the number of classes?
-	if (numberOfClasses==0)
-	{
-        numberOfClasses = (unsigned)ceil(sqrt((double)numberOfElements));
-	}
 	if (numberOfClasses<2)
 	{
         return -2.0; //not enough points/classes
 	}
 
-	//try to allocate the histogram values array (if necessary)
-	unsigned* histo = (histoValues ? histoValues : new unsigned[numberOfClasses]);
-	if (!histo)
-	{
-		//not enough memory
-		return -1.0;
-	}
 	memset(histo,0,sizeof(unsigned)*numberOfClasses);
 
 	//accumulate histogram
@@ -132,9 +156,9 @@ double StatisticalTestingTools::computeAdaptativeChi2Dist(	const GenericDistribu
 	unsigned histoAfter = 0;
 	if (dV > ZERO_TOLERANCE)
 	{
-		for (unsigned i=0;i<n;++i)
+		for (unsigned i=0;i<count;++i)
 		{
-			ScalarType V = cloud->getPointScalarValue(i);
+			ScalarType V = values[i];
 			if (ScalarField::ValidValue(V))
 			{
 				int bin = (int)floor((V-minV)*(ScalarType)numberOfClasses/dV);
@@ -158,62 +182,38 @@ double StatisticalTestingTools::computeAdaptativeChi2Dist(	const GenericDistribu
 	}
 	else
 	{
-		histo[0] = n;
+		histo[0] = count;
 	}
 
-	//we build up the list of classes
-	Chi2ClassList classes;
-	//before?
+	//theoretical probabilities of each class
+	const double* classesPis = precomputedPis;
+	if (!classesPis)
 	{
-		if (histoBefore)
-		{
-			try
-			{
-				classes.push_back(Chi2Class(1.0e-6,(int)histoBefore));
-			}
-			catch(std::bad_alloc)
-			{
-				//not enough memory!
-				return -1.0;
-			}
-		}
-		double p1 = distrib->computePfromZero(minV);
-		for (unsigned k=1; k<=numberOfClasses; ++k)
-		{
-			double p2 = distrib->computePfromZero(minV + (ScalarType)k * dV / (ScalarType)numberOfClasses);
-
-			//add the class to the chain
-			Chi2Class currentClass;
-			currentClass.n = histo[k-1];
-			currentClass.pi = p2-p1;
-			if (npis)
-				npis[k-1]= currentClass.pi * (double)numberOfElements;
-
-			try
-			{
-				classes.push_back(currentClass);
-			}
-			catch(std::bad_alloc)
-			{
-				//not enough memory!
-				return -1.0;
-			}
+		ComputeClassesProbabilities(distrib,minV,dV,numberOfClasses,pis);
+		classesPis = pis;
+	}
+	else
+	{
+		assert(histoMin && histoMax);
+	}
 
-			p1 = p2; //next intervale
-		}
-		if (histoAfter)
-		{
-			try
-			{
-				classes.push_back(Chi2Class(1.0e-6,(int)histoAfter));
-			}
-			catch(std::bad_alloc)
-			{
-				//not enough memory!
-				return -1.0;
-			}
-		}
+	//we build up the list of classes
+	try
+	{
+		classes.clear();
+		classes.reserve(numberOfClasses+2);
+	}
+	catch(std::bad_alloc)
+	{
+		//not enough memory!
+		return -1.0;
 	}
+	if (histoBefore)
+		classes.push_back(Chi2Class(1.0e-6,(int)histoBefore));
+	for (unsigned k=0; k<numberOfClasses; ++k)
+		classes.push_back(Chi2Class(classesPis[k],(int)histo[k]));
+	if (histoAfter)
+		classes.push_back(Chi2Class(1.0e-6,(int)histoAfter));
 
 	//classes compression
 	if (!noClassCompression)
@@ -224,42 +224,31 @@ double StatisticalTestingTools::computeAdaptativeChi2Dist(	const GenericDistribu
 		while (classes.size()>2)
 		{
 			//we look for the smallest class (smallest "npi")
-			Chi2ClassList::iterator it = classes.begin();
-			Chi2ClassList::iterator minIt = it;
-			for (; it != classes.end(); ++it)
-				if (it->pi < minIt->pi)
-					minIt = it;
+			size_t minIndex = 0;
+			for (size_t i=1; i<classes.size(); ++i)
+				if (classes[i].pi < classes[minIndex].pi)
+					minIndex = i;
 
-			if (minIt->pi >= minPi) //all classes are bigger than the minimum requirement
+			if (classes[minIndex].pi >= minPi) //all classes are bigger than the minimum requirement
 				break;
 
 			//otherwise we must fuse the smallest class with its neighbor (to make the classes repartition more equilibrated)
-			Chi2ClassList::iterator smallestIt;
-			{
-				Chi2ClassList::iterator nextIt = minIt; nextIt++;
-				if (minIt == classes.begin())
-				{
-					smallestIt = nextIt;
-				}
-				else
-				{
-					Chi2ClassList::iterator predIt = minIt; predIt--;
-					smallestIt = (nextIt != classes.end() && nextIt->pi < predIt->pi ? nextIt : predIt);
-				}
-			}
+			size_t smallestIndex = minIndex+1;
+			if (minIndex != 0 && (smallestIndex == classes.size() || classes[minIndex-1].pi <= classes[smallestIndex].pi))
+				smallestIndex = minIndex-1;
 
-			smallestIt->pi += minIt->pi;
-			smallestIt->n += minIt->n;
+			classes[smallestIndex].pi += classes[minIndex].pi;
+			classes[smallestIndex].n += classes[minIndex].n;
 
 			//we can remove the current class
-			classes.erase(minIt);
+			classes.erase(classes.begin()+minIndex);
 		}
 	}
 
 	//we compute the Chi2 distance with the remaining classes
 	double D2=0.0;
 	{
-		for (Chi2ClassList::iterator it = classes.begin(); it != classes.end(); ++it)
+		for (Chi2ClassList::const_iterator it = classes.begin(); it != classes.end(); ++it)
 		{
 			double npi = it->pi * (double)numberOfElements;
 			if (npi != 0.0)
@@ -280,14 +269,87 @@ double StatisticalTestingTools::computeAdaptativeChi2Dist(	const GenericDistribu
 		}
 	}
 
-	if (!histoValues)
-        delete[] histo;
-
 	finalNumberOfClasses = (unsigned)classes.size();
 
 	return D2;
 }
 
+double StatisticalTestingTools::computeAdaptativeChi2Dist(	const GenericDistribution* distrib,
+															const GenericCloud* cloud,
+															unsigned numberOfClasses,
+															unsigned &finalNumberOfClasses,
+															bool noClassCompression/*=false*/,
+															ScalarType* histoMin/*=0*/,
+															ScalarType* histoMax/*=0*/,
+															unsigned* histoValues/*=0*/,
+															double* npis/*=0*/)
+{
+    assert(distrib && cloud);
+	unsigned n = cloud->size();
+
+	if (n==0 || !distrib->isValid())
+		return -1.0;
+
+	std::vector<ScalarType> values;
+	std::vector<unsigned> histo;
+	std::vector<double> pis;
+	Chi2ClassList classes;
+	try
+	{
+		values.resize(n);
+		for (unsigned i=0; i<n; ++i)
+			values[i] = cloud->getPointScalarValue(i);
+
+		//shall we automatically compute the number of classes?
+		if (numberOfClasses==0)
+		{
+			unsigned numberOfElements = 0;
+			for (unsigned i=0; i<n; ++i)
+				if (ScalarField::ValidValue(values[i]))
+					++numberOfElements;
+			if (numberOfElements == 0)
+				return -1.0;
+			numberOfClasses = (unsigned)ceil(sqrt((double)numberOfElements));
+		}
+		if (numberOfClasses<2)
+		{
+			return -2.0; //not enough points/classes
+		}
+
+		if (!histoValues)
+			histo.resize(numberOfClasses);
+		pis.resize(numberOfClasses);
+	}
+	catch(std::bad_alloc)
+	{
+		//not enough memory
+		return -1.0;
+	}
+
+	unsigned numberOfElements = 0;
+	double D2 = ComputeChi2Dist(distrib,
+								&values[0],
+								n,
+								numberOfClasses,
+								noClassCompression,
+								histoMin,
+								histoMax,
+								0,
+								histoValues ? histoValues : &histo[0],
+								&pis[0],
+								classes,
+								numberOfElements,
+								finalNumberOfClasses);
+
+	if (D2 >= 0.0 && npis)
+	{
+		for (unsigned k=0; k<numberOfClasses; ++k)
+			npis[k] = pis[k] * (double)numberOfElements;
+	}
+
+	return D2;
+}
+
 double StatisticalTestingTools::computeChi2Fractile(double p, int d)
 {
 	return Chi2Helper::critchi(p,d);
@@ -303,7 +365,8 @@ double StatisticalTestingTools::testCloudWithStatisticalModel(const GenericDistr
                                                               unsigned numberOfNeighbours,
                                                               double pTrust,
                                                               GenericProgressCallback* progressCb/*=0*/,
-                                                              DgmOctree* _theOctree/*=0*/)
+                                                              DgmOctree* _theOctree/*=0*/,
+                                                              bool noClassCompression/*=true*/)
 {
 	assert(theCloud);
 
@@ -328,15 +391,6 @@ double StatisticalTestingTools::testCloudWithStatisticalModel(const GenericDistr
 
 	unsigned numberOfChi2Classes = (unsigned)ceil(sqrt((double)numberOfNeighbours));
 
-	//Chi2 hisogram values
-	unsigned* histoValues = new unsigned[numberOfChi2Classes];
-	if (!histoValues)
-	{
-		if (!_theOctree)
-			delete theOctree;
-		return -3.0;
-	}
-
 	ScalarType* histoMin = 0, customHistoMin = 0;
 	ScalarType* histoMax = 0, customHistoMax = 0;
 	if (strcmp(distrib->getName(),"Gauss")==0)
@@ -355,13 +409,32 @@ double StatisticalTestingTools::testCloudWithStatisticalModel(const GenericDistr
 		histoMin = &customHistoMin;
 	}
 
+	//if the histogram bounds are fixed, the theoretical probabilities of
+	//the classes are the same for all points: we compute them only once
+	std::vector<double> pis;
+	if (histoMin && histoMax && numberOfChi2Classes > 1)
+	{
+		try
+		{
+			pis.resize(numberOfChi2Classes);
+		}
+		catch(std::bad_alloc)
+		{
+			if (!_theOctree)
+				delete theOctree;
+			return -3.0;
+		}
+		ComputeClassesProbabilities(distrib,*histoMin,*histoMax-*histoMin,numberOfChi2Classes,&pis[0]);
+	}
+
 	//additionnal parameters for local process
 	void* additionalParameters[] = {	(void*)distrib,
 										(void*)&numberOfNeighbours,
 										(void*)&numberOfChi2Classes,
-										(void*)histoValues,
+										(void*)(pis.empty() ? 0 : &pis[0]),
 										(void*)histoMin,
-										(void*)histoMax};
+										(void*)histoMax,
+										(void*)&noClassCompression};
 
 	double maxChi2 = -1.0;
 
@@ -386,9 +459,6 @@ double StatisticalTestingTools::testCloudWithStatisticalModel(const GenericDistr
 		}
 	}
 
-	delete[] histoValues;
-	histoValues=0;
-
 	if (!_theOctree)
         delete theOctree;
 
@@ -401,9 +471,10 @@ bool StatisticalTestingTools::computeLocalChi2DistAtLevel(const DgmOctree::octre
 	GenericDistribution* statModel		= (GenericDistribution*)additionalParameters[0];
 	unsigned numberOfNeighbours         = *(unsigned*)additionalParameters[1];
 	unsigned numberOfChi2Classes		= *(unsigned*)additionalParameters[2];
-	unsigned* histoValues				= (unsigned*)additionalParameters[3];
+	const double* pis					= (const double*)additionalParameters[3];
 	ScalarType* histoMin				= (ScalarType*)additionalParameters[4];
 	ScalarType* histoMax				= (ScalarType*)additionalParameters[5];
+	bool noClassCompression				= *(bool*)additionalParameters[6];
 
 	//number of points in the current cell
 	unsigned n = cell.points->size();
@@ -435,13 +506,26 @@ bool StatisticalTestingTools::computeLocalChi2DistAtLevel(const DgmOctree::octre
 		nNSS.alreadyVisitedNeighbourhoodSize = 1;
 	}
 
-	ReferenceCloud neighboursCloud(cell.points->getAssociatedCloud());
-	if (!neighboursCloud.reserve(numberOfNeighbours))
+	//working buffers (local to the cell so that cells can be processed in parallel)
+	std::vector<ScalarType> values;
+	std::vector<unsigned> histo;
+	std::vector<double> localPis;
+	Chi2ClassList classes;
+	try
+	{
+		values.resize(std::max(numberOfNeighbours,1u));
+		histo.resize(std::max(numberOfChi2Classes,1u));
+		if (!pis)
+			localPis.resize(std::max(numberOfChi2Classes,1u));
+		classes.reserve(numberOfChi2Classes+2);
+	}
+	catch (std::bad_alloc) //out of memory
 	{
-		//not enough memory!
 		return false;
 	}
 
+	const GenericIndexedCloudPersist* cloud = cell.points->getAssociatedCloud();
+
 	for (unsigned i=0;i<n;++i)
 	{
 		cell.points->getPoint(i,nNSS.queryPoint);
@@ -449,21 +533,28 @@ bool StatisticalTestingTools::computeLocalChi2DistAtLevel(const DgmOctree::octre
 
 		if (ScalarField::ValidValue(D))
 		{
-			//nNSS.theNearestPoints.clear();
-
+			//the neighbourhood of the previous points of the cell is reused (see findNearestNeighborsStartingFromCell)
 			unsigned k = cell.parentOctree->findNearestNeighborsStartingFromCell(nNSS,true);
 			if (k>numberOfNeighbours)
 				k=numberOfNeighbours;
 
-			neighboursCloud.clear(false);
 			for (unsigned j=0; j<k; ++j)
-				neighboursCloud.addPointIndex(nNSS.pointsInNeighbourhood[j].pointIndex);
-
-			unsigned finalNumberOfChi2Classes=0;
-			//VERSION "SYMPA" (test grossier)
-			double Chi2Dist = (ScalarType)computeAdaptativeChi2Dist(statModel,&neighboursCloud,numberOfChi2Classes,finalNumberOfChi2Classes,true,histoMin,histoMax,histoValues);
-			//VERSION "SEVERE" (test ultra-precis)
-			//double Chi2Dist = (ScalarType)computeAdaptativeChi2Dist(statModel,&neighboursCloud,numberOfChi2Classes,finalNumberOfChi2Classes,false,histoMin,histoMax,histoValues);
+				values[j] = cloud->getPointScalarValue(nNSS.pointsInNeighbourhood[j].pointIndex);
+
+			unsigned numberOfElements = 0, finalNumberOfChi2Classes = 0;
+			double Chi2Dist = (ScalarType)ComputeChi2Dist(	statModel,
+												&values[0],
+												k,
+												numberOfChi2Classes,
+												noClassCompression,
+												histoMin,
+												histoMax,
+												pis,
+												&histo[0],
+												pis ? 0 : &localPis[0],
+												classes,
+												numberOfElements,
+												finalNumberOfChi2Classes);
 
 			D = (Chi2Dist >= 0.0 ? (ScalarType)sqrt(Chi2Dist) : NAN_VALUE);
 		}
@@ -20,12 +20,17 @@
 //local
 #include "GenericProgressCallback.h"
 #include "GenericIndexedCloudPersist.h"
-#include "Neighbourhood.h"
-#include "DistanceComputationTools.h"
+#include "Matrix.h"
+#include "DgmOctree.h" //for ENABLE_MT_OCTREE
 
 //system
 #include <algorithm>
 #include <assert.h>
+#include <vector>
+
+#ifdef ENABLE_MT_OCTREE
+#include <QtCore/QtCore>
+#endif
 
 using namespace CCLib;
 
@@ -44,140 +49,322 @@ void TrueKdTree::clear()
 	m_root = 0;
 }
 
-//shared structure used to sort the points along a single dimension (see TrueKdTree::split)
-static std::vector<PointCoordinateType> s_sortedCoordsForSplit;
+//! Running sums of a set of points (used to fit the LS plane of a node in constant time)
+struct PointSetMoments
+{
+	//! Sum of the coordinates (relatively to the build origin)
+	double sum[3];
+	//! Sum of the coordinates products (xx, yy, zz, xy, xz, yz)
+	double sum2[6];
+
+	PointSetMoments()
+	{
+		memset(sum,0,sizeof(double)*3);
+		memset(sum2,0,sizeof(double)*6);
+	}
 
-TrueKdTree::BaseNode* TrueKdTree::split(ReferenceCloud* subset)
+	inline void add(const CCVector3d& P)
+	{
+		sum[0] += P.x;
+		sum[1] += P.y;
+		sum[2] += P.z;
+		sum2[0] += P.x*P.x;
+		sum2[1] += P.y*P.y;
+		sum2[2] += P.z*P.z;
+		sum2[3] += P.x*P.y;
+		sum2[4] += P.x*P.z;
+		sum2[5] += P.y*P.z;
+	}
+
+	//! Computes the LS plane of 'count' points (same as Neighbourhood::getLSQPlane)
+	bool computeLSPlane(unsigned count, const CCVector3d& origin, PointCoordinateType planeEq[4]) const
+	{
+		assert(count > 3);
+		double invCount = 1.0/(double)count;
+		CCVector3d G(sum[0]*invCount, sum[1]*invCount, sum[2]*invCount);
+
+		//covariance matrix
+		SymmetricMatrix3d eig;
+		eig.set(sum2[0]*invCount - G.x*G.x,
+				sum2[1]*invCount - G.y*G.y,
+				sum2[2]*invCount - G.z*G.z,
+				sum2[3]*invCount - G.x*G.y,
+				sum2[4]*invCount - G.x*G.z,
+				sum2[5]*invCount - G.y*G.z );
+		if (!eig.computeEigenValuesAndVectors())
+			return false;
+
+		//the smallest eigen vector corresponds to the "least square best fitting plane" normal
+		double vec[3];
+		eig.getMinEigenValueAndVector(vec);
+		Vector3Tpl<double>::vnormalize(vec);
+		planeEq[0] = (PointCoordinateType)vec[0];
+		planeEq[1] = (PointCoordinateType)vec[1];
+		planeEq[2] = (PointCoordinateType)vec[2];
+
+		//the plane pass through the centroid
+		CCVector3 C((PointCoordinateType)(G.x+origin.x),(PointCoordinateType)(G.y+origin.y),(PointCoordinateType)(G.z+origin.z));
+		planeEq[3] = C.dot(CCVector3(planeEq));
+
+		return true;
+	}
+};
+
+//! TrueKdTree build structures
+/** Each node corresponds to a range of the (single) points permutation array.
+	As the ranges of two nodes that are not parent of each other never overlap,
+	the subtrees can be built concurrently (the temporary buffers are split the
+	same way).
+**/
+struct TrueKdTreeBuildContext
 {
-	assert(subset); //subset will always be taken care of by this method
-	
-	unsigned count = subset->size();
+	//! Associated cloud
+	GenericIndexedCloudPersist* cloud;
+	//! Max RMS for planarity-based split strategy
+	double maxRMS;
+	//! Moments origin (to preserve numerical accuracy)
+	CCVector3d origin;
+	//! Points permutation
+	std::vector<unsigned> indexes;
+	//! Temporary buffer for partitioning
+	std::vector<unsigned> partitionBuffer;
+	//! Temporary buffer for distances or coordinates sorting
+	std::vector<PointCoordinateType> values;
+};
 
-	const PointCoordinateType* planeEquation = Neighbourhood(subset).getLSQPlane();
-	if (!planeEquation)
+//! Creates a leaf from a range of the points permutation
+static TrueKdTree::Leaf* CreateLeaf(const TrueKdTreeBuildContext& context, unsigned first, unsigned count, const PointCoordinateType* planeEq, ScalarType rms)
+{
+	ReferenceCloud* subset = new ReferenceCloud(context.cloud);
+	if (!subset->reserve(count))
 	{
-		//an error occured during LS plane computation?!
+		//not enough memory!
 		delete subset;
 		return 0;
 	}
-	
-	assert(fabs(CCVector3(planeEquation).norm2() - 1.0) < 1.0e-6);
-	//ScalarType rms = (count != 3 ? DistanceComputationTools::computeCloud2PlaneDistanceRMS(subset, planeEquation) : 0);
-	ScalarType rms = (count != 3 ? DistanceComputationTools::ComputeCloud2PlaneRobustMax(subset, planeEquation, 0.02f) : 0);
-	
+	for (unsigned i=0; i<count; ++i)
+		subset->addPointIndex(context.indexes[first+i]);
+
+	TrueKdTree::Leaf* leaf = new TrueKdTree::Leaf(subset);
+	memcpy(leaf->planeEq,planeEq,sizeof(PointCoordinateType)*4);
+	leaf->rms = rms;
+
+	return leaf;
+}
+
+//! Subsets with more points than this are split in parallel (see SplitRange)
+static const unsigned MIN_POINTS_FOR_PARALLEL_SPLIT = 65536;
+
+#ifdef ENABLE_MT_OCTREE
+//! Subtree build job
+struct SplitJob
+{
+	TrueKdTreeBuildContext* context;
+	unsigned first;
+	unsigned count;
+	PointSetMoments moments;
+	TrueKdTree::BaseNode* result;
+};
+
+static TrueKdTree::BaseNode* SplitRange(TrueKdTreeBuildContext& context, unsigned first, unsigned count, const PointSetMoments& moments);
+
+void SplitRange_MT(SplitJob& job)
+{
+	job.result = SplitRange(*job.context, job.first, job.count, job.moments);
+}
+#endif
+
+//! Recursive split process
+/** \param context build structures
+	\param first first index of the subset (in the points permutation)
+	\param count subset size
+	\param moments subset moments (the LS plane is deduced from them)
+	\return subtree (or 0 if an error occured)
+**/
+static TrueKdTree::BaseNode* SplitRange(TrueKdTreeBuildContext& context, unsigned first, unsigned count, const PointSetMoments& moments)
+{
+	assert(count >= 3);
+	const unsigned* indexes = &context.indexes[first];
+
+	PointCoordinateType planeEquation[4];
+	if (count > 3)
+	{
+		if (!moments.computeLSPlane(count,context.origin,planeEquation))
+		{
+			//an error occured during LS plane computation?!
+			return 0;
+		}
+	}
+	else
+	{
+		//we simply compute the normal of the 3 points by cross product!
+		const CCVector3* A = context.cloud->getPointPersistentPtr(indexes[0]);
+		const CCVector3* B = context.cloud->getPointPersistentPtr(indexes[1]);
+		const CCVector3* C = context.cloud->getPointPersistentPtr(indexes[2]);
+		CCVector3 N = (*B-*A).cross(*C-*A);
+		N.normalize();
+		planeEquation[0] = N.x;
+		planeEquation[1] = N.y;
+		planeEquation[2] = N.z;
+		planeEquation[3] = A->dot(N);
+	}
+
+	//robust max distance to the plane (i.e. we ignore the 2% farthest points) and cell limits
+	PointCoordinateType* values = &context.values[first];
+	ScalarType rms = 0;
+	CCVector3 bbMin, bbMax;
+	{
+		for (unsigned i=0; i<count; ++i)
+		{
+			const CCVector3* P = context.cloud->getPointPersistentPtr(indexes[i]);
+			PointCoordinateType d = CCVector3::vdot(P->u,planeEquation) - planeEquation[3];
+			values[i] = d*d;
+			if (i != 0)
+			{
+				for (unsigned char k=0; k<3; ++k)
+				{
+					if (P->u[k] < bbMin.u[k])
+						bbMin.u[k] = P->u[k];
+					else if (P->u[k] > bbMax.u[k])
+						bbMax.u[k] = P->u[k];
+				}
+			}
+			else
+			{
+				bbMin = bbMax = *P;
+			}
+		}
+
+		if (count != 3)
+		{
+			size_t tailSize = (size_t)ceil((float)count * 0.02f);
+			std::nth_element(values, values+(count-tailSize), values+count);
+			rms = (ScalarType)sqrt(values[count-tailSize]);
+		}
+	}
+
 	//if we have less than 6 points, then the subdivision would produce a subset with less than 3 points
 	//(and we can't fit a plane on less than 3 points!)
-	bool isLeaf = (count < 6 || rms <= m_maxRMS);
+	bool isLeaf = (count < 6 || rms <= context.maxRMS);
 	if (isLeaf)
 	{
-		Leaf* leaf = new Leaf(subset);
-		memcpy(leaf->planeEq,planeEquation,sizeof(PointCoordinateType)*4);
-		leaf->rms = rms;
-		
-		return leaf;
+		return CreateLeaf(context,first,count,planeEquation,rms);
 	}
 
 	/*** proceed with a 'standard' binary partition ***/
 
-	//cell limits (dimensions)
-	CCVector3 dims;
-	{
-		CCVector3 bbMin,bbMax;
-		subset->getBoundingBox(bbMin.u,bbMax.u);
-		dims = bbMax-bbMin;
-	}
-
 	//find the largest dimension
-	uint8_t splitDim = X_DIM;
+	CCVector3 dims = bbMax-bbMin;
+	uint8_t splitDim = TrueKdTree::X_DIM;
 	if (dims.y > dims.x)
-		splitDim = Y_DIM;
+		splitDim = TrueKdTree::Y_DIM;
 	if (dims.z > dims.u[splitDim])
-		splitDim = Z_DIM;
+		splitDim = TrueKdTree::Z_DIM;
 
 	//find the median by sorting the points coordinates
-	assert(s_sortedCoordsForSplit.size() >= (size_t)count);
 	for (unsigned i=0; i<count; ++i)
 	{
-		const CCVector3* P = subset->getPoint(i);
-		s_sortedCoordsForSplit[i] = P->u[splitDim];
+		const CCVector3* P = context.cloud->getPointPersistentPtr(indexes[i]);
+		values[i] = P->u[splitDim];
 	}
-	std::sort(s_sortedCoordsForSplit.begin(),s_sortedCoordsForSplit.begin()+count);
+	std::sort(values,values+count);
 
 	unsigned splitCount = count>>1;
 	assert(splitCount >= 3); //count >= 6 (see above)
-	
+
 	//we must check that the split value is the 'first one'
-	if (s_sortedCoordsForSplit[splitCount-1] == s_sortedCoordsForSplit[splitCount])
+	if (values[splitCount-1] == values[splitCount])
 	{
-		if (s_sortedCoordsForSplit[2] != s_sortedCoordsForSplit[splitCount]) //can we go backward?
+		if (values[2] != values[splitCount]) //can we go backward?
 		{
-			while (/*splitCount>0 &&*/ s_sortedCoordsForSplit[splitCount-1] == s_sortedCoordsForSplit[splitCount])
+			while (/*splitCount>0 &&*/ values[splitCount-1] == values[splitCount])
 			{
 				assert(splitCount > 0);
 				--splitCount;
 			}
 		}
-		else if (s_sortedCoordsForSplit[count-3] != s_sortedCoordsForSplit[splitCount]) //can we go forward?
+		else if (values[count-3] != values[splitCount]) //can we go forward?
 		{
 			do
 			{
 				++splitCount;
 				assert(splitCount < count);
 			}
-			while (/*splitCount+1<count &&*/ s_sortedCoordsForSplit[splitCount] == s_sortedCoordsForSplit[splitCount-1]);
+			while (/*splitCount+1<count &&*/ values[splitCount] == values[splitCount-1]);
 		}
 		else //in fact we can't split this cell!
 		{
-			Leaf* leaf = new Leaf(subset);
-			memcpy(leaf->planeEq,planeEquation,sizeof(PointCoordinateType)*4);
-			leaf->rms = rms;
-			return leaf;
+			return CreateLeaf(context,first,count,planeEquation,rms);
 		}
 	}
 
-	PointCoordinateType splitCoord = s_sortedCoordsForSplit[splitCount]; //count > 3 --> splitCount >= 2
-
-	ReferenceCloud* leftSubset = new ReferenceCloud(subset->getAssociatedCloud());
-	ReferenceCloud* rightSubset = new ReferenceCloud(subset->getAssociatedCloud());
-	if (!leftSubset->reserve(splitCount) || !rightSubset->reserve(count-splitCount))
-	{
-		//not enough memory!
-		delete leftSubset;
-		delete rightSubset;
-		delete subset;
-		return 0;
-	}
+	PointCoordinateType splitCoord = values[splitCount]; //count > 3 --> splitCount >= 2
 
-	//fill subsets
-	for (unsigned i=0; i<count; ++i)
+	//partition the subset (the points order is preserved) and compute the moments of both halves
+	PointSetMoments leftMoments, rightMoments;
 	{
-		const CCVector3* P = subset->getPoint(i);
-		if (P->u[splitDim] < splitCoord)
-		{
-			leftSubset->addPointIndex(subset->getPointGlobalIndex(i));
-		}
-		else
+		unsigned* permutation = &context.indexes[first];
+		unsigned* rightIndexes = &context.partitionBuffer[first];
+		unsigned leftCount = 0, rightCount = 0;
+		for (unsigned i=0; i<count; ++i)
 		{
-			rightSubset->addPointIndex(subset->getPointGlobalIndex(i));
+			unsigned index = permutation[i];
+			const CCVector3* P = context.cloud->getPointPersistentPtr(index);
+			CCVector3d Pd(P->x-context.origin.x, P->y-context.origin.y, P->z-context.origin.z);
+			if (P->u[splitDim] < splitCoord)
+			{
+				permutation[leftCount++] = index;
+				leftMoments.add(Pd);
+			}
+			else
+			{
+				rightIndexes[rightCount++] = index;
+				rightMoments.add(Pd);
+			}
 		}
+		assert(leftCount == splitCount);
+		memcpy(permutation+leftCount,rightIndexes,sizeof(unsigned)*rightCount);
 	}
 
-	//release some memory before the next incursion!
-	delete subset;
-	subset = 0;
+	//process subsets (in parallel for big ones)
+	TrueKdTree::BaseNode* leftChild = 0;
+	TrueKdTree::BaseNode* rightChild = 0;
+#ifdef ENABLE_MT_OCTREE
+	if (count >= MIN_POINTS_FOR_PARALLEL_SPLIT)
+	{
+		std::vector<SplitJob> jobs(2);
+		jobs[0].context = jobs[1].context = &context;
+		jobs[0].first = first;
+		jobs[0].count = splitCount;
+		jobs[0].moments = leftMoments;
+		jobs[1].first = first+splitCount;
+		jobs[1].count = count-splitCount;
+		jobs[1].moments = rightMoments;
+		jobs[0].result = jobs[1].result = 0;
+
+		QtConcurrent::blockingMap(jobs, SplitRange_MT);
+
+		leftChild = jobs[0].result;
+		rightChild = jobs[1].result;
+	}
+	else
+#endif
+	{
+		leftChild = SplitRange(context,first,splitCount,leftMoments);
+		if (leftChild)
+			rightChild = SplitRange(context,first+splitCount,count-splitCount,rightMoments);
+	}
 
-	//process subsets (if any)
-	BaseNode* leftChild = split(leftSubset);
-	if (!leftChild)
-		return 0;
-	BaseNode* rightChild = split(rightSubset);
-	if (!rightChild)
+	if (!leftChild || !rightChild)
 	{
-		delete leftChild;
+		if (leftChild)
+			delete leftChild;
+		if (rightChild)
+			delete rightChild;
 		return 0;
 	}
 
-	Node* node = new Node;
+	TrueKdTree::Node* node = new TrueKdTree::Node;
 	node->leftChild = leftChild;
 	leftChild->parent = node;
 	node->rightChild = rightChild;
@@ -202,11 +389,20 @@ bool TrueKdTree::build(double maxRMS, GenericProgressCallback* progressCb/*=0*/)
 	{
 		return false;
 	}
+	else if (count < 3) //we can't fit a plane on less than 3 points!
+	{
+		return false;
+	}
 
-	//structures used to sort the points along the 3 dimensions
+	//build structures
+	TrueKdTreeBuildContext context;
+	context.cloud = m_associatedCloud;
+	context.maxRMS = maxRMS;
 	try
 	{
-		s_sortedCoordsForSplit.resize(count);
+		context.indexes.resize(count);
+		context.partitionBuffer.resize(count);
+		context.values.resize(count);
 	}
 	catch(std::bad_alloc)
 	{
@@ -214,21 +410,30 @@ bool TrueKdTree::build(double maxRMS, GenericProgressCallback* progressCb/*=0*/)
 		return false;
 	}
 
-	//initial 'subset' to start recursion
-	ReferenceCloud* subset = new ReferenceCloud(m_associatedCloud);
-	if (!subset->addPointIndex(0,count))
+	//initial 'subset' (all points) and its moments
+	PointSetMoments moments;
 	{
-		//not enough memory
-		delete subset;
-		return false;
+		CCVector3d Psum(0,0,0);
+		for (unsigned i=0; i<count; ++i)
+		{
+			const CCVector3* P = m_associatedCloud->getPointPersistentPtr(i);
+			Psum.x += P->x;
+			Psum.y += P->y;
+			Psum.z += P->z;
+		}
+		context.origin = Psum / (double)count;
+
+		for (unsigned i=0; i<count; ++i)
+		{
+			context.indexes[i] = i;
+			const CCVector3* P = m_associatedCloud->getPointPersistentPtr(i);
+			moments.add(CCVector3d(P->x-context.origin.x, P->y-context.origin.y, P->z-context.origin.z));
+		}
 	}
 
 	//launch recursive process
 	m_maxRMS = maxRMS;
-	m_root = split(subset);
-
-	//clear static structure
-	s_sortedCoordsForSplit.clear();
+	m_root = SplitRange(context,0,count,moments);
 
 	return (m_root != 0);
 }
@@ -0,0 +1,272 @@
+//##########################################################################
+//#                                                                        #
+//#                               CCLIB                                    #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU Library General Public License as       #
+//#  published by the Free Software Foundation; version 2 of the License.  #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: EDF R&D / TELECOM ParisTech (ENST-TSI)             #
+//#                                                                        #
+//##########################################################################
+
+//Accuracy check of the closed form eigen decomposition of SymmetricMatrix3Tpl
+//(compared with the generic Jacobi method of MatrixTpl). Run with 'make check'.
+
+#include "Matrix.h"
+
+//system
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+
+using namespace CCLib;
+
+//! Number of random matrices per test case
+static const unsigned s_trials = 20000;
+//! Tolerance (relative to the biggest eigen value)
+static const double s_tolerance = 1.0e-6;
+//! Minimum (relative) gap between eigen values to compare the eigen vectors with the Jacobi ones
+static const double s_minGap = 1.0e-3;
+
+//! Test cases (eigen values structure)
+enum CHECK_CASES {	RANDOM_EIGEN_VALUES,		/**< distinct eigen values **/
+					DOUBLE_EIGEN_VALUE,			/**< two equal eigen values **/
+					TRIPLE_EIGEN_VALUE,			/**< three equal eigen values **/
+					NEAR_NULL_EIGEN_VALUE,		/**< one (nearly) null eigen value (planar points) **/
+					TWO_NEAR_NULL_EIGEN_VALUES,	/**< two (nearly) null eigen values (linear points) **/
+					CHECK_CASES_COUNT
+};
+
+static const char* s_caseNames[CHECK_CASES_COUNT] = {	"random",
+														"double",
+														"triple",
+														"near-null",
+														"two near-null" };
+
+//! Returns a random value in [-1;1]
+static double Random()
+{
+	return 2.0*(double)rand()/(double)RAND_MAX - 1.0;
+}
+
+//! Generates a random orthonormal basis (as rows)
+static void RandomBasis(double Q[3][3])
+{
+	double n = 0;
+	do
+	{
+		for (unsigned i=0; i<3; ++i)
+			Q[0][i] = Random();
+		n = sqrt(Q[0][0]*Q[0][0] + Q[0][1]*Q[0][1] + Q[0][2]*Q[0][2]);
+	}
+	while (n < 0.1);
+	for (unsigned i=0; i<3; ++i)
+		Q[0][i] /= n;
+
+	do
+	{
+		for (unsigned i=0; i<3; ++i)
+			Q[1][i] = Random();
+		double d = Q[0][0]*Q[1][0] + Q[0][1]*Q[1][1] + Q[0][2]*Q[1][2];
+		for (unsigned i=0; i<3; ++i)
+			Q[1][i] -= d*Q[0][i];
+		n = sqrt(Q[1][0]*Q[1][0] + Q[1][1]*Q[1][1] + Q[1][2]*Q[1][2]);
+	}
+	while (n < 0.1);
+	for (unsigned i=0; i<3; ++i)
+		Q[1][i] /= n;
+
+	Q[2][0] = Q[0][1]*Q[1][2] - Q[0][2]*Q[1][1];
+	Q[2][1] = Q[0][2]*Q[1][0] - Q[0][0]*Q[1][2];
+	Q[2][2] = Q[0][0]*Q[1][1] - Q[0][1]*Q[1][0];
+}
+
+//! Generates a covariance matrix with a given eigen values structure
+/** The covariance is computed from random points (uniform distribution
+	scaled along the axes of a random basis), as Neighbourhood does.
+**/
+static void RandomCovariance(CHECK_CASES testCase, SymmetricMatrix3d& cov)
+{
+	double scales[3] = { 1.0+9.0*fabs(Random()), 1.0+9.0*fabs(Random()), 1.0+9.0*fabs(Random()) };
+	switch (testCase)
+	{
+	case DOUBLE_EIGEN_VALUE:
+		scales[1] = scales[0];
+		break;
+	case TRIPLE_EIGEN_VALUE:
+		scales[1] = scales[2] = scales[0];
+		break;
+	case NEAR_NULL_EIGEN_VALUE:
+		scales[2] = (rand() & 1 ? 0.0 : 1.0e-7*scales[0]);
+		break;
+	case TWO_NEAR_NULL_EIGEN_VALUES:
+		scales[1] = 1.0e-7*scales[0];
+		scales[2] = (rand() & 1 ? 0.0 : 1.0e-8*scales[0]);
+		break;
+	default:
+		break;
+	}
+
+	//the equal eigen values cases are built directly (random points wouldn't give exactly equal ones)
+	double Q[3][3];
+	RandomBasis(Q);
+	if (testCase == DOUBLE_EIGEN_VALUE || testCase == TRIPLE_EIGEN_VALUE)
+	{
+		for (unsigned l=0; l<3; ++l)
+			for (unsigned c=l; c<3; ++c)
+			{
+				double v = 0;
+				for (unsigned k=0; k<3; ++k)
+					v += scales[k]*scales[k]*Q[k][l]*Q[k][c];
+				cov.m_values[l][c] = cov.m_values[c][l] = v;
+			}
+		return;
+	}
+
+	static const unsigned s_pointCount = 32;
+	double points[s_pointCount][3];
+	double G[3] = {0,0,0};
+	for (unsigned i=0; i<s_pointCount; ++i)
+	{
+		double u[3] = { scales[0]*Random(), scales[1]*Random(), scales[2]*Random() };
+		for (unsigned k=0; k<3; ++k)
+		{
+			points[i][k] = 100.0 + u[0]*Q[0][k] + u[1]*Q[1][k] + u[2]*Q[2][k];
+			G[k] += points[i][k];
+		}
+	}
+	for (unsigned k=0; k<3; ++k)
+		G[k] /= s_pointCount;
+
+	for (unsigned l=0; l<3; ++l)
+		for (unsigned c=l; c<3; ++c)
+		{
+			double v = 0;
+			for (unsigned i=0; i<s_pointCount; ++i)
+				v += (points[i][l]-G[l])*(points[i][c]-G[c]);
+			cov.m_values[l][c] = cov.m_values[c][l] = v/s_pointCount;
+		}
+}
+
+//! Checks the eigen decomposition of a matrix
+/** \return the maximum error (relative to the biggest eigen value)
+**/
+static double CheckMatrix(SymmetricMatrix3d& S, bool& jacobiCompared)
+{
+	jacobiCompared = false;
+
+	SymmetricMatrix3d A = S;
+	if (!S.computeEigenValuesAndVectors())
+		return 1.0;
+
+	double maxEigenValue = std::max(S.eigenValues[0],std::max(S.eigenValues[1],S.eigenValues[2]));
+	if (maxEigenValue <= 0)
+		return 1.0;
+
+	double maxError = 0;
+
+	//residuals (A.v = lambda.v) and orthonormality
+	for (unsigned k=0; k<3; ++k)
+	{
+		double v[3], w[3];
+		double lambda = S.getEigenValueAndVector(k,v);
+		double r = 0;
+		for (unsigned i=0; i<3; ++i)
+		{
+			double av = A.m_values[i][0]*v[0] + A.m_values[i][1]*v[1] + A.m_values[i][2]*v[2];
+			r += (av-lambda*v[i])*(av-lambda*v[i]);
+		}
+		maxError = std::max(maxError,sqrt(r)/maxEigenValue);
+
+		for (unsigned j=k; j<3; ++j)
+		{
+			S.getEigenValueAndVector(j,w);
+			double d = v[0]*w[0] + v[1]*w[1] + v[2]*w[2];
+			maxError = std::max(maxError,fabs(d - (j == k ? 1.0 : 0.0)));
+		}
+	}
+
+	//comparison with the Jacobi method
+	SquareMatrixd J = A.toSquareMatrix().computeJacobianEigenValuesAndVectors();
+	if (!J.isValid())
+		return maxError;
+	jacobiCompared = true;
+
+	double e1[3], e2[3];
+	for (unsigned k=0; k<3; ++k)
+	{
+		e1[k] = S.eigenValues[k];
+		e2[k] = J.getEigenValueAndVector(k);
+	}
+	std::sort(e1,e1+3);
+	std::sort(e2,e2+3);
+	for (unsigned k=0; k<3; ++k)
+		maxError = std::max(maxError,fabs(e1[k]-e2[k])/maxEigenValue);
+
+	//eigen vectors are only unique for well separated eigen values
+	double v1[3], v2[3];
+	if (e1[1]-e1[0] > s_minGap*maxEigenValue)
+	{
+		S.getMinEigenValueAndVector(v1);
+		J.getMinEigenValueAndVector(v2);
+		maxError = std::max(maxError,1.0-fabs(v1[0]*v2[0] + v1[1]*v2[1] + v1[2]*v2[2]));
+	}
+	if (e1[2]-e1[1] > s_minGap*maxEigenValue)
+	{
+		S.getMaxEigenValueAndVector(v1);
+		J.getMaxEigenValueAndVector(v2);
+		maxError = std::max(maxError,1.0-fabs(v1[0]*v2[0] + v1[1]*v2[1] + v1[2]*v2[2]));
+	}
+
+	return maxError;
+}
+
+int main(int argc, char** argv)
+{
+	srand(argc > 1 ? atoi(argv[1]) : 1);
+
+	bool success = true;
+	for (unsigned c=0; c<CHECK_CASES_COUNT; ++c)
+	{
+		double maxError = 0;
+		unsigned failures = 0;
+		unsigned jacobiCount = 0;
+		for (unsigned i=0; i<s_trials; ++i)
+		{
+			SymmetricMatrix3d S;
+			RandomCovariance(static_cast<CHECK_CASES>(c),S);
+
+			bool jacobiCompared = false;
+			double error = CheckMatrix(S,jacobiCompared);
+			maxError = std::max(maxError,error);
+			if (error > s_tolerance)
+				++failures;
+			if (jacobiCompared)
+				++jacobiCount;
+		}
+
+		printf("[%s] %u matrices (%u compared with Jacobi): max error = %g, failures = %u\n",s_caseNames[c],s_trials,jacobiCount,maxError,failures);
+		if (failures != 0)
+			success = false;
+	}
+
+	//special case: null matrix
+	{
+		SymmetricMatrix3d S;
+		if (!S.computeEigenValuesAndVectors() || S.eigenValues[0] != 0 || S.eigenValues[1] != 0 || S.eigenValues[2] != 0)
+		{
+			printf("[null] failed\n");
+			success = false;
+		}
+	}
+
+	printf(success ? "SymmetricMatrix3 check: OK\n" : "SymmetricMatrix3 check: FAILED\n");
+	return (success ? EXIT_SUCCESS : EXIT_FAILURE);
+}
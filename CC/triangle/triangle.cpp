@@ -629,9 +629,8 @@ REAL ccwerrboundA, ccwerrboundB, ccwerrboundC;
 REAL iccerrboundA, iccerrboundB, iccerrboundC;
 REAL o3derrboundA, o3derrboundB, o3derrboundC;
 
-/* Random number seed is not constant, but I've made it global anyway.       */
-
-unsigned long randomseed;                     /* Current random number seed. */
+/* The random number seed is stored in the mesh structure (so that several   */
+/*   meshes can be processed concurrently).                                  */
 
 
 /* Mesh data structure.  Triangle operates on only one mesh, but the mesh    */
@@ -689,6 +688,7 @@ struct mesh {
   int checkquality;                  /* Has quality triangulation begun yet? */
   int readnodefile;                           /* Has a .node file been read? */
   long samples;              /* Number of random samples for point location. */
+  unsigned long randomseed;                   /* Current random number seed. */
 
   long incirclecount;                 /* Number of incircle tests performed. */
   long counterclockcount;     /* Number of counterclockwise tests performed. */
@@ -4657,39 +4657,15 @@ void makesubseg(struct mesh *m, struct osub *newsubseg)
 /*                                                                           */
 /*****************************************************************************/
 
-void exactinit()
+/* The constants are only computed once: several meshes may be processed    */
+/*   concurrently (the FPU control word is set by each call, as it is        */
+/*   specific to each thread).                                               */
+
+static int exactconstantsinit()
 {
   REAL half;
   REAL check, lastcheck;
   int every_other;
-#ifdef LINUX
-  int cword;
-#endif /* LINUX */
-
-#ifdef CPU86
-#ifdef SINGLE
-  //DGM: MSDN says "On the x64 architecture, changing the floating point precision is not supported.
-  //If the precision control mask is used on that platform, an assertion and the invalid parameter
-  //handler is invoked, as described in Parameter Validation."
-#ifndef _M_AMD64
-  _control87(_PC_24, _MCW_PC); /* Set FPU control word for single precision. */
-#endif
-#else /* not SINGLE */
-  _control87(_PC_53, _MCW_PC); /* Set FPU control word for double precision. */
-#endif /* not SINGLE */
-#endif /* CPU86 */
-#ifdef LINUX
-#ifdef SINGLE
-  /*  cword = 4223; */
-  cword = 4210;                 /* set FPU control word for single precision */
-#else /* not SINGLE */
-  /*  cword = 4735; */
-  cword = 4722;                 /* set FPU control word for double precision */
-#endif /* not SINGLE */
-#ifndef __APPLE__
-    _FPU_SETCW(cword);
-#endif
-#endif /* LINUX */
 
   every_other = 1;
   half = 0.5;
@@ -4721,6 +4697,44 @@ void exactinit()
   o3derrboundA = (7.0f + 56.0f * epsilon) * epsilon;
   o3derrboundB = (3.0f + 28.0f * epsilon) * epsilon;
   o3derrboundC = (26.0f + 288.0f * epsilon) * epsilon * epsilon;
+
+  return 1;
+}
+
+void exactinit()
+{
+#ifdef LINUX
+  int cword;
+#endif /* LINUX */
+
+#ifdef CPU86
+#ifdef SINGLE
+  //DGM: MSDN says "On the x64 architecture, changing the floating point precision is not supported.
+  //If the precision control mask is used on that platform, an assertion and the invalid parameter
+  //handler is invoked, as described in Parameter Validation."
+#ifndef _M_AMD64
+  _control87(_PC_24, _MCW_PC); /* Set FPU control word for single precision. */
+#endif
+#else /* not SINGLE */
+  _control87(_PC_53, _MCW_PC); /* Set FPU control word for double precision. */
+#endif /* not SINGLE */
+#endif /* CPU86 */
+#ifdef LINUX
+#ifdef SINGLE
+  /*  cword = 4223; */
+  cword = 4210;                 /* set FPU control word for single precision */
+#else /* not SINGLE */
+  /*  cword = 4735; */
+  cword = 4722;                 /* set FPU control word for double precision */
+#endif /* not SINGLE */
+#ifndef __APPLE__
+    _FPU_SETCW(cword);
+#endif
+#endif /* LINUX */
+
+  /* Thread-safe initialization (function-local static). */
+  static const int exactconstantsinitialized = exactconstantsinit();
+  (void) exactconstantsinitialized;
 }
 
 /*****************************************************************************/
@@ -5024,7 +5038,9 @@ REAL counterclockwise(struct mesh *m, struct behavior *b,
 /*                                                                           */
 /*  incircle()   Return a positive value if the point pd lies inside the     */
 /*               circle passing through pa, pb, and pc; a negative value if  */
-/*               it lies outside; and zero if the four points are cocircular.*/
+/*               it lies outside.  Ties between cocircular points are        */
+/*               broken by incirclesos(), so zero is only returned for       */
+/*               fully degenerate (collinear) configurations.                */
 /*               The points pa, pb, and pc must be in counterclockwise       */
 /*               order, or the sign of the result will be reversed.          */
 /*                                                                           */
@@ -5608,6 +5624,61 @@ REAL incircleadapt(vertex pa, vertex pb, vertex pc, vertex pd, REAL permanent)
   return finnow[finlength - 1];
 }
 
+/*****************************************************************************/
+/*                                                                           */
+/*  incirclesos()   Break the tie of four cocircular points with a symbolic  */
+/*                  perturbation ("Simulation of Simplicity").               */
+/*                                                                           */
+/*  Each vertex is lifted by an infinitesimal that grows with its rank in    */
+/*  the lexicographic (x, then y) order.  The sign of the perturbed          */
+/*  determinant is the sign of the first nonzero orientation term, taken     */
+/*  from the highest ranked vertex down.  The order only depends on the      */
+/*  coordinates, so every triangulation of a subset of the same vertices     */
+/*  breaks the ties the same way, and the Delaunay triangulation is unique.  */
+/*                                                                           */
+/*****************************************************************************/
+
+REAL incirclesos(struct mesh *m, struct behavior *b,
+                 vertex pa, vertex pb, vertex pc, vertex pd)
+{
+  vertex sorted[4];
+  vertex swapvertex;
+  REAL term;
+  int i, j;
+
+  sorted[0] = pa;
+  sorted[1] = pb;
+  sorted[2] = pc;
+  sorted[3] = pd;
+  for (i = 1; i < 4; i++) {
+    for (j = i; (j > 0) &&
+                ((sorted[j][0] < sorted[j - 1][0]) ||
+                 ((sorted[j][0] == sorted[j - 1][0]) &&
+                  (sorted[j][1] < sorted[j - 1][1]))); j--) {
+      swapvertex = sorted[j];
+      sorted[j] = sorted[j - 1];
+      sorted[j - 1] = swapvertex;
+    }
+  }
+
+  for (i = 3; i >= 0; i--) {
+    if (sorted[i] == pa) {
+      term = counterclockwise(m, b, pd, pb, pc);
+    } else if (sorted[i] == pb) {
+      term = counterclockwise(m, b, pa, pd, pc);
+    } else if (sorted[i] == pc) {
+      term = counterclockwise(m, b, pa, pb, pd);
+    } else {
+      term = -counterclockwise(m, b, pa, pb, pc);
+    }
+    if (term != 0.0) {
+      return term;
+    }
+  }
+
+  return 0.0;
+}
+
 REAL incircle(struct mesh *m, struct behavior *b,
               vertex pa, vertex pb, vertex pc, vertex pd)
 {
@@ -5654,7 +5725,11 @@ REAL incircle(struct mesh *m, struct behavior *b,
     return det;
   }
 
-  return incircleadapt(pa, pb, pc, pd, permanent);
+  det = incircleadapt(pa, pb, pc, pd, permanent);
+  if (det == 0.0) {
+    return incirclesos(m, b, pa, pb, pc, pd);
+  }
+  return det;
 }
 
 /*****************************************************************************/
@@ -6304,7 +6379,7 @@ void triangleinit(struct mesh *m)
   m->checkquality = 0;     /* The quality triangulation stage has not begun. */
   m->incirclecount = m->counterclockcount = m->orient3dcount = 0;
   m->hyperbolacount = m->circletopcount = m->circumcentercount = 0;
-  randomseed = 1;
+  m->randomseed = 1;
 
   exactinit();                     /* Initialize exact arithmetic constants. */
 }
@@ -6319,10 +6394,10 @@ void triangleinit(struct mesh *m)
 /*                                                                           */
 /*****************************************************************************/
 
-unsigned long randomnation(unsigned int choices)
+unsigned long randomnation(struct mesh *m, unsigned int choices)
 {
-  randomseed = (randomseed * 1366l + 150889l) % 714025l;
-  return randomseed / (714025l / choices + 1);
+  m->randomseed = (m->randomseed * 1366l + 150889l) % 714025l;
+  return m->randomseed / (714025l / choices + 1);
 }
 
 /********* Mesh quality testing routines begin here                  *********/
@@ -7295,7 +7370,7 @@ enum locateresult locate(struct mesh *m, struct behavior *b,
     /* Choose `samplesleft' randomly sampled triangles in this block. */
     do {
       sampletri.tri = (triangle *) (firsttri +
-                                    (randomnation((unsigned int) population) *
+                                    (randomnation(m, (unsigned int) population) *
                                      m->triangles.itembytes));
       if (!deadtri(sampletri.tri)) {
         org(sampletri, torg);
@@ -8698,7 +8773,7 @@ void undovertex(struct mesh *m, struct behavior *b)
 /*                                                                           */
 /*****************************************************************************/
 
-void vertexsort(vertex *sortarray, int arraysize)
+void vertexsort(struct mesh *m, vertex *sortarray, int arraysize)
 {
   int left, right;
   int pivot;
@@ -8717,7 +8792,7 @@ void vertexsort(vertex *sortarray, int arraysize)
     return;
   }
   /* Choose a random pivot to split the array. */
-  pivot = (int) randomnation((unsigned int) arraysize);
+  pivot = (int) randomnation(m, (unsigned int) arraysize);
   pivotx = sortarray[pivot][0];
   pivoty = sortarray[pivot][1];
   /* Split the array. */
@@ -8745,11 +8820,11 @@ void vertexsort(vertex *sortarray, int arraysize)
   }
   if (left > 1) {
     /* Recursively sort the left subset. */
-    vertexsort(sortarray, left);
+    vertexsort(m, sortarray, left);
   }
   if (right < arraysize - 2) {
     /* Recursively sort the right subset. */
-    vertexsort(&sortarray[right + 1], arraysize - right - 1);
+    vertexsort(m, &sortarray[right + 1], arraysize - right - 1);
   }
 }
 
@@ -8765,7 +8840,7 @@ void vertexsort(vertex *sortarray, int arraysize)
 /*                                                                           */
 /*****************************************************************************/
 
-void vertexmedian(vertex *sortarray, int arraysize, int median, int axis)
+void vertexmedian(struct mesh *m, vertex *sortarray, int arraysize, int median, int axis)
 {
   int left, right;
   int pivot;
@@ -8784,7 +8859,7 @@ void vertexmedian(vertex *sortarray, int arraysize, int median, int axis)
     return;
   }
   /* Choose a random pivot to split the array. */
-  pivot = (int) randomnation((unsigned int) arraysize);
+  pivot = (int) randomnation(m, (unsigned int) arraysize);
   pivot1 = sortarray[pivot][axis];
   pivot2 = sortarray[pivot][1 - axis];
   /* Split the array. */
@@ -8814,11 +8889,11 @@ void vertexmedian(vertex *sortarray, int arraysize, int median, int axis)
   /*   conditionals is true.                             */
   if (left > median) {
     /* Recursively shuffle the left subset. */
-    vertexmedian(sortarray, left, median, axis);
+    vertexmedian(m, sortarray, left, median, axis);
   }
   if (right < median - 1) {
     /* Recursively shuffle the right subset. */
-    vertexmedian(&sortarray[right + 1], arraysize - right - 1,
+    vertexmedian(m, &sortarray[right + 1], arraysize - right - 1,
                  median - right - 1, axis);
   }
 }
@@ -8834,7 +8909,7 @@ void vertexmedian(vertex *sortarray, int arraysize, int median, int axis)
 /*                                                                           */
 /*****************************************************************************/
 
-void alternateaxes(vertex *sortarray, int arraysize, int axis)
+void alternateaxes(struct mesh *m, vertex *sortarray, int arraysize, int axis)
 {
   int divider;
 
@@ -8845,13 +8920,13 @@ void alternateaxes(vertex *sortarray, int arraysize, int axis)
     axis = 0;
   }
   /* Partition with a horizontal or vertical cut. */
-  vertexmedian(sortarray, arraysize, divider, axis);
+  vertexmedian(m, sortarray, arraysize, divider, axis);
   /* Recursively partition the subsets with a cross cut. */
   if (arraysize - divider >= 2) {
     if (divider >= 2) {
-      alternateaxes(sortarray, divider, 1 - axis);
+      alternateaxes(m, sortarray, divider, 1 - axis);
     }
-    alternateaxes(&sortarray[divider], arraysize - divider, 1 - axis);
+    alternateaxes(m, &sortarray[divider], arraysize - divider, 1 - axis);
   }
 }
 
@@ -9430,7 +9505,7 @@ long divconqdelaunay(struct mesh *m, struct behavior *b)
     sortarray[i] = vertextraverse(m);
   }
   /* Sort the vertices. */
-  vertexsort(sortarray, m->invertices);
+  vertexsort(m, sortarray, m->invertices);
   /* Discard duplicate vertices, which can really mess up the algorithm. */
   i = 0;
   for (j = 1; j < m->invertices; j++) {
@@ -9454,9 +9529,9 @@ long divconqdelaunay(struct mesh *m, struct behavior *b)
     divider = i >> 1;
     if (i - divider >= 2) {
       if (divider >= 2) {
-        alternateaxes(sortarray, divider, 1);
+        alternateaxes(m, sortarray, divider, 1);
       }
-      alternateaxes(&sortarray[divider], i - divider, 1);
+      alternateaxes(m, &sortarray[divider], i - divider, 1);
     }
   }
 
@@ -10195,7 +10270,7 @@ long sweeplinedelaunay(struct mesh *m, struct behavior *b)
       lnext(fliptri, righttri);
       sym(lefttri, farlefttri);
 
-      if (randomnation(SAMPLERATE) == 0) {
+      if (randomnation(m, SAMPLERATE) == 0) {
         symself(fliptri);
         dest(fliptri, leftvertex);
         apex(fliptri, midvertex);
@@ -10252,9 +10327,9 @@ long sweeplinedelaunay(struct mesh *m, struct behavior *b)
           otricopy(lefttri, bottommost);
         }
 
-        if (randomnation(SAMPLERATE) == 0) {
+        if (randomnation(m, SAMPLERATE) == 0) {
           splayroot = splayinsert(m, splayroot, &lefttri, nextvertex);
-        } else if (randomnation(SAMPLERATE) == 0) {
+        } else if (randomnation(m, SAMPLERATE) == 0) {
           lnext(righttri, inserttri);
           splayroot = splayinsert(m, splayroot, &inserttri, nextvertex);
         }
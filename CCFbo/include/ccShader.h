@@ -44,6 +44,9 @@ public:
     **/
     virtual bool loadProgram(const char *vertShaderFile, const char *fragShaderFile);
 
+    //! Creates program from one or two shader sources (in memory)
+    virtual bool loadProgramFromSource(const char *vertShaderSource, const char *fragShaderSource);
+
     virtual void reset();
 
     virtual void start();
@@ -86,6 +89,9 @@ protected:
     //! Loads a shader from a file
     static GLuint LoadShader(GLenum type, const char *filename);
 
+    //! Compiles a shader from its source code
+    static GLuint CompileShader(GLenum type, const char *source);
+
     //! Bufferizes a shader file in memory
     static char* ReadShaderFile(const char *filename);
 
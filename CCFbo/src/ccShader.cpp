@@ -139,6 +139,60 @@ bool ccShader::loadProgram(const char *vertexShaderFile, const char *pixelShader
     return true;
 }
 
+bool ccShader::loadProgramFromSource(const char *vertexShaderSource, const char *pixelShaderSource)
+{
+    assert(vertexShaderSource || pixelShaderSource);
+
+    reset();
+    assert(_prog == 0);
+
+    //GL ids
+    GLuint vs = 0, ps = 0;
+
+    //we compile the shaders
+    if(vertexShaderSource)
+    {
+        vs = CompileShader(GL_VERTEX_SHADER, vertexShaderSource);
+        if(!vs)
+            return false;
+    }
+    if(pixelShaderSource)
+    {
+        ps = CompileShader(GL_FRAGMENT_SHADER, pixelShaderSource);
+        if(!ps)
+        {
+            if(glIsShader(vs))
+                glDeleteShader(vs);
+            return false;
+        }
+    }
+
+    //we create an empty GL program and link the shaders alltogether
+    _prog = glCreateProgram();
+    if(vs)
+        glAttachShader(_prog, vs);
+    if(ps)
+        glAttachShader(_prog, ps);
+    glLinkProgram(_prog);
+
+    //we check for success
+    GLint linkStatus = GL_TRUE;
+    glGetProgramiv(_prog, GL_LINK_STATUS, &linkStatus);
+    if(linkStatus != GL_TRUE)
+    {
+        glDeleteProgram(_prog);
+        _prog = 0;
+    }
+
+    // even if program creation was successful, we don't need the shaders anymore
+    if(vs)
+        glDeleteShader(vs);
+    if(ps)
+        glDeleteShader(ps);
+
+    return (_prog != 0);
+}
+
 char* ccShader::ReadShaderFile(const char *filename)
 {
     //we try to open the ASCII file (containing the "program" source code)
@@ -175,29 +229,33 @@ char* ccShader::ReadShaderFile(const char *filename)
 
 GLuint ccShader::LoadShader(GLenum type, const char *filename)
 {
-    //Shader creation
-    GLuint shader = glCreateShader(type);
-    if(shader == 0)
-    {
-        //ccConsole::Error("Can't create shader!");
-        return 0;
-    }
-
     //Program loading
     char *src = ReadShaderFile(filename);
     if(!src)
-    {
-        glDeleteShader(shader);
         return 0;
-    }
 
-    glShaderSource(shader, 1, (const GLchar**)&src, NULL);
-    glCompileShader(shader);
+    GLuint shader = CompileShader(type, src);
 
     //we don't need the program code anymore
     delete[] src;
     src=0;
 
+    return shader;
+}
+
+GLuint ccShader::CompileShader(GLenum type, const char *source)
+{
+    //Shader creation
+    GLuint shader = glCreateShader(type);
+    if(shader == 0)
+    {
+        //ccConsole::Error("Can't create shader!");
+        return 0;
+    }
+
+    glShaderSource(shader, 1, (const GLchar**)&source, NULL);
+    glCompileShader(shader);
+
     //we must check compilation result
     GLint status = GL_TRUE;
     glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
@@ -217,7 +275,7 @@ GLuint ccShader::LoadShader(GLenum type, const char *filename)
         memset(log, 0, logSize+1);
 
         glGetShaderInfoLog(shader, logSize, &logSize, log);
-        //ccConsole::Error("Can't compile shader (file:'%s').\nLog: %s",filename,log);
+        //ccConsole::Error("Can't compile shader.\nLog: %s",log);
 
         //free memory
         delete[] log;
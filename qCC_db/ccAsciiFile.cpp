@@ -0,0 +1,537 @@
+//##########################################################################
+//#                                                                        #
+//#                            CLOUDCOMPARE                                #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 of the License.               #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: EDF R&D / TELECOM ParisTech (ENST-TSI)             #
+//#                                                                        #
+//##########################################################################
+
+#include "ccAsciiFile.h"
+
+//Local
+#include "ccPointCloud.h"
+#include "ccScalarField.h"
+#include "ccLog.h"
+
+//CCLib
+#include <DgmOctree.h> //for ENABLE_MT_OCTREE
+
+//system
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <assert.h>
+#include <vector>
+#include <algorithm>
+
+//! Powers of 10 that can be exactly represented by a double
+static const double s_exactPowersOf10[23] = {	1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+												1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+												1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+static inline bool IsSeparator(char c)
+{
+	return (c == ' ' || c == '\t' || c == ',' || c == ';' || c == '\r');
+}
+
+static inline bool IsDigit(char c)
+{
+	return (c >= '0' && c <= '9');
+}
+
+//! Parses a value with strtod (slow path)
+static bool ParseValueWithStrtod(const char*& p, const char* end, double& value)
+{
+	const char* tokenEnd = p;
+	while (tokenEnd < end && !IsSeparator(*tokenEnd) && *tokenEnd != '\n')
+		++tokenEnd;
+
+	//the buffer is not null-terminated
+	char buffer[128];
+	size_t length = static_cast<size_t>(tokenEnd-p);
+	if (length == 0 || length >= sizeof(buffer))
+		return false;
+	memcpy(buffer,p,length);
+	buffer[length] = 0;
+
+	char* stop = 0;
+	value = strtod(buffer,&stop);
+	if (stop != buffer+length)
+		return false;
+
+	p = tokenEnd;
+	return true;
+}
+
+bool ccAsciiFile::ParseValue(const char*& p, const char* end, double& value)
+{
+	const char* q = p;
+
+	bool negative = false;
+	if (q < end && (*q == '-' || *q == '+'))
+	{
+		negative = (*q == '-');
+		++q;
+	}
+
+	//we keep (at most) 19 significant digits
+	uint64_t mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+	bool anyDigit = false;
+
+	//integer part
+	for (; q < end && IsDigit(*q); ++q)
+	{
+		anyDigit = true;
+		unsigned d = static_cast<unsigned>(*q - '0');
+		if (digits < 19)
+		{
+			mantissa = mantissa*10 + d;
+			if (mantissa != 0)
+				++digits;
+		}
+		else
+		{
+			++exponent;
+		}
+	}
+
+	//decimal part
+	if (q < end && *q == '.')
+	{
+		for (++q; q < end && IsDigit(*q); ++q)
+		{
+			anyDigit = true;
+			unsigned d = static_cast<unsigned>(*q - '0');
+			if (digits < 19)
+			{
+				mantissa = mantissa*10 + d;
+				if (mantissa != 0)
+					++digits;
+				--exponent;
+			}
+		}
+	}
+
+	if (!anyDigit)
+	{
+		//nan, inf, etc.
+		return ParseValueWithStrtod(p,end,value);
+	}
+
+	//exponent
+	if (q < end && (*q == 'e' || *q == 'E'))
+	{
+		++q;
+		bool negativeExp = false;
+		if (q < end && (*q == '-' || *q == '+'))
+		{
+			negativeExp = (*q == '-');
+			++q;
+		}
+		if (q == end || !IsDigit(*q))
+			return false;
+		int e = 0;
+		for (; q < end && IsDigit(*q); ++q)
+			if (e < 100000)
+				e = e*10 + (*q - '0');
+		exponent += (negativeExp ? -e : e);
+	}
+
+	//fast path: the mantissa and the power of 10 are exact doubles,
+	//so that the result of the (single) operation is correctly rounded
+	if (digits <= 15 && exponent >= -22 && exponent <= 22)
+	{
+		double v = static_cast<double>(mantissa);
+		v = (exponent < 0 ? v / s_exactPowersOf10[-exponent] : v * s_exactPowersOf10[exponent]);
+		value = (negative ? -v : v);
+		p = q;
+		return true;
+	}
+
+	return ParseValueWithStrtod(p,end,value);
+}
+
+int ccAsciiFile::ParseLine(const char* p, const char* lineEnd, double* values, unsigned maxCount)
+{
+	unsigned count = 0;
+	while (count < maxCount)
+	{
+		while (p < lineEnd && IsSeparator(*p))
+			++p;
+		if (p == lineEnd)
+			break;
+
+		if (!ParseValue(p,lineEnd,values[count]))
+			return -1;
+		//a value must be followed by a separator
+		if (p < lineEnd && !IsSeparator(*p))
+			return -1;
+		++count;
+	}
+
+	return static_cast<int>(count);
+}
+
+bool ccAsciiFile::IsCommentLine(const char* p, const char* lineEnd)
+{
+	while (p < lineEnd && IsSeparator(*p))
+		++p;
+
+	return (p == lineEnd || *p == '#' || (*p == '/' && p+1 < lineEnd && p[1] == '/'));
+}
+
+//! Returns the end of a line (i.e. the position of '\n' or 'end')
+static inline const char* LineEnd(const char* p, const char* end)
+{
+	const char* lineEnd = static_cast<const char*>(memchr(p,'\n',static_cast<size_t>(end-p)));
+	return (lineEnd ? lineEnd : end);
+}
+
+//! Size of the blocks parsed by each job
+static const size_t ASCII_BLOCK_SIZE = (1<<22);
+
+static void CountBlockLines(ccAsciiFile::LinesBlock& block)
+{
+	unsigned count = 0;
+	for (const char* p = block.begin; p < block.end; ++count)
+		p = LineEnd(p,block.end) + 1;
+	block.lineCount = count;
+}
+
+//! Columns layout and output arrays
+struct asciiParsingContext
+{
+	unsigned columns;
+	bool hasRGB;
+	double shift[3];
+	GenericChunkedArray<3,PointCoordinateType>* points;
+	ColorsTableType* colors;
+	std::vector<ccScalarField*> scalarFields;
+	//! First column of scalar values
+	unsigned firstSFColumn;
+};
+
+//! Block of lines parsed by one job
+struct asciiBlockDesc
+{
+	ccAsciiFile::LinesBlock lines;
+	//! Number of points actually read (the first point index is lines.firstLine)
+	unsigned pointCount;
+};
+
+static void ParseBlock(const asciiParsingContext& context, asciiBlockDesc& block)
+{
+	double values[ccAsciiFile::MAX_COLUMNS];
+	unsigned index = block.lines.firstLine;
+	unsigned maxIndex = block.lines.firstLine + block.lines.lineCount;
+
+	for (const char* p = block.lines.begin; p < block.lines.end && index < maxIndex; )
+	{
+		const char* lineEnd = LineEnd(p,block.lines.end);
+		int count = ccAsciiFile::ParseLine(p,lineEnd,values,context.columns);
+		p = lineEnd + 1;
+
+		//invalid lines are ignored (header, comments, missing values, etc.)
+		if (count < static_cast<int>(context.columns))
+			continue;
+
+		PointCoordinateType* P = context.points->getValue(index);
+		P[0] = static_cast<PointCoordinateType>(values[0] + context.shift[0]);
+		P[1] = static_cast<PointCoordinateType>(values[1] + context.shift[1]);
+		P[2] = static_cast<PointCoordinateType>(values[2] + context.shift[2]);
+
+		if (context.hasRGB)
+		{
+			colorType* C = context.colors->getValue(index);
+			for (unsigned k=0; k<3; ++k)
+				C[k] = static_cast<colorType>(std::max(0.0,std::min(values[3+k],255.0)));
+		}
+
+		for (size_t k=0; k<context.scalarFields.size(); ++k)
+			context.scalarFields[k]->setValue(index,static_cast<ScalarType>(values[context.firstSFColumn+k]));
+
+		++index;
+	}
+
+	block.pointCount = index - block.lines.firstLine;
+}
+
+#ifdef ENABLE_MT_OCTREE
+
+#include <QtCore/QtCore>
+
+static const asciiParsingContext* s_asciiContext_MT = 0;
+
+void CountBlockLines_MT(ccAsciiFile::LinesBlock& block)
+{
+	CountBlockLines(block);
+}
+
+void ParseBlock_MT(asciiBlockDesc* &block)
+{
+	ParseBlock(*s_asciiContext_MT,*block);
+}
+
+#endif
+
+bool ccAsciiFile::SplitInBlocks(const char* begin, const char* end, std::vector<LinesBlock>& blocks, uint64_t& lineCount)
+{
+	blocks.clear();
+	lineCount = 0;
+
+	try
+	{
+		blocks.reserve(static_cast<size_t>(end-begin)/ASCII_BLOCK_SIZE + 1);
+		for (const char* p = begin; p < end; )
+		{
+			LinesBlock block;
+			block.begin = p;
+			block.end = (static_cast<size_t>(end-p) > ASCII_BLOCK_SIZE ? LineEnd(p+ASCII_BLOCK_SIZE,end) : end);
+			if (block.end < end)
+				++block.end; //we include the '\n' character
+			block.lineCount = block.firstLine = 0;
+			blocks.push_back(block);
+			p = block.end;
+		}
+	}
+	catch(std::bad_alloc)
+	{
+		blocks.clear();
+		return false;
+	}
+
+#ifndef ENABLE_MT_OCTREE
+	for (size_t i=0; i<blocks.size(); ++i)
+		CountBlockLines(blocks[i]);
+#else
+	QtConcurrent::blockingMap(blocks, CountBlockLines_MT);
+#endif
+
+	for (size_t i=0; i<blocks.size(); ++i)
+	{
+		blocks[i].firstLine = static_cast<unsigned>(lineCount);
+		lineCount += blocks[i].lineCount;
+	}
+
+	return true;
+}
+
+//! Copies the point #from to the point #to (see ccAsciiFile::Load)
+static inline void MovePoint(const asciiParsingContext& context, unsigned from, unsigned to)
+{
+	memcpy(context.points->getValue(to),context.points->getValue(from),sizeof(PointCoordinateType)*3);
+	if (context.hasRGB)
+		memcpy(context.colors->getValue(to),context.colors->getValue(from),sizeof(colorType)*3);
+	for (size_t k=0; k<context.scalarFields.size(); ++k)
+		context.scalarFields[k]->setValue(to,context.scalarFields[k]->getValue(from));
+}
+
+CC_FILE_ERROR ccAsciiFile::Load(const char* filename, ccPointCloud*& cloud, CCLib::GenericProgressCallback* progressCb/*=0*/)
+{
+	cloud = 0;
+
+	CC_FILE_ERROR error = CC_FERR_NO_ERROR;
+	ccMappedFile* file = ccMappedFile::Map(filename,&error);
+	if (!file)
+		return error;
+
+	const char* data = reinterpret_cast<const char*>(file->data());
+	const char* end = data + file->size();
+
+	//look for the first valid line (to deduce the columns layout)
+	double firstValues[MAX_COLUMNS];
+	const char* firstLine = data;
+	int columns = 0;
+	while (firstLine < end)
+	{
+		const char* lineEnd = LineEnd(firstLine,end);
+		if (!IsCommentLine(firstLine,lineEnd))
+			columns = ParseLine(firstLine,lineEnd,firstValues,MAX_COLUMNS);
+		if (columns >= 3)
+			break;
+		firstLine = lineEnd + 1;
+	}
+
+	if (columns < 3)
+	{
+		file->release();
+		return CC_FERR_WRONG_FILE_TYPE;
+	}
+
+	asciiParsingContext context;
+	context.columns = static_cast<unsigned>(columns);
+	context.hasRGB = (columns >= 6);
+	for (unsigned k=3; k<6 && context.hasRGB; ++k)
+		context.hasRGB = (firstValues[k] >= 0.0 && firstValues[k] <= 255.0 && firstValues[k] == floor(firstValues[k]));
+	context.firstSFColumn = (context.hasRGB ? 6 : 3);
+	if (ccGenericPointCloud::SuggestOriginalShift(firstValues,context.shift))
+		ccLog::Warning("[ccAsciiFile] Coordinates are too big: cloud has been shifted by (%f;%f;%f)",context.shift[0],context.shift[1],context.shift[2]);
+
+	//split the file in blocks (at line boundaries)
+	std::vector<LinesBlock> linesBlocks;
+	uint64_t lineCount = 0;
+	std::vector<asciiBlockDesc> blocks;
+	std::vector<asciiBlockDesc*> blockPtrs;
+	try
+	{
+		if (!SplitInBlocks(firstLine,end,linesBlocks,lineCount))
+			throw std::bad_alloc();
+		blocks.resize(linesBlocks.size());
+		blockPtrs.resize(linesBlocks.size());
+		for (size_t i=0; i<linesBlocks.size(); ++i)
+		{
+			blocks[i].lines = linesBlocks[i];
+			blocks[i].pointCount = 0;
+			blockPtrs[i] = &blocks[i];
+		}
+	}
+	catch(std::bad_alloc)
+	{
+		file->release();
+		return CC_FERR_NOT_ENOUGH_MEMORY;
+	}
+
+	if (lineCount >= (1ULL<<32))
+	{
+		file->release();
+		return CC_FERR_NOT_IMPLEMENTED;
+	}
+
+	//the arrays are allocated once (for the max number of points)
+	std::string name(filename);
+	size_t slash = name.find_last_of("/\\");
+	cloud = new ccPointCloud(slash == std::string::npos ? name : name.substr(slash+1));
+	bool success = cloud->resize(static_cast<unsigned>(lineCount));
+	if (success && context.hasRGB)
+		success = cloud->resizeTheRGBTable(false);
+	for (unsigned k=context.firstSFColumn; k<context.columns && success; ++k)
+	{
+		char sfName[64];
+		sprintf(sfName,"Scalar field #%u",k-context.firstSFColumn+1);
+		ccScalarField* sf = new ccScalarField(sfName);
+		if (!sf->resize(static_cast<unsigned>(lineCount)) || cloud->addScalarField(sf) < 0)
+		{
+			sf->release();
+			success = false;
+			break;
+		}
+		context.scalarFields.push_back(sf);
+	}
+	if (!success)
+	{
+		delete cloud;
+		cloud = 0;
+		file->release();
+		return CC_FERR_NOT_ENOUGH_MEMORY;
+	}
+	context.points = cloud->pointsTable();
+	context.colors = cloud->rgbColors();
+
+	CCLib::NormalizedProgress* nprogress = 0;
+	if (progressCb)
+	{
+		progressCb->reset();
+		nprogress = new CCLib::NormalizedProgress(progressCb,static_cast<unsigned>(blocks.size()));
+		progressCb->setMethodTitle("Load ASCII file");
+		char buffer[256];
+		sprintf(buffer,"Lines: %u\nColumns: %i",static_cast<unsigned>(lineCount),columns);
+		progressCb->setInfo(buffer);
+		progressCb->start();
+	}
+
+	//second pass: parse the blocks (the points are directly written in the cloud arrays)
+#ifdef ENABLE_MT_OCTREE
+	s_asciiContext_MT = &context;
+	//blocks are processed by batches so as to report the progress
+	const size_t batchSize = static_cast<size_t>(std::max(1,QThread::idealThreadCount()))*4;
+	std::vector<asciiBlockDesc*> batch;
+#endif
+	for (size_t i=0; i<blocks.size() && error == CC_FERR_NO_ERROR; )
+	{
+#ifndef ENABLE_MT_OCTREE
+		ParseBlock(context,blocks[i]);
+		size_t processed = 1;
+#else
+		size_t processed = std::min(batchSize,blocks.size()-i);
+		batch.assign(blockPtrs.begin()+i,blockPtrs.begin()+(i+processed));
+		QtConcurrent::blockingMap(batch, ParseBlock_MT);
+#endif
+		i += processed;
+
+		for (size_t j=0; j<processed && nprogress; ++j)
+			if (!nprogress->oneStep())
+				error = CC_FERR_CANCELED_BY_USER;
+	}
+#ifdef ENABLE_MT_OCTREE
+	s_asciiContext_MT = 0;
+#endif
+
+	if (nprogress)
+	{
+		delete nprogress;
+		progressCb->stop();
+	}
+
+	//we can release the file now
+	file->release();
+	file = 0;
+
+	if (error != CC_FERR_NO_ERROR)
+	{
+		delete cloud;
+		cloud = 0;
+		return error;
+	}
+
+	//remove the gaps left by the invalid lines
+	unsigned pointCount = 0;
+	for (size_t i=0; i<blocks.size(); ++i)
+	{
+		const asciiBlockDesc& block = blocks[i];
+		if (block.lines.firstLine != pointCount)
+			for (unsigned j=0; j<block.pointCount; ++j)
+				MovePoint(context,block.lines.firstLine+j,pointCount+j);
+		pointCount += block.pointCount;
+	}
+
+	if (pointCount == 0)
+	{
+		delete cloud;
+		cloud = 0;
+		return CC_FERR_MALFORMED_FILE;
+	}
+
+	if (pointCount < lineCount)
+	{
+		cloud->resize(pointCount); //can't fail (reduction) and updates the SFs min and max
+	}
+	else
+	{
+		for (size_t k=0; k<context.scalarFields.size(); ++k)
+			context.scalarFields[k]->computeMinAndMax();
+	}
+	cloud->invalidateBoundingBox();
+	cloud->setOriginalShift(context.shift[0],context.shift[1],context.shift[2]);
+	if (context.hasRGB)
+		cloud->showColors(true);
+	if (!context.scalarFields.empty())
+	{
+		cloud->setCurrentDisplayedScalarField(0);
+		cloud->showSF(!context.hasRGB);
+	}
+
+	return CC_FERR_NO_ERROR;
+}
@@ -0,0 +1,110 @@
+//##########################################################################
+//#                                                                        #
+//#                            CLOUDCOMPARE                                #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 of the License.               #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: EDF R&D / TELECOM ParisTech (ENST-TSI)             #
+//#                                                                        #
+//##########################################################################
+
+#ifndef CC_ASCII_FILE_HEADER
+#define CC_ASCII_FILE_HEADER
+
+//Local
+#include "ccMappedFile.h"
+
+//CCLib
+#include <GenericProgressCallback.h>
+
+//system
+#include <stdint.h>
+#include <vector>
+
+class ccPointCloud;
+
+//! ASCII point cloud file (XYZ, TXT, ASC, CSV, etc.)
+/** One point per line: X Y Z [R G B] [scalar values...]
+	Values can be separated by spaces, tabs, commas or semicolons.
+	Header and comment lines (i.e. lines starting with '#' or '//', or
+	lines that don't contain at least 3 numerical values) are ignored.
+	The columns layout is deduced from the first valid line: columns 4 to 6
+	are considered as RGB colors if they are integers between 0 and 255.
+	All other columns are loaded as scalar fields.
+	The file is mapped in memory and split into blocks (at line boundaries)
+	that are parsed in parallel (if ENABLE_MT_OCTREE is defined).
+**/
+#ifdef QCC_DB_USE_AS_DLL
+#include "qCC_db_dll.h"
+class QCC_DB_DLL_API ccAsciiFile
+#else
+class ccAsciiFile
+#endif
+{
+public:
+
+	//! Max number of columns per line (extra columns are ignored)
+	static const unsigned MAX_COLUMNS = 64;
+
+	//! Loads an ASCII cloud
+	/** \param filename input filename
+		\param[out] cloud loaded cloud
+		\param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
+		\return error code
+	**/
+	static CC_FILE_ERROR Load(const char* filename, ccPointCloud*& cloud, CCLib::GenericProgressCallback* progressCb=0);
+
+	//! Parses a numerical value (locale independent)
+	/** Most values (up to 15 significant digits) are parsed without calling
+		strtod, with the same (correctly rounded) result.
+		\param[in,out] p current position (moved after the value in case of success)
+		\param end end of the buffer
+		\param[out] value parsed value
+		\return whether a value could be parsed
+	**/
+	static bool ParseValue(const char*& p, const char* end, double& value);
+
+	//! Parses the values of one line
+	/** \param p beginning of the line
+		\param lineEnd end of the line
+		\param[out] values parsed values
+		\param maxCount max number of values to parse (extra values are ignored)
+		\return number of parsed values or -1 if the line contains a non numerical token
+	**/
+	static int ParseLine(const char* p, const char* lineEnd, double* values, unsigned maxCount);
+
+	//! Returns whether a line is a comment line (or an empty line)
+	static bool IsCommentLine(const char* p, const char* lineEnd);
+
+	//! Block of lines (see SplitInBlocks)
+	struct LinesBlock
+	{
+		//! Beginning of the block
+		const char* begin;
+		//! End of the block (after the last '\n')
+		const char* end;
+		//! Number of lines
+		unsigned lineCount;
+		//! Index of the first line (relatively to the whole buffer)
+		unsigned firstLine;
+	};
+
+	//! Splits a buffer in blocks of lines (to be parsed in parallel)
+	/** Lines of each block are counted (in parallel if ENABLE_MT_OCTREE is defined).
+		\param begin beginning of the buffer
+		\param end end of the buffer
+		\param[out] blocks blocks
+		\param[out] lineCount total number of lines
+		\return false if there's not enough memory
+	**/
+	static bool SplitInBlocks(const char* begin, const char* end, std::vector<LinesBlock>& blocks, uint64_t& lineCount);
+};
+
+#endif //CC_ASCII_FILE_HEADER
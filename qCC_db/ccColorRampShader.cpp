@@ -0,0 +1,188 @@
+//##########################################################################
+//#                                                                        #
+//#                            CLOUDCOMPARE                                #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 of the License.               #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: EDF R&D / TELECOM ParisTech (ENST-TSI)             #
+//#                                                                        #
+//##########################################################################
+
+#include "ccColorRampShader.h"
+
+//Local
+#include "ccScalarField.h"
+
+//System
+#include <assert.h>
+#include <string.h>
+
+//! Color ramp fragment shader
+/** Scalar value: 1st texture coordinate. Lighting: incoming color.
+	Mapping modes: 0 = linear, 1 = symmetrical, 2 = log scale (see
+	ccScalarField::normalize). The color index is computed the same way as
+	ccColorScale::getColorByRelativePos.
+**/
+static const char s_colorRampFragSource[] =
+	"#ifdef GL_ES\n"
+	"precision highp float;\n"
+	"#endif\n"
+	"uniform sampler2D uf_colorRamp;\n"
+	"uniform float uf_rampSteps;\n"
+	"uniform int uf_mode;\n"
+	"uniform float uf_displayStart;\n"
+	"uniform float uf_displayStop;\n"
+	"uniform float uf_satStart;\n"
+	"uniform float uf_satRange;\n"
+	"uniform int uf_showNaNInGrey;\n"
+	"uniform vec3 uf_colorGrey;\n"
+	"void main()\n"
+	"{\n"
+	"	float v = gl_TexCoord[0].s;\n"
+	"	vec3 color;\n"
+	"	if (!(v >= uf_displayStart && v <= uf_displayStop))\n" //NaN values are also rejected
+	"	{\n"
+	"		if (uf_showNaNInGrey == 0)\n"
+	"			discard;\n"
+	"		color = uf_colorGrey;\n"
+	"	}\n"
+	"	else\n"
+	"	{\n"
+	"		float t;\n"
+	"		if (uf_mode == 1)\n"
+	"		{\n"
+	"			float a = abs(v);\n"
+	"			t = (a <= uf_satStart ? 0.0 : min((a - uf_satStart) / uf_satRange, 1.0));\n"
+	"			t = (1.0 + (v < 0.0 ? -t : t)) / 2.0;\n"
+	"		}\n"
+	"		else if (uf_mode == 2)\n"
+	"		{\n"
+	"			float vLog = log(max(abs(v), 1.0e-8)) * 0.43429448190325176;\n"
+	"			t = clamp((vLog - uf_satStart) / uf_satRange, 0.0, 1.0);\n"
+	"		}\n"
+	"		else\n"
+	"		{\n"
+	"			t = clamp((v - uf_satStart) / uf_satRange, 0.0, 1.0);\n"
+	"		}\n"
+	"		float x = t * uf_rampSteps;\n"
+	"		float index = floor(x);\n"
+	"		if (fract(x) * 65536.0 < x)\n" //i.e. floor(x * 65535/65536) without rounding issues
+	"			index -= 1.0;\n"
+	"		index = clamp(index, 0.0, uf_rampSteps - 1.0);\n"
+	"		color = texture2D(uf_colorRamp, vec2((index + 0.5) / uf_rampSteps, 0.5)).rgb;\n"
+	"	}\n"
+	"	gl_FragColor = vec4(color * gl_Color.rgb, 1.0);\n"
+	"}\n";
+
+ccColorRampShader::ccColorRampShader()
+	: ccShader()
+	, m_rampTexture(0)
+{
+}
+
+ccColorRampShader::~ccColorRampShader()
+{
+	release();
+}
+
+bool ccColorRampShader::init()
+{
+	return loadProgramFromSource(0,s_colorRampFragSource);
+}
+
+void ccColorRampShader::release()
+{
+	if (m_rampTexture != 0)
+	{
+		glDeleteTextures(1,&m_rampTexture);
+		m_rampTexture = 0;
+	}
+	m_rampColors.clear();
+}
+
+bool ccColorRampShader::updateRampTexture(const ccColorScale::Shared& colorScale, unsigned steps)
+{
+	assert(colorScale && steps > 1 && steps <= ccColorScale::MAX_STEPS);
+
+	//we compute the ramp colors (cheap) but we only upload them if they have changed
+	colorType rampColors[ccColorScale::MAX_STEPS*3];
+	for (unsigned i=0; i<steps; ++i)
+	{
+		const colorType* col = colorScale->getColorByIndex((i*(ccColorScale::MAX_STEPS-1)) / (steps-1));
+		memcpy(rampColors+3*i,col,3*sizeof(colorType));
+	}
+
+	if (m_rampTexture != 0 && m_rampColors.size() == 3*steps && memcmp(&m_rampColors[0],rampColors,3*steps*sizeof(colorType)) == 0)
+	{
+		glBindTexture(GL_TEXTURE_2D,m_rampTexture);
+		return true;
+	}
+
+	try
+	{
+		m_rampColors.assign(rampColors,rampColors+3*steps);
+	}
+	catch(std::bad_alloc)
+	{
+		//not enough memory
+		m_rampColors.clear();
+		return false;
+	}
+
+	if (m_rampTexture == 0)
+		glGenTextures(1,&m_rampTexture);
+
+	glBindTexture(GL_TEXTURE_2D,m_rampTexture);
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+	glPixelStorei(GL_UNPACK_ALIGNMENT,1);
+	glTexImage2D(GL_TEXTURE_2D,0,GL_RGB,steps,1,0,GL_RGB,GL_UNSIGNED_BYTE,rampColors);
+	glPixelStorei(GL_UNPACK_ALIGNMENT,4);
+
+	return true;
+}
+
+bool ccColorRampShader::setup(const ccScalarField* sf)
+{
+	assert(sf && sf->getColorScale());
+
+	unsigned steps = sf->getColorRampSteps();
+	if (steps < 2 || steps > ccColorScale::MAX_STEPS)
+		return false;
+
+	glActiveTexture(GL_TEXTURE0);
+	if (!updateRampTexture(sf->getColorScale(),steps))
+		return false;
+
+	setUniform1i("uf_colorRamp",0);
+	setUniform1f("uf_rampSteps",static_cast<float>(steps));
+
+	//display range
+	const ccScalarField::Range& displayRange = sf->displayRange();
+	setUniform1f("uf_displayStart",displayRange.start());
+	setUniform1f("uf_displayStop",displayRange.stop());
+
+	//mapping (saturation range is the log one in log scale mode)
+	const ccScalarField::Range& saturationRange = sf->saturationRange();
+	setUniform1i("uf_mode",sf->logScale() ? 2 : (sf->symmetricalScale() ? 1 : 0));
+	setUniform1f("uf_satStart",saturationRange.start());
+	setUniform1f("uf_satRange",saturationRange.range());
+
+	//'grayed' points color
+	setUniform1i("uf_showNaNInGrey",sf->areNaNValuesShownInGrey() ? 1 : 0);
+	float grey[3] = {	static_cast<float>(ccColor::lightGrey[0])/MAX_COLOR_COMP,
+						static_cast<float>(ccColor::lightGrey[1])/MAX_COLOR_COMP,
+						static_cast<float>(ccColor::lightGrey[2])/MAX_COLOR_COMP };
+	setUniform3fv("uf_colorGrey",grey);
+
+	return (glGetError() == 0);
+}
@@ -29,67 +29,62 @@
 #include "ccColorScale.h"
 
 //System
-#include <assert.h>
-
-//! Maximum color ramp size
-/** 252 so as to get 1024 bytes as total required memory
-(see MinRequiredBytes).
+#include <vector>
+
+class ccScalarField;
+
+//! Color ramp shader
+/** Scalar values are sent as is (as 1D texture coordinates) and converted
+	to colors on the GPU side: the shader applies the same mapping as
+	ccScalarField::getColor (linear, symmetrical or log scale, saturation,
+	hidden or grey out-of-range and NaN values). The color scale itself is
+	stored as a (steps x 1) texture that is only uploaded when it changes.
+	Therefore, changing the display parameters of a scalar field only
+	costs a few uniforms updates.
+	The (fragment) shader source is built-in (see init). The incoming color
+	is used as lighting modulation (it should be white).
 **/
-static const unsigned CC_MAX_SHADER_COLOR_RAMP_SIZE = 256;
-
-//! Buffer for converting a color scale to packed values before sending it to shader
-static float s_packedColormapf[CC_MAX_SHADER_COLOR_RAMP_SIZE];
-
 class ccColorRampShader : public ccShader
 {
 public:
 
 	//! Default constructor
-	ccColorRampShader() : ccShader() {}
+	ccColorRampShader();
 
 	//! Destructor
-	virtual ~ccColorRampShader() {}
+	virtual ~ccColorRampShader();
+
+	//! Loads the (built-in) shader program
+	/** Must be called with a valid OpenGL context.
+	**/
+	bool init();
 
-	//! Setups shader
-	/** Shader must have already been stared!
+	//! Setups shader for a given scalar field
+	/** Shader must have already been started!
+		The color ramp texture is bound to texture unit 0.
 	**/
-	bool setup(float minSatRel, float maxSatRel, unsigned colorSteps, const ccColorScale::Shared& colorScale)
-	{
-		if (colorSteps > CC_MAX_SHADER_COLOR_RAMP_SIZE)
-		{
-			colorSteps = CC_MAX_SHADER_COLOR_RAMP_SIZE;
-		}
-
-		setUniform1f("uf_minSaturation",minSatRel);
-		setUniform1f("uf_maxSaturation",maxSatRel);
-		setUniform1f("uf_colormapSize",(float)colorSteps);
-
-		//set 'grayed' points color as a float-packed value
-		{
-			int rgb = (ccColor::lightGrey[0] << 16) | (ccColor::lightGrey[1] << 8) | ccColor::lightGrey[2];
-			float packedColorGray = (float)((double)rgb/(double)(1<<24));
-			setUniform1f("uf_colorGray",packedColorGray);
-		}
-
-		//send colormap to shader
-		assert(colorScale);
-		for (unsigned i=0; i<colorSteps; ++i)
-		{
-			const colorType* col = colorScale->getColorByRelativePos((double)i/(double)(colorSteps-1),colorSteps);
-			//set ramp colors as float-packed values
-			int rgb = (col[0] << 16) | (col[1] << 8) | col[2];
-			s_packedColormapf[i] = (float)((double)rgb/(double)(1<<24));
-		}
-		setTabUniform1fv("uf_colormapTable",colorSteps,s_packedColormapf);
-
-		return (glGetError() == 0);
-	}
+	bool setup(const ccScalarField* sf);
+
+	//! Releases the color ramp texture
+	/** Shader must have already been stopped!
+	**/
+	void release();
 
 	//! Returns the minimum memory required on the shader side
 	/** See GL_MAX_FRAGMENT_UNIFORM_COMPONENTS
 	**/
-	static GLint MinRequiredBytes() { return (CC_MAX_SHADER_COLOR_RAMP_SIZE + 4) * 4; }
+	static GLint MinRequiredBytes() { return 16 * 4; }
+
+protected:
+
+	//! Updates the color ramp texture (if necessary)
+	bool updateRampTexture(const ccColorScale::Shared& colorScale, unsigned steps);
+
+	//! Color ramp texture
+	GLuint m_rampTexture;
 
+	//! Current color ramp (RGB, same as the texture content)
+	std::vector<colorType> m_rampColors;
 };
 
 #endif //CC_COLOR_RAMP_SHADER_HEADER
@@ -21,12 +21,17 @@
 #include "ccGBLSensor.h"
 
 //CCLib
-//#include <GenericIndexedCloud.h>
+#include <DgmOctree.h> //for ENABLE_MT_OCTREE
 
 //system
 #include <string.h>
 #include <assert.h>
 
+#ifdef ENABLE_MT_OCTREE
+#include <QtCore/QtCore>
+#include <atomic>
+#endif
+
 ccGBLSensor::ccGBLSensor(ROTATION_ORDER rotOrder/*=THETA_PHI*/)
 	: ccSensor()
 	, base(0)
@@ -93,39 +98,157 @@ inline void ccGBLSensor::projectPoint(const CCVector3& sourcePoint, CCVector2& d
 	depth = (ScalarType)sqrt(norm);
 }
 
+//! Number of points processed by each job
+static const unsigned GBL_POINTS_JOB_SIZE = 65536;
+//! Number of depth buffer pixels (approximately) processed by each job
+static const unsigned GBL_PIXELS_JOB_SIZE = 65536;
+
+bool ccGBLSensor::CreateJobRanges(unsigned count, unsigned rangeSize, std::vector<JobRange>& jobs)
+{
+	assert(rangeSize != 0);
+	try
+	{
+		jobs.clear();
+		jobs.reserve((count+rangeSize-1)/rangeSize);
+		for (unsigned i=0; i<count; i+=rangeSize)
+		{
+			JobRange range;
+			range.first = i;
+			range.last = std::min(count, i+rangeSize);
+			jobs.push_back(range);
+		}
+	}
+	catch(std::bad_alloc)
+	{
+		//not enough memory
+		return false;
+	}
+
+	return true;
+}
+
+void ccGBLSensor::projectPoints(CCVector3* points, ScalarType* depths, const JobRange& range) const
+{
+	for (unsigned i=range.first; i<range.last; ++i)
+	{
+		CCVector2 Q;
+		projectPoint(points[i],Q,depths[i]);
+		points[i] = CCVector3(Q.x,Q.y,0);
+	}
+}
+
+#ifdef ENABLE_MT_OCTREE
+
+static const ccGBLSensor* s_sensor_MT = 0;
+static CCVector3* s_points_MT = 0;
+static ScalarType* s_depths_MT = 0;
+static std::atomic<ScalarType>* s_zBuff_MT = 0;
+static const ScalarType* s_zBuffTemp_MT = 0;
+static CCLib::GenericIndexedCloud* s_cloud_MT = 0;
+static uchar* s_visibility_MT = 0;
+
+void ccGBLSensor::ProjectPoints_MT(const JobRange& range)
+{
+	s_sensor_MT->projectPoints(s_points_MT,s_depths_MT,range);
+}
+
+void ccGBLSensor::AccumulateDepths_MT(const JobRange& range)
+{
+	const ccGBLSensor* sensor = s_sensor_MT;
+	int width = sensor->m_depthBuffer.width;
+	int height = sensor->m_depthBuffer.height;
+
+	for (unsigned i=range.first; i<range.last; ++i)
+	{
+		const CCVector3& Q = s_points_MT[i];
+		int x = (int)floor((Q.x-sensor->thetaMin)/sensor->deltaTheta);
+		int y = (int)floor((Q.y-sensor->phiMin)/sensor->deltaPhi);
+		if (x<0 || x>=width || y<0 || y>=height)
+			continue;
+
+		//we keep the greatest depth (atomic max)
+		ScalarType depth = s_depths_MT[i];
+		std::atomic<ScalarType>& zBuf = s_zBuff_MT[y*width+x];
+		ScalarType current = zBuf.load(std::memory_order_relaxed);
+		while (current < depth && !zBuf.compare_exchange_weak(current,depth,std::memory_order_relaxed))
+		{
+		}
+	}
+}
+
+void ccGBLSensor::FillZBufferHoles_MT(const JobRange& range)
+{
+	const_cast<ccGBLSensor*>(s_sensor_MT)->fillZBufferHoles(s_zBuffTemp_MT,range);
+}
+
+void ccGBLSensor::CheckVisibility_MT(const JobRange& range)
+{
+	s_sensor_MT->checkVisibility(s_cloud_MT,s_visibility_MT,range);
+}
+
+#endif
+
 CCLib::SimpleCloud* ccGBLSensor::project(CCLib::GenericCloud* theCloud, int& errorCode, bool autoParameters/*false*/)
 {
 	assert(theCloud);
 
-	CCLib::SimpleCloud* newCloud = new CCLib::SimpleCloud();
-
 	unsigned pointCount = theCloud->size();
-	if (!newCloud->reserve(pointCount) || !newCloud->enableScalarField()) //not enough memory
+	if (pointCount == 0)
 	{
-		errorCode = -4;
-		delete newCloud;
+		errorCode = -1;
 		return 0;
 	}
 
-	ScalarType maxDepth=0;
+	//we copy the points first (the cloud global iterator can't be shared)
+	//and then project them (in place) by blocks
+	std::vector<CCVector3> points;
+	std::vector<ScalarType> depths;
+	std::vector<JobRange> jobs;
+	try
+	{
+		points.resize(pointCount);
+		depths.resize(pointCount);
+	}
+	catch(std::bad_alloc)
+	{
+		//not enough memory
+		errorCode = -4;
+		return 0;
+	}
+	if (!CreateJobRanges(pointCount,GBL_POINTS_JOB_SIZE,jobs))
+	{
+		errorCode = -4;
+		return 0;
+	}
 
 	theCloud->placeIteratorAtBegining();
-	{
-		for (unsigned i=0; i<pointCount; ++i)
-		{
-			const CCVector3 *P = theCloud->getNextPoint();
-			CCVector2 Q;
-			ScalarType depth;
-			projectPoint(*P,Q,depth);
+	for (unsigned i=0; i<pointCount; ++i)
+		points[i] = *theCloud->getNextPoint();
+
+#ifdef ENABLE_MT_OCTREE
+	s_sensor_MT = this;
+	s_points_MT = &points[0];
+	s_depths_MT = &depths[0];
+	QtConcurrent::blockingMap(jobs, ProjectPoints_MT);
+#else
+	for (size_t j=0; j<jobs.size(); ++j)
+		projectPoints(&points[0],&depths[0],jobs[j]);
+#endif
 
-			newCloud->addPoint(CCVector3(Q.x,Q.y,0.0));
-			newCloud->setPointScalarValue(i,depth);
+	CCLib::SimpleCloud* newCloud = new CCLib::SimpleCloud();
+	if (!newCloud->reserve(pointCount) || !newCloud->enableScalarField()) //not enough memory
+	{
+		errorCode = -4;
+		delete newCloud;
+		return 0;
+	}
 
-			if (i != 0)
-				maxDepth = std::max(maxDepth,depth);
-			else
-				maxDepth = depth;
-		}
+	ScalarType maxDepth = depths[0];
+	for (unsigned i=0; i<pointCount; ++i)
+	{
+		newCloud->addPoint(points[i]);
+		newCloud->setPointScalarValue(i,depths[i]);
+		maxDepth = std::max(maxDepth,depths[i]);
 	}
 
 	if (autoParameters)
@@ -173,24 +296,78 @@ CCLib::SimpleCloud* ccGBLSensor::project(CCLib::GenericCloud* theCloud, int& err
 		memset(m_depthBuffer.zBuff,0,zBuffSize*sizeof(ScalarType));
 	}
 
-	//project points and accumulate them in Z-buffer
-	newCloud->placeIteratorAtBegining();
-	for (unsigned i=0;i<newCloud->size();++i)
+	//accumulate the projected points in Z-buffer
+#ifdef ENABLE_MT_OCTREE
 	{
-		const CCVector3 *P = newCloud->getNextPoint();
-		ScalarType depth = newCloud->getPointScalarValue(i);
-
-		int x = (int)floor((P->x-thetaMin)/deltaTheta);
-		int y = (int)floor((P->y-phiMin)/deltaPhi);
+		unsigned zBuffSize = m_depthBuffer.width*m_depthBuffer.height;
+		std::atomic<ScalarType>* zBuffAtomic = new std::atomic<ScalarType>[zBuffSize];
+		for (unsigned i=0; i<zBuffSize; ++i)
+			zBuffAtomic[i].store(0,std::memory_order_relaxed);
+
+		s_zBuff_MT = zBuffAtomic;
+		QtConcurrent::blockingMap(jobs, AccumulateDepths_MT);
+		s_zBuff_MT = 0;
+
+		for (unsigned i=0; i<zBuffSize; ++i)
+			m_depthBuffer.zBuff[i] = zBuffAtomic[i].load(std::memory_order_relaxed);
+		delete[] zBuffAtomic;
+	}
+	s_sensor_MT = 0;
+	s_points_MT = 0;
+	s_depths_MT = 0;
+#else
+	for (unsigned i=0; i<pointCount; ++i)
+	{
+		const CCVector3& Q = points[i];
+		int x = (int)floor((Q.x-thetaMin)/deltaTheta);
+		int y = (int)floor((Q.y-phiMin)/deltaPhi);
+		if (x<0 || x>=m_depthBuffer.width || y<0 || y>=m_depthBuffer.height)
+			continue;
 
 		ScalarType& zBuf = m_depthBuffer.zBuff[y*m_depthBuffer.width+x];
-		zBuf = std::max(zBuf,depth);
+		zBuf = std::max(zBuf,depths[i]);
 	}
+#endif
 
 	errorCode = 0;
 	return newCloud;
 }
 
+void ccGBLSensor::fillZBufferHoles(const ScalarType* zBuffTemp, const JobRange& range)
+{
+	int dx = m_depthBuffer.width+2;
+	for (int y=(int)range.first; y<(int)range.last; ++y)
+	{
+		const ScalarType* zu = zBuffTemp + y*dx;
+		const ScalarType* z = zu + dx;
+		const ScalarType* zd = z + dx;
+		ScalarType* zOut = m_depthBuffer.zBuff + y*m_depthBuffer.width;
+		for (int x=0; x<m_depthBuffer.width; ++x,++zu,++z,++zd)
+		{
+			if (z[1] == 0) //hole
+			{
+				uchar nsup=0; //non empty holes
+				//upper line
+				nsup += (zu[0]>0);
+				nsup += (zu[1]>0);
+				nsup += (zu[2]>0);
+				//current line
+				nsup += ( z[0]>0);
+				nsup += ( z[2]>0);
+				//next line
+				nsup += (zd[0]>0);
+				nsup += (zd[1]>0);
+				nsup += (zd[2]>0);
+
+				if (nsup>3)
+				{
+					zOut[x] = (zu[0]+zu[1]+zu[2]+ z[0]+z[2]+ zd[0]+zd[1]+zd[2])/(ScalarType)nsup;
+				}
+			}
+		}
+	}
+}
+
 int ccGBLSensor::fillZBufferHoles()
 {
 	if (!m_depthBuffer.zBuff)
@@ -200,14 +377,23 @@ int ccGBLSensor::fillZBufferHoles()
 	int dx = m_depthBuffer.width+2;
 	int dy = m_depthBuffer.height+2;
 	unsigned tempZBuffSize = dx*dy;
-	ScalarType* zBuffTemp = new ScalarType[tempZBuffSize];
-	if (!zBuffTemp)
+	std::vector<ScalarType> zBuffTemp;
+	std::vector<JobRange> jobs;
+	try
+	{
+		zBuffTemp.resize(tempZBuffSize,0);
+	}
+	catch(std::bad_alloc)
+	{
+		return -2; //not enough memory
+	}
+	unsigned rowsPerJob = std::max<unsigned>(1,GBL_PIXELS_JOB_SIZE/m_depthBuffer.width);
+	if (!CreateJobRanges(m_depthBuffer.height,rowsPerJob,jobs))
 		return -2; //not enough memory
-	memset(zBuffTemp,0,tempZBuffSize*sizeof(ScalarType));
 
 	//copy old zBuffer in temp one (with 1 pixel border)
 	{
-		ScalarType *_zBuffTemp = zBuffTemp+dx+1; //2nd line, 2nd column
+		ScalarType *_zBuffTemp = &zBuffTemp[0]+dx+1; //2nd line, 2nd column
 		ScalarType *_zBuff = m_depthBuffer.zBuff; //first line, first column of the true buffer
 		for (int y=0; y<m_depthBuffer.height; ++y)
 		{
@@ -218,39 +404,16 @@ int ccGBLSensor::fillZBufferHoles()
 	}
 
 	//fill holes with their neighbor's mean value
-	{
-		for (int y=0;y<m_depthBuffer.height;++y)
-		{
-			ScalarType* zu = zBuffTemp + y*dx;
-			ScalarType* z = zu + dx;
-			ScalarType* zd = z + dx;
-			for (int x=0; x<m_depthBuffer.width; ++x,++zu,++z,++zd)
-			{
-				if (z[1] == 0) //hole
-				{
-					uchar nsup=0; //non empty holes
-					//upper line
-					nsup += (zu[0]>0);
-					nsup += (zu[1]>0);
-					nsup += (zu[2]>0);
-					//current line
-					nsup += ( z[0]>0);
-					nsup += ( z[2]>0);
-					//next line
-					nsup += (zd[0]>0);
-					nsup += (zd[1]>0);
-					nsup += (zd[2]>0);
-
-					if (nsup>3)
-					{
-						m_depthBuffer.zBuff[x+y*m_depthBuffer.width] = (zu[0]+zu[1]+zu[2]+ z[0]+z[2]+ zd[0]+zd[1]+zd[2])/(ScalarType)nsup;
-					}
-				}
-			}
-		}
-	}
-
-	delete[] zBuffTemp;
+#ifdef ENABLE_MT_OCTREE
+	s_sensor_MT = this;
+	s_zBuffTemp_MT = &zBuffTemp[0];
+	QtConcurrent::blockingMap(jobs, FillZBufferHoles_MT);
+	s_zBuffTemp_MT = 0;
+	s_sensor_MT = 0;
+#else
+	for (size_t j=0; j<jobs.size(); ++j)
+		fillZBufferHoles(&zBuffTemp[0],jobs[j]);
+#endif
 
 	return 0;
 }
@@ -434,6 +597,13 @@ uchar ccGBLSensor::checkVisibility(const CCVector3& P) const
 	if (!m_depthBuffer.zBuff) //no z-buffer?
 		return POINT_VISIBLE;
 
+	//out of sight (the depth doesn't depend on the sensor orientation,
+	//so we can skip the projection)
+	CCVector3 U = P - sensorCenter;
+	U.x += base;
+	if ((ScalarType)U.norm2() > sensorRange*sensorRange)
+		return POINT_OUT_OF_RANGE;
+
 	//project point
 	CCVector2 Q;
 	ScalarType depth;
@@ -457,6 +627,52 @@ uchar ccGBLSensor::checkVisibility(const CCVector3& P) const
 	return POINT_VISIBLE;
 }
 
+void ccGBLSensor::checkVisibility(CCLib::GenericIndexedCloud* cloud, uchar* visibility, const JobRange& range) const
+{
+	for (unsigned i=range.first; i<range.last; ++i)
+	{
+		CCVector3 P;
+		cloud->getPoint(i,P);
+		visibility[i] = ccGBLSensor::checkVisibility(P);
+	}
+}
+
+void ccGBLSensor::checkVisibility(CCLib::GenericIndexedCloud* cloud, uchar* visibility) const
+{
+	assert(cloud && visibility);
+
+	unsigned pointCount = cloud->size();
+	if (!m_depthBuffer.zBuff) //no z-buffer?
+	{
+		memset(visibility,POINT_VISIBLE,pointCount);
+		return;
+	}
+
+	JobRange wholeCloud;
+	wholeCloud.first = 0;
+	wholeCloud.last = pointCount;
+
+#ifdef ENABLE_MT_OCTREE
+	std::vector<JobRange> jobs;
+	if (!CreateJobRanges(pointCount,GBL_POINTS_JOB_SIZE,jobs))
+	{
+		//not enough memory: we process the cloud in a single block
+		checkVisibility(cloud,visibility,wholeCloud);
+		return;
+	}
+
+	s_sensor_MT = this;
+	s_cloud_MT = cloud;
+	s_visibility_MT = visibility;
+	QtConcurrent::blockingMap(jobs, CheckVisibility_MT);
+	s_cloud_MT = 0;
+	s_visibility_MT = 0;
+	s_sensor_MT = 0;
+#else
+	checkVisibility(cloud,visibility,wholeCloud);
+#endif
+}
+
 void ccGBLSensor::setOrientationMatrix(const ccGLMatrix& mat)
 {
 	m_orientation = mat;
@@ -25,8 +25,13 @@
 
 //CCLib
 #include <GenericCloud.h>
+#include <GenericIndexedCloud.h>
 #include <SimpleCloud.h>
 #include <CCGeom.h>
+#include <DgmOctree.h> //for ENABLE_MT_OCTREE
+
+//system
+#include <vector>
 
 //! Ground based LiDAR sensor model
 /** An implementation of the ccSensor interface that can be used
@@ -159,6 +164,8 @@ public:
 
 	//! Projects a point cloud along the sensor point of view defined by this instance
 	/** WARNING: this method uses the cloud global iterator
+		The points are projected by blocks (in parallel if ENABLE_MT_OCTREE is defined).
+		Points falling outside of the angular limits are not stored in the depth buffer.
 		\param cloud a point cloud
 		\param errorCode error code in case the returned cloud is 0
 		\param autoParameters try to deduce most trivial parameters (min and max angles, max range and uncertainty) from input cloud
@@ -168,6 +175,7 @@ public:
 
 	/** Apply a mean filter to fill the small holes (lack of information) of the depth map.
 		The depth buffer must have been created before (see GroundBasedLidarSensor::project).
+		Rows are processed in parallel if ENABLE_MT_OCTREE is defined.
 		\return a negative value if an error occurs, 0 otherwise
 	**/
 	int fillZBufferHoles();
@@ -193,6 +201,14 @@ public:
 	**/
 	virtual uchar checkVisibility(const CCVector3& P) const;
 
+	//! Determines the "visibility" of all the points of a cloud
+	/** Same as checkVisibility(const CCVector3&) but for a whole cloud, processed
+		by blocks (in parallel if ENABLE_MT_OCTREE is defined).
+		\param cloud the points to test
+		\param[out] visibility the visibility of each point (should be cloud->size() long)
+	**/
+	void checkVisibility(CCLib::GenericIndexedCloud* cloud, uchar* visibility) const;
+
 	//! Sensor "depth map"
 	/** Contains an array of depth values (along each scanned direction) and its dimensions.
 		This array corresponds roughly to what have been "seen" by the sensor during
@@ -255,6 +271,43 @@ protected:
 	**/
 	void projectPoint(const CCVector3& sourcePoint, CCVector2& destPoint, ScalarType &depth) const;
 
+	//! Range of points (or of depth buffer rows) processed by one job
+	struct JobRange
+	{
+		unsigned first;
+		unsigned last;
+	};
+
+	//! Splits [0,count[ in consecutive ranges of (at most) 'rangeSize' elements
+	static bool CreateJobRanges(unsigned count, unsigned rangeSize, std::vector<JobRange>& jobs);
+
+	//! Projects a range of points in place (see project)
+	/** \param points 3D points (replaced by their projection: (theta,phi,0) or (phi,theta,0))
+		\param[out] depths distance from the sensor optical center to each point
+		\param range range of points to process
+	**/
+	void projectPoints(CCVector3* points, ScalarType* depths, const JobRange& range) const;
+
+	//! Fills holes of a range of depth buffer rows (see fillZBufferHoles)
+	/** \param zBuffTemp copy of the depth buffer with a 1 pixel border
+		\param range range of rows to process
+	**/
+	void fillZBufferHoles(const ScalarType* zBuffTemp, const JobRange& range);
+
+	//! Determines the visibility of a range of points (see checkVisibility)
+	void checkVisibility(CCLib::GenericIndexedCloud* cloud, uchar* visibility, const JobRange& range) const;
+
+#ifdef ENABLE_MT_OCTREE
+	//! Multi-threaded version of projectPoints
+	static void ProjectPoints_MT(const JobRange& range);
+	//! Multi-threaded depth buffer accumulation (see project)
+	static void AccumulateDepths_MT(const JobRange& range);
+	//! Multi-threaded version of fillZBufferHoles
+	static void FillZBufferHoles_MT(const JobRange& range);
+	//! Multi-threaded version of checkVisibility
+	static void CheckVisibility_MT(const JobRange& range);
+#endif
+
 	//! Base distance (distance form emitter to receptor)
 	PointCoordinateType base;
 	//! Center (origin)
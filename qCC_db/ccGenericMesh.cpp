@@ -23,8 +23,12 @@
 #include "ccNormalVectors.h"
 #include "ccMaterialSet.h"
 
+//CCLib
+#include <DgmOctree.h> //for ENABLE_MT_OCTREE
+
 //system
 #include <assert.h>
+#include <algorithm>
 
 ccGenericMesh::ccGenericMesh(ccGenericPointCloud* associatedCloud, std::string name/*=""*/)
 	: GenericIndexedMesh()
@@ -34,6 +38,9 @@ ccGenericMesh::ccGenericMesh(ccGenericPointCloud* associatedCloud, std::string n
 	, m_triNormals(0)
 	, m_texCoords(0)
 	, m_materials(0)
+	, m_vertexAdjacency(0)
+	, m_adjacencyVertCount(0)
+	, m_adjacencyTriCount(0)
 {
     setVisible(true);
     lockVisibility(false);
@@ -44,6 +51,7 @@ ccGenericMesh::~ccGenericMesh()
 	clearTriNormals();
 	setMaterialSet(0);
 	setTexCoordinatesTable(0);
+	invalidateVertexAdjacency();
 }
 
 ccGenericPointCloud* ccGenericMesh::getAssociatedCloud() const
@@ -53,6 +61,8 @@ ccGenericPointCloud* ccGenericMesh::getAssociatedCloud() const
 
 void ccGenericMesh::setAssociatedCloud(ccGenericPointCloud* cloud)
 {
+    if (m_associatedCloud != cloud)
+		invalidateVertexAdjacency();
     m_associatedCloud=cloud;
 }
 
@@ -414,9 +424,197 @@ void ccGenericMesh::applyGLTransformation(const ccGLMatrix& trans)
 	}
 }
 
-bool ccGenericMesh::laplacianSmooth(unsigned nbIteration, float factor, CCLib::GenericProgressCallback* progressCb/*=0*/)
+const ccGenericMesh::VertexAdjacency* ccGenericMesh::getVertexAdjacency()
 {
 	if (!m_associatedCloud)
+		return 0;
+
+	unsigned vertCount = m_associatedCloud->size();
+	unsigned triCount = size();
+
+	//already up-to-date?
+	if (m_vertexAdjacency && m_adjacencyVertCount == vertCount && m_adjacencyTriCount == triCount)
+		return m_vertexAdjacency;
+
+	invalidateVertexAdjacency();
+
+	VertexAdjacency* adjacency = new VertexAdjacency;
+	try
+	{
+		//count the (non unique) edges to which belong each vertex
+		adjacency->offsets.resize(vertCount+1,0);
+		placeIteratorAtBegining();
+		for (unsigned i=0; i<triCount; ++i)
+		{
+			const CCLib::TriangleSummitsIndexes* tsi = getNextTriangleIndexes();
+			assert(tsi->i1<vertCount && tsi->i2<vertCount && tsi->i3<vertCount);
+			adjacency->offsets[tsi->i1+1] += 2;
+			adjacency->offsets[tsi->i2+1] += 2;
+			adjacency->offsets[tsi->i3+1] += 2;
+		}
+		for (unsigned i=0; i<vertCount; ++i)
+			adjacency->offsets[i+1] += adjacency->offsets[i];
+
+		adjacency->neighbours.resize(adjacency->offsets[vertCount]);
+	}
+	catch(std::bad_alloc)
+	{
+		//not enough memory
+		delete adjacency;
+		return 0;
+	}
+
+	std::vector<unsigned>& offsets = adjacency->offsets;
+	std::vector<unsigned>& neighbours = adjacency->neighbours;
+
+	//fill the neighbours lists (offsets[i] is used as insertion position,
+	//so that at the end it points to the beginning of the next list)
+	placeIteratorAtBegining();
+	for (unsigned i=0; i<triCount; ++i)
+	{
+		const CCLib::TriangleSummitsIndexes* tsi = getNextTriangleIndexes();
+		neighbours[offsets[tsi->i1]++] = tsi->i2;
+		neighbours[offsets[tsi->i1]++] = tsi->i3;
+		neighbours[offsets[tsi->i2]++] = tsi->i3;
+		neighbours[offsets[tsi->i2]++] = tsi->i1;
+		neighbours[offsets[tsi->i3]++] = tsi->i1;
+		neighbours[offsets[tsi->i3]++] = tsi->i2;
+	}
+	for (unsigned i=vertCount; i>0; --i)
+		offsets[i] = offsets[i-1];
+	offsets[0] = 0;
+
+	//sort each list and count the unique neighbours
+	unsigned uniqueCount = 0;
+	{
+		for (unsigned i=0; i<vertCount; ++i)
+		{
+			unsigned start = offsets[i];
+			unsigned stop = offsets[i+1];
+			if (start == stop)
+				continue;
+			std::sort(neighbours.begin()+start, neighbours.begin()+stop);
+			++uniqueCount;
+			for (unsigned k=start+1; k<stop; ++k)
+				if (neighbours[k] != neighbours[k-1])
+					++uniqueCount;
+		}
+	}
+
+	try
+	{
+		adjacency->edgeCounts.resize(uniqueCount);
+	}
+	catch(std::bad_alloc)
+	{
+		//not enough memory
+		delete adjacency;
+		return 0;
+	}
+
+	//remove duplicates (in place) and store their multiplicity
+	{
+		unsigned pos = 0;
+		unsigned start = 0;
+		for (unsigned i=0; i<vertCount; ++i)
+		{
+			unsigned stop = offsets[i+1];
+			offsets[i] = pos;
+			for (unsigned k=start; k<stop; ++k)
+			{
+				if (k == start || neighbours[k] != neighbours[pos-1])
+				{
+					neighbours[pos] = neighbours[k];
+					adjacency->edgeCounts[pos] = 1;
+					++pos;
+				}
+				else
+				{
+					++adjacency->edgeCounts[pos-1];
+				}
+			}
+			start = stop;
+		}
+		assert(pos == uniqueCount);
+		offsets[vertCount] = pos;
+	}
+
+	//release the unused memory (if possible)
+	try
+	{
+		std::vector<unsigned>(neighbours.begin(), neighbours.begin()+uniqueCount).swap(neighbours);
+	}
+	catch(std::bad_alloc)
+	{
+		neighbours.resize(uniqueCount);
+	}
+
+	m_vertexAdjacency = adjacency;
+	m_adjacencyVertCount = vertCount;
+	m_adjacencyTriCount = triCount;
+
+	return m_vertexAdjacency;
+}
+
+//! Applies one Laplacian step to a range of vertices (reads 'in', writes 'out')
+static void SmoothVerticesStep(	const ccGenericMesh::VertexAdjacency& adjacency,
+								const CCVector3* in,
+								CCVector3* out,
+								PointCoordinateType factor,
+								unsigned firstIndex,
+								unsigned lastIndex)
+{
+	const unsigned* offsets = &adjacency.offsets[0];
+	const unsigned* neighbours = adjacency.neighbours.empty() ? 0 : &adjacency.neighbours[0];
+	const unsigned* edgeCounts = adjacency.edgeCounts.empty() ? 0 : &adjacency.edgeCounts[0];
+
+	for (unsigned i=firstIndex; i<lastIndex; ++i)
+	{
+		const CCVector3& P = in[i];
+
+		//each edge is weighted by the number of triangles it belongs to
+		CCVector3 d(0,0,0);
+		unsigned weight = 0;
+		for (unsigned k=offsets[i]; k<offsets[i+1]; ++k)
+		{
+			d += (in[neighbours[k]]-P) * (PointCoordinateType)edgeCounts[k];
+			weight += edgeCounts[k];
+		}
+
+		//isolated vertices don't move
+		out[i] = (weight != 0 ? P + d*(factor/(PointCoordinateType)weight) : P);
+	}
+}
+
+#ifdef ENABLE_MT_OCTREE
+
+#include <QtCore/QtCore>
+
+//! Number of vertices processed by each job
+static const unsigned SMOOTH_VERTICES_JOB_SIZE = 16384;
+
+//! Range of vertices processed by one job
+struct smoothJobDesc
+{
+	unsigned firstIndex;
+	unsigned lastIndex;
+};
+
+static const ccGenericMesh::VertexAdjacency* s_smoothAdjacency_MT = 0;
+static const CCVector3* s_smoothIn_MT = 0;
+static CCVector3* s_smoothOut_MT = 0;
+static PointCoordinateType s_smoothFactor_MT = 0;
+
+void SmoothVerticesStep_MT(const smoothJobDesc& desc)
+{
+	SmoothVerticesStep(*s_smoothAdjacency_MT, s_smoothIn_MT, s_smoothOut_MT, s_smoothFactor_MT, desc.firstIndex, desc.lastIndex);
+}
+
+#endif
+
+bool ccGenericMesh::smoothVertices(unsigned nbIteration, const float* factors, unsigned factorCount, const char* title, CCLib::GenericProgressCallback* progressCb)
+{
+	if (!m_associatedCloud || !factors || factorCount == 0)
 		return false;
 
 	//vertices
@@ -426,31 +624,50 @@ bool ccGenericMesh::laplacianSmooth(unsigned nbIteration, float factor, CCLib::G
 	if (!vertCount || !faceCount)
 		return false;
 
-	GenericChunkedArray<3,PointCoordinateType>* verticesDisplacement = new GenericChunkedArray<3,PointCoordinateType>;
-	if (!verticesDisplacement->resize(vertCount))
+	//vertex adjacency (computed once)
+	const VertexAdjacency* adjacency = getVertexAdjacency();
+	if (!adjacency)
 	{
 		//not enough memory
-		verticesDisplacement->release();
 		return false;
 	}
 
-	//compute the number of edges to which belong each vertex
-	unsigned* edgesCount = new unsigned[vertCount];
-	if (!edgesCount)
+	//double buffering: each step reads one buffer and writes the other
+	std::vector<CCVector3> buffers[2];
+	try
+	{
+		buffers[0].resize(vertCount);
+		buffers[1].resize(vertCount);
+	}
+	catch(std::bad_alloc)
 	{
 		//not enough memory
-		verticesDisplacement->release();
 		return false;
 	}
-	memset(edgesCount, 0, sizeof(unsigned)*vertCount);
-	placeIteratorAtBegining();
-	for(unsigned j=0; j<faceCount; j++)
+
+	for (unsigned i=0; i<vertCount; ++i)
+		buffers[0][i] = *m_associatedCloud->getPoint(i);
+
+#ifdef ENABLE_MT_OCTREE
+	std::vector<smoothJobDesc> jobs;
+	try
+	{
+		jobs.reserve((vertCount+SMOOTH_VERTICES_JOB_SIZE-1)/SMOOTH_VERTICES_JOB_SIZE);
+		for (unsigned i=0; i<vertCount; i+=SMOOTH_VERTICES_JOB_SIZE)
+		{
+			smoothJobDesc desc;
+			desc.firstIndex = i;
+			desc.lastIndex = std::min(vertCount, i+SMOOTH_VERTICES_JOB_SIZE);
+			jobs.push_back(desc);
+		}
+	}
+	catch(std::bad_alloc)
 	{
-		const CCLib::TriangleSummitsIndexes* tri = getNextTriangleIndexes();
-		edgesCount[tri->i1]+=2;
-		edgesCount[tri->i2]+=2;
-		edgesCount[tri->i3]+=2;
+		//not enough memory
+		return false;
 	}
+	s_smoothAdjacency_MT = adjacency;
+#endif
 
 	//progress dialog
 	CCLib::NormalizedProgress* nProgress = 0;
@@ -458,38 +675,31 @@ bool ccGenericMesh::laplacianSmooth(unsigned nbIteration, float factor, CCLib::G
 	{
 		unsigned totalSteps = nbIteration;
 		nProgress = new CCLib::NormalizedProgress(progressCb,totalSteps);
-		progressCb->setMethodTitle("Laplacian smooth");
+		progressCb->setMethodTitle(title);
 		char buf[256];
 		sprintf(buf, "Iterations: %u\nVertices: %u\nFaces: %u", nbIteration, vertCount, faceCount);
 		progressCb->setInfo(buf);
 		progressCb->start();
 	}
 
-	//repeat Laplacian smoothing iterations
-	for(unsigned iter = 0; iter < nbIteration; iter++)
+	//repeat smoothing iterations
+	unsigned current = 0;
+	for (unsigned iter = 0; iter < nbIteration; iter++)
 	{
-		verticesDisplacement->fill(0);
-
-		//for each triangle
-		placeIteratorAtBegining();
-		for(unsigned j=0; j<faceCount; j++)
+		for (unsigned f=0; f<factorCount; ++f)
 		{
-			const CCLib::TriangleSummitsIndexes* tri = getNextTriangleIndexes();
-
-			const CCVector3* A = m_associatedCloud->getPoint(tri->i1);
-			const CCVector3* B = m_associatedCloud->getPoint(tri->i2);
-			const CCVector3* C = m_associatedCloud->getPoint(tri->i3);
-
-			CCVector3 dAB = (*B-*A);
-			CCVector3 dAC = (*C-*A);
-			CCVector3 dBC = (*C-*B);
-
-			CCVector3* dA = (CCVector3*)verticesDisplacement->getValue(tri->i1);
-			(*dA) += dAB+dAC;
-			CCVector3* dB = (CCVector3*)verticesDisplacement->getValue(tri->i2);
-			(*dB) += dBC-dAB;
-			CCVector3* dC = (CCVector3*)verticesDisplacement->getValue(tri->i3);
-			(*dC) -= dAC+dBC;
+			const CCVector3* in = &buffers[current][0];
+			CCVector3* out = &buffers[1-current][0];
+
+#ifndef ENABLE_MT_OCTREE
+			SmoothVerticesStep(*adjacency, in, out, static_cast<PointCoordinateType>(factors[f]), 0, vertCount);
+#else
+			s_smoothIn_MT = in;
+			s_smoothOut_MT = out;
+			s_smoothFactor_MT = static_cast<PointCoordinateType>(factors[f]);
+			QtConcurrent::blockingMap(jobs, SmoothVerticesStep_MT);
+#endif
+			current = 1-current;
 		}
 
 		if (nProgress && !nProgress->oneStep())
@@ -497,16 +707,14 @@ bool ccGenericMesh::laplacianSmooth(unsigned nbIteration, float factor, CCLib::G
 			//cancelled by user
 			break;
 		}
+	}
 
-		//apply displacement
-		verticesDisplacement->placeIteratorAtBegining();
-		for (unsigned i=0; i<vertCount; i++)
-		{
-			//this is a "persistent" pointer and we know what type of cloud is behind ;)
-			CCVector3* P = const_cast<CCVector3*>(m_associatedCloud->getPointPersistentPtr(i));
-			const CCVector3* d = (const CCVector3*)verticesDisplacement->getValue(i);
-			(*P) += (*d)*(factor/(PointCoordinateType)edgesCount[i]);
-		}
+	//apply the new positions
+	for (unsigned i=0; i<vertCount; i++)
+	{
+		//this is a "persistent" pointer and we know what type of cloud is behind ;)
+		CCVector3* P = const_cast<CCVector3*>(m_associatedCloud->getPointPersistentPtr(i));
+		*P = buffers[current][i];
 	}
 
 	m_associatedCloud->updateModificationTime();
@@ -514,14 +722,6 @@ bool ccGenericMesh::laplacianSmooth(unsigned nbIteration, float factor, CCLib::G
 	if (hasNormals())
 		computeNormals();
 
-	if (verticesDisplacement)
-		verticesDisplacement->release();
-	verticesDisplacement=0;
-
-	if (edgesCount)
-		delete[] edgesCount;
-	edgesCount=0;
-
 	if (nProgress)
 		delete nProgress;
 	nProgress=0;
@@ -529,6 +729,17 @@ bool ccGenericMesh::laplacianSmooth(unsigned nbIteration, float factor, CCLib::G
 	return true;
 }
 
+bool ccGenericMesh::laplacianSmooth(unsigned nbIteration, float factor, CCLib::GenericProgressCallback* progressCb/*=0*/)
+{
+	return smoothVertices(nbIteration, &factor, 1, "Laplacian smooth", progressCb);
+}
+
+bool ccGenericMesh::taubinSmooth(unsigned nbIteration, float lambda, float mu, CCLib::GenericProgressCallback* progressCb/*=0*/)
+{
+	float factors[2] = {lambda, mu};
+	return smoothVertices(nbIteration, factors, 2, "Taubin smooth", progressCb);
+}
+
 bool ccGenericMesh::convertMaterialsToVertexColors()
 {
 	if (!hasMaterials())
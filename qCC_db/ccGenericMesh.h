@@ -27,6 +27,9 @@
 #include "ccHObject.h"
 #include "ccAdvancedTypes.h"
 
+//system
+#include <vector>
+
 class ccGenericPointCloud;
 class ccMaterialSet;
 
@@ -187,6 +190,52 @@ public:
 	**/
 	bool laplacianSmooth(unsigned nbIteration=100, float factor=0.01, CCLib::GenericProgressCallback* progressCb=0);
 
+	//! Taubin (lambda|mu) smoothing
+	/** Each iteration is made of a shrinking Laplacian step (lambda > 0) followed by an
+		inflating one (mu < -lambda), so that the mesh is smoothed without shrinking.
+		\param nbIteration smoothing iterations
+		\param lambda smoothing 'force'
+		\param mu inflating 'force' (negative)
+		\param progressCb progress dialog callback
+	**/
+	bool taubinSmooth(unsigned nbIteration=50, float lambda=0.5f, float mu=-0.53f, CCLib::GenericProgressCallback* progressCb=0);
+
+	//! Vertex adjacency structure (compressed sparse row layout)
+	/** The neighbours of vertex i are neighbours[offsets[i]] ... neighbours[offsets[i+1]-1]
+		(sorted, without duplicates). edgeCounts[k] is the number of triangles sharing the
+		edge (i,neighbours[k]) (i.e. 1 for a border edge, 2 for a manifold one, etc.).
+	**/
+	struct VertexAdjacency
+	{
+		std::vector<unsigned> offsets;
+		std::vector<unsigned> neighbours;
+		std::vector<unsigned> edgeCounts;
+	};
+
+	//! Returns the vertex adjacency structure
+	/** It is computed on the first call and then cached until the number of
+		triangles or vertices changes or invalidateVertexAdjacency is called.
+		Vertices positions are not taken into account (only their count).
+		\return adjacency structure (or 0 if not enough memory)
+	**/
+	const VertexAdjacency* getVertexAdjacency();
+
+	//! Releases the cached vertex adjacency structure
+	/** Called by the methods giving a write access to the triangles indexes
+		(addTriangle, the non const versions of getTriangleIndexes and
+		getNextTriangleIndexes, resize, etc.). Must also be called after any
+		other modification of the triangles indexes.
+		Does nothing (and writes nothing) if no structure is cached.
+	**/
+	inline void invalidateVertexAdjacency()
+	{
+		if (m_vertexAdjacency)
+		{
+			delete m_vertexAdjacency;
+			m_vertexAdjacency = 0;
+		}
+	}
+
 	//! Interpolates normal(s) inside a given triangle
 	/** \param triIndex triangle index
 		\param P point where to interpolate (should be inside the triangle!)
@@ -227,6 +276,15 @@ protected:
 	virtual void drawMeOnly(CC_DRAW_CONTEXT& context);
     virtual void applyGLTransformation(const ccGLMatrix& trans);
 
+	//! Smoothes the vertices with the cached adjacency (see laplacianSmooth and taubinSmooth)
+	/** \param nbIteration smoothing iterations
+		\param factors successive Laplacian factors applied at each iteration
+		\param factorCount number of factors
+		\param title progress dialog title
+		\param progressCb progress dialog callback
+	**/
+	bool smoothVertices(unsigned nbIteration, const float* factors, unsigned factorCount, const char* title, CCLib::GenericProgressCallback* progressCb);
+
 	//! display
 	bool m_showWired;
 
@@ -241,6 +299,13 @@ protected:
 
 	//! Materials
 	ccMaterialSet* m_materials;
+
+	//! Cached vertex adjacency (see getVertexAdjacency)
+	VertexAdjacency* m_vertexAdjacency;
+	//! Number of vertices when the vertex adjacency was computed
+	unsigned m_adjacencyVertCount;
+	//! Number of triangles when the vertex adjacency was computed
+	unsigned m_adjacencyTriCount;
 };
 
 #endif //CC_GENERIC_MESH_HEADER
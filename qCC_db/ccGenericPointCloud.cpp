@@ -62,6 +62,7 @@ bool ccGenericPointCloud::razVisibilityArray()
 	}
 
 	m_pointsVisibility->fill(POINT_VISIBLE); //by default, all points are visible
+	notifyVisibilityChanged();
 
 	return true;
 }
@@ -71,6 +72,7 @@ void ccGenericPointCloud::unallocateVisibilityArray()
 	if (m_pointsVisibility)
 		m_pointsVisibility->release();
 	m_pointsVisibility=0;
+	notifyVisibilityChanged();
 }
 
 bool ccGenericPointCloud::isVisibilityTableInstantiated() const
@@ -136,6 +138,14 @@ ccOctree* ccGenericPointCloud::computeOctree(CCLib::GenericProgressCallback* pro
 
 
 ccGenericPointCloud::VisibilityTableType* ccGenericPointCloud::getTheVisibilityArray()
+{
+	//the caller may modify the array
+	notifyVisibilityChanged();
+
+    return m_pointsVisibility;
+}
+
+const ccGenericPointCloud::VisibilityTableType* ccGenericPointCloud::getTheVisibilityArray() const
 {
     return m_pointsVisibility;
 }
@@ -205,10 +215,10 @@ ccPlane* ccGenericPointCloud::fitPlane(double* rms/*= 0*/)
 	CCLib::Neighbourhood Yk(this);
 
 	//we determine plane normal by computing the smallest eigen value of M = 1/n * S[(p-�)*(p-�)']
-	CCLib::SquareMatrixd eig = Yk.computeCovarianceMatrix().computeJacobianEigenValuesAndVectors();
+	CCLib::SymmetricMatrix3d eig;
 
 	//invalid matrix?
-	if (!eig.isValid())
+	if (!Yk.computeCovarianceMatrix(eig) || !eig.computeEigenValuesAndVectors())
 	{
 		//ccConsole::Warning(QString("[ccPointCloud::fitPlane] Failed to compute plane/normal for cloud '%1'").arg(getName()));
 		return 0;
@@ -290,3 +300,26 @@ void ccGenericPointCloud::setOriginalShift(double x, double y, double z)
 	m_originalShift[1]=y;
 	m_originalShift[2]=z;
 }
+
+bool ccGenericPointCloud::SuggestOriginalShift(const double P[3], double shift[3])
+{
+	//above this value, float coordinates can't reach a millimetric precision
+	static const double MAX_COORDINATE = 1.0e5;
+
+	bool needShift = false;
+	for (unsigned k=0; k<3; ++k)
+	{
+		if (fabs(P[k]) >= MAX_COORDINATE)
+		{
+			//rounded to the nearest km (for readability)
+			shift[k] = -floor(P[k]/1000.0)*1000.0;
+			needShift = true;
+		}
+		else
+		{
+			shift[k] = 0.0;
+		}
+	}
+
+	return needShift;
+}
@@ -160,8 +160,21 @@ public:
 	typedef GenericChunkedArray<1,uchar> VisibilityTableType;
 
     //! Returns associated visiblity array
+	/** As the array may be modified by the caller, the cloud considers that
+		its visibility has changed (see notifyVisibilityChanged). Use the
+		const version for a read-only access.
+	**/
 	virtual VisibilityTableType* getTheVisibilityArray();
 
+    //! Returns associated visiblity array (read-only access)
+	virtual const VisibilityTableType* getTheVisibilityArray() const;
+
+	//! Notifies the cloud that its visibility array has been modified
+	/** Only necessary if the array is modified through a pointer retrieved
+		before (see getTheVisibilityArray).
+	**/
+	virtual void notifyVisibilityChanged() {}
+
     //! Returns a ReferenceCloud equivalent to the visiblity array
 	virtual CCLib::ReferenceCloud* getTheVisiblePoints() const;
 
@@ -210,6 +223,14 @@ public:
 	//! Returns shift to cloud original coordinates
 	const double* getOriginalShift() const { return m_originalShift; }
 
+	//! Suggests a shift for original coordinates too big to be stored as PointCoordinateType
+	/** Loaded coordinates should be P+shift (see setOriginalShift).
+		\param P original coordinates of (any) point of the cloud
+		\param[out] shift suggested shift (0 for the dimensions that don't need any)
+		\return whether a shift is necessary
+	**/
+	static bool SuggestOriginalShift(const double P[3], double shift[3]);
+
 	//! Sets point size
 	/** Overrides default value one if superior than 0
 		(see glPointSize).
@@ -187,6 +187,7 @@ bool ccGenericPrimitive::init(unsigned vertCount, bool vertNormals, unsigned fac
 	//clear triangles indexes
 	assert(m_triIndexes);
 	m_triIndexes->clear();
+	invalidateVertexAdjacency();
 
 	//clear per triangle normals
 	removePerTriangleNormalIndexes();
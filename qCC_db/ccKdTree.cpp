@@ -25,9 +25,11 @@
 #include "ccPointCloud.h"
 
 //CCLib
-#include <DistanceComputationTools.h>
-#include <Neighbourhood.h>
 #include <GenericProgressCallback.h>
+#include <Matrix.h>
+
+//System
+#include <queue>
 
 ccKdTree::ccKdTree(ccGenericPointCloud* aCloud)
 	: CCLib::TrueKdTree(aCloud)
@@ -367,37 +369,172 @@ bool ccKdTree::getNeighborLeaves(ccKdTree::BaseNode* cell, ccKdTree::LeafSet& ne
 	return true;
 }
 
-static bool AscendingLeafRMSComparison(const ccKdTree::Leaf* a, const ccKdTree::Leaf* b)
-{
-	return a->rms < b->rms;
-}
 static bool DescendingLeafSizeComparison(const ccKdTree::Leaf* a, const ccKdTree::Leaf* b)
 {
 	return a->points->size() > b->points->size();
 }
 
-struct Candidate
+//! Mergeable plane statistics of a set of points (see ccKdTree::fuseCells)
+struct PlaneMoments
 {
-	ccKdTree::Leaf* leaf;
-	ScalarType dist;
-	ScalarType radius;
-	CCVector3 centroid;
+	//! Number of points
+	unsigned count;
+	//! Sum of the coordinates (relatively to an arbitrary origin)
+	double sum[3];
+	//! Sum of the coordinates products (xx, yy, zz, xy, xz, yz)
+	double sum2[6];
+
+	PlaneMoments() : count(0)
+	{
+		memset(sum,0,sizeof(double)*3);
+		memset(sum2,0,sizeof(double)*6);
+	}
 
-	Candidate() : leaf(0), dist(NAN_VALUE), radius(0) {}
-	Candidate(ccKdTree::Leaf* l) : leaf(l), dist(NAN_VALUE), radius(0)
+	inline void add(const CCVector3d& P)
 	{
-		if (leaf && leaf->points)
-		{
-			CCLib::Neighbourhood N(leaf->points);
-			centroid = *N.getGravityCenter();
-			radius = N.computeLargestRadius();
-		}
+		++count;
+		sum[0] += P.x;
+		sum[1] += P.y;
+		sum[2] += P.z;
+		sum2[0] += P.x*P.x;
+		sum2[1] += P.y*P.y;
+		sum2[2] += P.z*P.z;
+		sum2[3] += P.x*P.y;
+		sum2[4] += P.x*P.z;
+		sum2[5] += P.y*P.z;
+	}
+
+	inline void add(const PlaneMoments& m)
+	{
+		count += m.count;
+		for (unsigned k=0; k<3; ++k)
+			sum[k] += m.sum[k];
+		for (unsigned k=0; k<6; ++k)
+			sum2[k] += m.sum2[k];
+	}
+
+	inline CCVector3d centroid() const
+	{
+		assert(count != 0);
+		return CCVector3d(sum[0],sum[1],sum[2]) / (double)count;
+	}
+
+	//! Fits the LS plane
+	/** \param[out] N plane normal
+		\return the RMS distance of the points to the plane (or -1 if the fitting failed)
+	**/
+	double fitPlane(CCVector3d& N) const
+	{
+		if (count < 3)
+			return -1.0;
+
+		CCVector3d G = centroid();
+		double invCount = 1.0/(double)count;
+		CCLib::SymmetricMatrix3d eig;
+		eig.set(sum2[0]*invCount - G.x*G.x,
+				sum2[1]*invCount - G.y*G.y,
+				sum2[2]*invCount - G.z*G.z,
+				sum2[3]*invCount - G.x*G.y,
+				sum2[4]*invCount - G.x*G.z,
+				sum2[5]*invCount - G.y*G.z );
+		if (!eig.computeEigenValuesAndVectors())
+			return -1.0;
+
+		//the smallest eigen value is the mean square distance to the plane
+		double lambdaMin = eig.getMinEigenValueAndVector(N.u);
+		N.normalize();
+
+		return sqrt(lambdaMin);
 	}
 };
 
-static bool CandidateDistAscendingComparison(const Candidate& a, const Candidate& b)
+//! Fusion region (i.e. a set of fused cells)
+struct FusionRegion
+{
+	//! Parent region (union-find structure)
+	unsigned parent;
+	//! Version (incremented each time the region grows)
+	unsigned version;
+	//! Plane statistics
+	PlaneMoments moments;
+	//! LS plane normal
+	CCVector3d normal;
+};
+
+//! Fusion candidate (i.e. a potential merge of two regions)
+struct FusionCandidate
+{
+	//! Merge cost (RMS of the merged set, or distance between the regions centroids)
+	double cost;
+	//! Regions
+	unsigned a, b;
+	//! Regions versions at the time the cost was computed
+	unsigned versionA, versionB;
+
+	//! For std::priority_queue (which is a max-heap)
+	bool operator < (const FusionCandidate& other) const { return cost > other.cost; }
+};
+
+//! Returns the root of a region (with path compression)
+static unsigned FindRegionRoot(std::vector<FusionRegion>& regions, unsigned index)
+{
+	unsigned root = index;
+	while (regions[root].parent != root)
+		root = regions[root].parent;
+	while (regions[index].parent != root)
+	{
+		unsigned next = regions[index].parent;
+		regions[index].parent = root;
+		index = next;
+	}
+	return root;
+}
+
+//! Returns the minimum distance between a set of points and a (cell) centroid
+static PointCoordinateType MinDistToCentroid(CCLib::ReferenceCloud* subset, const CCVector3& centroid)
+{
+	PointCoordinateType minDist2 = 0;
+	for (unsigned k=0; k<subset->size(); ++k)
+	{
+		PointCoordinateType d2 = (*subset->getPoint(k)-centroid).norm2();
+		if (d2 < minDist2 || k == 0)
+			minDist2 = d2;
+	}
+	return sqrt(minDist2);
+}
+
+//! Evaluates the fusion of two regions
+/** \return false if the fusion is not acceptable
+**/
+static bool EvaluateFusion(	const std::vector<FusionRegion>& regions,
+							unsigned a,
+							unsigned b,
+							double maxRMS,
+							double minCosNormAngle,
+							bool closestFirst,
+							FusionCandidate& candidate)
 {
-	return a.dist < b.dist;
+	const FusionRegion& ra = regions[a];
+	const FusionRegion& rb = regions[b];
+
+	//if the orientations are too different
+	if (fabs(ra.normal.dot(rb.normal)) < minCosNormAngle)
+		return false;
+
+	PlaneMoments merged = ra.moments;
+	merged.add(rb.moments);
+	CCVector3d N;
+	double rms = merged.fitPlane(N);
+	if (rms < 0.0 || rms > maxRMS)
+		return false;
+
+	candidate.a = a;
+	candidate.b = b;
+	candidate.versionA = ra.version;
+	candidate.versionB = rb.version;
+	candidate.cost = (closestFirst ? (ra.moments.centroid()-rb.moments.centroid()).norm2() : rms);
+
+	return true;
 }
 
 bool ccKdTree::fuseCells(double maxRMS, double maxAngle_deg, double overlapCoef, bool closestFirst/*=true*/, CCLib::GenericProgressCallback* progressCb/*=0*/)
@@ -417,7 +554,7 @@ bool ccKdTree::fuseCells(double maxRMS, double maxAngle_deg, double overlapCoef,
 		progressCb->reset();
 		progressCb->setMethodTitle("Fuse Kd-tree cells");
 		char buf[256];
-		sprintf(buf, "cells: %u\nmax RMS: %u", leaves.size(), maxRMS);
+		sprintf(buf, "cells: %u\nmax RMS: %f", (unsigned)leaves.size(), maxRMS);
 		progressCb->setInfo(buf);
 		nProgress = new CCLib::NormalizedProgress(progressCb,(unsigned)leaves.size());
 		progressCb->start();
@@ -425,262 +562,191 @@ bool ccKdTree::fuseCells(double maxRMS, double maxAngle_deg, double overlapCoef,
 
 	ccPointCloud* pc = static_cast<ccPointCloud*>(m_associatedGenericCloud);
 
-	//sort cells based on their population size (we start by the biggest ones)
+	//sort cells based on their population size (the biggest ones get the first indexes)
 	std::sort(leaves.begin(),leaves.end(),DescendingLeafSizeComparison);
 
-	//set all 'userData' to -1 (i.e. unfused cells)
+	// max angle between fused 'planes'
+	const double c_minCosNormAngle = cos(maxAngle_deg * CC_DEG_TO_RAD);
+
+	//one region per cell (cells already above the max RMS are ignored)
+	std::vector<FusionRegion> regions;
+	std::vector<CCVector3> centroids;
+	std::vector<PointCoordinateType> radii;
+	std::priority_queue<FusionCandidate> candidates;
+	try
 	{
-		for (size_t i=0; i<leaves.size(); ++i)
+		regions.resize(leaves.size());
+		centroids.resize(leaves.size());
+		radii.resize(leaves.size());
+	}
+	catch (std::bad_alloc)
+	{
+		//not enough memory!
+		ccLog::Warning("[ccKdTree::fuseCells] Not enough memory!");
+		if (nProgress)
+			delete nProgress;
+		return false;
+	}
+
+	//moments origin (to preserve numerical accuracy)
+	CCVector3d origin(0,0,0);
+	{
+		ccBBox box = getMyOwnBB();
+		if (box.isValid())
 		{
-			leaves[i]->userData = -1;
-			//check by the way that the plane normal is unit!
-			assert(fabs(CCVector3(leaves[i]->planeEq).norm2() - 1.0) < 1.0e-6);
+			CCVector3 C = box.getCenter();
+			origin = CCVector3d(C.x,C.y,C.z);
 		}
 	}
 
-	// max angle between fused 'planes'
-	const double c_minCosNormAngle = cos(maxAngle_deg * CC_DEG_TO_RAD);
+	for (size_t i=0; i<leaves.size(); ++i)
+	{
+		Leaf* leaf = leaves[i];
+		//check by the way that the plane normal is unit!
+		assert(fabs(CCVector3(leaf->planeEq).norm2() - 1.0) < 1.0e-6);
+		//we use 'userData' to store the cell index (temporarily)
+		leaf->userData = (int)i;
+
+		FusionRegion& region = regions[i];
+		region.parent = (unsigned)i;
+		region.version = 0;
+		region.normal = CCVector3d(leaf->planeEq[0],leaf->planeEq[1],leaf->planeEq[2]);
+
+		CCLib::ReferenceCloud* subset = leaf->points;
+		for (unsigned j=0; j<subset->size(); ++j)
+		{
+			const CCVector3* P = subset->getPoint(j);
+			region.moments.add(CCVector3d(P->x-origin.x,P->y-origin.y,P->z-origin.z));
+		}
 
-	//fuse all cells, starting from the ones with the best RMS
-	const int unvisitedNeighborValue = -1;
-	int macroIndex = 1; //starts at 1 (0 is reserved for cells already above the max RMS)
+		//cell centroid and largest radius
+		CCVector3d G = region.moments.centroid();
+		centroids[i] = CCVector3((PointCoordinateType)(G.x+origin.x),(PointCoordinateType)(G.y+origin.y),(PointCoordinateType)(G.z+origin.z));
+		PointCoordinateType maxSquareDist = 0;
+		for (unsigned j=0; j<subset->size(); ++j)
+			maxSquareDist = std::max(maxSquareDist,(*subset->getPoint(j)-centroids[i]).norm2());
+		radii[i] = sqrt(maxSquareDist);
+	}
+
+	//leaves adjacency graph: each pair of touching cells is evaluated once
+	for (size_t i=0; i<leaves.size(); ++i)
 	{
-		for (size_t i=0; i<leaves.size(); ++i)
+		//cells already above the user defined threshold can't be fused
+		if (leaves[i]->rms >= maxRMS)
+			continue;
+
+		LeafSet neighbors;
+		if (!getNeighborLeaves(leaves[i], neighbors))
+		{
+			//an error occured
+			if (nProgress)
+				delete nProgress;
+			return false;
+		}
+
+		CCLib::ReferenceCloud* subset = leaves[i]->points;
+		for (LeafSet::iterator it=neighbors.begin(); it != neighbors.end(); ++it)
 		{
-			Leaf* currentCell = leaves[i];
-			if (currentCell->rms >= maxRMS)
-				currentCell->userData = 0; //0 = special group for cells already above the user defined threshold!
+			size_t j = (size_t)(*it)->userData;
+			if (j <= i || leaves[j]->rms >= maxRMS)
+				continue;
 
-			//already fused?
-			if (currentCell->userData != -1)
+			//if the cells are too far (i.e. one of the centroids is farther from the other cell points than its own cell radius)
+			if (	radii[j] < MinDistToCentroid(subset,centroids[j]) / overlapCoef
+				||	radii[i] < MinDistToCentroid(leaves[j]->points,centroids[i]) / overlapCoef)
 			{
-				if (nProgress && !nProgress->oneStep()) //process canceled by user
-					break;
 				continue;
 			}
 
-			//we create a new "macro cell" index
-			currentCell->userData = macroIndex++;
-
-			//we init the current set of 'fused' points with the cell's points
-			CCLib::ReferenceCloud* currentPointSet = currentCell->points;
-			//current fused set centroid and radius
-			CCVector3 currentCentroid;
+			FusionCandidate candidate;
+			if (EvaluateFusion(regions,(unsigned)i,(unsigned)j,maxRMS,c_minCosNormAngle,closestFirst,candidate))
 			{
-				CCLib::Neighbourhood N(currentPointSet);
-				currentCentroid = *N.getGravityCenter();
+				try
+				{
+					candidates.push(candidate);
+				}
+				catch (std::bad_alloc)
+				{
+					//not enough memory!
+					ccLog::Warning("[ccKdTree::fuseCells] Not enough memory!");
+					if (nProgress)
+						delete nProgress;
+					return false;
+				}
 			}
-			CCVector3 currentNormal(currentCell->planeEq);
-
-			//visited neighbors
-			LeafSet visitedNeighbors;
-			//set of candidates
-			std::list<Candidate> candidates;
+		}
+	}
 
-			//we are going to iteratively look for neighbor cells that could be fused to this one
-			LeafVector cellsToTest;
-			cellsToTest.push_back(currentCell);
+	//fuse the regions, starting from the best candidates
+	while (!candidates.empty())
+	{
+		FusionCandidate candidate = candidates.top();
+		candidates.pop();
 
-			if (nProgress && !nProgress->oneStep()) //process canceled by user
-				break;
+		unsigned a = FindRegionRoot(regions,candidate.a);
+		unsigned b = FindRegionRoot(regions,candidate.b);
+		if (a == b)
+			continue; //already fused
 
-			while (!cellsToTest.empty() || !candidates.empty())
+		//one of the regions has changed since this candidate was evaluated
+		if (a != candidate.a || b != candidate.b || regions[a].version != candidate.versionA || regions[b].version != candidate.versionB)
+		{
+			FusionCandidate updated;
+			if (EvaluateFusion(regions,a,b,maxRMS,c_minCosNormAngle,closestFirst,updated))
 			{
-				//get all neighbors around the 'waiting' cell(s)
-				if (!cellsToTest.empty())
+				try
 				{
-					LeafSet neighbors;
-					while (!cellsToTest.empty())
-					{
-						if (!getNeighborLeaves(cellsToTest.back(), neighbors, &unvisitedNeighborValue)) //we only consider unvisited cells!
-						{
-							//an error occured
-							return false;
-						}
-						cellsToTest.pop_back();
-					}
-
-					//add those (new) neighbors to the 'visitedNeighbors' set and to the candidates set by the way
-					//if they are not yet there
-					for (LeafSet::iterator it=neighbors.begin(); it != neighbors.end(); ++it)
-					{
-						Leaf* neighbor = *it;
-						std::pair<LeafSet::iterator,bool> ret = visitedNeighbors.insert(neighbor);
-						//neighbour not already in the set?
-						if (ret.second)
-						{
-							//we create the corresponding candidate
-							try
-							{
-								candidates.push_back(Candidate(neighbor));
-							}
-							catch (std::bad_alloc)
-							{
-								//not enough memory!
-								ccLog::Warning("[ccKdTree::fuseCells] Not enough memory!");
-								return false;
-							}
-						}
-					}
+					candidates.push(updated);
 				}
-
-				//is there remaining candidates?
-				if (!candidates.empty())
+				catch (std::bad_alloc)
 				{
-					//update the set of candidates
-					if (closestFirst && candidates.size() > 1)
-					{
-						for (std::list<Candidate>::iterator it = candidates.begin(); it !=candidates.end(); ++it)
-							it->dist = (it->centroid-currentCentroid).norm2();
-
-						//sort candidates by their distance
-						candidates.sort(CandidateDistAscendingComparison);
-					}
-					
-					//we will keep track of the best fused 'couple' at each pass
-					std::list<Candidate>::iterator bestIt = candidates.end();
-					CCLib::ReferenceCloud* bestFused = 0;
-					CCVector3 bestNormal(0,0,0);
-					double bestRMS = -1.0;
-
-					unsigned skipCount = 0;
-					for (std::list<Candidate>::iterator it = candidates.begin(); it != candidates.end(); /*++it*/)
-					{
-						assert(it->leaf && it->leaf->points);
-						assert(currentPointSet->getAssociatedCloud() == it->leaf->points->getAssociatedCloud());
-
-						//if the leaf orientation is too different
-						if (fabs(CCVector3(it->leaf->planeEq).dot(currentNormal)) < c_minCosNormAngle)
-						{
-							it = candidates.erase(it);
-							//++it;
-							//++skipCount;
-							continue;
-						}
-
-						//compute the minimum distance between the candidate centroid and the 'currentPointSet'
-						PointCoordinateType minDistToMainSet = 0.0;
-						{
-							for (unsigned j=0; j<currentPointSet->size(); ++j)
-							{
-								const CCVector3* P = currentPointSet->getPoint(j);
-								PointCoordinateType d2 = (*P-it->centroid).norm2();
-								if (d2 < minDistToMainSet || j == 0)
-									minDistToMainSet = d2;
-							}
-							minDistToMainSet = sqrt(minDistToMainSet);
-						}
-						
-						//if the leaf is too far
-						if (it->radius < minDistToMainSet / overlapCoef)
-						{
-							++it;
-							++skipCount;
-							continue;
-						}
-
-						//fuse the best fused set with the current candidate
-						CCLib::ReferenceCloud* fused = new CCLib::ReferenceCloud(*currentPointSet);
-						if (!fused->add(*(it->leaf->points)))
-						{
-							//not enough memory!
-							ccLog::Warning("[ccKdTree::fuseCells] Not enough memory!");
-							delete fused;
-							if (currentPointSet != currentCell->points)
-								delete currentPointSet;
-							return false;
-						}
-
-						//fit a plane and estimate resulting RMS
-						double rms = -1.0;
-						const PointCoordinateType* planeEquation = CCLib::Neighbourhood(fused).getLSQPlane();
-						if (planeEquation)
-							//rms = CCLib::DistanceComputationTools::computeCloud2PlaneDistanceRMS(fused, planeEquation);
-							rms = CCLib::DistanceComputationTools::ComputeCloud2PlaneRobustMax(fused, planeEquation, 0.02f);
-						//double rms = 0.0; //FIXME TEST
-
-						if (rms < 0.0 || rms > maxRMS)
-						{
-							//candidate is rejected
-							it = candidates.erase(it);
-						}
-						else
-						{
-							//otherwise we keep track of the best one!
-							if (bestRMS < 0.0 || rms < bestRMS)
-							{
-								bestIt = it;
-								bestRMS = rms;
-								if (bestFused)
-									delete bestFused;
-								bestFused = fused;
-								bestNormal = CCVector3(planeEquation);
-								fused = 0;
-								
-								if (closestFirst)
-									break; //if we have found a good candidate, we stop here (closest first ;)
-							}
-							++it;
-						}
-
-						if (fused)
-						{
-							delete fused;
-							fused = 0;
-						}
-					}
-
-					//we have a (best) candidate for this pass?
-					if (bestIt != candidates.end())
-					{
-						assert(bestFused && bestRMS >= 0.0);
-						if (currentPointSet != currentCell->points)
-							delete currentPointSet;
-						currentPointSet = bestFused;
-						{
-							//update infos
-							CCLib::Neighbourhood N(currentPointSet);
-							//currentCentroid = *N.getGravityCenter(); //if we update it, the search will naturally shift along one dimension!
-							//currentNormal = bestNormal; //same thing here for normals
-						}
-
-						bestIt->leaf->userData = currentCell->userData;
-						//bestIt->leaf->userData = macroIndex++; //FIXME TEST
-
-						//we will test this cell's neighbors as well
-						cellsToTest.push_back(bestIt->leaf);
-
-						if (nProgress && !nProgress->oneStep()) //process canceled by user
-						{
-							//permaturate end!
-							candidates.clear();
-							cellsToTest.clear();
-							i = leaves.size();
-							break;
-						}
-						//QApplication::processEvents(); // TODO
-
-						//we also remove it from the candidates list
-						candidates.erase(bestIt);
-					}
-
-					if (skipCount == candidates.size() && cellsToTest.empty())
-					{
-						//only far leaves remain...
-						candidates.clear();
-					}
-
+					//not enough memory!
+					ccLog::Warning("[ccKdTree::fuseCells] Not enough memory!");
+					if (nProgress)
+						delete nProgress;
+					return false;
 				}
-			
-			} //no more candidates or cells to test
+			}
+			continue;
+		}
+
+		//fuse the smallest region into the biggest one
+		if (regions[a].moments.count < regions[b].moments.count)
+			std::swap(a,b);
+		regions[b].parent = a;
+		regions[a].moments.add(regions[b].moments);
+		regions[a].moments.fitPlane(regions[a].normal);
+		++regions[a].version;
+
+		if (nProgress && !nProgress->oneStep()) //process canceled by user
+			break;
+	}
+
+	//regions indexes
+	int macroIndex = 1; //starts at 1 (0 is reserved for cells already above the max RMS)
+	{
+		std::vector<int> regionIndexes(leaves.size(),-1);
+		for (size_t i=0; i<leaves.size(); ++i)
+		{
+			if (leaves[i]->rms >= maxRMS)
+			{
+				leaves[i]->userData = 0; //0 = special group for cells already above the user defined threshold!
+				continue;
+			}
 
-			//end of the fusion process for the current leaf
-			if (currentPointSet != currentCell->points)
-				delete currentPointSet;
-			currentPointSet = 0;
+			unsigned root = FindRegionRoot(regions,(unsigned)i);
+			if (regionIndexes[root] < 0)
+				regionIndexes[root] = macroIndex++;
+			leaves[i]->userData = regionIndexes[root];
 		}
 	}
 
+	if (nProgress)
+	{
+		delete nProgress;
+		nProgress = 0;
+	}
+
 	//convert fused indexes to SF
 	{
 		pc->enableScalarField();
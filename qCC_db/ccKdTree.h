@@ -77,9 +77,15 @@ public:
 
 	//! Fuses cells
 	/** Creates a new scalar fields with the groups indexes.
+		The leaves adjacency graph is computed once, then the candidate fusions
+		(pairs of adjacent sets) are processed by order of cost with a priority
+		queue. Each set keeps the moments of its points, so that the LS plane
+		(and RMS) of two fused sets is computed in constant time.
 		\param maxRMS max RMS after fusion
 		\param maxAngle_deg maximum angle between two sets to allow fusion (in degrees)
 		\param overlapCoef maximum relative distance between two sets to accept fusion (1 = no distance, < 1 = overlap, > 1 = gap)
+		\param closestFirst whether the closest sets (centroids distance) should be fused first, or the ones that give the smallest RMS
+		\param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
 	**/
 	bool fuseCells(double maxRMS, double maxAngle_deg, double overlapCoef = 1.0, bool closestFirst = true, CCLib::GenericProgressCallback* progressCb = 0);
 
@@ -0,0 +1,539 @@
+//##########################################################################
+//#                                                                        #
+//#                            CLOUDCOMPARE                                #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 of the License.               #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: EDF R&D / TELECOM ParisTech (ENST-TSI)             #
+//#                                                                        #
+//##########################################################################
+
+#include "ccLasFile.h"
+
+//Local
+#include "ccPointCloud.h"
+#include "ccScalarField.h"
+#include "ccLog.h"
+
+//CCLib
+#include <DgmOctree.h> //for ENABLE_MT_OCTREE
+
+//system
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <assert.h>
+#include <vector>
+#include <algorithm>
+
+//! Reads a little endian value (LAS files are always little endian)
+template<typename T> static inline T ReadLE(const unsigned char* p)
+{
+	T value;
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+	unsigned char bytes[sizeof(T)];
+	for (size_t i=0; i<sizeof(T); ++i)
+		bytes[i] = p[sizeof(T)-1-i];
+	memcpy(&value,bytes,sizeof(T));
+#else
+	memcpy(&value,p,sizeof(T));
+#endif
+	return value;
+}
+
+//! Min record length for each point format
+static const unsigned s_lasMinRecordLength[11] = { 20, 28, 26, 34, 57, 63, 30, 36, 38, 59, 67 };
+
+//! Header size of version 1.0 files (the smallest)
+static const size_t LAS_MIN_HEADER_SIZE = 227;
+
+//! Number of records processed by each job
+static const unsigned LAS_JOB_SIZE = MAX_NUMBER_OF_ELEMENTS_PER_CHUNK;
+
+//! Records layout and output arrays
+struct lasLoadingContext
+{
+	const unsigned char* records;
+	unsigned recordLength;
+	unsigned pointFormat;
+
+	//! Filter (in integer coordinates)
+	bool useBox;
+	int64_t boxMin[3];
+	int64_t boxMax[3];
+	unsigned step;
+
+	//! Fields offsets in the records (-1 if the field is not present)
+	int gpsTimeOffset;
+	int rgbOffset;
+	int classificationOffset;
+	unsigned char classificationMask;
+	bool colors16Bits;
+
+	//! Conversion from integer coordinates (including the global shift)
+	double scale[3];
+	double offset[3];
+	double gpsTimeShift;
+
+	GenericChunkedArray<3,PointCoordinateType>* points;
+	ColorsTableType* colors;
+	ccScalarField* intensitySF;
+	ccScalarField* classificationSF;
+	ccScalarField* gpsTimeSF;
+};
+
+//! Block of records
+struct lasJobDesc
+{
+	uint64_t firstRecord;
+	uint64_t lastRecord;
+	//! Index of the first point of the block (in the cloud)
+	unsigned firstIndex;
+	//! Number of points passing the filter
+	unsigned count;
+};
+
+//! Returns whether a record passes the filter
+static inline bool AcceptRecord(const lasLoadingContext& context, uint64_t recordIndex, const unsigned char* record)
+{
+	if (context.step > 1 && (recordIndex % context.step) != 0)
+		return false;
+
+	if (context.useBox)
+	{
+		for (unsigned k=0; k<3; ++k)
+		{
+			int64_t v = ReadLE<int32_t>(record+4*k);
+			if (v < context.boxMin[k] || v > context.boxMax[k])
+				return false;
+		}
+	}
+
+	return true;
+}
+
+//! First pass: counts the points of a block that pass the filter
+static void CountRecords(const lasLoadingContext& context, lasJobDesc& job)
+{
+	unsigned count = 0;
+	const unsigned char* record = context.records + job.firstRecord*context.recordLength;
+	for (uint64_t i=job.firstRecord; i<job.lastRecord; ++i, record += context.recordLength)
+		if (AcceptRecord(context,i,record))
+			++count;
+	job.count = count;
+}
+
+//! Second pass: decodes the points of a block that pass the filter
+static void DecodeRecords(const lasLoadingContext& context, lasJobDesc& job)
+{
+	unsigned index = job.firstIndex;
+	const unsigned char* record = context.records + job.firstRecord*context.recordLength;
+	for (uint64_t i=job.firstRecord; i<job.lastRecord; ++i, record += context.recordLength)
+	{
+		if (!AcceptRecord(context,i,record))
+			continue;
+
+		PointCoordinateType* P = context.points->getValue(index);
+		for (unsigned k=0; k<3; ++k)
+			P[k] = static_cast<PointCoordinateType>(ReadLE<int32_t>(record+4*k)*context.scale[k] + context.offset[k]);
+
+		context.intensitySF->setValue(index,static_cast<ScalarType>(ReadLE<uint16_t>(record+12)));
+		context.classificationSF->setValue(index,static_cast<ScalarType>(record[context.classificationOffset] & context.classificationMask));
+
+		if (context.gpsTimeSF)
+			context.gpsTimeSF->setValue(index,static_cast<ScalarType>(ReadLE<double>(record+context.gpsTimeOffset) - context.gpsTimeShift));
+
+		if (context.colors)
+		{
+			colorType* C = context.colors->getValue(index);
+			for (unsigned k=0; k<3; ++k)
+			{
+				uint16_t c = ReadLE<uint16_t>(record+context.rgbOffset+2*k);
+				C[k] = static_cast<colorType>(context.colors16Bits ? (c >> 8) : std::min<uint16_t>(c,255));
+			}
+		}
+
+		++index;
+	}
+
+	assert(index - job.firstIndex == job.count);
+}
+
+#ifdef ENABLE_MT_OCTREE
+
+#include <QtCore/QtCore>
+
+static const lasLoadingContext* s_lasContext_MT = 0;
+
+void CountRecords_MT(lasJobDesc* &job)
+{
+	CountRecords(*s_lasContext_MT,*job);
+}
+
+void DecodeRecords_MT(lasJobDesc* &job)
+{
+	DecodeRecords(*s_lasContext_MT,*job);
+}
+
+#endif
+
+//! Runs a pass on all jobs (by batches, to report the progress)
+static bool RunPass(const lasLoadingContext& context, const std::vector<lasJobDesc*>& jobPtrs, bool decode, CCLib::NormalizedProgress* nprogress)
+{
+#ifdef ENABLE_MT_OCTREE
+	s_lasContext_MT = &context;
+	const size_t batchSize = static_cast<size_t>(std::max(1,QThread::idealThreadCount()))*4;
+	std::vector<lasJobDesc*> batch;
+#endif
+
+	bool success = true;
+	for (size_t i=0; i<jobPtrs.size() && success; )
+	{
+#ifndef ENABLE_MT_OCTREE
+		if (decode)
+			DecodeRecords(context,*jobPtrs[i]);
+		else
+			CountRecords(context,*jobPtrs[i]);
+		size_t processed = 1;
+#else
+		size_t processed = std::min(batchSize,jobPtrs.size()-i);
+		batch.assign(jobPtrs.begin()+i,jobPtrs.begin()+(i+processed));
+		QtConcurrent::blockingMap(batch, decode ? DecodeRecords_MT : CountRecords_MT);
+#endif
+		i += processed;
+
+		for (size_t j=0; j<processed && nprogress; ++j)
+			if (!nprogress->oneStep())
+				success = false;
+	}
+
+#ifdef ENABLE_MT_OCTREE
+	s_lasContext_MT = 0;
+#endif
+
+	return success;
+}
+
+CC_FILE_ERROR ccLasFile::Load(const char* filename, ccPointCloud*& cloud, const Filter* filter/*=0*/, CCLib::GenericProgressCallback* progressCb/*=0*/)
+{
+	cloud = 0;
+
+	CC_FILE_ERROR error = CC_FERR_NO_ERROR;
+	ccMappedFile* file = ccMappedFile::Map(filename,&error);
+	if (!file)
+		return error;
+
+	const unsigned char* data = file->data();
+	size_t size = file->size();
+
+	/*** header ***/
+
+	if (size < 4 || memcmp(data,"LASF",4) != 0)
+	{
+		file->release();
+		return CC_FERR_WRONG_FILE_TYPE;
+	}
+	if (size < LAS_MIN_HEADER_SIZE)
+	{
+		file->release();
+		return CC_FERR_MALFORMED_FILE;
+	}
+
+	unsigned versionMajor = data[24];
+	unsigned versionMinor = data[25];
+	unsigned headerSize = ReadLE<uint16_t>(data+94);
+	uint32_t pointsOffset = ReadLE<uint32_t>(data+96);
+	unsigned pointFormat = data[104];
+	unsigned recordLength = ReadLE<uint16_t>(data+105);
+	uint64_t pointCount = ReadLE<uint32_t>(data+107);
+	double scale[3] = { ReadLE<double>(data+131), ReadLE<double>(data+139), ReadLE<double>(data+147) };
+	double offset[3] = { ReadLE<double>(data+155), ReadLE<double>(data+163), ReadLE<double>(data+171) };
+	double bbMax[3] = { ReadLE<double>(data+179), ReadLE<double>(data+195), ReadLE<double>(data+211) };
+	double bbMin[3] = { ReadLE<double>(data+187), ReadLE<double>(data+203), ReadLE<double>(data+219) };
+
+	if (versionMajor != 1 || versionMinor > 4)
+	{
+		ccLog::Warning("[ccLasFile] Unhandled version (%u.%u)",versionMajor,versionMinor);
+		file->release();
+		return CC_FERR_NOT_IMPLEMENTED;
+	}
+	//LAS 1.4: 64 bits points count
+	if (versionMinor >= 4 && headerSize >= 375 && size >= 375 && pointCount == 0)
+		pointCount = ReadLE<uint64_t>(data+247);
+
+	if (pointFormat & 0xC0)
+	{
+		ccLog::Warning("[ccLasFile] Compressed files (LAZ) are not handled");
+		file->release();
+		return CC_FERR_NOT_IMPLEMENTED;
+	}
+	if (pointFormat > 10)
+	{
+		ccLog::Warning("[ccLasFile] Unhandled point format (%u)",pointFormat);
+		file->release();
+		return CC_FERR_NOT_IMPLEMENTED;
+	}
+	if (recordLength < s_lasMinRecordLength[pointFormat] || scale[0] <= 0 || scale[1] <= 0 || scale[2] <= 0 || pointsOffset < headerSize || pointsOffset > size)
+	{
+		file->release();
+		return CC_FERR_MALFORMED_FILE;
+	}
+
+	//truncated files
+	uint64_t availableCount = (size - pointsOffset) / recordLength;
+	if (availableCount < pointCount)
+	{
+		ccLog::Warning("[ccLasFile] File is truncated (%llu points out of %llu)",static_cast<unsigned long long>(availableCount),static_cast<unsigned long long>(pointCount));
+		pointCount = availableCount;
+	}
+
+	/*** loading context ***/
+
+	lasLoadingContext context;
+	context.records = data + pointsOffset;
+	context.recordLength = recordLength;
+	context.pointFormat = pointFormat;
+	context.useBox = false;
+	context.step = (filter && filter->step > 1 ? filter->step : 1);
+	context.points = 0;
+	context.colors = 0;
+	context.intensitySF = context.classificationSF = context.gpsTimeSF = 0;
+
+	bool legacyFormat = (pointFormat < 6);
+	context.classificationOffset = (legacyFormat ? 15 : 16);
+	context.classificationMask = (legacyFormat ? 0x1F : 0xFF);
+	switch (pointFormat)
+	{
+	case 1: case 4:
+		context.gpsTimeOffset = 20;
+		context.rgbOffset = -1;
+		break;
+	case 2:
+		context.gpsTimeOffset = -1;
+		context.rgbOffset = 20;
+		break;
+	case 3: case 5:
+		context.gpsTimeOffset = 20;
+		context.rgbOffset = 28;
+		break;
+	case 6: case 9:
+		context.gpsTimeOffset = 22;
+		context.rgbOffset = -1;
+		break;
+	case 7: case 8: case 10:
+		context.gpsTimeOffset = 22;
+		context.rgbOffset = 30;
+		break;
+	default: //format 0
+		context.gpsTimeOffset = -1;
+		context.rgbOffset = -1;
+		break;
+	}
+
+	if (filter && filter->useBox)
+	{
+		//quick rejection with the header bounding box
+		for (unsigned k=0; k<3; ++k)
+		{
+			if (filter->boxMin[k] > bbMax[k] || filter->boxMax[k] < bbMin[k])
+			{
+				file->release();
+				return CC_FERR_NO_ERROR;
+			}
+		}
+
+		//the box is converted in integer coordinates (so that records are filtered without any conversion)
+		context.useBox = true;
+		for (unsigned k=0; k<3; ++k)
+		{
+			double rawMin = ceil((filter->boxMin[k] - offset[k]) / scale[k]);
+			double rawMax = floor((filter->boxMax[k] - offset[k]) / scale[k]);
+			context.boxMin[k] = static_cast<int64_t>(std::max(rawMin,static_cast<double>(INT32_MIN)));
+			context.boxMax[k] = static_cast<int64_t>(std::min(rawMax,static_cast<double>(INT32_MAX)));
+		}
+	}
+
+	//global shift
+	double shift[3] = {0,0,0};
+	{
+		double P[3] = { bbMin[0], bbMin[1], bbMin[2] };
+		if (pointCount != 0)
+			for (unsigned k=0; k<3; ++k)
+				P[k] = ReadLE<int32_t>(context.records+4*k)*scale[k] + offset[k];
+		if (ccGenericPointCloud::SuggestOriginalShift(P,shift))
+			ccLog::Warning("[ccLasFile] Coordinates are too big: cloud has been shifted by (%f;%f;%f)",shift[0],shift[1],shift[2]);
+	}
+	for (unsigned k=0; k<3; ++k)
+	{
+		context.scale[k] = scale[k];
+		context.offset[k] = offset[k] + shift[k];
+	}
+
+	//GPS time shift
+	context.gpsTimeShift = 0;
+	if (context.gpsTimeOffset >= 0 && pointCount != 0)
+	{
+		context.gpsTimeShift = floor(ReadLE<double>(context.records+context.gpsTimeOffset));
+		if (context.gpsTimeShift != 0)
+			ccLog::Print("[ccLasFile] GPS times are relative to %f",context.gpsTimeShift);
+	}
+
+	//colors coded on 8 or 16 bits (we look at the first block)
+	context.colors16Bits = false;
+	if (context.rgbOffset >= 0)
+	{
+		const unsigned char* record = context.records;
+		for (uint64_t i=0; i<std::min<uint64_t>(pointCount,LAS_JOB_SIZE) && !context.colors16Bits; ++i, record += recordLength)
+			for (unsigned k=0; k<3; ++k)
+				if (ReadLE<uint16_t>(record+context.rgbOffset+2*k) > 255)
+					context.colors16Bits = true;
+	}
+
+	/*** jobs ***/
+
+	std::vector<lasJobDesc> jobs;
+	std::vector<lasJobDesc*> jobPtrs;
+	try
+	{
+		jobs.resize(static_cast<size_t>((pointCount + LAS_JOB_SIZE - 1) / LAS_JOB_SIZE));
+		jobPtrs.resize(jobs.size());
+		for (size_t i=0; i<jobs.size(); ++i)
+		{
+			jobs[i].firstRecord = static_cast<uint64_t>(i) * LAS_JOB_SIZE;
+			jobs[i].lastRecord = std::min<uint64_t>(pointCount,jobs[i].firstRecord + LAS_JOB_SIZE);
+			jobs[i].firstIndex = jobs[i].count = 0;
+			jobPtrs[i] = &jobs[i];
+		}
+	}
+	catch(std::bad_alloc)
+	{
+		file->release();
+		return CC_FERR_NOT_ENOUGH_MEMORY;
+	}
+
+	CCLib::NormalizedProgress* nprogress = 0;
+	if (progressCb)
+	{
+		progressCb->reset();
+		nprogress = new CCLib::NormalizedProgress(progressCb,static_cast<unsigned>(jobs.size()*(context.useBox ? 2 : 1)));
+		progressCb->setMethodTitle("Load LAS file");
+		char buffer[256];
+		sprintf(buffer,"Points: %llu\nFormat: %u",static_cast<unsigned long long>(pointCount),pointFormat);
+		progressCb->setInfo(buffer);
+		progressCb->start();
+	}
+
+	//first pass: filtering (only if necessary)
+	uint64_t loadedCount = 0;
+	if (context.useBox)
+	{
+		if (!RunPass(context,jobPtrs,false,nprogress))
+			error = CC_FERR_CANCELED_BY_USER;
+	}
+	else
+	{
+		//the subsampling is deterministic
+		for (size_t i=0; i<jobs.size(); ++i)
+		{
+			lasJobDesc& job = jobs[i];
+			uint64_t firstKept = (job.firstRecord + context.step - 1) / context.step;
+			uint64_t lastKept = (job.lastRecord + context.step - 1) / context.step;
+			job.count = static_cast<unsigned>(lastKept - firstKept);
+		}
+	}
+	for (size_t i=0; i<jobs.size(); ++i)
+	{
+		jobs[i].firstIndex = static_cast<unsigned>(loadedCount);
+		loadedCount += jobs[i].count;
+	}
+
+	if (error == CC_FERR_NO_ERROR && loadedCount >= (1ULL<<32))
+	{
+		ccLog::Warning("[ccLasFile] Too many points (use a filter)");
+		error = CC_FERR_NOT_IMPLEMENTED;
+	}
+
+	//the arrays are allocated once (only for the points that passed the filter)
+	if (error == CC_FERR_NO_ERROR && loadedCount != 0)
+	{
+		std::string name(filename);
+		size_t slash = name.find_last_of("/\\");
+		cloud = new ccPointCloud(slash == std::string::npos ? name : name.substr(slash+1));
+
+		bool success = cloud->resize(static_cast<unsigned>(loadedCount));
+		if (success && context.rgbOffset >= 0)
+			success = cloud->resizeTheRGBTable(false);
+
+		const char* sfNames[3] = { "Intensity", "Classification", "GPS time" };
+		ccScalarField** sfs[3] = { &context.intensitySF, &context.classificationSF, &context.gpsTimeSF };
+		unsigned sfCount = (context.gpsTimeOffset >= 0 ? 3 : 2);
+		for (unsigned i=0; i<sfCount && success; ++i)
+		{
+			ccScalarField* sf = new ccScalarField(sfNames[i]);
+			if (!sf->resize(static_cast<unsigned>(loadedCount)) || cloud->addScalarField(sf) < 0)
+			{
+				sf->release();
+				success = false;
+				break;
+			}
+			*sfs[i] = sf;
+		}
+
+		if (success)
+		{
+			context.points = cloud->pointsTable();
+			context.colors = cloud->rgbColors();
+
+			//second pass: decoding
+			if (!RunPass(context,jobPtrs,true,nprogress))
+				error = CC_FERR_CANCELED_BY_USER;
+		}
+		else
+		{
+			error = CC_FERR_NOT_ENOUGH_MEMORY;
+		}
+	}
+
+	if (nprogress)
+	{
+		delete nprogress;
+		progressCb->stop();
+	}
+
+	file->release();
+
+	if (error != CC_FERR_NO_ERROR)
+	{
+		if (cloud)
+			delete cloud;
+		cloud = 0;
+		return error;
+	}
+
+	if (cloud)
+	{
+		for (unsigned i=0; i<cloud->getNumberOfScalarFields(); ++i)
+			cloud->getScalarField(i)->computeMinAndMax();
+		cloud->invalidateBoundingBox();
+		cloud->setOriginalShift(shift[0],shift[1],shift[2]);
+		if (context.colors)
+		{
+			cloud->showColors(true);
+		}
+		else
+		{
+			cloud->setCurrentDisplayedScalarField(0);
+			cloud->showSF(true);
+		}
+	}
+
+	return CC_FERR_NO_ERROR;
+}
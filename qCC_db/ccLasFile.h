@@ -0,0 +1,82 @@
+//##########################################################################
+//#                                                                        #
+//#                            CLOUDCOMPARE                                #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 of the License.               #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: EDF R&D / TELECOM ParisTech (ENST-TSI)             #
+//#                                                                        #
+//##########################################################################
+
+#ifndef CC_LAS_FILE_HEADER
+#define CC_LAS_FILE_HEADER
+
+//Local
+#include "ccMappedFile.h"
+
+//CCLib
+#include <GenericProgressCallback.h>
+
+class ccPointCloud;
+
+//! LAS file (versions 1.0 to 1.4, point formats 0 to 10)
+/** Loaded fields: coordinates (shifted if necessary, see
+	ccGenericPointCloud::SuggestOriginalShift), RGB colors (formats 2, 3, 5,
+	7, 8 and 10) and 'Intensity', 'Classification' and 'GPS time' (formats
+	with GPS time) scalar fields. GPS times are stored relatively to the
+	(integer part of the) first point time, so as to fit in a ScalarType.
+	Compressed files (LAZ) are not handled.
+	The file is mapped in memory and the points are decoded by blocks in
+	parallel (if ENABLE_MT_OCTREE is defined). Points can be filtered (see
+	ccLasFile::Filter) before anything is allocated: the filtered out points
+	are never decoded (only their integer coordinates are read).
+**/
+#ifdef QCC_DB_USE_AS_DLL
+#include "qCC_db_dll.h"
+class QCC_DB_DLL_API ccLasFile
+#else
+class ccLasFile
+#endif
+{
+public:
+
+	//! Points filter
+	struct Filter
+	{
+		//! Whether the points should be inside a bounding box
+		bool useBox;
+		//! Bounding box min corner (original coordinates)
+		double boxMin[3];
+		//! Bounding box max corner (original coordinates)
+		double boxMax[3];
+		//! Subsampling step (only one point every 'step' points is kept)
+		unsigned step;
+
+		//! Default constructor (no filtering)
+		Filter()
+			: useBox(false)
+			, step(1)
+		{
+			boxMin[0] = boxMin[1] = boxMin[2] = 0;
+			boxMax[0] = boxMax[1] = boxMax[2] = 0;
+		}
+	};
+
+	//! Loads a LAS file
+	/** \param filename input filename
+		\param[out] cloud loaded cloud (0 if no point passes the filter)
+		\param filter points filter (optional)
+		\param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
+		\return error code
+	**/
+	static CC_FILE_ERROR Load(const char* filename, ccPointCloud*& cloud, const Filter* filter=0, CCLib::GenericProgressCallback* progressCb=0);
+};
+
+#endif //CC_LAS_FILE_HEADER
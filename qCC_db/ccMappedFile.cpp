@@ -0,0 +1,168 @@
+//##########################################################################
+//#                                                                        #
+//#                            CLOUDCOMPARE                                #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 of the License.               #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: EDF R&D / TELECOM ParisTech (ENST-TSI)             #
+//#                                                                        #
+//##########################################################################
+
+#include "ccMappedFile.h"
+
+//system
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+ccMappedFile::ccMappedFile()
+	: CCShareable()
+	, m_data(0)
+	, m_size(0)
+	, m_mapped(false)
+{
+}
+
+ccMappedFile::~ccMappedFile()
+{
+	if (!m_data)
+		return;
+
+	if (m_mapped)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(m_data);
+#else
+		munmap(m_data,m_size);
+#endif
+	}
+	else
+	{
+		free(m_data);
+	}
+}
+
+//! Reads a whole file in memory (when it can't be mapped)
+static unsigned char* ReadWholeFile(const char* filename, size_t& size, CC_FILE_ERROR& error)
+{
+	FILE* fp = fopen(filename,"rb");
+	if (!fp)
+	{
+		error = CC_FERR_UNKNOWN_FILE;
+		return 0;
+	}
+
+	unsigned char* data = 0;
+	size = 0;
+	if (fseek(fp,0,SEEK_END) == 0)
+	{
+		long fileSize = ftell(fp);
+		if (fileSize > 0 && fseek(fp,0,SEEK_SET) == 0)
+		{
+			size = (size_t)fileSize;
+			data = (unsigned char*)malloc(size);
+			if (!data)
+				error = CC_FERR_NOT_ENOUGH_MEMORY;
+			else if (fread(data,1,size,fp) != size)
+			{
+				free(data);
+				data = 0;
+				error = CC_FERR_READING;
+			}
+		}
+		else
+		{
+			error = (fileSize == 0 ? CC_FERR_MALFORMED_FILE : CC_FERR_READING);
+		}
+	}
+	else
+	{
+		error = CC_FERR_READING;
+	}
+
+	fclose(fp);
+	return data;
+}
+
+ccMappedFile* ccMappedFile::Map(const char* filename, CC_FILE_ERROR* error/*=0*/)
+{
+	CC_FILE_ERROR result = CC_FERR_NO_ERROR;
+	if (!error)
+		error = &result;
+	*error = CC_FERR_NO_ERROR;
+
+	if (!filename)
+	{
+		*error = CC_FERR_BAD_ARGUMENT;
+		return 0;
+	}
+
+	ccMappedFile* file = new ccMappedFile();
+
+#ifdef _WIN32
+	HANDLE hFile = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile != INVALID_HANDLE_VALUE)
+	{
+		LARGE_INTEGER fileSize;
+		if (GetFileSizeEx(hFile,&fileSize) && fileSize.QuadPart > 0)
+		{
+			HANDLE hMapping = CreateFileMappingA(hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+			if (hMapping)
+			{
+				file->m_data = (unsigned char*)MapViewOfFile(hMapping, FILE_MAP_COPY, 0, 0, 0);
+				file->m_size = (size_t)fileSize.QuadPart;
+				file->m_mapped = (file->m_data != 0);
+				CloseHandle(hMapping); //the view keeps the mapping alive
+			}
+		}
+		CloseHandle(hFile);
+	}
+#else
+	int fd = open(filename, O_RDONLY);
+	if (fd >= 0)
+	{
+		struct stat st;
+		if (fstat(fd,&st) == 0 && st.st_size > 0)
+		{
+			void* data = mmap(0, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+			if (data != MAP_FAILED)
+			{
+				file->m_data = (unsigned char*)data;
+				file->m_size = (size_t)st.st_size;
+				file->m_mapped = true;
+			}
+		}
+		close(fd); //the mapping keeps the file alive
+	}
+#endif
+
+	//fallback: we read the whole file
+	if (!file->m_data)
+	{
+		file->m_data = ReadWholeFile(filename, file->m_size, *error);
+		file->m_mapped = false;
+		if (!file->m_data)
+		{
+			file->link();
+			file->release();
+			return 0;
+		}
+	}
+
+	file->link();
+	return file;
+}
@@ -0,0 +1,88 @@
+//##########################################################################
+//#                                                                        #
+//#                            CLOUDCOMPARE                                #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 of the License.               #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: EDF R&D / TELECOM ParisTech (ENST-TSI)             #
+//#                                                                        #
+//##########################################################################
+
+#ifndef CC_MAPPED_FILE_HEADER
+#define CC_MAPPED_FILE_HEADER
+
+//CCLib
+#include <CCShareable.h>
+
+//system
+#include <stddef.h>
+
+//! Errors that may occur during file I/O
+enum CC_FILE_ERROR {	CC_FERR_NO_ERROR			=	0,	/**< No error **/
+						CC_FERR_BAD_ARGUMENT		=	1,	/**< Invalid argument **/
+						CC_FERR_UNKNOWN_FILE		=	2,	/**< File not found (or can't be opened) **/
+						CC_FERR_WRONG_FILE_TYPE		=	3,	/**< File format not recognized **/
+						CC_FERR_WRITING				=	4,	/**< Error while writing the file **/
+						CC_FERR_READING				=	5,	/**< Error while reading the file **/
+						CC_FERR_NOT_ENOUGH_MEMORY	=	6,	/**< Not enough memory **/
+						CC_FERR_MALFORMED_FILE		=	7,	/**< File is corrupted or truncated **/
+						CC_FERR_CANCELED_BY_USER	=	8,	/**< Process canceled by user **/
+						CC_FERR_NOT_IMPLEMENTED		=	9	/**< Feature or format version not supported **/
+};
+
+//! Read-only memory mapping of a whole file
+/** The file is mapped in 'copy-on-write' mode: the mapped memory can be
+	modified by the application (modified pages are silently duplicated)
+	but the file itself is never written.
+	[SHAREABLE] Arrays adopting chunks of the mapped memory (see
+	GenericChunkedArray::adoptChunk) keep the mapping alive: it is only
+	unmapped once the last of them has released it.
+**/
+#ifdef QCC_DB_USE_AS_DLL
+#include "qCC_db_dll.h"
+class QCC_DB_DLL_API ccMappedFile : public CCShareable
+#else
+class ccMappedFile : public CCShareable
+#endif
+{
+public:
+
+	//! Maps a file in memory
+	/** \param filename file to map
+		\param[out] error error code (if any)
+		\return mapped file (already linked once, or 0 if an error occurred)
+	**/
+	static ccMappedFile* Map(const char* filename, CC_FILE_ERROR* error=0);
+
+	//! Returns the mapped data
+	inline unsigned char* data() const { return m_data; }
+
+	//! Returns the mapped data size (i.e. file size)
+	inline size_t size() const { return m_size; }
+
+protected:
+
+	//! Default constructor
+	ccMappedFile();
+
+	//! Destructor (unmaps the file)
+	/** [SHAREABLE] Call 'release' to destroy this object properly.
+	**/
+	virtual ~ccMappedFile();
+
+	//! Mapped data
+	unsigned char* m_data;
+	//! Mapped data size
+	size_t m_size;
+	//! Whether the data is actually mapped or has been read (fallback mode)
+	bool m_mapped;
+};
+
+#endif //CC_MAPPED_FILE_HEADER
@@ -444,6 +444,8 @@ ccBBox ccMesh::getMyOwnBB()
 //specific methods
 void ccMesh::addTriangle(unsigned i1, unsigned i2, unsigned i3)
 {
+	invalidateVertexAdjacency();
+
 	CCLib::TriangleSummitsIndexes t(i1,i2,i3);
 	m_triIndexes->addElement(t.i);
 }
@@ -469,6 +471,7 @@ bool ccMesh::resize(unsigned n)
 {
 	m_bBox.setValidity(false);
 	updateModificationTime();
+	invalidateVertexAdjacency();
 
 	if (m_triMtlIndexes)
 	{
@@ -495,6 +498,9 @@ bool ccMesh::resize(unsigned n)
 
 CCLib::TriangleSummitsIndexes* ccMesh::getTriangleIndexes(unsigned triangleIndex)
 {
+	//write access: the triangle may be modified
+	invalidateVertexAdjacency();
+
 	return (CCLib::TriangleSummitsIndexes*)m_triIndexes->getValue(triangleIndex);
 }
 
@@ -587,7 +593,7 @@ void ccMesh::drawMeOnly(CC_DRAW_CONTEXT& context)
 		glParams.showNorms &= bool(MACRO_LightIsEnabled(context));
 
 		//vertices visibility
-		const ccGenericPointCloud::VisibilityTableType* verticesVisibility = m_associatedCloud->getTheVisibilityArray();
+		const ccGenericPointCloud::VisibilityTableType* verticesVisibility = static_cast<const ccGenericPointCloud*>(m_associatedCloud)->getTheVisibilityArray();
 		bool visFiltering = (verticesVisibility && verticesVisibility->isAllocated());
 
 		//wireframe ? (not compatible with LOD)
@@ -1531,6 +1537,8 @@ ccGenericMesh* ccMesh::createNewMeshFromSelection(bool removeSelectedVertices, C
 
 void ccMesh::shiftTriangleIndexes(unsigned shift)
 {
+	invalidateVertexAdjacency();
+
 	m_triIndexes->placeIteratorAtBegining();
 	unsigned *ti,i=0;
 	for (;i<m_triIndexes->currentSize();++i)
@@ -1980,185 +1988,419 @@ bool ccMesh::getColorFromMaterial(unsigned triIndex, const CCVector3& P, colorTy
 	return true;
 }
 
-//we use as many static variables as we can to limit the size of the heap used by each recursion...
-static const unsigned s_defaultSubdivideGrowRate = 50;
-static float s_maxSubdivideArea = 1;
-static std::map<int64_t,unsigned> s_alreadyCreatedVertices; //map to store already created edges middle points
-
-static int64_t GenerateKey(unsigned edgeIndex1, unsigned edgeIndex2)
+//! Hash table (open addressing with linear probing) storing the edges middle points
+/** Keys are the (sorted) edge vertices indexes, values are the middle points indexes.
+**/
+class ccEdgeMidPointsTable
 {
-	if (edgeIndex1>edgeIndex2)
-		std::swap(edgeIndex1,edgeIndex2);
+public:
 
-	return ((((int64_t)edgeIndex1)<<32) | (int64_t)edgeIndex2);
-}
+	//! Default constructor
+	ccEdgeMidPointsTable() : m_mask(0), m_bitDec(64), m_count(0) {}
 
-bool ccMesh::pushSubdivide(/*PointCoordinateType maxArea, */unsigned indexA, unsigned indexB, unsigned indexC)
-{
-	if (s_maxSubdivideArea/*maxArea*/<=ZERO_TOLERANCE)
+	//! Generates the key associated to an edge
+	static inline uint64_t GenerateKey(unsigned edgeIndex1, unsigned edgeIndex2)
 	{
-		ccLog::Error("[ccMesh::pushSubdivide] Invalid input argument!");
-		return false;
+		if (edgeIndex1>edgeIndex2)
+			std::swap(edgeIndex1,edgeIndex2);
+
+		return ((((uint64_t)edgeIndex1)<<32) | (uint64_t)edgeIndex2);
 	}
 
-	if (!getAssociatedCloud() || !getAssociatedCloud()->isA(CC_POINT_CLOUD))
+	//! Reserves memory for a given number of edges
+	/** May throw std::bad_alloc.
+	**/
+	void reserve(unsigned edgeCount)
 	{
-		ccLog::Error("[ccMesh::pushSubdivide] Vertices set must be a true point cloud!");
-		return false;
+		unsigned bits = 4;
+		while (bits < 31 && (1U<<bits) < 2*edgeCount)
+			++bits;
+		if ((1U<<bits) > m_keys.size())
+			rehash(bits);
 	}
-	ccPointCloud* vertices = static_cast<ccPointCloud*>(getAssociatedCloud());
-	assert(vertices);
-	const CCVector3* A = vertices->getPoint(indexA);
-	const CCVector3* B = vertices->getPoint(indexB);
-	const CCVector3* C = vertices->getPoint(indexC);
 
-	//do we need to sudivide this triangle?
-	PointCoordinateType area = ((*B-*A)*(*C-*A)).norm()/(PointCoordinateType)2.0;
-	if (area > s_maxSubdivideArea/*maxArea*/)
+	//! Returns the number of stored edges
+	inline unsigned size() const { return m_count; }
+
+	//! Returns the middle point associated to an edge (if any)
+	inline bool find(unsigned edgeIndex1, unsigned edgeIndex2, unsigned& midPointIndex) const
 	{
-		//we will add 3 new vertices, so we must be sure to have enough memory
-		if (vertices->size()+2 >= vertices->capacity())
+		if (m_keys.empty())
+			return false;
+		uint64_t key = GenerateKey(edgeIndex1,edgeIndex2);
+		for (size_t pos = hash(key); ; pos = ((pos+1) & m_mask))
 		{
-			assert(s_defaultSubdivideGrowRate>2);
-			if (!vertices->reserve(vertices->size()+s_defaultSubdivideGrowRate))
+			if (m_keys[pos] == key)
 			{
-				ccLog::Error("[ccMesh::pushSubdivide] Not enough memory!");
-				return false;
+				midPointIndex = m_values[pos];
+				return true;
 			}
-			//We have to update pointers as they may have been wrangled by the 'reserve' call
-			A = vertices->getPoint(indexA);
-			B = vertices->getPoint(indexB);
-			C = vertices->getPoint(indexC);
+			if (m_keys[pos] == EMPTY_KEY)
+				return false;
+		}
+	}
+
+	//! Inserts an edge (if not already in the table)
+	/** May throw std::bad_alloc.
+		\return true if the edge was actually inserted
+	**/
+	bool insert(unsigned edgeIndex1, unsigned edgeIndex2, unsigned midPointIndex)
+	{
+		if (2*(m_count+1) > m_keys.size())
+			reserve(m_count+1);
+
+		uint64_t key = GenerateKey(edgeIndex1,edgeIndex2);
+		size_t pos = hash(key);
+		while (m_keys[pos] != EMPTY_KEY)
+		{
+			if (m_keys[pos] == key)
+				return false;
+			pos = ((pos+1) & m_mask);
+		}
+		m_keys[pos] = key;
+		m_values[pos] = midPointIndex;
+		++m_count;
+		return true;
+	}
+
+protected:
+
+	//! Empty slot marker (can't be a valid key as indexes are sorted)
+	static const uint64_t EMPTY_KEY = ~((uint64_t)0);
+
+	//! Fibonacci hashing
+	inline size_t hash(uint64_t key) const { return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> m_bitDec); }
+
+	//! Resizes the table (2^bits slots)
+	void rehash(unsigned bits)
+	{
+		std::vector<uint64_t> oldKeys;
+		std::vector<unsigned> oldValues;
+		oldKeys.swap(m_keys);
+		oldValues.swap(m_values);
+
+		m_keys.resize((size_t)1<<bits, static_cast<uint64_t>(EMPTY_KEY));
+		m_values.resize((size_t)1<<bits);
+		m_mask = ((size_t)1<<bits)-1;
+		m_bitDec = 64-bits;
+
+		for (size_t i=0; i<oldKeys.size(); ++i)
+		{
+			if (oldKeys[i] == EMPTY_KEY)
+				continue;
+			size_t pos = hash(oldKeys[i]);
+			while (m_keys[pos] != EMPTY_KEY)
+				pos = ((pos+1) & m_mask);
+			m_keys[pos] = oldKeys[i];
+			m_values[pos] = oldValues[i];
+		}
+	}
+
+	//! Keys
+	std::vector<uint64_t> m_keys;
+	//! Values
+	std::vector<unsigned> m_values;
+	//! Slot index mask
+	size_t m_mask;
+	//! Hash shift
+	unsigned m_bitDec;
+	//! Number of stored edges
+	unsigned m_count;
+};
+
+//! Data shared by the subdivision stages
+struct ccSubdivideContext
+{
+	//! Vertices (new middle points are appended)
+	ccPointCloud* vertices;
+	//! Vertices scalar fields
+	std::vector<CCLib::ScalarField*> scalarFields;
+	//! Max triangle area
+	PointCoordinateType maxArea;
+	//! Input triangles (3 vertices indexes per triangle)
+	const std::vector<unsigned>* triangles;
+	//! Number of output triangles per input triangle (then offset of the first one)
+	std::vector<unsigned>* outOffsets;
+	//! Output triangles (3 vertices indexes per triangle)
+	std::vector<unsigned>* outTriangles;
+	//! Edges middle points
+	const ccEdgeMidPointsTable* midPoints;
+	//! Edges to split during the current round (2 vertices indexes per edge)
+	const std::vector<unsigned>* newEdges;
+	//! Index of the first middle point created during the current round
+	unsigned firstNewVertex;
+};
+
+//! Stage 1: tests which triangles must be subdivided (i.e. split in 4)
+static void SubdivideTestTriangles(const ccSubdivideContext& context, unsigned first, unsigned last)
+{
+	const ccPointCloud* vertices = context.vertices;
+	const unsigned* tris = &(*context.triangles)[0];
+	for (unsigned i=first; i<last; ++i)
+	{
+		const unsigned* tri = tris+3*i;
+		const CCVector3* A = vertices->getPoint(tri[0]);
+		const CCVector3* B = vertices->getPoint(tri[1]);
+		const CCVector3* C = vertices->getPoint(tri[2]);
+
+		PointCoordinateType area = ((*B-*A)*(*C-*A)).norm()/(PointCoordinateType)2.0;
+		(*context.outOffsets)[i] = (area > context.maxArea ? 4 : 1);
+	}
+}
+
+//! Stage 2: computes the new middle points (position, color, normal and scalar values)
+static void SubdivideComputeMidPoints(const ccSubdivideContext& context, unsigned first, unsigned last)
+{
+	ccPointCloud* vertices = context.vertices;
+	bool hasColors = vertices->hasColors();
+	bool hasNormals = vertices->hasNormals();
+	for (unsigned i=first; i<last; ++i)
+	{
+		unsigned indexA = (*context.newEdges)[2*i];
+		unsigned indexB = (*context.newEdges)[2*i+1];
+		unsigned indexG = context.firstNewVertex+i;
+
+		//this is a "persistent" pointer and we know what type of cloud is behind ;)
+		CCVector3* G = const_cast<CCVector3*>(vertices->getPointPersistentPtr(indexG));
+		*G = (*vertices->getPointPersistentPtr(indexA) + *vertices->getPointPersistentPtr(indexB))/(PointCoordinateType)2.0;
+
+		if (hasColors)
+		{
+			const colorType* colA = vertices->getPointColor(indexA);
+			const colorType* colB = vertices->getPointColor(indexB);
+			colorType col[3] = {	(colorType)(((unsigned)colA[0]+(unsigned)colB[0])/2),
+									(colorType)(((unsigned)colA[1]+(unsigned)colB[1])/2),
+									(colorType)(((unsigned)colA[2]+(unsigned)colB[2])/2) };
+			vertices->setPointColor(indexG,col);
 		}
 
-		//add new vertices
-		unsigned indexG1 = 0;
+		if (hasNormals)
 		{
-			int64_t key = GenerateKey(indexA,indexB);
-			auto it = s_alreadyCreatedVertices.find(key);
-			if (it == s_alreadyCreatedVertices.end())
+			CCVector3 N = CCVector3(vertices->getPointNormal(indexA)) + CCVector3(vertices->getPointNormal(indexB));
+			if (N.norm2() > ZERO_TOLERANCE)
 			{
-				//generate new vertex
-				indexG1 = vertices->size();
-				CCVector3 G1 = (*A+*B)/(PointCoordinateType)2.0;
-				vertices->addPoint(G1.u);
-				//interpolate other features?
-				/*if (vertices->hasNormals())
-				{
-				//vertices->reserveTheNormsTable();
-				CCVector3 N(0.0,0.0,1.0);
-				interpolateNormals(indexA,indexB,indexC,G1,N);
-				vertices->addNorm(N.u);
-				}
-				//*/
-				if (vertices->hasColors())
-				{
-					colorType C[3]={MAX_COLOR_COMP,MAX_COLOR_COMP,MAX_COLOR_COMP};
-					interpolateColors(indexA,indexB,indexC,G1,C);
-					vertices->addRGBColor(C);
-				}
-				//and add it to the map
-				s_alreadyCreatedVertices[key] = indexG1;
+				N.normalize();
+				vertices->setPointNormal(indexG,N.u);
 			}
 			else
 			{
-				indexG1 = it->second;
+				vertices->setPointNormalIndex(indexG,vertices->getPointNormalIndex(indexA));
 			}
 		}
-		unsigned indexG2 = 0;
+
+		for (size_t j=0; j<context.scalarFields.size(); ++j)
+		{
+			CCLib::ScalarField* sf = context.scalarFields[j];
+			ScalarType vA = sf->getValue(indexA);
+			ScalarType vB = sf->getValue(indexB);
+			if (CCLib::ScalarField::ValidValue(vA) && CCLib::ScalarField::ValidValue(vB))
+				sf->setValue(indexG,(vA+vB)/(ScalarType)2.0);
+			else
+				sf->setValue(indexG,NAN_VALUE);
+		}
+	}
+}
+
+//! Stage 3: outputs the (subdivided) triangles
+static void SubdivideEmitTriangles(const ccSubdivideContext& context, unsigned first, unsigned last)
+{
+	const unsigned* tris = &(*context.triangles)[0];
+	const unsigned* offsets = &(*context.outOffsets)[0];
+	unsigned* out = &(*context.outTriangles)[0];
+	for (unsigned i=first; i<last; ++i)
+	{
+		const unsigned* tri = tris+3*i;
+		unsigned* outTri = out+3*offsets[i];
+		if (offsets[i+1]-offsets[i] == 1)
 		{
-			int64_t key = GenerateKey(indexB,indexC);
-			auto it = s_alreadyCreatedVertices.find(key);
-			if (it == s_alreadyCreatedVertices.end())
+			//we keep this triangle as is
+			outTri[0] = tri[0];
+			outTri[1] = tri[1];
+			outTri[2] = tri[2];
+			continue;
+		}
+
+		unsigned indexA = tri[0], indexB = tri[1], indexC = tri[2];
+		unsigned indexG1 = 0, indexG2 = 0, indexG3 = 0;
+		context.midPoints->find(indexA,indexB,indexG1);
+		context.midPoints->find(indexB,indexC,indexG2);
+		context.midPoints->find(indexC,indexA,indexG3);
+
+		unsigned subTris[12] = {	indexA, indexG1, indexG3,
+									indexB, indexG2, indexG1,
+									indexC, indexG3, indexG2,
+									indexG1, indexG2, indexG3 };
+		memcpy(outTri,subTris,sizeof(unsigned)*12);
+	}
+}
+
+//! Stage 4: counts the triangles required to 'fix' the triangles sharing an edge with a subdivided triangle
+static void SubdivideCountFixedTriangles(const ccSubdivideContext& context, unsigned first, unsigned last)
+{
+	const unsigned* tris = &(*context.triangles)[0];
+	for (unsigned i=first; i<last; ++i)
+	{
+		const unsigned* tri = tris+3*i;
+		unsigned indexG = 0;
+		unsigned brokenEdges =	(context.midPoints->find(tri[0],tri[1],indexG) ? 1 : 0)
+							+	(context.midPoints->find(tri[1],tri[2],indexG) ? 1 : 0)
+							+	(context.midPoints->find(tri[2],tri[0],indexG) ? 1 : 0);
+		(*context.outOffsets)[i] = 1+brokenEdges;
+	}
+}
+
+//! Stage 5: outputs the 'fixed' triangles
+static void SubdivideEmitFixedTriangles(const ccSubdivideContext& context, unsigned first, unsigned last)
+{
+	const unsigned* tris = &(*context.triangles)[0];
+	const unsigned* offsets = &(*context.outOffsets)[0];
+	unsigned* out = &(*context.outTriangles)[0];
+	for (unsigned i=first; i<last; ++i)
+	{
+		const unsigned* tri = tris+3*i;
+		unsigned* outTri = out+3*offsets[i];
+
+		unsigned indexA = tri[0], indexB = tri[1], indexC = tri[2];
+
+		//test all edges
+		unsigned indexG1 = 0, indexG2 = 0, indexG3 = 0;
+		bool brokenG1 = context.midPoints->find(indexA,indexB,indexG1);
+		bool brokenG2 = context.midPoints->find(indexB,indexC,indexG2);
+		bool brokenG3 = context.midPoints->find(indexC,indexA,indexG3);
+		unsigned brokenEdges = (brokenG1 ? 1 : 0) + (brokenG2 ? 1 : 0) + (brokenG3 ? 1 : 0);
+		assert(offsets[i+1]-offsets[i] == 1+brokenEdges);
+
+		if (brokenEdges == 0)
+		{
+			//we keep this triangle as is
+			outTri[0] = indexA;
+			outTri[1] = indexB;
+			outTri[2] = indexC;
+		}
+		else if (brokenEdges == 1)
+		{
+			unsigned indexG = indexG1;
+			unsigned char i1 = 2; //relative index facing the broken edge
+			if (brokenG2)
 			{
-				//generate new vertex
-				indexG2 = vertices->size();
-				CCVector3 G2 = (*B+*C)/(PointCoordinateType)2.0;
-				vertices->addPoint(G2.u);
-				//interpolate other features?
-				/*if (vertices->hasNormals())
-				{
-				//vertices->reserveTheNormsTable();
-				CCVector3 N(0.0,0.0,1.0);
-				interpolateNormals(indexA,indexB,indexC,G2,N);
-				vertices->addNorm(N.u);
-				}
-				//*/
-				if (vertices->hasColors())
-				{
-					colorType C[3]={MAX_COLOR_COMP,MAX_COLOR_COMP,MAX_COLOR_COMP};
-					interpolateColors(indexA,indexB,indexC,G2,C);
-					vertices->addRGBColor(C);
-				}
-				//and add it to the map
-				s_alreadyCreatedVertices[key] = indexG2;
+				indexG = indexG2;
+				i1 = 0;
 			}
-			else
+			else if (brokenG3)
 			{
-				indexG2 = it->second;
+				indexG = indexG3;
+				i1 = 1;
 			}
+
+			unsigned indexes[3] = { indexA, indexB, indexC };
+
+			//split the triangle in 2
+			unsigned subTris[6] = {	indexes[i1], indexG, indexes[(i1+2)%3],
+									indexes[i1], indexes[(i1+1)%3], indexG };
+			memcpy(outTri,subTris,sizeof(unsigned)*6);
 		}
-		unsigned indexG3 = vertices->size();
+		else if (brokenEdges == 2)
 		{
-			int64_t key = GenerateKey(indexC,indexA);
-			auto it = s_alreadyCreatedVertices.find(key);
-			if (it == s_alreadyCreatedVertices.end())
+			if (!brokenG1) //broken edges: BC and CA
 			{
-				//generate new vertex
-				indexG3 = vertices->size();
-				CCVector3 G3 = (*C+*A)/(PointCoordinateType)2.0;
-				vertices->addPoint(G3.u);
-				//interpolate other features?
-				/*if (vertices->hasNormals())
-				{
-				//vertices->reserveTheNormsTable();
-				CCVector3 N(0.0,0.0,1.0);
-				interpolateNormals(indexA,indexB,indexC,G3,N);
-				vertices->addNorm(N.u);
-				}
-				//*/
-				if (vertices->hasColors())
-				{
-					colorType C[3]={MAX_COLOR_COMP,MAX_COLOR_COMP,MAX_COLOR_COMP};
-					interpolateColors(indexA,indexB,indexC,G3,C);
-					vertices->addRGBColor(C);
-				}
-				//and add it to the map
-				s_alreadyCreatedVertices[key] = indexG3;
+				//the 'pointy' part and the remaining 'trapezoid' split in 2
+				unsigned subTris[9] = {	indexC, indexG3, indexG2,
+										indexA, indexG2, indexG3,
+										indexA, indexB, indexG2 };
+				memcpy(outTri,subTris,sizeof(unsigned)*9);
 			}
-			else
+			else if (!brokenG2) //broken edges: AB and CA
 			{
-				indexG3 = it->second;
+				unsigned subTris[9] = {	indexA, indexG1, indexG3,
+										indexB, indexG3, indexG1,
+										indexB, indexC, indexG3 };
+				memcpy(outTri,subTris,sizeof(unsigned)*9);
 			}
-		}
-
-		//add new triangles
-		if (!pushSubdivide(/*maxArea, */indexA, indexG1, indexG3))
-			return false;
-		if (!pushSubdivide(/*maxArea, */indexB, indexG2, indexG1))
-			return false;
-		if (!pushSubdivide(/*maxArea, */indexC, indexG3, indexG2))
-			return false;
-		if (!pushSubdivide(/*maxArea, */indexG1, indexG2, indexG3))
-			return false;
-	}
-	else
-	{
-		//we will add one triangle, so we must be sure to have enough memory
-		if (size() == maxSize())
-		{
-			if (!reserve(size()+3*s_defaultSubdivideGrowRate))
+			else /*if (!brokenG3)*/ //broken edges: AB and BC
 			{
-				ccLog::Error("[ccMesh::pushSubdivide] Not enough memory!");
-				return false;
+				unsigned subTris[9] = {	indexB, indexG2, indexG1,
+										indexC, indexG1, indexG2,
+										indexC, indexA, indexG1 };
+				memcpy(outTri,subTris,sizeof(unsigned)*9);
 			}
 		}
+		else //works just as a standard subdivision in fact!
+		{
+			unsigned subTris[12] = {	indexA, indexG1, indexG3,
+										indexB, indexG2, indexG1,
+										indexC, indexG3, indexG2,
+										indexG1, indexG2, indexG3 };
+			memcpy(outTri,subTris,sizeof(unsigned)*12);
+		}
+	}
+}
+
+//! Subdivision stage (applied to a range of elements)
+typedef void (*SubdivideStageFunc)(const ccSubdivideContext&, unsigned, unsigned);
 
-		//we keep this triangle as is
-		addTriangle(indexA,indexB,indexC);
+#ifdef ENABLE_MT_OCTREE
+
+#include <QtCore/QtCore>
+
+//! Number of elements processed by each job
+static const unsigned SUBDIVIDE_JOB_SIZE = 16384;
+
+//! Range of elements processed by one job
+struct subdivideJobDesc
+{
+	unsigned first;
+	unsigned last;
+};
+
+static const ccSubdivideContext* s_subdivideContext_MT = 0;
+static SubdivideStageFunc s_subdivideStage_MT = 0;
+
+void SubdivideStage_MT(const subdivideJobDesc& desc)
+{
+	s_subdivideStage_MT(*s_subdivideContext_MT, desc.first, desc.last);
+}
+
+#endif
+
+//! Applies a subdivision stage to all elements (may throw std::bad_alloc)
+static void RunSubdivideStage(SubdivideStageFunc stage, const ccSubdivideContext& context, unsigned count)
+{
+	if (count == 0)
+		return;
+
+#ifndef ENABLE_MT_OCTREE
+	stage(context, 0, count);
+#else
+	std::vector<subdivideJobDesc> jobs;
+	jobs.reserve((count+SUBDIVIDE_JOB_SIZE-1)/SUBDIVIDE_JOB_SIZE);
+	for (unsigned i=0; i<count; i+=SUBDIVIDE_JOB_SIZE)
+	{
+		subdivideJobDesc desc;
+		desc.first = i;
+		desc.last = std::min(count, i+SUBDIVIDE_JOB_SIZE);
+		jobs.push_back(desc);
 	}
 
-	return true;
+	s_subdivideContext_MT = &context;
+	s_subdivideStage_MT = stage;
+	QtConcurrent::blockingMap(jobs, SubdivideStage_MT);
+	s_subdivideContext_MT = 0;
+	s_subdivideStage_MT = 0;
+#endif
+}
+
+//! Turns per-triangle output counts into offsets (offsets[count] = total)
+static unsigned ComputeSubdivideOffsets(std::vector<unsigned>& offsets, unsigned count)
+{
+	unsigned total = 0;
+	for (unsigned i=0; i<count; ++i)
+	{
+		unsigned n = offsets[i];
+		offsets[i] = total;
+		total += n;
+	}
+	offsets[count] = total;
+	return total;
 }
 
 ccMesh* ccMesh::subdivide(float maxArea) const
@@ -2168,7 +2410,6 @@ ccMesh* ccMesh::subdivide(float maxArea) const
 		ccLog::Error("[ccMesh::subdivide] Invalid input argument!");
 		return 0;
 	}
-	s_maxSubdivideArea = maxArea;
 
 	unsigned triCount = size();
 	ccGenericPointCloud* vertices = getAssociatedCloud();
@@ -2193,186 +2434,110 @@ ccMesh* ccMesh::subdivide(float maxArea) const
 	ccMesh* resultMesh = new ccMesh(resultVertices);
 	resultMesh->addChild(resultVertices);
 
-	if (!resultMesh->reserve(triCount))
-	{
-		ccLog::Error("[ccMesh::subdivide] Not enough memory!");
-		delete resultMesh;
-		return 0;
-	}
+	//the normals table must be initialized before any concurrent access
+	if (resultVertices->hasNormals())
+		ccNormalVectors::GetUniqueInstance();
 
-	s_alreadyCreatedVertices.clear();
+	ccSubdivideContext context;
+	context.vertices = resultVertices;
+	context.maxArea = (PointCoordinateType)maxArea;
+	context.firstNewVertex = 0;
+	for (unsigned i=0; i<resultVertices->getNumberOfScalarFields(); ++i)
+		context.scalarFields.push_back(resultVertices->getScalarField((int)i));
 
-	try
-	{		
-		for (unsigned i=0;i<triCount;++i)
-		{
-			const unsigned* tri = m_triIndexes->getValue(i);
-			if (!resultMesh->pushSubdivide(/*maxArea,*/tri[0],tri[1],tri[2]))
-			{
-				ccLog::Error("[ccMesh::subdivide] Not enough memory!");
-				delete resultMesh;
-				return 0;
-			}
-		}
-	}
-	catch(...)
-	{
-		ccLog::Error("[ccMesh::subdivide] An error occured!");
-		delete resultMesh;
-		return 0;
-	}
+	ccEdgeMidPointsTable midPoints;
+	context.midPoints = &midPoints;
 
-	//we must also 'fix' the triangles that share (at least) an edge with a subdivided triangle!
 	try
 	{
-		unsigned newTriCount = resultMesh->size();
-		for (unsigned i=0;i<newTriCount;++i)
+		//input triangles
+		std::vector<unsigned> triangles(3*triCount);
+		for (unsigned i=0; i<triCount; ++i)
+			memcpy(&triangles[3*i],m_triIndexes->getValue(i),sizeof(unsigned)*3);
+
+		std::vector<unsigned> outTriangles;
+		std::vector<unsigned> outOffsets;
+		std::vector<unsigned> newEdges;
+		context.triangles = &triangles;
+		context.outTriangles = &outTriangles;
+		context.outOffsets = &outOffsets;
+		context.newEdges = &newEdges;
+
+		//each round splits in 4 all the triangles that are too big
+		//(children replace their parent so that the original order is kept)
+		while (true)
 		{
-			unsigned* _face = resultMesh->m_triIndexes->getValue(i); //warning: array might change at each call to reallocate!
-			unsigned indexA = _face[0];
-			unsigned indexB = _face[1];
-			unsigned indexC = _face[2];
-
-			//test all edges
-			int indexG1 = -1;
-			{
-				auto it = s_alreadyCreatedVertices.find(GenerateKey(indexA,indexB));
-				if (it != s_alreadyCreatedVertices.end())
-					indexG1 = (int)it->second;
-			}
-			int indexG2 = -1;
-			{
-				auto it = s_alreadyCreatedVertices.find(GenerateKey(indexB,indexC));
-				if (it != s_alreadyCreatedVertices.end())
-					indexG2 = (int)it->second;
-			}
-			int indexG3 = -1;
-			{
-				auto it = s_alreadyCreatedVertices.find(GenerateKey(indexC,indexA));
-				if (it != s_alreadyCreatedVertices.end())
-					indexG3 = (int)it->second;
-			}
-
-			//at least one edge is 'wrong'
-			unsigned brokenEdges = (indexG1<0 ? 0:1)
-				+ (indexG2<0 ? 0:1)
-				+ (indexG3<0 ? 0:1);
-
-			if (brokenEdges == 1)
-			{
-				int indexG = indexG1;
-				unsigned char i1 = 2; //relative index facing the broken edge
-				if (indexG2>=0)
-				{
-					indexG = indexG2;
-					i1 = 0;
-				}
-				else if (indexG3>=0)
-				{
-					indexG = indexG3;
-					i1 = 1;
-				}
-				assert(indexG>=0);
-				assert(i1<3);
-
-				unsigned indexes[3] = { indexA, indexB, indexC };
-
-				//replace current triangle by one half
-				_face[0] = indexes[i1];
-				_face[1] = indexG;
-				_face[2] = indexes[(i1+2)%3];
-				//and add the other half (we can use pushSubdivide as the area should alredy be ok!)
-				if (!resultMesh->pushSubdivide(/*maxArea,*/indexes[i1],indexes[(i1+1)%3],indexG))
-				{
-					ccLog::Error("[ccMesh::subdivide] Not enough memory!");
-					delete resultMesh;
-					return 0;
-				}
-			}
-			else if (brokenEdges == 2)
+			outOffsets.resize(triCount+1);
+			RunSubdivideStage(SubdivideTestTriangles, context, triCount);
+			unsigned outTriCount = ComputeSubdivideOffsets(outOffsets, triCount);
+			if (outTriCount == triCount)
+				break;
+
+			//create the middle points of all split edges
+			unsigned currentVertCount = resultVertices->size();
+			newEdges.clear();
+			midPoints.reserve(midPoints.size()+(outTriCount-triCount)); //3 edges per split triangle (at most)
+			for (unsigned i=0; i<triCount; ++i)
 			{
-				if (indexG1<0) //broken edges: BC and CA
-				{
-					//replace current triangle by the 'pointy' part
-					_face[0] = indexC;
-					_face[1] = indexG3;
-					_face[2] = indexG2;
-					//split the remaining 'trapezoid' in 2
-					if (!resultMesh->pushSubdivide(/*maxArea, */indexA, indexG2, indexG3) ||
-						!resultMesh->pushSubdivide(/*maxArea, */indexA, indexB, indexG2))
-					{
-						ccLog::Error("[ccMesh::subdivide] Not enough memory!");
-						delete resultMesh;
-						return 0;
-					}
-				}
-				else if (indexG2<0) //broken edges: AB and CA
-				{
-					//replace current triangle by the 'pointy' part
-					_face[0] = indexA;
-					_face[1] = indexG1;
-					_face[2] = indexG3;
-					//split the remaining 'trapezoid' in 2
-					if (!resultMesh->pushSubdivide(/*maxArea, */indexB, indexG3, indexG1) ||
-						!resultMesh->pushSubdivide(/*maxArea, */indexB, indexC, indexG3))
-					{
-						ccLog::Error("[ccMesh::subdivide] Not enough memory!");
-						delete resultMesh;
-						return 0;
-					}
-				}
-				else /*if (indexG3<0)*/ //broken edges: AB and BC
+				if (outOffsets[i+1]-outOffsets[i] == 1)
+					continue;
+				const unsigned* tri = &triangles[3*i];
+				for (unsigned j=0; j<3; ++j)
 				{
-					//replace current triangle by the 'pointy' part
-					_face[0] = indexB;
-					_face[1] = indexG2;
-					_face[2] = indexG1;
-					//split the remaining 'trapezoid' in 2
-					if (!resultMesh->pushSubdivide(/*maxArea, */indexC, indexG1, indexG2) ||
-						!resultMesh->pushSubdivide(/*maxArea, */indexC, indexA, indexG1))
+					unsigned i1 = tri[j];
+					unsigned i2 = tri[(j+1)%3];
+					if (midPoints.insert(i1,i2,currentVertCount+(unsigned)(newEdges.size()/2)))
 					{
-						ccLog::Error("[ccMesh::subdivide] Not enough memory!");
-						delete resultMesh;
-						return 0;
+						newEdges.push_back(i1);
+						newEdges.push_back(i2);
 					}
 				}
 			}
-			else if (brokenEdges == 3) //works just as a standard subdivision in fact!
-			{
-				//replace current triangle by one quarter
-				_face[0] = indexA;
-				_face[1] = indexG1;
-				_face[2] = indexG3;
-				//and add the other 3 quarters (we can use pushSubdivide as the area should alredy be ok!)
-				if (!resultMesh->pushSubdivide(/*maxArea, */indexB, indexG2, indexG1) ||
-					!resultMesh->pushSubdivide(/*maxArea, */indexC, indexG3, indexG2) ||
-					!resultMesh->pushSubdivide(/*maxArea, */indexG1, indexG2, indexG3))
-				{
-					ccLog::Error("[ccMesh::subdivide] Not enough memory!");
-					delete resultMesh;
-					return 0;
-				}
-			}
+
+			unsigned newVertCount = (unsigned)(newEdges.size()/2);
+			if (!resultVertices->resize(currentVertCount+newVertCount))
+				throw std::bad_alloc();
+			context.firstNewVertex = currentVertCount;
+			RunSubdivideStage(SubdivideComputeMidPoints, context, newVertCount);
+
+			outTriangles.resize(3*outTriCount);
+			RunSubdivideStage(SubdivideEmitTriangles, context, triCount);
+
+			triangles.swap(outTriangles);
+			triCount = outTriCount;
 		}
+
+		//we must also 'fix' the triangles that share (at least) an edge with a subdivided triangle!
+		unsigned finalTriCount = triCount;
+		if (!newEdges.empty())
+		{
+			RunSubdivideStage(SubdivideCountFixedTriangles, context, triCount);
+			finalTriCount = ComputeSubdivideOffsets(outOffsets, triCount);
+			outTriangles.resize(3*finalTriCount);
+			RunSubdivideStage(SubdivideEmitFixedTriangles, context, triCount);
+			triangles.swap(outTriangles);
+		}
+
+		if (!resultMesh->reserve(finalTriCount))
+			throw std::bad_alloc();
+		for (unsigned i=0; i<finalTriCount; ++i)
+			resultMesh->addTriangle(triangles[3*i],triangles[3*i+1],triangles[3*i+2]);
 	}
-	catch(...)
+	catch(std::bad_alloc)
 	{
-		ccLog::Error("[ccMesh::subdivide] An error occured!");
+		ccLog::Error("[ccMesh::subdivide] Not enough memory!");
 		delete resultMesh;
 		return 0;
 	}
 
-	s_alreadyCreatedVertices.clear();
-
-	if (resultMesh->size() < resultMesh->maxSize())
-		resultMesh->resize(resultMesh->size());
-	if (resultVertices->size()<resultVertices->capacity())
-		resultVertices->resize(resultVertices->size());
+	for (size_t i=0; i<context.scalarFields.size(); ++i)
+		context.scalarFields[i]->computeMinAndMax();
 
 	//we import from the original mesh... what we can
 	if (hasNormals())
 	{
-		if (hasNormals()) //normals interpolation doesn't work well...
+		//per-vertex normals are interpolated, per-triangle ones must be recomputed
+		if (!resultVertices->hasNormals())
 			resultMesh->computeNormals();
 		resultMesh->showNormals(normalsShown());
 	}
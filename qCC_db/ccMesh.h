@@ -266,9 +266,6 @@ protected:
 	//! Same as other 'interpolateColors' method with a set of 3 vertices indexes
 	bool interpolateColors(unsigned i1, unsigned i2, unsigned i3, const CCVector3& P, colorType rgb[]);
 
-	//! Used internally by 'subdivide'
-	bool pushSubdivide(/*PointCoordinateType maxArea, */unsigned indexA, unsigned indexB, unsigned indexC);
-
 	//! Container of per-triangle vertices indexes (3)
 	typedef GenericChunkedArray<3,unsigned> triangleIndexesContainer;
 	//! Triangles indexes
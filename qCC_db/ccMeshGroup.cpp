@@ -207,6 +207,9 @@ CCLib::GenericTriangle* ccMeshGroup::_getNextTriangle() //temporary object
 
 CCLib::TriangleSummitsIndexes* ccMeshGroup::getNextTriangleIndexes()
 {
+    //write access: the triangle may be modified
+    invalidateVertexAdjacency();
+
     if (currentChildIndex<int(m_children.size()))
     {
         CCLib::TriangleSummitsIndexes* tsi = static_cast<ccGenericMesh*>(m_children[currentChildIndex])->getNextTriangleIndexes();
@@ -290,6 +293,9 @@ bool ccMeshGroup::getTriangleSummits_recursive(unsigned triangleIndex, CCVector3
 static CCLib::TriangleSummitsIndexes* s_triSummits; //to avoid heap overflow
 CCLib::TriangleSummitsIndexes* ccMeshGroup::getTriangleIndexes_recursive(unsigned& triangleIndex)
 {
+    //write access: the triangle may be modified
+    invalidateVertexAdjacency();
+
     for (size_t i=0; i<m_children.size(); ++i)
     {
         if (m_children[i]->isKindOf(CC_MESH))
@@ -0,0 +1,848 @@
+//##########################################################################
+//#                                                                        #
+//#                            CLOUDCOMPARE                                #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 of the License.               #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: EDF R&D / TELECOM ParisTech (ENST-TSI)             #
+//#                                                                        #
+//##########################################################################
+
+#include "ccNativeCloudFile.h"
+
+//Local
+#include "ccPointCloud.h"
+#include "ccScalarField.h"
+#include "ccOctree.h"
+#include "ccAdvancedTypes.h"
+#include "ccLog.h"
+
+//system
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <algorithm>
+
+//the file layout must not depend on the compiler
+static_assert(sizeof(ccNativeCloudFile::FileHeader) == 112, "Unexpected FileHeader size");
+static_assert(sizeof(ccNativeCloudFile::SectionHeader) == 112, "Unexpected SectionHeader size");
+
+static const char NATIVE_CLOUD_MAGIC[8] = {'C','C','N','A','T','I','V','E'};
+
+typedef GenericChunkedArray<3,PointCoordinateType> PointsTableType;
+
+//! Returns the expected element size for a given section type (or 0 if the type is unknown)
+static uint32_t ExpectedElementSize(uint32_t type)
+{
+	switch (type)
+	{
+	case ccNativeCloudFile::SECTION_POINTS:
+		return 3*sizeof(PointCoordinateType);
+	case ccNativeCloudFile::SECTION_COLORS:
+		return 3*sizeof(colorType);
+	case ccNativeCloudFile::SECTION_NORMALS:
+		return sizeof(normsType);
+	case ccNativeCloudFile::SECTION_SCALAR_FIELD:
+		return sizeof(ScalarType);
+	case ccNativeCloudFile::SECTION_OCTREE_BOX:
+		return sizeof(CCVector3);
+	case ccNativeCloudFile::SECTION_OCTREE_CODES:
+		return sizeof(CCLib::DgmOctree::IndexAndCode);
+	}
+	return 0;
+}
+
+//! Returns whether a section type corresponds to a per-point array
+static bool IsPerPointSection(uint32_t type)
+{
+	return (type == ccNativeCloudFile::SECTION_POINTS
+		||	type == ccNativeCloudFile::SECTION_COLORS
+		||	type == ccNativeCloudFile::SECTION_NORMALS
+		||	type == ccNativeCloudFile::SECTION_SCALAR_FIELD);
+}
+
+/*** Per-point arrays (chunks) helpers ***/
+
+template<int N, class ElementType> static bool AdoptChunks(GenericChunkedArray<N,ElementType>* array, unsigned char* data, unsigned count, CCShareable* owner)
+{
+	const size_t chunkBytes = static_cast<size_t>(MAX_NUMBER_OF_ELEMENTS_PER_CHUNK)*N*sizeof(ElementType);
+	for (unsigned i=0; i<count; i+=MAX_NUMBER_OF_ELEMENTS_PER_CHUNK)
+	{
+		if (!array->adoptChunk(reinterpret_cast<ElementType*>(data),std::min(count-i,MAX_NUMBER_OF_ELEMENTS_PER_CHUNK),owner))
+			return false;
+		data += chunkBytes;
+	}
+	return true;
+}
+
+template<int N, class ElementType> static bool WriteChunks(FILE* fp, const GenericChunkedArray<N,ElementType>* array, unsigned count, CCLib::NormalizedProgress* nprogress)
+{
+	for (unsigned c=0; c<array->chunksCount() && count != 0; ++c)
+	{
+		unsigned chunkCount = std::min(array->chunkSize(c),count);
+		if (fwrite(array->chunkStartPtr(c),N*sizeof(ElementType),chunkCount,fp) != chunkCount)
+			return false;
+		count -= chunkCount;
+		if (nprogress && !nprogress->oneStep())
+			return false;
+	}
+	return (count == 0);
+}
+
+//! Creates the (empty) array corresponding to a per-point section
+/** The returned array is already linked once.
+**/
+static CCShareable* CreateArray(const ccNativeCloudFile::SectionHeader& section)
+{
+	CCShareable* array = 0;
+	switch (section.type)
+	{
+	case ccNativeCloudFile::SECTION_POINTS:
+		array = new PointsTableType();
+		break;
+	case ccNativeCloudFile::SECTION_COLORS:
+		array = new ColorsTableType();
+		break;
+	case ccNativeCloudFile::SECTION_NORMALS:
+		array = new NormsIndexesTableType();
+		break;
+	case ccNativeCloudFile::SECTION_SCALAR_FIELD:
+		{
+			char name[sizeof(section.name)+1];
+			memcpy(name,section.name,sizeof(section.name));
+			name[sizeof(section.name)]=0;
+			array = new ccScalarField(name);
+		}
+		break;
+	default:
+		assert(false);
+		return 0;
+	}
+	array->link();
+	return array;
+}
+
+//! Makes an array (see CreateArray) use the data of a section directly
+static bool AdoptSection(CCShareable* array, uint32_t type, unsigned char* data, unsigned count, CCShareable* owner)
+{
+	switch (type)
+	{
+	case ccNativeCloudFile::SECTION_POINTS:
+		return AdoptChunks(static_cast<PointsTableType*>(array),data,count,owner);
+	case ccNativeCloudFile::SECTION_COLORS:
+		return AdoptChunks(static_cast<ColorsTableType*>(array),data,count,owner);
+	case ccNativeCloudFile::SECTION_NORMALS:
+		return AdoptChunks(static_cast<NormsIndexesTableType*>(array),data,count,owner);
+	case ccNativeCloudFile::SECTION_SCALAR_FIELD:
+		return AdoptChunks(static_cast<ccScalarField*>(array),data,count,owner);
+	}
+	return false;
+}
+
+//! Allocates the memory of an array (see CreateArray)
+static bool AllocateSection(CCShareable* array, uint32_t type, unsigned count)
+{
+	switch (type)
+	{
+	case ccNativeCloudFile::SECTION_POINTS:
+		return static_cast<PointsTableType*>(array)->resize(count);
+	case ccNativeCloudFile::SECTION_COLORS:
+		return static_cast<ColorsTableType*>(array)->resize(count);
+	case ccNativeCloudFile::SECTION_NORMALS:
+		return static_cast<NormsIndexesTableType*>(array)->resize(count);
+	case ccNativeCloudFile::SECTION_SCALAR_FIELD:
+		return static_cast<ccScalarField*>(array)->resize(count);
+	}
+	return false;
+}
+
+//! Returns the first byte of a given chunk of an array (see CreateArray)
+static unsigned char* SectionChunkStart(CCShareable* array, uint32_t type, unsigned chunkIndex)
+{
+	switch (type)
+	{
+	case ccNativeCloudFile::SECTION_POINTS:
+		return reinterpret_cast<unsigned char*>(static_cast<PointsTableType*>(array)->chunkStartPtr(chunkIndex));
+	case ccNativeCloudFile::SECTION_COLORS:
+		return reinterpret_cast<unsigned char*>(static_cast<ColorsTableType*>(array)->chunkStartPtr(chunkIndex));
+	case ccNativeCloudFile::SECTION_NORMALS:
+		return reinterpret_cast<unsigned char*>(static_cast<NormsIndexesTableType*>(array)->chunkStartPtr(chunkIndex));
+	case ccNativeCloudFile::SECTION_SCALAR_FIELD:
+		return reinterpret_cast<unsigned char*>(static_cast<ccScalarField*>(array)->chunkStartPtr(chunkIndex));
+	}
+	return 0;
+}
+
+static void ReleaseArrays(std::vector<CCShareable*>& arrays)
+{
+	for (size_t i=0; i<arrays.size(); ++i)
+		if (arrays[i])
+			arrays[i]->release();
+	arrays.clear();
+}
+
+/*** Header parsing ***/
+
+//! Checks the file header
+static CC_FILE_ERROR CheckFileHeader(const ccNativeCloudFile::FileHeader& header)
+{
+	if (memcmp(header.magic,NATIVE_CLOUD_MAGIC,sizeof(NATIVE_CLOUD_MAGIC)) != 0)
+		return CC_FERR_WRONG_FILE_TYPE;
+
+	if (header.byteOrderMark != ccNativeCloudFile::BYTE_ORDER_MARK)
+	{
+		ccLog::Warning("[ccNativeCloudFile] File has been written on a machine with a different byte order");
+		return CC_FERR_NOT_IMPLEMENTED;
+	}
+
+	if (header.version == 0 || header.version > ccNativeCloudFile::CURRENT_VERSION)
+	{
+		ccLog::Warning("[ccNativeCloudFile] Unhandled file version (%u)",header.version);
+		return CC_FERR_NOT_IMPLEMENTED;
+	}
+
+	if (header.chunkSize != MAX_NUMBER_OF_ELEMENTS_PER_CHUNK)
+	{
+		ccLog::Warning("[ccNativeCloudFile] Unhandled chunk size (%u)",header.chunkSize);
+		return CC_FERR_NOT_IMPLEMENTED;
+	}
+
+	if (static_cast<uint64_t>(header.headerSize) != sizeof(ccNativeCloudFile::FileHeader) + static_cast<uint64_t>(header.sectionCount)*sizeof(ccNativeCloudFile::SectionHeader))
+		return CC_FERR_MALFORMED_FILE;
+
+	return CC_FERR_NO_ERROR;
+}
+
+//! Checks the sections table and returns the total file size
+static CC_FILE_ERROR CheckSections(const ccNativeCloudFile::FileHeader& header, const ccNativeCloudFile::SectionHeader* sections, uint64_t& fileSize)
+{
+	fileSize = header.headerSize;
+	unsigned pointsSections = 0;
+
+	for (uint32_t i=0; i<header.sectionCount; ++i)
+	{
+		const ccNativeCloudFile::SectionHeader& section = sections[i];
+
+		//sections must be stored in order (for progressive loading) and aligned (for mapping)
+		if (section.offset < fileSize || (section.offset & 7) != 0)
+			return CC_FERR_MALFORMED_FILE;
+		if (section.byteSize != static_cast<uint64_t>(section.elementSize)*section.elementCount)
+			return CC_FERR_MALFORMED_FILE;
+		fileSize = section.offset + section.byteSize;
+
+		uint32_t expectedSize = ExpectedElementSize(section.type);
+		if (expectedSize == 0) //unknown section (ignored)
+			continue;
+		if (section.elementSize != expectedSize)
+		{
+			ccLog::Warning("[ccNativeCloudFile] Section #%u: element size doesn't match (%u bytes instead of %u)",i,section.elementSize,expectedSize);
+			return CC_FERR_NOT_IMPLEMENTED;
+		}
+
+		switch (section.type)
+		{
+		case ccNativeCloudFile::SECTION_POINTS:
+			++pointsSections;
+			if (section.elementCount != header.pointCount)
+				return CC_FERR_MALFORMED_FILE;
+			break;
+		case ccNativeCloudFile::SECTION_COLORS:
+		case ccNativeCloudFile::SECTION_NORMALS:
+		case ccNativeCloudFile::SECTION_SCALAR_FIELD:
+			if (section.elementCount != header.pointCount)
+				return CC_FERR_MALFORMED_FILE;
+			break;
+		case ccNativeCloudFile::SECTION_OCTREE_BOX:
+			if (section.elementCount != 4)
+				return CC_FERR_MALFORMED_FILE;
+			break;
+		case ccNativeCloudFile::SECTION_OCTREE_CODES:
+			if (section.elementCount > header.pointCount)
+				return CC_FERR_MALFORMED_FILE;
+			break;
+		}
+	}
+
+	return (pointsSections == 1 ? CC_FERR_NO_ERROR : CC_FERR_MALFORMED_FILE);
+}
+
+//! Builds the cloud from the (filled) sections arrays
+/** \param header file header
+	\param sections sections table
+	\param arrays per-point sections arrays (see CreateArray)
+	\param rawData other sections data
+	\param[out] cloud output cloud
+	\return error code
+**/
+static CC_FILE_ERROR BuildCloud(const ccNativeCloudFile::FileHeader& header,
+								const ccNativeCloudFile::SectionHeader* sections,
+								const std::vector<CCShareable*>& arrays,
+								const std::vector<const unsigned char*>& rawData,
+								ccPointCloud*& cloud)
+{
+	cloud = new ccPointCloud();
+
+	const CCVector3* octreeBox = 0;
+	const CCLib::DgmOctree::IndexAndCode* octreeCodes = 0;
+	unsigned octreeCodesCount = 0;
+	//the displayed SF index is relative to the scalar field sections
+	int32_t sfSectionIndex = 0;
+	int displayedSFIndex = -1;
+
+	for (uint32_t i=0; i<header.sectionCount; ++i)
+	{
+		const ccNativeCloudFile::SectionHeader& section = sections[i];
+		switch (section.type)
+		{
+		case ccNativeCloudFile::SECTION_POINTS:
+			{
+				PointsTableType* points = static_cast<PointsTableType*>(arrays[i]);
+				PointCoordinateType bbMin[3] = {(PointCoordinateType)header.bbMin[0],(PointCoordinateType)header.bbMin[1],(PointCoordinateType)header.bbMin[2]};
+				PointCoordinateType bbMax[3] = {(PointCoordinateType)header.bbMax[0],(PointCoordinateType)header.bbMax[1],(PointCoordinateType)header.bbMax[2]};
+				points->setMin(bbMin);
+				points->setMax(bbMax);
+				cloud->setPointsTable(points,header.pointCount != 0);
+			}
+			break;
+		case ccNativeCloudFile::SECTION_COLORS:
+			if (cloud->rgbColors())
+			{
+				ccLog::Warning("[ccNativeCloudFile] Duplicate colors section ignored");
+				break;
+			}
+			cloud->setRGBColorsTable(static_cast<ColorsTableType*>(arrays[i]));
+			cloud->showColors(true);
+			break;
+		case ccNativeCloudFile::SECTION_NORMALS:
+			if (cloud->normals())
+			{
+				ccLog::Warning("[ccNativeCloudFile] Duplicate normals section ignored");
+				break;
+			}
+			cloud->setNormsTable(static_cast<NormsIndexesTableType*>(arrays[i]));
+			cloud->showNormals(true);
+			break;
+		case ccNativeCloudFile::SECTION_SCALAR_FIELD:
+			{
+				ccScalarField* sf = static_cast<ccScalarField*>(arrays[i]);
+				//the boundaries are saved with the field (no need to read all the values)
+				sf->setMinAndMax(static_cast<ScalarType>(section.minValue),static_cast<ScalarType>(section.maxValue));
+				int sfIndex = cloud->addScalarField(sf);
+				if (sfIndex < 0)
+					ccLog::Warning("[ccNativeCloudFile] Scalar field '%s' ignored (duplicate name?)",sf->getName());
+				else if (sfSectionIndex == header.displayedSF)
+					displayedSFIndex = sfIndex;
+				++sfSectionIndex;
+			}
+			break;
+		case ccNativeCloudFile::SECTION_OCTREE_BOX:
+			octreeBox = reinterpret_cast<const CCVector3*>(rawData[i]);
+			break;
+		case ccNativeCloudFile::SECTION_OCTREE_CODES:
+			octreeCodes = reinterpret_cast<const CCLib::DgmOctree::IndexAndCode*>(rawData[i]);
+			octreeCodesCount = section.elementCount;
+			break;
+		}
+	}
+
+	if (displayedSFIndex >= 0)
+	{
+		cloud->setCurrentDisplayedScalarField(displayedSFIndex);
+		cloud->showSF(true);
+	}
+
+	cloud->setOriginalShift(header.originalShift[0],header.originalShift[1],header.originalShift[2]);
+
+	//octree (optional)
+	if (octreeBox && octreeCodes && octreeCodesCount != 0)
+	{
+		ccOctree* octree = new ccOctree(cloud);
+		if (octree->buildFromCellCodes(octreeBox[0],octreeBox[1],octreeBox[2],octreeBox[3],octreeCodes,octreeCodesCount) > 0)
+		{
+			cloud->addChild(octree);
+		}
+		else
+		{
+			ccLog::Warning("[ccNativeCloudFile] Invalid octree data (ignored)");
+			delete octree;
+		}
+	}
+
+	return CC_FERR_NO_ERROR;
+}
+
+/*** ccNativeCloudFile ***/
+
+CC_FILE_ERROR ccNativeCloudFile::Save(ccPointCloud* cloud, const char* filename, bool saveOctree/*=true*/, CCLib::GenericProgressCallback* progressCb/*=0*/)
+{
+	if (!cloud || !filename)
+		return CC_FERR_BAD_ARGUMENT;
+
+	unsigned pointCount = cloud->size();
+
+	//sections table
+	std::vector<SectionHeader> sections;
+	std::vector<const void*> sectionsArray;
+	ccOctree* octree = (saveOctree ? cloud->getOctree() : 0);
+	CCVector3 octreeBox[4];
+	int32_t displayedSF = -1; //index of the displayed SF among the scalar field sections
+	try
+	{
+		SectionHeader section;
+		memset(&section,0,sizeof(SectionHeader));
+		section.elementCount = pointCount;
+
+		section.type = SECTION_POINTS;
+		sections.push_back(section);
+		sectionsArray.push_back(cloud->pointsTable());
+
+		ColorsTableType* colors = cloud->rgbColors();
+		if (colors && colors->currentSize() >= pointCount)
+		{
+			section.type = SECTION_COLORS;
+			sections.push_back(section);
+			sectionsArray.push_back(colors);
+		}
+
+		NormsIndexesTableType* normals = cloud->normals();
+		if (normals && normals->currentSize() >= pointCount)
+		{
+			section.type = SECTION_NORMALS;
+			sections.push_back(section);
+			sectionsArray.push_back(normals);
+		}
+
+		int32_t sfSectionCount = 0;
+		for (unsigned i=0; i<cloud->getNumberOfScalarFields(); ++i)
+		{
+			CCLib::ScalarField* sf = cloud->getScalarField(i);
+			if (sf->currentSize() < pointCount)
+			{
+				ccLog::Warning("[ccNativeCloudFile] Scalar field '%s' is too small (skipped)",sf->getName());
+				continue;
+			}
+			if (static_cast<int>(i) == cloud->getCurrentDisplayedScalarFieldIndex())
+				displayedSF = sfSectionCount;
+			++sfSectionCount;
+			section.type = SECTION_SCALAR_FIELD;
+			size_t nameLength = strlen(sf->getName());
+			if (nameLength >= sizeof(section.name))
+			{
+				nameLength = sizeof(section.name)-1;
+				ccLog::Warning("[ccNativeCloudFile] Scalar field name '%s' is too long (truncated to %u characters)",sf->getName(),static_cast<unsigned>(nameLength));
+			}
+			memcpy(section.name,sf->getName(),nameLength);
+			section.name[nameLength] = 0;
+			//make sure the boundaries are up to date (without modifying the display parameters)
+			sf->CCLib::ScalarField::computeMinAndMax();
+			section.minValue = static_cast<double>(sf->getMin());
+			section.maxValue = static_cast<double>(sf->getMax());
+			sections.push_back(section);
+			sectionsArray.push_back(sf);
+			memset(section.name,0,sizeof(section.name));
+			section.minValue = section.maxValue = 0;
+		}
+
+		if (octree && octree->getNumberOfProjectedPoints() != 0)
+		{
+			octreeBox[0] = octree->getOctreeMins();
+			octreeBox[1] = octree->getOctreeMaxs();
+			octreeBox[2] = octree->getPointsMins();
+			octreeBox[3] = octree->getPointsMaxs();
+
+			section.type = SECTION_OCTREE_BOX;
+			section.elementCount = 4;
+			sections.push_back(section);
+			sectionsArray.push_back(octreeBox);
+
+			section.type = SECTION_OCTREE_CODES;
+			section.elementCount = octree->getNumberOfProjectedPoints();
+			section.flags = CCLib::DgmOctree::MAX_OCTREE_LEVEL;
+			sections.push_back(section);
+			sectionsArray.push_back(&(octree->pointsAndTheirCellCodes()[0]));
+		}
+	}
+	catch(std::bad_alloc)
+	{
+		return CC_FERR_NOT_ENOUGH_MEMORY;
+	}
+
+	//file header
+	FileHeader header;
+	memset(&header,0,sizeof(FileHeader));
+	memcpy(header.magic,NATIVE_CLOUD_MAGIC,sizeof(NATIVE_CLOUD_MAGIC));
+	header.version = CURRENT_VERSION;
+	header.byteOrderMark = BYTE_ORDER_MARK;
+	header.sectionCount = (uint32_t)sections.size();
+	header.headerSize = (uint32_t)(sizeof(FileHeader) + sections.size()*sizeof(SectionHeader));
+	header.pointCount = pointCount;
+	header.chunkSize = MAX_NUMBER_OF_ELEMENTS_PER_CHUNK;
+	header.alignment = SECTION_ALIGNMENT;
+	header.displayedSF = displayedSF;
+	{
+		const double* shift = cloud->getOriginalShift();
+		PointCoordinateType bbMin[3],bbMax[3];
+		cloud->getBoundingBox(bbMin,bbMax);
+		for (unsigned k=0; k<3; ++k)
+		{
+			header.originalShift[k] = shift[k];
+			header.bbMin[k] = bbMin[k];
+			header.bbMax[k] = bbMax[k];
+		}
+	}
+
+	//sections layout
+	uint64_t offset = header.headerSize;
+	for (size_t i=0; i<sections.size(); ++i)
+	{
+		SectionHeader& section = sections[i];
+		section.elementSize = ExpectedElementSize(section.type);
+		section.byteSize = static_cast<uint64_t>(section.elementSize)*section.elementCount;
+		section.offset = ((offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT) * SECTION_ALIGNMENT;
+		offset = section.offset + section.byteSize;
+	}
+
+	FILE* fp = fopen(filename,"wb");
+	if (!fp)
+		return CC_FERR_WRITING;
+
+	CCLib::NormalizedProgress* nprogress = 0;
+	if (progressCb)
+	{
+		unsigned chunks = (pointCount + MAX_NUMBER_OF_ELEMENTS_PER_CHUNK - 1) / MAX_NUMBER_OF_ELEMENTS_PER_CHUNK;
+		progressCb->reset();
+		nprogress = new CCLib::NormalizedProgress(progressCb,chunks*(unsigned)sections.size());
+		progressCb->setMethodTitle("Save native cloud");
+		char buf[256];
+		sprintf(buf,"Number of points = %u",pointCount);
+		progressCb->setInfo(buf);
+		progressCb->start();
+	}
+
+	CC_FILE_ERROR result = CC_FERR_NO_ERROR;
+	if (fwrite(&header,sizeof(FileHeader),1,fp) != 1
+		||	fwrite(&sections[0],sizeof(SectionHeader),sections.size(),fp) != sections.size())
+	{
+		result = CC_FERR_WRITING;
+	}
+
+	offset = header.headerSize;
+	static const unsigned char s_padding[SECTION_ALIGNMENT] = {0};
+	for (size_t i=0; i<sections.size() && result == CC_FERR_NO_ERROR; ++i)
+	{
+		const SectionHeader& section = sections[i];
+
+		//padding
+		assert(section.offset >= offset && section.offset-offset <= SECTION_ALIGNMENT);
+		size_t paddingSize = static_cast<size_t>(section.offset - offset);
+		if (paddingSize != 0 && fwrite(s_padding,1,paddingSize,fp) != paddingSize)
+		{
+			result = CC_FERR_WRITING;
+			break;
+		}
+
+		bool success = true;
+		switch (section.type)
+		{
+		case SECTION_POINTS:
+			success = WriteChunks(fp,static_cast<const PointsTableType*>(sectionsArray[i]),pointCount,nprogress);
+			break;
+		case SECTION_COLORS:
+			success = WriteChunks(fp,static_cast<const ColorsTableType*>(sectionsArray[i]),pointCount,nprogress);
+			break;
+		case SECTION_NORMALS:
+			success = WriteChunks(fp,static_cast<const NormsIndexesTableType*>(sectionsArray[i]),pointCount,nprogress);
+			break;
+		case SECTION_SCALAR_FIELD:
+			success = WriteChunks(fp,static_cast<const CCLib::ScalarField*>(sectionsArray[i]),pointCount,nprogress);
+			break;
+		default:
+			success = (fwrite(sectionsArray[i],section.elementSize,section.elementCount,fp) == section.elementCount);
+			break;
+		}
+
+		if (!success)
+			result = (progressCb && progressCb->isCancelRequested() ? CC_FERR_CANCELED_BY_USER : CC_FERR_WRITING);
+
+		offset = section.offset + section.byteSize;
+	}
+
+	if (fclose(fp) != 0 && result == CC_FERR_NO_ERROR)
+		result = CC_FERR_WRITING;
+
+	if (nprogress)
+	{
+		delete nprogress;
+		progressCb->stop();
+	}
+
+	return result;
+}
+
+CC_FILE_ERROR ccNativeCloudFile::Load(const char* filename, ccPointCloud*& cloud)
+{
+	cloud = 0;
+
+	CC_FILE_ERROR error = CC_FERR_NO_ERROR;
+	ccMappedFile* file = ccMappedFile::Map(filename,&error);
+	if (!file)
+		return error;
+
+	error = Load(file,cloud);
+
+	//the cloud arrays keep the file mapped as long as needed
+	file->release();
+
+	return error;
+}
+
+CC_FILE_ERROR ccNativeCloudFile::Load(ccMappedFile* buffer, ccPointCloud*& cloud)
+{
+	cloud = 0;
+
+	if (!buffer)
+		return CC_FERR_BAD_ARGUMENT;
+
+	unsigned char* data = buffer->data();
+	size_t size = buffer->size();
+
+	if (size < sizeof(FileHeader))
+		return (size >= sizeof(NATIVE_CLOUD_MAGIC) && memcmp(data,NATIVE_CLOUD_MAGIC,sizeof(NATIVE_CLOUD_MAGIC)) == 0 ? CC_FERR_MALFORMED_FILE : CC_FERR_WRONG_FILE_TYPE);
+
+	const FileHeader& header = *reinterpret_cast<const FileHeader*>(data);
+	CC_FILE_ERROR error = CheckFileHeader(header);
+	if (error != CC_FERR_NO_ERROR)
+		return error;
+	if (size < header.headerSize)
+		return CC_FERR_MALFORMED_FILE;
+
+	const SectionHeader* sections = reinterpret_cast<const SectionHeader*>(data + sizeof(FileHeader));
+	uint64_t fileSize = 0;
+	error = CheckSections(header,sections,fileSize);
+	if (error != CC_FERR_NO_ERROR)
+		return error;
+	if (size < fileSize)
+		return CC_FERR_MALFORMED_FILE;
+
+	//the arrays directly use the file chunks
+	std::vector<CCShareable*> arrays;
+	std::vector<const unsigned char*> rawData;
+	try
+	{
+		arrays.resize(header.sectionCount,0);
+		rawData.resize(header.sectionCount,0);
+		for (uint32_t i=0; i<header.sectionCount; ++i)
+		{
+			const SectionHeader& section = sections[i];
+			if (IsPerPointSection(section.type))
+			{
+				arrays[i] = CreateArray(section);
+				if (!AdoptSection(arrays[i],section.type,data+section.offset,section.elementCount,buffer))
+				{
+					error = CC_FERR_NOT_ENOUGH_MEMORY;
+					break;
+				}
+			}
+			else if (ExpectedElementSize(section.type) != 0)
+			{
+				rawData[i] = data+section.offset;
+			}
+		}
+	}
+	catch(std::bad_alloc)
+	{
+		error = CC_FERR_NOT_ENOUGH_MEMORY;
+	}
+
+	if (error == CC_FERR_NO_ERROR)
+		error = BuildCloud(header,sections,arrays,rawData,cloud);
+
+	ReleaseArrays(arrays);
+
+	return error;
+}
+
+/*** ccNativeCloudFile::ProgressiveLoader ***/
+
+ccNativeCloudFile::ProgressiveLoader::ProgressiveLoader()
+	: m_received(0)
+	, m_totalBytes(0)
+	, m_error(CC_FERR_NO_ERROR)
+	, m_cloud(0)
+{
+}
+
+ccNativeCloudFile::ProgressiveLoader::~ProgressiveLoader()
+{
+	ReleaseArrays(m_arrays);
+	if (m_cloud)
+		delete m_cloud;
+}
+
+ccPointCloud* ccNativeCloudFile::ProgressiveLoader::takeCloud()
+{
+	ccPointCloud* cloud = m_cloud;
+	m_cloud = 0;
+	return cloud;
+}
+
+CC_FILE_ERROR ccNativeCloudFile::ProgressiveLoader::feed(const void* data, size_t size)
+{
+	if (m_error != CC_FERR_NO_ERROR)
+		return m_error;
+	if (!data && size != 0)
+		return CC_FERR_BAD_ARGUMENT;
+
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+	//header and sections table
+	while (m_totalBytes == 0 && size != 0)
+	{
+		size_t expected = (m_headerBuffer.size() < sizeof(FileHeader) ? sizeof(FileHeader) : reinterpret_cast<const FileHeader*>(&m_headerBuffer[0])->headerSize);
+		size_t count = std::min(expected-m_headerBuffer.size(),size);
+		try
+		{
+			m_headerBuffer.insert(m_headerBuffer.end(),bytes,bytes+count);
+		}
+		catch(std::bad_alloc)
+		{
+			return (m_error = CC_FERR_NOT_ENOUGH_MEMORY);
+		}
+		m_received += count;
+		bytes += count;
+		size -= count;
+
+		if (m_headerBuffer.size() < expected)
+			break;
+
+		const FileHeader* header = reinterpret_cast<const FileHeader*>(&m_headerBuffer[0]);
+		if (expected == sizeof(FileHeader))
+		{
+			if ((m_error = CheckFileHeader(*header)) != CC_FERR_NO_ERROR)
+				return m_error;
+			if (header->headerSize > expected)
+				continue;
+		}
+
+		//whole table received: we can allocate the arrays
+		const SectionHeader* sections = reinterpret_cast<const SectionHeader*>(&m_headerBuffer[0] + sizeof(FileHeader));
+		uint64_t fileSize = 0;
+		if ((m_error = CheckSections(*header,sections,fileSize)) != CC_FERR_NO_ERROR)
+			return m_error;
+
+		try
+		{
+			m_arrays.resize(header->sectionCount,0);
+			m_rawData.resize(header->sectionCount);
+			for (uint32_t i=0; i<header->sectionCount; ++i)
+			{
+				const SectionHeader& section = sections[i];
+				if (IsPerPointSection(section.type))
+				{
+					m_arrays[i] = CreateArray(section);
+					if (!AllocateSection(m_arrays[i],section.type,section.elementCount))
+						return (m_error = CC_FERR_NOT_ENOUGH_MEMORY);
+				}
+				else if (ExpectedElementSize(section.type) != 0)
+				{
+					m_rawData[i].resize(static_cast<size_t>(section.byteSize));
+				}
+			}
+		}
+		catch(std::bad_alloc)
+		{
+			return (m_error = CC_FERR_NOT_ENOUGH_MEMORY);
+		}
+
+		m_totalBytes = fileSize;
+	}
+
+	if (m_totalBytes == 0)
+		return CC_FERR_NO_ERROR; //header is still incomplete
+
+	if (m_received + size > m_totalBytes)
+		return (m_error = CC_FERR_BAD_ARGUMENT);
+
+	if (size != 0)
+	{
+		copySectionsData(bytes,m_received,size);
+		m_received += size;
+	}
+
+	if (m_received == m_totalBytes && !m_cloud)
+	{
+		const FileHeader& header = *reinterpret_cast<const FileHeader*>(&m_headerBuffer[0]);
+		const SectionHeader* sections = reinterpret_cast<const SectionHeader*>(&m_headerBuffer[0] + sizeof(FileHeader));
+
+		std::vector<const unsigned char*> rawData;
+		try
+		{
+			rawData.resize(header.sectionCount,0);
+		}
+		catch(std::bad_alloc)
+		{
+			return (m_error = CC_FERR_NOT_ENOUGH_MEMORY);
+		}
+		for (uint32_t i=0; i<header.sectionCount; ++i)
+			if (!m_rawData[i].empty())
+				rawData[i] = &(m_rawData[i][0]);
+
+		m_error = BuildCloud(header,sections,m_arrays,rawData,m_cloud);
+
+		//the cloud now holds the arrays
+		ReleaseArrays(m_arrays);
+		m_rawData.clear();
+		m_headerBuffer.clear();
+	}
+
+	return m_error;
+}
+
+void ccNativeCloudFile::ProgressiveLoader::copySectionsData(const unsigned char* data, uint64_t position, size_t size)
+{
+	const FileHeader& header = *reinterpret_cast<const FileHeader*>(&m_headerBuffer[0]);
+	const SectionHeader* sections = reinterpret_cast<const SectionHeader*>(&m_headerBuffer[0] + sizeof(FileHeader));
+
+	uint64_t end = position + size;
+	for (uint32_t i=0; i<header.sectionCount && position < end; ++i)
+	{
+		const SectionHeader& section = sections[i];
+		uint64_t sectionEnd = section.offset + section.byteSize;
+		if (sectionEnd <= position)
+			continue;
+		if (section.offset >= end)
+			break; //sections are ordered
+
+		//part of the section covered by the received bytes
+		uint64_t start = std::max(section.offset,position);
+		uint64_t stop = std::min(sectionEnd,end);
+		const unsigned char* src = data + (start - position);
+
+		if (m_arrays[i])
+		{
+			//chunk by chunk
+			const uint64_t chunkBytes = static_cast<uint64_t>(MAX_NUMBER_OF_ELEMENTS_PER_CHUNK)*section.elementSize;
+			while (start < stop)
+			{
+				uint64_t relativePos = start - section.offset;
+				unsigned chunkIndex = static_cast<unsigned>(relativePos / chunkBytes);
+				uint64_t posInChunk = relativePos % chunkBytes;
+				size_t count = static_cast<size_t>(std::min(chunkBytes-posInChunk,stop-start));
+				memcpy(SectionChunkStart(m_arrays[i],section.type,chunkIndex)+posInChunk,src,count);
+				src += count;
+				start += count;
+			}
+		}
+		else if (!m_rawData[i].empty())
+		{
+			memcpy(&(m_rawData[i][static_cast<size_t>(start - section.offset)]),src,static_cast<size_t>(stop-start));
+		}
+	}
+}
@@ -0,0 +1,215 @@
+//##########################################################################
+//#                                                                        #
+//#                            CLOUDCOMPARE                                #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 of the License.               #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: EDF R&D / TELECOM ParisTech (ENST-TSI)             #
+//#                                                                        #
+//##########################################################################
+
+#ifndef CC_NATIVE_CLOUD_FILE_HEADER
+#define CC_NATIVE_CLOUD_FILE_HEADER
+
+//Local
+#include "ccMappedFile.h"
+
+//CCLib
+#include <GenericProgressCallback.h>
+
+//system
+#include <stdint.h> //for uint fixed-sized types
+#include <vector>
+
+class ccPointCloud;
+
+//! Native binary point cloud file (versioned and chunk-aligned)
+/** File layout (little endian):
+	- a header (see FileHeader)
+	- a table of sections (see SectionHeader): points, RGB colors, compressed
+	normals, scalar fields (any number) and optionally the octree
+	- the sections data, each one starting on a SECTION_ALIGNMENT boundary
+	Per-point sections are stored as consecutive chunks of
+	MAX_NUMBER_OF_ELEMENTS_PER_CHUNK elements, i.e. exactly as in memory
+	(see GenericChunkedArray). Therefore a mapped file can be used directly
+	by the cloud arrays (no copy, no parsing). Sections are stored in the
+	same order as in the file so that it can also be parsed progressively
+	(see ccNativeCloudFile::ProgressiveLoader).
+	Unknown sections (written by a newer version) are ignored.
+**/
+#ifdef QCC_DB_USE_AS_DLL
+#include "qCC_db_dll.h"
+class QCC_DB_DLL_API ccNativeCloudFile
+#else
+class ccNativeCloudFile
+#endif
+{
+public:
+
+	//! Current file format version
+	static const uint32_t CURRENT_VERSION = 1;
+
+	//! Sections alignment (in bytes)
+	static const uint32_t SECTION_ALIGNMENT = 4096;
+
+	//! Sections types
+	enum SECTION_TYPE {	SECTION_POINTS			= 1,	/**< Points coordinates **/
+						SECTION_COLORS			= 2,	/**< RGB colors **/
+						SECTION_NORMALS			= 3,	/**< Compressed normals **/
+						SECTION_SCALAR_FIELD	= 4,	/**< Scalar field (the name is stored in the section header) **/
+						SECTION_OCTREE_BOX		= 5,	/**< Octree limits (octree min/max and points min/max) **/
+						SECTION_OCTREE_CODES	= 6		/**< Octree points indexes and cell codes (sorted) **/
+	};
+
+	//! File header
+	struct FileHeader
+	{
+		//! Magic string ("CCNATIVE")
+		char magic[8];
+		//! File format version
+		uint32_t version;
+		//! Byte order mark (BYTE_ORDER_MARK)
+		uint32_t byteOrderMark;
+		//! Header and sections table size (in bytes)
+		uint32_t headerSize;
+		//! Number of sections
+		uint32_t sectionCount;
+		//! Number of points
+		uint32_t pointCount;
+		//! Number of elements per chunk
+		uint32_t chunkSize;
+		//! Sections alignment (in bytes)
+		uint32_t alignment;
+		//! Displayed scalar field index (among the scalar field sections, -1 if none)
+		int32_t displayedSF;
+		//! Original shift
+		double originalShift[3];
+		//! Points bounding-box (min corner)
+		double bbMin[3];
+		//! Points bounding-box (max corner)
+		double bbMax[3];
+	};
+
+	//! Section header
+	struct SectionHeader
+	{
+		//! Section type (see SECTION_TYPE)
+		uint32_t type;
+		//! Size of one element (in bytes)
+		uint32_t elementSize;
+		//! Number of elements
+		uint32_t elementCount;
+		//! Flags (reserved)
+		uint32_t flags;
+		//! Offset of the section data (from the beginning of the file)
+		uint64_t offset;
+		//! Size of the section data (in bytes)
+		uint64_t byteSize;
+		//! Min value (scalar fields)
+		double minValue;
+		//! Max value (scalar fields)
+		double maxValue;
+		//! Section name (scalar fields)
+		char name[64];
+	};
+
+	//! Byte order mark
+	static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+	//! Saves a cloud
+	/** \param cloud cloud to save (with its colors, normals and scalar fields)
+		\param filename output filename
+		\param saveOctree whether to save the cloud octree (if any)
+		\param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
+		\return error code
+	**/
+	static CC_FILE_ERROR Save(ccPointCloud* cloud, const char* filename, bool saveOctree=true, CCLib::GenericProgressCallback* progressCb=0);
+
+	//! Loads a cloud
+	/** The file is mapped in memory and the cloud arrays directly use the
+		mapped chunks (the file is not parsed nor copied). Mapped pages are
+		only read from disk when they are accessed and any modification of
+		the cloud stays in memory (copy-on-write).
+		\param filename input filename
+		\param[out] cloud loaded cloud
+		\return error code
+	**/
+	static CC_FILE_ERROR Load(const char* filename, ccPointCloud*& cloud);
+
+	//! Loads a cloud from a memory buffer
+	/** Same as Load (the buffer is shared by the cloud arrays, no copy is made).
+		\param buffer buffer containing the whole file (it will be linked by the cloud arrays)
+		\param[out] cloud loaded cloud
+		\return error code
+	**/
+	static CC_FILE_ERROR Load(ccMappedFile* buffer, ccPointCloud*& cloud);
+
+	//! Progressive loader
+	/** To parse a file while it's being received (e.g. fetched over the network).
+		Bytes must be fed in order, but they can be split arbitrarily.
+	**/
+#ifdef QCC_DB_USE_AS_DLL
+	class QCC_DB_DLL_API ProgressiveLoader
+#else
+	class ProgressiveLoader
+#endif
+	{
+	public:
+
+		//! Default constructor
+		ProgressiveLoader();
+
+		//! Destructor
+		virtual ~ProgressiveLoader();
+
+		//! Feeds the next bytes of the file
+		/** \param data bytes
+			\param size number of bytes
+			\return error code (the loader can't be used anymore in case of error)
+		**/
+		CC_FILE_ERROR feed(const void* data, size_t size);
+
+		//! Returns the number of bytes received so far
+		inline uint64_t bytesReceived() const { return m_received; }
+
+		//! Returns the total file size (or 0 if the header has not been received yet)
+		inline uint64_t totalBytes() const { return m_totalBytes; }
+
+		//! Returns whether the whole file has been received
+		inline bool isComplete() const { return m_cloud != 0; }
+
+		//! Returns the loaded cloud (once complete)
+		/** The caller takes ownership of the cloud.
+		**/
+		ccPointCloud* takeCloud();
+
+	protected:
+
+		//! Copies bytes in the sections data
+		void copySectionsData(const unsigned char* data, uint64_t position, size_t size);
+
+		//! Header and sections table buffer
+		std::vector<unsigned char> m_headerBuffer;
+		//! Number of bytes received so far
+		uint64_t m_received;
+		//! Total file size
+		uint64_t m_totalBytes;
+		//! Sections arrays (per-point sections)
+		std::vector<CCShareable*> m_arrays;
+		//! Sections raw data (other sections)
+		std::vector< std::vector<unsigned char> > m_rawData;
+		//! Last error
+		CC_FILE_ERROR m_error;
+		//! Loaded cloud
+		ccPointCloud* m_cloud;
+	};
+};
+
+#endif //CC_NATIVE_CLOUD_FILE_HEADER
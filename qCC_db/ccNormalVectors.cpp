@@ -22,9 +22,14 @@
 #include <Neighbourhood.h>
 
 #include <assert.h>
+#include <vector>
+#include <algorithm>
 
 static ccNormalVectors* s_uniqueInstance = 0;
 
+//! Invalid quantization lookup table entry
+static const normsType s_invalidLUTCode = static_cast<normsType>(-1);
+
 //Number of points for local modeling to compute normals with 2D1/2 Delaunay triangulation
 #define	NUMBER_OF_POINTS_FOR_NORM_WITH_TRI 6
 //Number of points for local modeling to compute normals with least square plane
@@ -50,6 +55,8 @@ ccNormalVectors::ccNormalVectors()
 	: m_theNormalVectors(0)
 	, m_theNormalHSVColors(0)
 	, m_numberOfVectors(0)
+	, m_quantizeLUT(0)
+	, m_quantizeLUTRes(0)
 {
 	init(NORMALS_QUANTIZE_LEVEL);
 }
@@ -60,6 +67,8 @@ ccNormalVectors::~ccNormalVectors()
 		delete[] m_theNormalVectors;
 	if (m_theNormalHSVColors)
 		delete[] m_theNormalHSVColors;
+	if (m_quantizeLUT)
+		delete[] m_quantizeLUT;
 }
 
 bool ccNormalVectors::enableNormalHSVColorsArray()
@@ -117,6 +126,35 @@ void ccNormalVectors::init(unsigned quantizeLevel)
 		*P++ = N.y;
 		*P++ = N.z;
 	}
+
+	//quantization lookup table: for each cell (qx,qy,qz) of a regular grid
+	//(with 2^level cells per dimension), we store the code of its center.
+	//As x+y+z=1, we have qx+qy+qz in [res-3;res] (see getNormIndex).
+	m_quantizeLUTRes = (1<<quantizeLevel);
+	const unsigned lutRes = m_quantizeLUTRes;
+	m_quantizeLUT = new normsType[lutRes*lutRes*4];
+	normsType* code = m_quantizeLUT;
+	for (unsigned qx=0; qx<lutRes; ++qx)
+	{
+		for (unsigned qy=0; qy<lutRes; ++qy)
+		{
+			for (unsigned s=0; s<4; ++s,++code)
+			{
+				int qz = static_cast<int>(lutRes+s) - 3 - static_cast<int>(qx+qy);
+				if (qz < 0 || qz >= static_cast<int>(lutRes))
+				{
+					*code = s_invalidLUTCode;
+				}
+				else
+				{
+					float x = (static_cast<float>(qx)+0.5f)/lutRes;
+					float y = (static_cast<float>(qy)+0.5f)/lutRes;
+					float z = (static_cast<float>(qz)+0.5f)/lutRes;
+					*code = static_cast<normsType>(Quant_quantize_normalized_octant(x,y,z,quantizeLevel));
+				}
+			}
+		}
+	}
 }
 
 void ccNormalVectors::InvertNormal(normsType &code)
@@ -254,16 +292,14 @@ bool ccNormalVectors::ComputeCloudNormals(ccGenericPointCloud* theCloud,
 		}
 	}
 
-	//we 'compress' each normal (and we check its orientation if necessary)
-	theNormsCodes.fill(0);
-	theNorms->placeIteratorAtBegining();
-	for (unsigned i=0;i<n;i++)
+	//we check the normals orientation if necessary
+	if (hasPreferedOrientation)
 	{
-		PointCoordinateType* N = theNorms->getCurrentValue();
-
-		//we check sign if necessary
-		if (hasPreferedOrientation)
+		theNorms->placeIteratorAtBegining();
+		for (unsigned i=0;i<n;i++)
 		{
+			PointCoordinateType* N = theNorms->getCurrentValue();
+
 			if (preferedOrientation == 6)
 			{
 				orientation = *(theCloud->getPoint(i))-barycenter;
@@ -275,13 +311,15 @@ bool ccNormalVectors::ComputeCloudNormals(ccGenericPointCloud* theCloud,
 
 			if (CCVector3::vdot(N,orientation.u) < 0)
 				CCVector3::vmultiply(N,-1.0);
-		}
 
-		normsType nCode = (normsType)Quant_quantize_normal(N,NORMALS_QUANTIZE_LEVEL);
-		theNormsCodes.setValue(i,nCode);
-		theNorms->forwardIterator();
+			theNorms->forwardIterator();
+		}
 	}
 
+	//then we 'compress' them
+	theNormsCodes.fill(0);
+	EncodeNormals(*theNorms,theNormsCodes);
+
 	theNorms->release();
 	theNorms=0;
 
@@ -536,9 +574,8 @@ unsigned ccNormalVectors::Quant_quantize_normal(const float* n, unsigned level)
 		return 0;
 
 	/// compute in which sector lie the elements
-	unsigned res = 0, sector = 0;
-	bool flip = false;
-	float x,y,z,box[6],halfBox[3],psnorm;
+	unsigned res = 0;
+	float x,y,z,psnorm;
 	if (n[0] >= 0.) { x = n[0]; } else { res |= 4; x = -n[0]; }
 	if (n[1] >= 0.) { y = n[1]; } else { res |= 2; y = -n[1]; }
 	if (n[2] >= 0.) { z = n[2]; } else { res |= 1; z = -n[2]; }
@@ -552,6 +589,15 @@ unsigned ccNormalVectors::Quant_quantize_normal(const float* n, unsigned level)
 	}
 	psnorm = 1. / psnorm;
 	x *= psnorm; y *= psnorm; z *= psnorm;
+
+	return (res << (level<<1)) | Quant_quantize_normalized_octant(x,y,z,level);
+}
+
+unsigned ccNormalVectors::Quant_quantize_normalized_octant(float x, float y, float z, unsigned level)
+{
+	unsigned res = 0, sector = 0;
+	bool flip = false;
+	float box[6],halfBox[3],tmp;
 	/// compute the box
 	box[0] = box[1] = box[2] = 0.;
 	box[3] = box[4] = box[5] = 1.;
@@ -587,14 +633,14 @@ unsigned ccNormalVectors::Quant_quantize_normal(const float* n, unsigned level)
 		if (flip)
 		{
 			if (sector != 3)
-				psnorm = box[sector];
+				tmp = box[sector];
 			box[0] = halfBox[0];
 			box[1] = halfBox[1];
 			box[2] = halfBox[2];
 			if (sector != 3)
 			{
 				box[3+sector] = box[sector];
-				box[sector] = psnorm;
+				box[sector] = tmp;
 			}
 			else
 			{
@@ -604,14 +650,14 @@ unsigned ccNormalVectors::Quant_quantize_normal(const float* n, unsigned level)
 		else
 		{
 			if (sector != 3)
-				psnorm = box[3+sector];
+				tmp = box[3+sector];
 			box[3] = halfBox[0];
 			box[4] = halfBox[1];
 			box[5] = halfBox[2];
 			if (sector != 3)
 			{
 				box[sector] = box[3+sector];
-				box[3+sector] = psnorm;
+				box[3+sector] = tmp;
 			}
 			else
 			{
@@ -620,7 +666,215 @@ unsigned ccNormalVectors::Quant_quantize_normal(const float* n, unsigned level)
 		}
 	}
 
-	return 0;
+	return res;
+}
+
+normsType ccNormalVectors::getNormIndex(const PointCoordinateType N[]) const
+{
+	//same preamble as Quant_quantize_normal (so that the results are identical)
+	unsigned res = 0;
+	float x,y,z,psnorm;
+	if (N[0] >= 0.) { x = N[0]; } else { res |= 4; x = -N[0]; }
+	if (N[1] >= 0.) { y = N[1]; } else { res |= 2; y = -N[1]; }
+	if (N[2] >= 0.) { z = N[2]; } else { res |= 1; z = -N[2]; }
+	res <<= (NORMALS_QUANTIZE_LEVEL<<1);
+
+	psnorm = x + y + z;
+	if (psnorm ==  0)
+		return static_cast<normsType>(res);
+	psnorm = 1. / psnorm;
+	x *= psnorm; y *= psnorm; z *= psnorm;
+
+	//All the thresholds used by the recursive algorithm are multiples of
+	//1/2^level. Therefore, as long as a vector doesn't lie exactly on one
+	//of them, its code only depends on the (integer) cell it falls in.
+	//And as x+y+z=1, the 3rd cell coordinate only takes a few values.
+	assert(m_quantizeLUT);
+	const int lutRes = static_cast<int>(m_quantizeLUTRes);
+	const float scale = static_cast<float>(lutRes);
+	const float X = x*scale, Y = y*scale, Z = z*scale; //exact (power of 2)
+	if (X > 0 && X < scale && Y > 0 && Y < scale && Z > 0 && Z < scale) //NaN values are rejected as well
+	{
+		int qx = static_cast<int>(X);
+		int qy = static_cast<int>(Y);
+		int qz = static_cast<int>(Z);
+		if (X != static_cast<float>(qx) && Y != static_cast<float>(qy) && Z != static_cast<float>(qz))
+		{
+			int s = qx + qy + qz - (lutRes-3);
+			if (s >= 0 && s < 4)
+			{
+				normsType code = m_quantizeLUT[((qx*lutRes)+qy)*4+s];
+				if (code != s_invalidLUTCode)
+					return static_cast<normsType>(res | code);
+			}
+		}
+	}
+
+	//refinement (the vector lies on a cell border)
+	return static_cast<normsType>(res | Quant_quantize_normalized_octant(x,y,z,NORMALS_QUANTIZE_LEVEL));
+}
+
+void ccNormalVectors::GetNormIndexes(const PointCoordinateType* normals, unsigned count, normsType* codes)
+{
+	const ccNormalVectors* instance = GetUniqueInstance();
+	for (unsigned i=0; i<count; ++i,normals+=3)
+		codes[i] = instance->getNormIndex(normals);
+}
+
+void ccNormalVectors::GetNormals(const normsType* codes, unsigned count, PointCoordinateType* normals)
+{
+	const PointCoordinateType* table = GetUniqueInstance()->m_theNormalVectors;
+	for (unsigned i=0; i<count; ++i,normals+=3)
+	{
+		const PointCoordinateType* N = table + 3*static_cast<unsigned>(codes[i]);
+		normals[0] = N[0];
+		normals[1] = N[1];
+		normals[2] = N[2];
+	}
+}
+
+//! Normals (de)compression job (one chunk of the output array)
+struct normalsCodecJobDesc
+{
+	//! Output chunk index
+	unsigned chunkIndex;
+	//! First element index
+	unsigned first;
+	//! Last element index (excluded)
+	unsigned last;
+};
+
+//! Compresses the normals of one chunk
+static void EncodeNormalsChunk(const NormsTableType& normals, NormsIndexesTableType& codes, const normalsCodecJobDesc& job)
+{
+	normsType* _codes = codes.chunkStartPtr(job.chunkIndex);
+	//the input array is read chunk by chunk as well
+	unsigned i = job.first;
+	while (i < job.last)
+	{
+		unsigned count = std::min(job.last-i, MAX_NUMBER_OF_ELEMENTS_PER_CHUNK - (i & (MAX_NUMBER_OF_ELEMENTS_PER_CHUNK-1)));
+		ccNormalVectors::GetNormIndexes(normals.getValue(i),count,_codes);
+		_codes += count;
+		i += count;
+	}
+}
+
+//! Decompresses the normals of one chunk
+static void DecodeNormalsChunk(const NormsIndexesTableType& codes, NormsTableType& normals, const normalsCodecJobDesc& job)
+{
+	PointCoordinateType* _normals = normals.chunkStartPtr(job.chunkIndex);
+	unsigned i = job.first;
+	while (i < job.last)
+	{
+		unsigned count = std::min(job.last-i, MAX_NUMBER_OF_ELEMENTS_PER_CHUNK - (i & (MAX_NUMBER_OF_ELEMENTS_PER_CHUNK-1)));
+		ccNormalVectors::GetNormals(&codes.getValue(i),count,_normals);
+		_normals += 3*count;
+		i += count;
+	}
+}
+
+//! Creates one job per chunk of the output array (returns false if there's not enough memory)
+template<int N, class ElementType> static bool CreateNormalsCodecJobs(const GenericChunkedArray<N,ElementType>& output, unsigned count, std::vector<normalsCodecJobDesc>& jobs)
+{
+	try
+	{
+		jobs.resize(output.chunksCount());
+	}
+	catch(std::bad_alloc)
+	{
+		return false;
+	}
+
+	unsigned first = 0;
+	for (unsigned k=0; k<output.chunksCount(); ++k)
+	{
+		normalsCodecJobDesc& job = jobs[k];
+		job.chunkIndex = k;
+		job.first = std::min(first,count);
+		job.last = std::min(first+output.chunkSize(k),count);
+		first += output.chunkSize(k);
+	}
+
+	return true;
+}
+
+#ifdef ENABLE_MT_OCTREE
+
+#include <QtCore/QtCore>
+
+static const NormsTableType* s_codecNormals_MT = 0;
+static const NormsIndexesTableType* s_codecCodes_MT = 0;
+static NormsTableType* s_codecOutNormals_MT = 0;
+static NormsIndexesTableType* s_codecOutCodes_MT = 0;
+
+void EncodeNormalsChunk_MT(normalsCodecJobDesc& job)
+{
+	EncodeNormalsChunk(*s_codecNormals_MT,*s_codecOutCodes_MT,job);
+}
+
+void DecodeNormalsChunk_MT(normalsCodecJobDesc& job)
+{
+	DecodeNormalsChunk(*s_codecCodes_MT,*s_codecOutNormals_MT,job);
+}
+
+#endif
+
+bool ccNormalVectors::EncodeNormals(const NormsTableType& normals, NormsIndexesTableType& codes)
+{
+	unsigned count = normals.currentSize();
+	if (codes.currentSize() < count && !codes.resize(count))
+		return false;
+	if (count == 0)
+		return true;
+
+	std::vector<normalsCodecJobDesc> jobs;
+	if (!CreateNormalsCodecJobs(codes,count,jobs))
+		return false;
+
+	//the lookup table must be built before the threads are launched
+	GetUniqueInstance();
+
+#ifndef ENABLE_MT_OCTREE
+	for (size_t i=0; i<jobs.size(); ++i)
+		EncodeNormalsChunk(normals,codes,jobs[i]);
+#else
+	s_codecNormals_MT = &normals;
+	s_codecOutCodes_MT = &codes;
+	QtConcurrent::blockingMap(jobs, EncodeNormalsChunk_MT);
+	s_codecNormals_MT = 0;
+	s_codecOutCodes_MT = 0;
+#endif
+
+	return true;
+}
+
+bool ccNormalVectors::DecodeNormals(const NormsIndexesTableType& codes, NormsTableType& normals)
+{
+	unsigned count = codes.currentSize();
+	if (normals.currentSize() < count && !normals.resize(count))
+		return false;
+	if (count == 0)
+		return true;
+
+	std::vector<normalsCodecJobDesc> jobs;
+	if (!CreateNormalsCodecJobs(normals,count,jobs))
+		return false;
+
+	//the decompression table must be built before the threads are launched
+	GetUniqueInstance();
+
+#ifndef ENABLE_MT_OCTREE
+	for (size_t i=0; i<jobs.size(); ++i)
+		DecodeNormalsChunk(codes,normals,jobs[i]);
+#else
+	s_codecCodes_MT = &codes;
+	s_codecOutNormals_MT = &normals;
+	QtConcurrent::blockingMap(jobs, DecodeNormalsChunk_MT);
+	s_codecCodes_MT = 0;
+	s_codecOutNormals_MT = 0;
+#endif
+
+	return true;
 }
 
 /************************************************************************/
@@ -64,7 +64,47 @@ public:
 	static inline void ComputeNormal(normsType normIndex, PointCoordinateType N[]) {Quant_dequantize_normal(normIndex,NORMALS_QUANTIZE_LEVEL,N);}
 
 	//! Returns the compressed index corresponding to a normal vector
-	static inline normsType GetNormIndex(const PointCoordinateType N[]) {return (normsType)Quant_quantize_normal(N,NORMALS_QUANTIZE_LEVEL);}
+	/** Static access to ccNormalVectors::getNormIndex
+	**/
+	static inline normsType GetNormIndex(const PointCoordinateType N[]) {return GetUniqueInstance()->getNormIndex(N);}
+
+	//! Returns the compressed index corresponding to a normal vector
+	/** Uses a pre-computed lookup table (see ccNormalVectors::init). Gives
+		exactly the same result as the recursive quantization algorithm,
+		which is only used for the (rare) vectors that lie on the border
+		of the table cells.
+	**/
+	normsType getNormIndex(const PointCoordinateType N[]) const;
+
+	//! Compresses a set of normal vectors
+	/** \param normals normal vectors (count*3 values)
+		\param count number of vectors
+		\param[out] codes compressed indexes (count values)
+	**/
+	static void GetNormIndexes(const PointCoordinateType* normals, unsigned count, normsType* codes);
+
+	//! Decompresses a set of normal vectors
+	/** \param codes compressed indexes (count values)
+		\param count number of vectors
+		\param[out] normals normal vectors (count*3 values)
+	**/
+	static void GetNormals(const normsType* codes, unsigned count, PointCoordinateType* normals);
+
+	//! Compresses an array of normal vectors
+	/** Processed chunk by chunk (in parallel if ENABLE_MT_OCTREE is defined).
+		\param normals normal vectors
+		\param[out] codes compressed indexes (enlarged if necessary)
+		\return false if there's not enough memory
+	**/
+	static bool EncodeNormals(const NormsTableType& normals, NormsIndexesTableType& codes);
+
+	//! Decompresses an array of compressed normals
+	/** Processed chunk by chunk (in parallel if ENABLE_MT_OCTREE is defined).
+		\param codes compressed indexes
+		\param[out] normals normal vectors (enlarged if necessary)
+		\return false if there's not enough memory
+	**/
+	static bool DecodeNormals(const NormsIndexesTableType& codes, NormsTableType& normals);
 
 	//! Inverts normal orresponding to a given compressed index
 	/** Compressed index is direclty updated.
@@ -159,10 +199,25 @@ protected:
 	//! Number of compressed normal vectors
 	unsigned m_numberOfVectors;
 
+	//! Quantization lookup table
+	/** Compressed index (without the 3 octant bits) for each cell of a regular
+		grid sampling the (normalized) octant. See ccNormalVectors::getNormIndex.
+	**/
+	normsType* m_quantizeLUT;
+
+	//! Quantization lookup table resolution
+	unsigned m_quantizeLUTRes;
+
 	//! Decompression algorithm
     static void Quant_dequantize_normal(unsigned q, unsigned level, float* res);
 	//! Compression algorithm
     static unsigned Quant_quantize_normal(const float* n, unsigned level);
+	//! Compression algorithm (inside an octant)
+	/** \param x,y,z absolute and normalized (x+y+z=1) coordinates
+		\param level quantization level
+		\return quantized index (without the 3 octant bits)
+	**/
+	static unsigned Quant_quantize_normalized_octant(float x, float y, float z, unsigned level);
 
 	//! Cellular method for octree-based normal computation
 	static bool ComputeNormsAtLevelWithHF(const CCLib::DgmOctree::octreeCell& cell, void** additionalParameters);
@@ -29,6 +29,9 @@
 #include <ScalarFieldTools.h>
 #include <Neighbourhood.h>
 
+//system
+#include <algorithm>
+
 ccOctree::ccOctree(ccGenericPointCloud* aCloud)
 	: CCLib::DgmOctree(aCloud)
 	, ccHObject("Octree")
@@ -37,6 +40,7 @@ ccOctree::ccOctree(ccGenericPointCloud* aCloud)
 	, m_displayedLevel(1)
 	, m_glListID(-1)
 	, m_shouldBeRefreshed(true)
+	, m_wireLevel(-1)
 {
 	setVisible(false);
 	lockVisibility(false);
@@ -68,6 +72,7 @@ void ccOctree::clear()
 			glDeleteLists(m_glListID,1);
 		m_glListID=-1;
 	}
+	releaseWireframe();
 
 	DgmOctree::clear();
 }
@@ -91,6 +96,12 @@ void ccOctree::multiplyBoundingBox(const PointCoordinateType multFactor)
 
 	for (int i=0;i<=MAX_OCTREE_LEVEL;++i)
 		m_cellSize[i] *= multFactor;
+
+	//the sorted copy of the points must follow them (same operation as the cloud)
+	for (std::vector<CCVector3>::iterator P = m_sortedPoints.begin(); P != m_sortedPoints.end(); ++P)
+		*P *= multFactor;
+
+	m_shouldBeRefreshed = true;
 }
 
 void ccOctree::translateBoundingBox(const CCVector3& T)
@@ -99,6 +110,12 @@ void ccOctree::translateBoundingBox(const CCVector3& T)
 	m_dimMax += T;
 	m_pointsMin += T;
 	m_pointsMax += T;
+
+	//the sorted copy of the points must follow them (same operation as the cloud)
+	for (std::vector<CCVector3>::iterator P = m_sortedPoints.begin(); P != m_sortedPoints.end(); ++P)
+		*P += T;
+
+	m_shouldBeRefreshed = true;
 }
 
 void ccOctree::drawMeOnly(CC_DRAW_CONTEXT& context)
@@ -118,7 +135,17 @@ void ccOctree::drawMeOnly(CC_DRAW_CONTEXT& context)
 			glPushName(getUniqueID());
 		}
 
-		RenderOctreeAs(m_displayType,this,m_displayedLevel,m_associatedCloud,m_glListID,m_shouldBeRefreshed);
+		if (m_displayType == WIRE)
+		{
+			//cached geometry (much faster than RenderOctreeAs)
+			drawWireframe();
+		}
+		else
+		{
+			if (m_wireLevel >= 0)
+				releaseWireframe();
+			RenderOctreeAs(m_displayType,this,m_displayedLevel,m_associatedCloud,m_glListID,m_shouldBeRefreshed);
+		}
 
 		if (m_shouldBeRefreshed)
 			m_shouldBeRefreshed = false;
@@ -130,6 +157,275 @@ void ccOctree::drawMeOnly(CC_DRAW_CONTEXT& context)
 
 /*** RENDERING METHODS ***/
 
+//! Number of levels between the wireframe blocks and the displayed cells (i.e. up to 8^3 cells per block)
+static const int WIREFRAME_BLOCK_LEVELS = 3;
+
+//! Index of a neighbour cell in a 3x3x3 neighbourhood
+static inline int NeighbourIndex(int dx, int dy, int dz)
+{
+	return (dx+1) + 3*(dy+1) + 9*(dz+1);
+}
+
+bool ccOctree::updateWireframe()
+{
+	releaseWireframe();
+
+	if (m_thePointsAndTheirCellCodes.empty() || m_displayedLevel < 1 || m_displayedLevel > MAX_OCTREE_LEVEL)
+		return false;
+
+	uchar level = (uchar)m_displayedLevel;
+	int gridSize = (1 << level);
+	uchar blockShift = (uchar)(3*std::min<int>(WIREFRAME_BLOCK_LEVELS,level));
+	const PointCoordinateType& cs = getCellSize(level);
+
+	try
+	{
+		//cell codes (sorted)
+		cellCodesContainer codes;
+		getCellCodes(level,codes,true);
+
+		//Each corner (resp. edge) is shared by up to 8 (resp. 4) cells. It is
+		//only created by the first of them (i.e. the one with the smallest code).
+		std::vector<unsigned> cellCorners(8*codes.size());
+		std::vector<unsigned> blockStart; //index of the first edge index of each block
+
+		OctreeCellCodeType currentBlock = 0;
+		for (size_t n=0; n<codes.size(); ++n)
+		{
+			OctreeCellCodeType code = codes[n];
+			if (n == 0 || (code >> blockShift) != currentBlock)
+			{
+				currentBlock = (code >> blockShift);
+				blockStart.push_back((unsigned)m_wireIndexes.size());
+			}
+
+			int pos[3];
+			getCellPos(code,level,pos,true);
+
+			//existing neighbour cells that come first (i.e. with a smaller code)
+			int before[27];
+			for (int dz=-1; dz<=1; ++dz)
+			for (int dy=-1; dy<=1; ++dy)
+			for (int dx=-1; dx<=1; ++dx)
+			{
+				int& index = before[NeighbourIndex(dx,dy,dz)];
+				index = -1;
+
+				int nPos[3] = { pos[0]+dx, pos[1]+dy, pos[2]+dz };
+				if (nPos[0] < 0 || nPos[0] >= gridSize || nPos[1] < 0 || nPos[1] >= gridSize || nPos[2] < 0 || nPos[2] >= gridSize)
+					continue;
+
+				OctreeCellCodeType nCode = generateTruncatedCellCode(nPos,level);
+				if (nCode < code)
+				{
+					cellCodesContainer::const_iterator it = std::lower_bound(codes.begin(),codes.begin()+n,nCode);
+					if (it != codes.begin()+n && *it == nCode)
+						index = (int)(it-codes.begin());
+				}
+			}
+
+			//the 8 corners
+			unsigned* corners = &cellCorners[8*n];
+			for (int c=0; c<8; ++c)
+			{
+				int C[3] = { c & 1, (c >> 1) & 1, (c >> 2) & 1 };
+
+				//the (existing) cell with the smallest code sharing this corner
+				int owner = -1;
+				int ownerCorner = 0;
+				for (int s=0; s<8; ++s)
+				{
+					int d[3] = { C[0]-1+(s & 1), C[1]-1+((s >> 1) & 1), C[2]-1+((s >> 2) & 1) };
+					int index = before[NeighbourIndex(d[0],d[1],d[2])];
+					if (index >= 0 && (owner < 0 || codes[index] < codes[owner]))
+					{
+						owner = index;
+						ownerCorner = (C[0]-d[0]) | ((C[1]-d[1]) << 1) | ((C[2]-d[2]) << 2);
+					}
+				}
+
+				if (owner >= 0)
+				{
+					corners[c] = cellCorners[8*owner+ownerCorner];
+				}
+				else
+				{
+					corners[c] = (unsigned)m_wireVertices.size();
+					m_wireVertices.push_back(CCVector3(	m_dimMin.x + (PointCoordinateType)(pos[0]+C[0]) * cs,
+														m_dimMin.y + (PointCoordinateType)(pos[1]+C[1]) * cs,
+														m_dimMin.z + (PointCoordinateType)(pos[2]+C[2]) * cs));
+				}
+			}
+
+			//the 12 edges (4 along each dimension)
+			for (int dim=0; dim<3; ++dim)
+			{
+				int u = (dim+1)%3;
+				int v = (dim+2)%3;
+				for (int du=0; du<2; ++du)
+				for (int dv=0; dv<2; ++dv)
+				{
+					//the 3 other cells sharing this edge
+					bool owned = false;
+					for (int su=0; su<2 && !owned; ++su)
+					for (int sv=0; sv<2 && !owned; ++sv)
+					{
+						int d[3] = {0,0,0};
+						d[u] = du-1+su;
+						d[v] = dv-1+sv;
+						if (d[u] != 0 || d[v] != 0)
+							owned = (before[NeighbourIndex(d[0],d[1],d[2])] >= 0);
+					}
+					if (owned)
+						continue;
+
+					int C[3] = {0,0,0};
+					C[u] = du;
+					C[v] = dv;
+					m_wireIndexes.push_back(corners[C[0] | (C[1] << 1) | (C[2] << 2)]);
+					C[dim] = 1;
+					m_wireIndexes.push_back(corners[C[0] | (C[1] << 1) | (C[2] << 2)]);
+				}
+			}
+		}
+		blockStart.push_back((unsigned)m_wireIndexes.size());
+
+		//blocks
+		m_wireBlocks.reserve(blockStart.size()-1);
+		for (size_t b=0; b+1<blockStart.size(); ++b)
+		{
+			WireframeBlock block;
+			block.firstIndex = blockStart[b];
+			block.indexCount = blockStart[b+1]-blockStart[b];
+			if (block.indexCount == 0)
+				continue;
+
+			block.bbMin = block.bbMax = m_wireVertices[m_wireIndexes[block.firstIndex]];
+			for (unsigned i=1; i<block.indexCount; ++i)
+			{
+				const CCVector3& P = m_wireVertices[m_wireIndexes[block.firstIndex+i]];
+				for (int k=0; k<3; ++k)
+				{
+					block.bbMin.u[k] = std::min(block.bbMin.u[k],P.u[k]);
+					block.bbMax.u[k] = std::max(block.bbMax.u[k],P.u[k]);
+				}
+			}
+			m_wireBlocks.push_back(block);
+		}
+	}
+	catch(std::bad_alloc)
+	{
+		//not enough memory
+		releaseWireframe();
+		return false;
+	}
+
+	m_wireLevel = m_displayedLevel;
+
+	return true;
+}
+
+void ccOctree::releaseWireframe()
+{
+	std::vector<CCVector3>().swap(m_wireVertices);
+	std::vector<unsigned>().swap(m_wireIndexes);
+	std::vector<WireframeBlock>().swap(m_wireBlocks);
+	m_wireLevel = -1;
+}
+
+//! Extracts the (object space) frustum planes from the current OpenGL matrices
+/** Plane equation: a.x + b.y + c.z + d >= 0 inside the frustum.
+**/
+static void GetFrustumPlanes(float planes[6][4])
+{
+	float MV[16],P[16];
+	glGetFloatv(GL_MODELVIEW_MATRIX, MV);
+	glGetFloatv(GL_PROJECTION_MATRIX, P);
+
+	//M = P * MV (column major)
+	float M[16];
+	for (int c=0; c<4; ++c)
+		for (int r=0; r<4; ++r)
+			M[c*4+r] = P[r]*MV[c*4] + P[4+r]*MV[c*4+1] + P[8+r]*MV[c*4+2] + P[12+r]*MV[c*4+3];
+
+	//rows of M
+	for (int i=0; i<3; ++i)
+	{
+		for (int c=0; c<4; ++c)
+		{
+			planes[2*i][c]   = M[c*4+3] + M[c*4+i];
+			planes[2*i+1][c] = M[c*4+3] - M[c*4+i];
+		}
+	}
+}
+
+//! Tests whether an axis-aligned box is (at least partially) inside the frustum
+static bool BoxInFrustum(const float planes[6][4], const CCVector3& bbMin, const CCVector3& bbMax)
+{
+	for (int i=0; i<6; ++i)
+	{
+		const float* p = planes[i];
+		//farthest corner along the plane normal
+		float x = (p[0] >= 0 ? bbMax.x : bbMin.x);
+		float y = (p[1] >= 0 ? bbMax.y : bbMin.y);
+		float z = (p[2] >= 0 ? bbMax.z : bbMin.z);
+		if (p[0]*x + p[1]*y + p[2]*z + p[3] < 0)
+			return false;
+	}
+
+	return true;
+}
+
+void ccOctree::drawWireframe()
+{
+	if (m_shouldBeRefreshed || m_wireLevel != m_displayedLevel)
+	{
+		if (!updateWireframe())
+			return;
+	}
+
+	if (m_wireIndexes.empty())
+		return;
+
+	float planes[6][4];
+	GetFrustumPlanes(planes);
+
+	glPushAttrib(GL_LIGHTING_BIT);
+	glDisable(GL_LIGHTING);
+	glColor3ubv(ccColor::green);
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(3,GL_FLOAT,0,m_wireVertices[0].u);
+
+	//consecutive visible blocks are drawn at once
+	unsigned firstIndex = 0;
+	unsigned indexCount = 0;
+	for (size_t b=0; b<m_wireBlocks.size(); ++b)
+	{
+		const WireframeBlock& block = m_wireBlocks[b];
+		if (!BoxInFrustum(planes,block.bbMin,block.bbMax))
+			continue;
+
+		if (indexCount != 0 && firstIndex+indexCount == block.firstIndex)
+		{
+			indexCount += block.indexCount;
+		}
+		else
+		{
+			if (indexCount != 0)
+				glDrawElements(GL_LINES,indexCount,GL_UNSIGNED_INT,&m_wireIndexes[firstIndex]);
+			firstIndex = block.firstIndex;
+			indexCount = block.indexCount;
+		}
+	}
+	if (indexCount != 0)
+		glDrawElements(GL_LINES,indexCount,GL_UNSIGNED_INT,&m_wireIndexes[firstIndex]);
+
+	glDisableClientState(GL_VERTEX_ARRAY);
+
+	glPopAttrib();
+}
+
 void ccOctree::RenderOctreeAs(  CC_OCTREE_DISPLAY_TYPE octreeDisplayType,
 								CCLib::DgmOctree* theOctree,
 								unsigned char level,
@@ -25,6 +25,9 @@
 //Local
 #include "ccHObject.h"
 
+//system
+#include <vector>
+
 class ccGenericPointCloud;
 
 //! Octree displaying methods
@@ -57,14 +60,15 @@ public:
 	//! Multiplies the bounding-box of the octree
 	/** If the cloud coordinates are simply multiplied by the same factor,
 		there is no use to recompute the octree structure. It's sufficient
-		to update its bounding-box.
+		to update its bounding-box (and the sorted copy of the points if any).
 		\param  multFactor multiplication factor
 	**/
 	void multiplyBoundingBox(const PointCoordinateType multFactor);
 
 	//! Translates the bounding-box of the octree
 	/** If the cloud has been simply translated, there is no use to recompute
-		the octree structure. It's sufficient to update its bounding-box.
+		the octree structure. It's sufficient to update its bounding-box (and
+		the sorted copy of the points if any).
 		\param T translation vector
 	**/
 	void translateBoundingBox(const CCVector3& T);
@@ -111,6 +115,22 @@ protected:
     //Inherited from ccHObject
     void drawMeOnly(CC_DRAW_CONTEXT& context);
 
+	//! Computes the wireframe geometry of the displayed level (see drawWireframe)
+	/** Each box edge (and each box corner) shared by neighbour cells is only
+		stored once. Edges are grouped by blocks of cells (the cells sharing the
+		same ancestor a few levels above) so as to be culled against the frustum.
+		\return false if there's not enough memory
+	**/
+	bool updateWireframe();
+
+	//! Releases the wireframe geometry
+	void releaseWireframe();
+
+	//! Draws the octree cells of the displayed level as wired boxes
+	/** The geometry is only computed once (see updateWireframe)
+	**/
+	void drawWireframe();
+
 	/*** RENDERING METHODS ***/
 
 	static bool DrawCellAsABox(const CCLib::DgmOctree::octreeCell& cell,
@@ -128,6 +148,24 @@ protected:
     int m_glListID;
     bool m_shouldBeRefreshed;
 
+	//! Wireframe block (group of edges with their bounding-box)
+	struct WireframeBlock
+	{
+		CCVector3 bbMin;
+		CCVector3 bbMax;
+		unsigned firstIndex;
+		unsigned indexCount;
+	};
+
+	//! Wireframe vertices (cells corners)
+	std::vector<CCVector3> m_wireVertices;
+	//! Wireframe edges (pairs of vertex indexes, sorted by block)
+	std::vector<unsigned> m_wireIndexes;
+	//! Wireframe blocks
+	std::vector<WireframeBlock> m_wireBlocks;
+	//! Level corresponding to the wireframe geometry (-1 if not computed)
+	int m_wireLevel;
+
 };
 
 #endif //CC_OCTREE_HEADER
@@ -0,0 +1,1118 @@
+//##########################################################################
+//#                                                                        #
+//#                            CLOUDCOMPARE                                #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 of the License.               #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: EDF R&D / TELECOM ParisTech (ENST-TSI)             #
+//#                                                                        #
+//##########################################################################
+
+#include "ccPlyFile.h"
+
+//Local
+#include "ccAsciiFile.h"
+#include "ccPointCloud.h"
+#include "ccMesh.h"
+#include "ccScalarField.h"
+#include "ccNormalVectors.h"
+#include "ccLog.h"
+
+//CCLib
+#include <DgmOctree.h> //for ENABLE_MT_OCTREE
+
+//system
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+//! PLY data types
+enum PLY_TYPE {	PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64, PLY_UNKNOWN_TYPE };
+
+//! PLY data types sizes (in bytes)
+static const size_t s_plyTypeSizes[PLY_UNKNOWN_TYPE] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+
+//! PLY formats
+enum PLY_FORMAT { PLY_ASCII, PLY_BINARY_LITTLE_ENDIAN, PLY_BINARY_BIG_ENDIAN };
+
+//! Role of a property
+enum PLY_ROLE {	ROLE_IGNORED, ROLE_X, ROLE_Y, ROLE_Z, ROLE_RED, ROLE_GREEN, ROLE_BLUE,
+				ROLE_NX, ROLE_NY, ROLE_NZ, ROLE_SCALAR, ROLE_VERTEX_INDICES };
+
+//! Reads a binary value (see ReadValue)
+typedef double (*plyReadFunc)(const unsigned char*);
+
+//! Reads a binary value of type T (with or without byte swapping)
+template<typename T, bool SWAP> static inline double ReadValue(const unsigned char* p)
+{
+	unsigned char bytes[sizeof(T)];
+	if (SWAP)
+	{
+		for (size_t i=0; i<sizeof(T); ++i)
+			bytes[i] = p[sizeof(T)-1-i];
+	}
+	else
+	{
+		memcpy(bytes,p,sizeof(T));
+	}
+
+	T value;
+	memcpy(&value,bytes,sizeof(T));
+	return static_cast<double>(value);
+}
+
+template<bool SWAP> static plyReadFunc GetReadFunc(PLY_TYPE type)
+{
+	switch (type)
+	{
+	case PLY_INT8:
+		return ReadValue<signed char,SWAP>;
+	case PLY_UINT8:
+		return ReadValue<unsigned char,SWAP>;
+	case PLY_INT16:
+		return ReadValue<int16_t,SWAP>;
+	case PLY_UINT16:
+		return ReadValue<uint16_t,SWAP>;
+	case PLY_INT32:
+		return ReadValue<int32_t,SWAP>;
+	case PLY_UINT32:
+		return ReadValue<uint32_t,SWAP>;
+	case PLY_FLOAT32:
+		return ReadValue<float,SWAP>;
+	case PLY_FLOAT64:
+		return ReadValue<double,SWAP>;
+	default:
+		assert(false);
+		break;
+	}
+	return 0;
+}
+
+static PLY_TYPE GetType(const std::string& name)
+{
+	if (name == "char" || name == "int8")
+		return PLY_INT8;
+	if (name == "uchar" || name == "uint8")
+		return PLY_UINT8;
+	if (name == "short" || name == "int16")
+		return PLY_INT16;
+	if (name == "ushort" || name == "uint16")
+		return PLY_UINT16;
+	if (name == "int" || name == "int32")
+		return PLY_INT32;
+	if (name == "uint" || name == "uint32")
+		return PLY_UINT32;
+	if (name == "float" || name == "float32")
+		return PLY_FLOAT32;
+	if (name == "double" || name == "float64")
+		return PLY_FLOAT64;
+	return PLY_UNKNOWN_TYPE;
+}
+
+//! PLY property
+struct plyProperty
+{
+	std::string name;
+	PLY_TYPE type;
+	//! Whether the property is a list
+	bool isList;
+	//! List count type
+	PLY_TYPE countType;
+	//! Offset in a (fixed size) binary record
+	size_t offset;
+	PLY_ROLE role;
+	//! Scalar field index (ROLE_SCALAR)
+	unsigned sfIndex;
+	plyReadFunc read;
+	plyReadFunc readCount;
+};
+
+//! PLY element
+struct plyElement
+{
+	std::string name;
+	unsigned count;
+	std::vector<plyProperty> properties;
+	//! Whether all records have the same size (binary)
+	bool fixedSize;
+	//! Record size (if fixedSize)
+	size_t stride;
+	//! Beginning of the element data (binary)
+	const unsigned char* begin;
+	//! Index of the first line of the element (ASCII)
+	unsigned firstLine;
+};
+
+//! Loading context (shared by all jobs)
+struct plyLoadingContext
+{
+	PLY_FORMAT format;
+	const plyElement* vertices;
+	const plyElement* faces;
+	//! Vertex property indexes (x, y, z)
+	unsigned xyzIndexes[3];
+	//! Face property index (vertex indexes list)
+	unsigned indicesIndex;
+	double shift[3];
+
+	GenericChunkedArray<3,PointCoordinateType>* points;
+	ColorsTableType* colors;
+	NormsIndexesTableType* normals;
+	std::vector<ccScalarField*> scalarFields;
+	ccMesh* mesh;
+};
+
+//! Job types
+enum PLY_JOB_TYPE { JOB_BINARY_VERTICES, JOB_BINARY_FACES, JOB_ASCII_LINES };
+
+//! Job (block of vertices, faces or lines)
+struct plyJob
+{
+	PLY_JOB_TYPE type;
+	//! First record (binary)
+	const unsigned char* begin;
+	//! Records range (binary)
+	unsigned firstIndex, lastIndex;
+	//! Lines (ASCII)
+	ccAsciiFile::LinesBlock lines;
+	//! Extra triangles (polygons with more than 3 vertices)
+	std::vector<unsigned> extraTriangles;
+	//! Number of invalid faces (less than 3 vertices or invalid indexes)
+	unsigned invalidFaces;
+	//! Whether memory was missing
+	bool notEnoughMemory;
+};
+
+/*** Vertices ***/
+
+//! Stores the (optional) vertex attributes
+/** \param values properties values (by property index)
+**/
+static inline void StoreVertexAttributes(const plyLoadingContext& context, unsigned index, const double* values)
+{
+	const std::vector<plyProperty>& properties = context.vertices->properties;
+	PointCoordinateType N[3] = {0,0,0};
+	colorType* C = (context.colors ? context.colors->getValue(index) : 0);
+
+	for (size_t i=0; i<properties.size(); ++i)
+	{
+		const plyProperty& prop = properties[i];
+		switch (prop.role)
+		{
+		case ROLE_RED:
+		case ROLE_GREEN:
+		case ROLE_BLUE:
+			{
+				double c = values[i];
+				if (prop.type == PLY_FLOAT32 || prop.type == PLY_FLOAT64)
+					c *= 255.0;
+				else if (prop.type == PLY_UINT16)
+					c /= 257.0;
+				C[prop.role-ROLE_RED] = static_cast<colorType>(std::max(0.0,std::min(c,255.0)));
+			}
+			break;
+		case ROLE_NX:
+		case ROLE_NY:
+		case ROLE_NZ:
+			N[prop.role-ROLE_NX] = static_cast<PointCoordinateType>(values[i]);
+			break;
+		case ROLE_SCALAR:
+			context.scalarFields[prop.sfIndex]->setValue(index,static_cast<ScalarType>(values[i]));
+			break;
+		default:
+			break;
+		}
+	}
+
+	if (context.normals)
+	{
+		PointCoordinateType norm2 = N[0]*N[0] + N[1]*N[1] + N[2]*N[2];
+		if (norm2 > ZERO_TOLERANCE)
+		{
+			PointCoordinateType norm = sqrt(norm2);
+			N[0] /= norm;
+			N[1] /= norm;
+			N[2] /= norm;
+		}
+		context.normals->setValue(index,ccNormalVectors::GetNormIndex(N));
+	}
+}
+
+//! Decodes a block of binary vertices
+/** Coordinates are read with a reader specialized at compile time (for the
+	most common layouts), the other properties through their own reader.
+**/
+template<typename CoordType, bool SWAP> static void DecodeBinaryVertices(const plyLoadingContext& context, plyJob& job)
+{
+	const plyElement& element = *context.vertices;
+	const std::vector<plyProperty>& properties = element.properties;
+	const size_t xyzOffsets[3] = {	properties[context.xyzIndexes[0]].offset,
+									properties[context.xyzIndexes[1]].offset,
+									properties[context.xyzIndexes[2]].offset };
+	bool hasAttributes = (context.colors || context.normals || !context.scalarFields.empty());
+
+	double values[ccAsciiFile::MAX_COLUMNS];
+	const unsigned char* record = job.begin;
+	for (unsigned index = job.firstIndex; index < job.lastIndex; ++index, record += element.stride)
+	{
+		PointCoordinateType* P = context.points->getValue(index);
+		for (unsigned k=0; k<3; ++k)
+			P[k] = static_cast<PointCoordinateType>(ReadValue<CoordType,SWAP>(record+xyzOffsets[k]) + context.shift[k]);
+
+		if (hasAttributes)
+		{
+			for (size_t i=0; i<properties.size(); ++i)
+				if (properties[i].role > ROLE_Z)
+					values[i] = properties[i].read(record+properties[i].offset);
+			StoreVertexAttributes(context,index,values);
+		}
+	}
+}
+
+//! Decodes a block of binary vertices (any coordinates type)
+static void DecodeBinaryVerticesGeneric(const plyLoadingContext& context, plyJob& job)
+{
+	const plyElement& element = *context.vertices;
+	const std::vector<plyProperty>& properties = element.properties;
+
+	double values[ccAsciiFile::MAX_COLUMNS];
+	const unsigned char* record = job.begin;
+	for (unsigned index = job.firstIndex; index < job.lastIndex; ++index, record += element.stride)
+	{
+		for (size_t i=0; i<properties.size(); ++i)
+			if (properties[i].role != ROLE_IGNORED)
+				values[i] = properties[i].read(record+properties[i].offset);
+
+		PointCoordinateType* P = context.points->getValue(index);
+		for (unsigned k=0; k<3; ++k)
+			P[k] = static_cast<PointCoordinateType>(values[context.xyzIndexes[k]] + context.shift[k]);
+
+		StoreVertexAttributes(context,index,values);
+	}
+}
+
+//! Binary vertices decoder
+typedef void (*plyVerticesDecoder)(const plyLoadingContext&, plyJob&);
+
+//! Returns the best binary vertices decoder for a given layout
+static plyVerticesDecoder GetVerticesDecoder(const plyLoadingContext& context)
+{
+	const std::vector<plyProperty>& properties = context.vertices->properties;
+	PLY_TYPE coordType = properties[context.xyzIndexes[0]].type;
+	if (	properties[context.xyzIndexes[1]].type == coordType
+		&&	properties[context.xyzIndexes[2]].type == coordType)
+	{
+		bool swap = (context.format == PLY_BINARY_BIG_ENDIAN);
+		if (coordType == PLY_FLOAT32)
+			return (swap ? DecodeBinaryVertices<float,true> : DecodeBinaryVertices<float,false>);
+		if (coordType == PLY_FLOAT64)
+			return (swap ? DecodeBinaryVertices<double,true> : DecodeBinaryVertices<double,false>);
+	}
+
+	return DecodeBinaryVerticesGeneric;
+}
+
+/*** Faces ***/
+
+//! Triangulates a face (fan)
+/** The first triangle is stored at the face index, the others in the job
+	extra triangles. Invalid faces are flagged (see RemoveInvalidFaces).
+**/
+static void StoreFace(const plyLoadingContext& context, plyJob& job, unsigned faceIndex, const unsigned* indexes, unsigned count)
+{
+	CCLib::TriangleSummitsIndexes* tri = context.mesh->getTriangleIndexes(faceIndex);
+
+	unsigned vertexCount = context.vertices->count;
+	bool valid = (count >= 3);
+	for (unsigned i=0; i<count && valid; ++i)
+		valid = (indexes[i] < vertexCount);
+	if (!valid)
+	{
+		tri->i1 = tri->i2 = tri->i3 = vertexCount; //invalid
+		++job.invalidFaces;
+		return;
+	}
+
+	tri->i1 = indexes[0];
+	tri->i2 = indexes[1];
+	tri->i3 = indexes[2];
+
+	try
+	{
+		for (unsigned i=3; i<count; ++i)
+		{
+			job.extraTriangles.push_back(indexes[0]);
+			job.extraTriangles.push_back(indexes[i-1]);
+			job.extraTriangles.push_back(indexes[i]);
+		}
+	}
+	catch(std::bad_alloc)
+	{
+		job.notEnoughMemory = true;
+	}
+}
+
+//! Max number of vertices per face
+static const unsigned MAX_FACE_VERTICES = 1024;
+
+//! Returns the size of a (binary) record starting at 'record' (or 0 if it goes beyond 'end')
+static size_t RecordSize(const plyElement& element, const unsigned char* record, const unsigned char* end)
+{
+	if (element.fixedSize)
+		return (element.stride <= static_cast<size_t>(end-record) ? element.stride : 0);
+
+	const unsigned char* p = record;
+	for (size_t i=0; i<element.properties.size(); ++i)
+	{
+		const plyProperty& prop = element.properties[i];
+		size_t size = s_plyTypeSizes[prop.type];
+		if (prop.isList)
+		{
+			size_t countSize = s_plyTypeSizes[prop.countType];
+			if (countSize > static_cast<size_t>(end-p))
+				return 0;
+			double count = prop.readCount(p);
+			if (count < 0 || count > static_cast<double>(end-p))
+				return 0;
+			size = countSize + static_cast<size_t>(count)*size;
+		}
+		if (size > static_cast<size_t>(end-p))
+			return 0;
+		p += size;
+	}
+
+	return static_cast<size_t>(p-record);
+}
+
+static void DecodeBinaryFaces(const plyLoadingContext& context, plyJob& job)
+{
+	const plyElement& element = *context.faces;
+	const plyProperty& indicesProp = element.properties[context.indicesIndex];
+	size_t indexSize = s_plyTypeSizes[indicesProp.type];
+
+	unsigned indexes[MAX_FACE_VERTICES];
+	const unsigned char* p = job.begin;
+	for (unsigned faceIndex = job.firstIndex; faceIndex < job.lastIndex; ++faceIndex)
+	{
+		//(the records have already been checked by RecordSize)
+		unsigned count = 0;
+		for (size_t i=0; i<element.properties.size(); ++i)
+		{
+			const plyProperty& prop = element.properties[i];
+			if (!prop.isList)
+			{
+				p += s_plyTypeSizes[prop.type];
+				continue;
+			}
+
+			unsigned n = static_cast<unsigned>(prop.readCount(p));
+			p += s_plyTypeSizes[prop.countType];
+			if (i == context.indicesIndex)
+			{
+				count = std::min(n,MAX_FACE_VERTICES);
+				for (unsigned j=0; j<count; ++j)
+				{
+					double index = prop.read(p+j*indexSize);
+					//negative indexes are invalid (as well as those too big)
+					indexes[j] = (index >= 0 ? static_cast<unsigned>(index) : context.vertices->count);
+				}
+			}
+			p += n*s_plyTypeSizes[prop.type];
+		}
+
+		StoreFace(context,job,faceIndex,indexes,count);
+	}
+}
+
+/*** ASCII ***/
+
+static void DecodeAsciiLines(const plyLoadingContext& context, plyJob& job)
+{
+	double values[ccAsciiFile::MAX_COLUMNS];
+	unsigned indexes[ccAsciiFile::MAX_COLUMNS];
+
+	const char* p = job.lines.begin;
+	for (unsigned l=0; l<job.lines.lineCount; ++l)
+	{
+		const char* lineEnd = static_cast<const char*>(memchr(p,'\n',static_cast<size_t>(job.lines.end-p)));
+		if (!lineEnd)
+			lineEnd = job.lines.end;
+		unsigned line = job.lines.firstLine + l;
+
+		if (line >= context.vertices->firstLine && line - context.vertices->firstLine < context.vertices->count)
+		{
+			//vertex
+			unsigned index = line - context.vertices->firstLine;
+			unsigned propCount = static_cast<unsigned>(context.vertices->properties.size());
+			int count = ccAsciiFile::ParseLine(p,lineEnd,values,propCount);
+			if (count < static_cast<int>(propCount))
+			{
+				for (int i=std::max(count,0); i<static_cast<int>(propCount); ++i)
+					values[i] = 0;
+				++job.invalidFaces; //flags invalid vertices as well
+			}
+
+			PointCoordinateType* P = context.points->getValue(index);
+			for (unsigned k=0; k<3; ++k)
+				P[k] = static_cast<PointCoordinateType>(values[context.xyzIndexes[k]] + context.shift[k]);
+			StoreVertexAttributes(context,index,values);
+		}
+		else if (context.faces && line >= context.faces->firstLine && line - context.faces->firstLine < context.faces->count)
+		{
+			//face
+			unsigned faceIndex = line - context.faces->firstLine;
+			int count = ccAsciiFile::ParseLine(p,lineEnd,values,ccAsciiFile::MAX_COLUMNS);
+			unsigned faceVertices = 0;
+			unsigned v = 0;
+			for (size_t i=0; i<context.faces->properties.size() && count >= 0; ++i)
+			{
+				unsigned n = 1;
+				if (context.faces->properties[i].isList)
+				{
+					if (v >= static_cast<unsigned>(count) || values[v] < 0)
+						break;
+					n = static_cast<unsigned>(values[v++]);
+				}
+				if (v+n > static_cast<unsigned>(count))
+					break;
+				if (i == context.indicesIndex)
+				{
+					for (unsigned j=0; j<n; ++j)
+						indexes[j] = (values[v+j] >= 0 ? static_cast<unsigned>(values[v+j]) : context.vertices->count);
+					faceVertices = n;
+				}
+				v += n;
+			}
+			StoreFace(context,job,faceIndex,indexes,faceVertices);
+		}
+
+		p = lineEnd + 1;
+	}
+}
+
+static void DecodeJob(const plyLoadingContext& context, plyVerticesDecoder verticesDecoder, plyJob& job)
+{
+	switch (job.type)
+	{
+	case JOB_BINARY_VERTICES:
+		verticesDecoder(context,job);
+		break;
+	case JOB_BINARY_FACES:
+		DecodeBinaryFaces(context,job);
+		break;
+	case JOB_ASCII_LINES:
+		DecodeAsciiLines(context,job);
+		break;
+	}
+}
+
+#ifdef ENABLE_MT_OCTREE
+
+#include <QtCore/QtCore>
+
+static const plyLoadingContext* s_plyContext_MT = 0;
+static plyVerticesDecoder s_plyVerticesDecoder_MT = 0;
+
+void DecodePlyJob_MT(plyJob* &job)
+{
+	DecodeJob(*s_plyContext_MT,s_plyVerticesDecoder_MT,*job);
+}
+
+#endif
+
+/*** Header ***/
+
+//! Reads the header lines
+static CC_FILE_ERROR ReadHeader(const char* data, const char* end, PLY_FORMAT& format, std::vector<plyElement>& elements, const char*& body)
+{
+	const char* p = data;
+	unsigned lineIndex = 0;
+	bool formatFound = false;
+	while (p < end)
+	{
+		const char* lineEnd = static_cast<const char*>(memchr(p,'\n',static_cast<size_t>(end-p)));
+		if (!lineEnd)
+			return (lineIndex == 0 ? CC_FERR_WRONG_FILE_TYPE : CC_FERR_MALFORMED_FILE);
+
+		//split the line in words
+		std::vector<std::string> words;
+		for (const char* q = p; q < lineEnd; )
+		{
+			while (q < lineEnd && (*q == ' ' || *q == '\t' || *q == '\r'))
+				++q;
+			const char* wordEnd = q;
+			while (wordEnd < lineEnd && *wordEnd != ' ' && *wordEnd != '\t' && *wordEnd != '\r')
+				++wordEnd;
+			if (wordEnd != q)
+				words.push_back(std::string(q,wordEnd));
+			q = wordEnd;
+		}
+		p = lineEnd + 1;
+
+		if (lineIndex++ == 0)
+		{
+			if (words.size() != 1 || words[0] != "ply")
+				return CC_FERR_WRONG_FILE_TYPE;
+			continue;
+		}
+		if (words.empty() || words[0] == "comment" || words[0] == "obj_info")
+			continue;
+
+		if (words[0] == "end_header")
+		{
+			body = p;
+			return (formatFound ? CC_FERR_NO_ERROR : CC_FERR_MALFORMED_FILE);
+		}
+		else if (words[0] == "format")
+		{
+			if (words.size() < 2)
+				return CC_FERR_MALFORMED_FILE;
+			if (words[1] == "ascii")
+				format = PLY_ASCII;
+			else if (words[1] == "binary_little_endian")
+				format = PLY_BINARY_LITTLE_ENDIAN;
+			else if (words[1] == "binary_big_endian")
+				format = PLY_BINARY_BIG_ENDIAN;
+			else
+				return CC_FERR_NOT_IMPLEMENTED;
+			formatFound = true;
+		}
+		else if (words[0] == "element")
+		{
+			if (words.size() < 3)
+				return CC_FERR_MALFORMED_FILE;
+			plyElement element;
+			element.name = words[1];
+			element.count = static_cast<unsigned>(strtoul(words[2].c_str(),0,10));
+			element.fixedSize = true;
+			element.stride = 0;
+			element.begin = 0;
+			element.firstLine = 0;
+			elements.push_back(element);
+		}
+		else if (words[0] == "property")
+		{
+			if (elements.empty() || words.size() < 3)
+				return CC_FERR_MALFORMED_FILE;
+			plyProperty prop;
+			prop.isList = (words[1] == "list");
+			if (prop.isList && words.size() < 5)
+				return CC_FERR_MALFORMED_FILE;
+			prop.countType = (prop.isList ? GetType(words[2]) : PLY_UINT8);
+			prop.type = GetType(words[prop.isList ? 3 : 1]);
+			prop.name = words[prop.isList ? 4 : 2];
+			if (prop.type == PLY_UNKNOWN_TYPE || prop.countType == PLY_UNKNOWN_TYPE)
+				return CC_FERR_MALFORMED_FILE;
+			prop.offset = 0;
+			prop.role = ROLE_IGNORED;
+			prop.sfIndex = 0;
+			prop.read = prop.readCount = 0;
+			elements.back().properties.push_back(prop);
+		}
+		else
+		{
+			return CC_FERR_MALFORMED_FILE;
+		}
+	}
+
+	return CC_FERR_MALFORMED_FILE;
+}
+
+//! Sets the properties roles and readers
+static void SetPropertiesRoles(plyElement& element, bool isVertex, PLY_FORMAT format)
+{
+	size_t offset = 0;
+	unsigned sfCount = 0;
+	for (size_t i=0; i<element.properties.size(); ++i)
+	{
+		plyProperty& prop = element.properties[i];
+
+		bool swap = (format == PLY_BINARY_BIG_ENDIAN);
+		prop.read = (swap ? GetReadFunc<true>(prop.type) : GetReadFunc<false>(prop.type));
+		prop.readCount = (swap ? GetReadFunc<true>(prop.countType) : GetReadFunc<false>(prop.countType));
+
+		prop.offset = offset;
+		if (prop.isList)
+			element.fixedSize = false;
+		else
+			offset += s_plyTypeSizes[prop.type];
+
+		const std::string& name = prop.name;
+		if (!isVertex)
+		{
+			if (prop.isList && (name == "vertex_indices" || name == "vertex_index"))
+				prop.role = ROLE_VERTEX_INDICES;
+			continue;
+		}
+		if (prop.isList)
+			continue;
+
+		if (name == "x")
+			prop.role = ROLE_X;
+		else if (name == "y")
+			prop.role = ROLE_Y;
+		else if (name == "z")
+			prop.role = ROLE_Z;
+		else if (name == "red" || name == "diffuse_red")
+			prop.role = ROLE_RED;
+		else if (name == "green" || name == "diffuse_green")
+			prop.role = ROLE_GREEN;
+		else if (name == "blue" || name == "diffuse_blue")
+			prop.role = ROLE_BLUE;
+		else if (name == "nx")
+			prop.role = ROLE_NX;
+		else if (name == "ny")
+			prop.role = ROLE_NY;
+		else if (name == "nz")
+			prop.role = ROLE_NZ;
+		else if (name != "alpha" && name != "diffuse_alpha")
+		{
+			prop.role = ROLE_SCALAR;
+			prop.sfIndex = sfCount++;
+		}
+	}
+
+	element.stride = (element.fixedSize ? offset : 0);
+}
+
+/*** Loading ***/
+
+//! Number of records decoded by each (binary) job
+static const unsigned PLY_JOB_SIZE = MAX_NUMBER_OF_ELEMENTS_PER_CHUNK;
+
+//! Removes the invalid faces and adds the extra triangles
+static bool FinalizeMesh(ccMesh* mesh, std::vector<plyJob>& jobs, unsigned invalidVertexIndex)
+{
+	unsigned faceCount = mesh->size();
+	unsigned validCount = 0;
+	for (unsigned i=0; i<faceCount; ++i)
+	{
+		const CCLib::TriangleSummitsIndexes* tri = mesh->getTriangleIndexes(i);
+		if (tri->i1 == invalidVertexIndex)
+			continue;
+		if (validCount != i)
+			*mesh->getTriangleIndexes(validCount) = *tri;
+		++validCount;
+	}
+
+	size_t extraCount = 0;
+	for (size_t i=0; i<jobs.size(); ++i)
+		extraCount += jobs[i].extraTriangles.size()/3;
+	if (!mesh->resize(validCount) || !mesh->reserve(static_cast<unsigned>(validCount+extraCount)))
+		return false;
+
+	for (size_t i=0; i<jobs.size(); ++i)
+	{
+		const std::vector<unsigned>& extra = jobs[i].extraTriangles;
+		for (size_t j=0; j<extra.size(); j+=3)
+			mesh->addTriangle(extra[j],extra[j+1],extra[j+2]);
+		std::vector<unsigned>().swap(jobs[i].extraTriangles);
+	}
+
+	return true;
+}
+
+CC_FILE_ERROR ccPlyFile::Load(const char* filename, ccHObject*& entity, CCLib::GenericProgressCallback* progressCb/*=0*/)
+{
+	entity = 0;
+
+	CC_FILE_ERROR error = CC_FERR_NO_ERROR;
+	ccMappedFile* file = ccMappedFile::Map(filename,&error);
+	if (!file)
+		return error;
+
+	const char* data = reinterpret_cast<const char*>(file->data());
+	const char* end = data + file->size();
+
+	//header
+	PLY_FORMAT format = PLY_ASCII;
+	std::vector<plyElement> elements;
+	const char* body = 0;
+	try
+	{
+		error = ReadHeader(data,end,format,elements,body);
+	}
+	catch(std::bad_alloc)
+	{
+		error = CC_FERR_NOT_ENOUGH_MEMORY;
+	}
+	if (error != CC_FERR_NO_ERROR)
+	{
+		file->release();
+		return error;
+	}
+
+	plyLoadingContext context;
+	context.format = format;
+	context.vertices = context.faces = 0;
+	context.indicesIndex = 0;
+	context.points = 0;
+	context.colors = 0;
+	context.normals = 0;
+	context.mesh = 0;
+
+	bool xyz[3] = {false,false,false};
+	bool hasRGB = false, hasNormals = false;
+	unsigned sfCount = 0;
+	for (size_t i=0; i<elements.size(); ++i)
+	{
+		plyElement& element = elements[i];
+		if (element.name == "vertex" && !context.vertices)
+		{
+			SetPropertiesRoles(element,true,format);
+			for (unsigned j=0; j<element.properties.size(); ++j)
+			{
+				const plyProperty& prop = element.properties[j];
+				if (prop.role >= ROLE_X && prop.role <= ROLE_Z)
+				{
+					xyz[prop.role-ROLE_X] = true;
+					context.xyzIndexes[prop.role-ROLE_X] = j;
+				}
+				hasRGB |= (prop.role >= ROLE_RED && prop.role <= ROLE_BLUE);
+				hasNormals |= (prop.role >= ROLE_NX && prop.role <= ROLE_NZ);
+				if (prop.role == ROLE_SCALAR)
+					++sfCount;
+			}
+			context.vertices = &element;
+		}
+		else if (element.name == "face" && !context.faces)
+		{
+			SetPropertiesRoles(element,false,format);
+			for (unsigned j=0; j<element.properties.size(); ++j)
+			{
+				if (element.properties[j].role == ROLE_VERTEX_INDICES)
+				{
+					context.indicesIndex = j;
+					context.faces = &element;
+					break;
+				}
+			}
+		}
+		else
+		{
+			SetPropertiesRoles(element,false,format);
+		}
+	}
+
+	if (!context.vertices || !xyz[0] || !xyz[1] || !xyz[2] || context.vertices->count == 0)
+	{
+		file->release();
+		return CC_FERR_MALFORMED_FILE;
+	}
+	if ((format != PLY_ASCII && !context.vertices->fixedSize) || context.vertices->properties.size() > ccAsciiFile::MAX_COLUMNS)
+	{
+		ccLog::Warning("[ccPlyFile] Unhandled vertex layout");
+		file->release();
+		return CC_FERR_NOT_IMPLEMENTED;
+	}
+	if (context.faces && context.faces->count == 0)
+		context.faces = 0;
+
+	//jobs
+	std::vector<plyJob> jobs;
+	std::vector<plyJob*> jobPtrs;
+	try
+	{
+		plyJob job;
+		job.begin = 0;
+		job.firstIndex = job.lastIndex = 0;
+		job.lines.begin = job.lines.end = 0;
+		job.lines.lineCount = job.lines.firstLine = 0;
+		job.invalidFaces = 0;
+		job.notEnoughMemory = false;
+
+		if (format == PLY_ASCII)
+		{
+			//elements are stored one record per line
+			unsigned line = 0;
+			for (size_t i=0; i<elements.size(); ++i)
+			{
+				elements[i].firstLine = line;
+				line += elements[i].count;
+			}
+
+			std::vector<ccAsciiFile::LinesBlock> blocks;
+			uint64_t lineCount = 0;
+			if (!ccAsciiFile::SplitInBlocks(body,end,blocks,lineCount))
+				throw std::bad_alloc();
+			if (lineCount < line)
+				error = CC_FERR_MALFORMED_FILE;
+
+			job.type = JOB_ASCII_LINES;
+			for (size_t i=0; i<blocks.size(); ++i)
+			{
+				job.lines = blocks[i];
+				jobs.push_back(job);
+			}
+		}
+		else
+		{
+			const unsigned char* p = reinterpret_cast<const unsigned char*>(body);
+			const unsigned char* bodyEnd = reinterpret_cast<const unsigned char*>(end);
+			for (size_t i=0; i<elements.size() && error == CC_FERR_NO_ERROR; ++i)
+			{
+				plyElement& element = elements[i];
+				element.begin = p;
+				bool isVertices = (&element == context.vertices);
+				bool isFaces = (&element == context.faces);
+				job.type = (isVertices ? JOB_BINARY_VERTICES : JOB_BINARY_FACES);
+
+				if (element.fixedSize)
+				{
+					if (element.stride != 0 && element.count > static_cast<size_t>(bodyEnd-p)/element.stride)
+					{
+						error = CC_FERR_MALFORMED_FILE;
+						break;
+					}
+					if (isVertices || isFaces)
+					{
+						for (unsigned j=0; j<element.count; j+=PLY_JOB_SIZE)
+						{
+							job.begin = p + j*element.stride;
+							job.firstIndex = j;
+							job.lastIndex = std::min(element.count,j+PLY_JOB_SIZE);
+							jobs.push_back(job);
+						}
+					}
+					p += element.count*element.stride;
+				}
+				else
+				{
+					//we have to read the lists sizes to find the records
+					for (unsigned j=0; j<element.count; ++j)
+					{
+						if (isFaces && (j % PLY_JOB_SIZE) == 0)
+						{
+							job.begin = p;
+							job.firstIndex = j;
+							job.lastIndex = std::min(element.count,j+PLY_JOB_SIZE);
+							jobs.push_back(job);
+						}
+						size_t size = RecordSize(element,p,bodyEnd);
+						if (size == 0)
+						{
+							error = CC_FERR_MALFORMED_FILE;
+							break;
+						}
+						p += size;
+					}
+				}
+			}
+		}
+
+		jobPtrs.resize(jobs.size());
+		for (size_t i=0; i<jobs.size(); ++i)
+			jobPtrs[i] = &jobs[i];
+	}
+	catch(std::bad_alloc)
+	{
+		error = CC_FERR_NOT_ENOUGH_MEMORY;
+	}
+	if (error != CC_FERR_NO_ERROR)
+	{
+		file->release();
+		return error;
+	}
+
+	//global shift (deduced from the first vertex)
+	{
+		double P[3] = {0,0,0};
+		if (format == PLY_ASCII)
+		{
+			const char* lineBegin = body;
+			for (unsigned l=0; l<context.vertices->firstLine; ++l)
+				lineBegin = static_cast<const char*>(memchr(lineBegin,'\n',static_cast<size_t>(end-lineBegin))) + 1;
+			const char* lineEnd = static_cast<const char*>(memchr(lineBegin,'\n',static_cast<size_t>(end-lineBegin)));
+			double values[ccAsciiFile::MAX_COLUMNS];
+			if (ccAsciiFile::ParseLine(lineBegin,lineEnd ? lineEnd : end,values,static_cast<unsigned>(context.vertices->properties.size())) > 0)
+				for (unsigned k=0; k<3; ++k)
+					P[k] = values[context.xyzIndexes[k]];
+		}
+		else
+		{
+			for (unsigned k=0; k<3; ++k)
+			{
+				const plyProperty& prop = context.vertices->properties[context.xyzIndexes[k]];
+				P[k] = prop.read(context.vertices->begin + prop.offset);
+			}
+		}
+		if (ccGenericPointCloud::SuggestOriginalShift(P,context.shift))
+			ccLog::Warning("[ccPlyFile] Coordinates are too big: cloud has been shifted by (%f;%f;%f)",context.shift[0],context.shift[1],context.shift[2]);
+	}
+
+	//the arrays are allocated once
+	std::string name(filename);
+	size_t slash = name.find_last_of("/\\");
+	if (slash != std::string::npos)
+		name = name.substr(slash+1);
+	ccPointCloud* cloud = new ccPointCloud(context.faces ? "vertices" : name);
+	unsigned vertexCount = context.vertices->count;
+	bool success = cloud->resize(vertexCount);
+	if (success && hasRGB)
+		success = cloud->resizeTheRGBTable(true);
+	if (success && hasNormals)
+		success = cloud->resizeTheNormsTable();
+	for (size_t j=0; j<context.vertices->properties.size() && success; ++j)
+	{
+		const plyProperty& prop = context.vertices->properties[j];
+		if (prop.role != ROLE_SCALAR)
+			continue;
+		std::string sfName = prop.name;
+		if (sfName.compare(0,7,"scalar_") == 0 && sfName.size() > 7)
+			sfName = sfName.substr(7);
+		ccScalarField* sf = new ccScalarField(sfName.c_str());
+		if (!sf->resize(vertexCount))
+		{
+			sf->release();
+			success = false;
+			break;
+		}
+		if (cloud->addScalarField(sf) < 0)
+		{
+			//duplicate name: we rename it
+			char buffer[64];
+			sprintf(buffer,"Scalar field #%u",prop.sfIndex+1);
+			sf->setName(buffer);
+			if (cloud->addScalarField(sf) < 0)
+			{
+				sf->release();
+				success = false;
+				break;
+			}
+		}
+		context.scalarFields.push_back(sf);
+	}
+	if (success && context.faces)
+	{
+		context.mesh = new ccMesh(cloud);
+		success = context.mesh->resize(context.faces->count);
+	}
+	if (!success)
+	{
+		if (context.mesh)
+			delete context.mesh;
+		delete cloud;
+		file->release();
+		return CC_FERR_NOT_ENOUGH_MEMORY;
+	}
+	context.points = cloud->pointsTable();
+	context.colors = cloud->rgbColors();
+	context.normals = cloud->normals();
+
+	//the normals table must be initialized before any concurrent access
+	if (context.normals)
+		ccNormalVectors::GetUniqueInstance();
+
+	plyVerticesDecoder verticesDecoder = (format != PLY_ASCII ? GetVerticesDecoder(context) : 0);
+
+	CCLib::NormalizedProgress* nprogress = 0;
+	if (progressCb)
+	{
+		progressCb->reset();
+		nprogress = new CCLib::NormalizedProgress(progressCb,static_cast<unsigned>(jobs.size()));
+		progressCb->setMethodTitle("Load PLY file");
+		char buffer[256];
+		sprintf(buffer,"Vertices: %u\nFaces: %u",vertexCount,context.faces ? context.faces->count : 0);
+		progressCb->setInfo(buffer);
+		progressCb->start();
+	}
+
+#ifdef ENABLE_MT_OCTREE
+	s_plyContext_MT = &context;
+	s_plyVerticesDecoder_MT = verticesDecoder;
+	//jobs are processed by batches so as to report the progress
+	const size_t batchSize = static_cast<size_t>(std::max(1,QThread::idealThreadCount()))*4;
+	std::vector<plyJob*> batch;
+#endif
+	for (size_t i=0; i<jobs.size() && error == CC_FERR_NO_ERROR; )
+	{
+#ifndef ENABLE_MT_OCTREE
+		DecodeJob(context,verticesDecoder,jobs[i]);
+		size_t processed = 1;
+#else
+		size_t processed = std::min(batchSize,jobs.size()-i);
+		batch.assign(jobPtrs.begin()+i,jobPtrs.begin()+(i+processed));
+		QtConcurrent::blockingMap(batch, DecodePlyJob_MT);
+#endif
+		i += processed;
+
+		for (size_t j=0; j<processed && nprogress; ++j)
+			if (!nprogress->oneStep())
+				error = CC_FERR_CANCELED_BY_USER;
+	}
+#ifdef ENABLE_MT_OCTREE
+	s_plyContext_MT = 0;
+	s_plyVerticesDecoder_MT = 0;
+#endif
+
+	if (nprogress)
+	{
+		delete nprogress;
+		progressCb->stop();
+	}
+
+	file->release();
+	file = 0;
+
+	unsigned invalidCount = 0;
+	for (size_t i=0; i<jobs.size() && error == CC_FERR_NO_ERROR; ++i)
+	{
+		if (jobs[i].notEnoughMemory)
+			error = CC_FERR_NOT_ENOUGH_MEMORY;
+		invalidCount += jobs[i].invalidFaces;
+	}
+	if (error == CC_FERR_NO_ERROR && context.mesh && !FinalizeMesh(context.mesh,jobs,vertexCount))
+		error = CC_FERR_NOT_ENOUGH_MEMORY;
+
+	if (error != CC_FERR_NO_ERROR)
+	{
+		if (context.mesh)
+			delete context.mesh;
+		delete cloud;
+		return error;
+	}
+
+	if (invalidCount != 0)
+		ccLog::Warning("[ccPlyFile] %u invalid element(s) ignored",invalidCount);
+
+	for (size_t k=0; k<context.scalarFields.size(); ++k)
+		context.scalarFields[k]->computeMinAndMax();
+	cloud->invalidateBoundingBox();
+	cloud->setOriginalShift(context.shift[0],context.shift[1],context.shift[2]);
+	cloud->showColors(hasRGB);
+	cloud->showNormals(hasNormals);
+	if (!context.scalarFields.empty())
+	{
+		cloud->setCurrentDisplayedScalarField(0);
+		cloud->showSF(!hasRGB);
+	}
+
+	if (context.mesh)
+	{
+		ccMesh* mesh = context.mesh;
+		mesh->setName(name);
+		cloud->setEnabled(false);
+		mesh->addChild(cloud);
+		mesh->showColors(hasRGB);
+		mesh->showNormals(hasNormals);
+		mesh->showSF(cloud->sfShown());
+		entity = mesh;
+	}
+	else
+	{
+		entity = cloud;
+	}
+
+	return CC_FERR_NO_ERROR;
+}
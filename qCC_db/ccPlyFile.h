@@ -0,0 +1,57 @@
+//##########################################################################
+//#                                                                        #
+//#                            CLOUDCOMPARE                                #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 of the License.               #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: EDF R&D / TELECOM ParisTech (ENST-TSI)             #
+//#                                                                        #
+//##########################################################################
+
+#ifndef CC_PLY_FILE_HEADER
+#define CC_PLY_FILE_HEADER
+
+//Local
+#include "ccMappedFile.h"
+
+//CCLib
+#include <GenericProgressCallback.h>
+
+class ccHObject;
+
+//! PLY file (ASCII, binary little endian or binary big endian)
+/** Vertex properties: x, y, z (mandatory), red, green, blue (optional),
+	nx, ny, nz (optional). Other scalar properties are loaded as scalar
+	fields. Faces ('vertex_indices' or 'vertex_index' list property) are
+	loaded as triangles (polygons are split in fans). Other elements are
+	ignored.
+	The file is mapped in memory and the vertices and faces are decoded by
+	blocks in parallel (if ENABLE_MT_OCTREE is defined), directly in the
+	cloud and mesh arrays.
+**/
+#ifdef QCC_DB_USE_AS_DLL
+#include "qCC_db_dll.h"
+class QCC_DB_DLL_API ccPlyFile
+#else
+class ccPlyFile
+#endif
+{
+public:
+
+	//! Loads a PLY file
+	/** \param filename input filename
+		\param[out] entity loaded entity: a mesh (with its vertices as child) if the file has faces, a cloud otherwise
+		\param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
+		\return error code
+	**/
+	static CC_FILE_ERROR Load(const char* filename, ccHObject*& entity, CCLib::GenericProgressCallback* progressCb=0);
+};
+
+#endif //CC_PLY_FILE_HEADER
@@ -38,6 +38,9 @@
 
 //system
 #include <assert.h>
+#include <limits>
+#include <vector>
+#include <algorithm>
 
 ccPointCloud::ccPointCloud(std::string name) throw()
 	: ChunkedPointCloud()
@@ -46,6 +49,8 @@ ccPointCloud::ccPointCloud(std::string name) throw()
 	, m_normals(0)
 	, m_currentDisplayedScalarField(0)
 	, m_currentDisplayedScalarFieldIndex(-1)
+	, m_visibleIndexesValid(false)
+	, m_visibleIndexesPointCount(0)
 {
 	init();
 }
@@ -111,6 +116,85 @@ ccPointCloud* ccPointCloud::From(const CCLib::GenericIndexedCloud* cloud)
 	return pc;
 }
 
+//! Partial clone context (see ccPointCloud::partialClone)
+struct ccPartialCloneContext
+{
+	//! Selection (indexes of the source points)
+	const CCLib::ReferenceCloud* selection;
+	//! Source and destination points
+	const GenericChunkedArray<3,PointCoordinateType>* srcPoints;
+	GenericChunkedArray<3,PointCoordinateType>* destPoints;
+	//! Source and destination colors (optional)
+	const ColorsTableType* srcColors;
+	ColorsTableType* destColors;
+	//! Source and destination compressed normals (optional)
+	const NormsIndexesTableType* srcNormals;
+	NormsIndexesTableType* destNormals;
+	//! Source and destination scalar fields
+	std::vector< std::pair<const ccScalarField*, ccScalarField*> > sfs;
+};
+
+//! Partial clone job (one chunk of the destination cloud)
+struct partialCloneJobDesc
+{
+	//! Destination chunk index
+	unsigned chunkIndex;
+	//! First destination element index
+	unsigned first;
+	//! Last destination element index (excluded)
+	unsigned last;
+};
+
+//! Returns a pointer on an element of a chunked array (N>1)
+template<int N, class ElementType> static inline const ElementType* ElementPtr(const GenericChunkedArray<N,ElementType>* array, unsigned index)
+{
+	return array->getValue(index);
+}
+
+//! Returns a pointer on an element of a chunked array (N=1)
+template<class ElementType> static inline const ElementType* ElementPtr(const GenericChunkedArray<1,ElementType>* array, unsigned index)
+{
+	return &array->getValue(index);
+}
+
+//! Gathers the selected elements of an array in one chunk of the destination array
+template<int N, class ElementType> static void GatherChunk(const GenericChunkedArray<N,ElementType>* src, GenericChunkedArray<N,ElementType>* dest, const CCLib::ReferenceCloud* selection, const partialCloneJobDesc& job)
+{
+	assert(job.chunkIndex < dest->chunksCount() && job.last-job.first <= dest->chunkSize(job.chunkIndex));
+	ElementType* out = dest->chunkStartPtr(job.chunkIndex);
+	for (unsigned i=job.first; i<job.last; ++i)
+	{
+		const ElementType* in = ElementPtr(src,selection->getPointGlobalIndex(i));
+		for (int j=0; j<N; ++j)
+			*out++ = in[j];
+	}
+}
+
+//! Gathers all the selected attributes in one chunk of the destination cloud
+static void GatherPartialCloneChunk(const ccPartialCloneContext& context, const partialCloneJobDesc& job)
+{
+	GatherChunk(context.srcPoints,context.destPoints,context.selection,job);
+	if (context.destColors)
+		GatherChunk(context.srcColors,context.destColors,context.selection,job);
+	if (context.destNormals)
+		GatherChunk(context.srcNormals,context.destNormals,context.selection,job);
+	for (size_t k=0; k<context.sfs.size(); ++k)
+		GatherChunk<1,ScalarType>(context.sfs[k].first,context.sfs[k].second,context.selection,job);
+}
+
+#ifdef ENABLE_MT_OCTREE
+
+#include <QtCore/QtCore>
+
+static const ccPartialCloneContext* s_partialCloneContext_MT = 0;
+
+void GatherPartialCloneChunk_MT(partialCloneJobDesc& job)
+{
+	GatherPartialCloneChunk(*s_partialCloneContext_MT, job);
+}
+
+#endif
+
 ccPointCloud* ccPointCloud::partialClone(const CCLib::ReferenceCloud* selection, int* warnings/*=0*/) const
 {
 	if (warnings)
@@ -131,18 +215,21 @@ ccPointCloud* ccPointCloud::partialClone(const CCLib::ReferenceCloud* selection,
 
 	ccPointCloud* result = new ccPointCloud(getName()+".extract");
 
-	if (!result->reserveThePointsTable(n))
+	//all the destination arrays are allocated at once (the selected
+	//elements are then gathered chunk by chunk, see below)
+	if (!result->reserveThePointsTable(n) || !result->resize(n))
 	{
 		ccLog::Error("[ccPointCloud::partialClone] Not enough memory to duplicate cloud!");
 		delete result;
 		return 0;
 	}
 
-	//import points
-	{
-		for (unsigned i=0; i<n; i++)
-			result->addPoint(*getPointPersistentPtr(selection->getPointGlobalIndex(i)));
-	}
+	ccPartialCloneContext context;
+	context.selection = selection;
+	context.srcPoints = m_points;
+	context.destPoints = result->m_points;
+	context.srcColors = context.destColors = 0;
+	context.srcNormals = context.destNormals = 0;
 
 	//visibility
 	result->setVisible(isVisible());
@@ -150,10 +237,10 @@ ccPointCloud* ccPointCloud::partialClone(const CCLib::ReferenceCloud* selection,
 	//RGB colors
 	if (hasColors())
 	{
-		if (result->reserveTheRGBTable())
+		if (result->resizeTheRGBTable(false))
 		{
-			for (unsigned i=0; i<n; i++)
-				result->addRGBColor(getPointColor(selection->getPointGlobalIndex(i)));
+			context.srcColors = m_rgbColors;
+			context.destColors = result->m_rgbColors;
 			result->showColors(colorsShown());
 		}
 		else
@@ -167,10 +254,10 @@ ccPointCloud* ccPointCloud::partialClone(const CCLib::ReferenceCloud* selection,
 	//normals
 	if (hasNormals())
 	{
-		if (result->reserveTheNormsTable())
+		if (result->resizeTheNormsTable())
 		{
-			for (unsigned i=0; i<n; i++)
-				result->addNormIndex(getPointNormalIndex(selection->getPointGlobalIndex(i)));
+			context.srcNormals = m_normals;
+			context.destNormals = result->m_normals;
 			result->showNormals(normalsShown());
 		}
 		else
@@ -183,68 +270,107 @@ ccPointCloud* ccPointCloud::partialClone(const CCLib::ReferenceCloud* selection,
 
 	//scalar fields
 	unsigned sfCount = getNumberOfScalarFields();
-	if (sfCount != 0)
+	for (unsigned k=0; k<sfCount; ++k)
 	{
-		for (unsigned k=0; k<sfCount; ++k)
+		const ccScalarField* sf = static_cast<ccScalarField*>(getScalarField(k));
+		assert(sf);
+		if (sf)
 		{
-			const ccScalarField* sf = static_cast<ccScalarField*>(getScalarField(k));
-			assert(sf);
-			if (sf)
+			//we create a new scalar field with same name (already resized)
+			int sfIdx = result->addScalarField(sf->getName());
+			ccScalarField* currentScalarField = (sfIdx >= 0 ? static_cast<ccScalarField*>(result->getScalarField(sfIdx)) : 0);
+			bool success = false;
+			if (currentScalarField)
 			{
-				//we create a new scalar field with same name
-				int sfIdx = result->addScalarField(sf->getName());
-				if (sfIdx>=0) //success
+				try
 				{
-					ccScalarField* currentScalarField = static_cast<ccScalarField*>(result->getScalarField(sfIdx));
-					assert(currentScalarField);
-					if (currentScalarField->resize(n))
-					{
-						//we copy data to new SF
-						for (unsigned i=0; i<n; i++)
-							currentScalarField->setValue(i,sf->getValue(selection->getPointGlobalIndex(i)));
-
-						currentScalarField->computeMinAndMax();
-						//copy color ramp parameters
-						currentScalarField->setColorRampSteps(sf->getColorRampSteps());
-						currentScalarField->setColorScale(sf->getColorScale());
-						currentScalarField->showNaNValuesInGrey(sf->areNaNValuesShownInGrey());
-						currentScalarField->setLogScale(sf->logScale());
-						currentScalarField->setSymmetricalScale(sf->symmetricalScale());
-						currentScalarField->alwaysShowZero(sf->isZeroAlwaysShown());
-						currentScalarField->setMinDisplayed(sf->displayRange().start());
-						currentScalarField->setMaxDisplayed(sf->displayRange().stop());
-						currentScalarField->setSaturationStart(sf->saturationRange().start());
-						currentScalarField->setSaturationStop(sf->saturationRange().stop());
-					}
-					else
-					{
-						//if we don't have enough memory, we cancel SF creation
-						result->deleteScalarField(sfIdx);
-						ccLog::Warning(std::string("[ccPointCloud::partialClone] Not enough memory to copy scalar field: ") + sf->getName());
-						if (warnings)
-							*warnings |= WRN_OUT_OF_MEM_FOR_SFS;
-					}
+					context.sfs.push_back(std::pair<const ccScalarField*, ccScalarField*>(sf,currentScalarField));
+					success = true;
+				}
+				catch(std::bad_alloc)
+				{
+					result->deleteScalarField(sfIdx);
 				}
 			}
-		}
 
-		unsigned copiedSFCount = getNumberOfScalarFields();
-		if (copiedSFCount)
-		{
-			//we display the same scalar field as the source (if we managed to copy it!)
-			if (getCurrentDisplayedScalarField())
+			if (!success)
 			{
-				int sfIdx = result->getScalarFieldIndexByName(getCurrentDisplayedScalarField()->getName());
-				if (sfIdx)
-					result->setCurrentDisplayedScalarField(sfIdx);
-				else
-					result->setCurrentDisplayedScalarField((int)copiedSFCount-1);
+				//if we don't have enough memory, we cancel SF creation
+				ccLog::Warning(std::string("[ccPointCloud::partialClone] Not enough memory to copy scalar field: ") + sf->getName());
+				if (warnings)
+					*warnings |= WRN_OUT_OF_MEM_FOR_SFS;
 			}
-			//copy visibility
-			result->showSF(sfShown());
 		}
 	}
 
+	//gather (one job per destination chunk)
+	std::vector<partialCloneJobDesc> jobs;
+	try
+	{
+		jobs.resize(result->m_points->chunksCount());
+	}
+	catch(std::bad_alloc)
+	{
+		ccLog::Error("[ccPointCloud::partialClone] Not enough memory to duplicate cloud!");
+		delete result;
+		return 0;
+	}
+	{
+		unsigned first = 0;
+		for (unsigned k=0; k<jobs.size(); ++k)
+		{
+			jobs[k].chunkIndex = k;
+			jobs[k].first = std::min(first,n);
+			jobs[k].last = std::min(first+result->m_points->chunkSize(k),n);
+			first += result->m_points->chunkSize(k);
+		}
+	}
+
+#ifndef ENABLE_MT_OCTREE
+	for (size_t i=0; i<jobs.size(); ++i)
+		GatherPartialCloneChunk(context, jobs[i]);
+#else
+	s_partialCloneContext_MT = &context;
+	QtConcurrent::blockingMap(jobs, GatherPartialCloneChunk_MT);
+	s_partialCloneContext_MT = 0;
+#endif
+
+	//scalar fields display parameters
+	for (size_t k=0; k<context.sfs.size(); ++k)
+	{
+		const ccScalarField* sf = context.sfs[k].first;
+		ccScalarField* currentScalarField = context.sfs[k].second;
+
+		currentScalarField->computeMinAndMax();
+		//copy color ramp parameters
+		currentScalarField->setColorRampSteps(sf->getColorRampSteps());
+		currentScalarField->setColorScale(sf->getColorScale());
+		currentScalarField->showNaNValuesInGrey(sf->areNaNValuesShownInGrey());
+		currentScalarField->setLogScale(sf->logScale());
+		currentScalarField->setSymmetricalScale(sf->symmetricalScale());
+		currentScalarField->alwaysShowZero(sf->isZeroAlwaysShown());
+		currentScalarField->setMinDisplayed(sf->displayRange().start());
+		currentScalarField->setMaxDisplayed(sf->displayRange().stop());
+		currentScalarField->setSaturationStart(sf->saturationRange().start());
+		currentScalarField->setSaturationStop(sf->saturationRange().stop());
+	}
+
+	unsigned copiedSFCount = result->getNumberOfScalarFields();
+	if (copiedSFCount)
+	{
+		//we display the same scalar field as the source (if we managed to copy it!)
+		if (getCurrentDisplayedScalarField())
+		{
+			int sfIdx = result->getScalarFieldIndexByName(getCurrentDisplayedScalarField()->getName());
+			if (sfIdx >= 0)
+				result->setCurrentDisplayedScalarField(sfIdx);
+			else
+				result->setCurrentDisplayedScalarField((int)copiedSFCount-1);
+		}
+		//copy visibility
+		result->showSF(sfShown());
+	}
+
 	//Meshes //TODO
 	/*Lib::GenericIndexedMesh* theMesh = source->_getMesh();
 	if (theMesh)
@@ -362,13 +488,66 @@ const ccPointCloud& ccPointCloud::operator +=(ccPointCloud* addedCloud)
 	return append(addedCloud,size());
 }
 
-const ccPointCloud& ccPointCloud::append(ccPointCloud* addedCloud, unsigned pointCountBefore)
+const ccPointCloud& ccPointCloud::merge(ccPointCloud* addedCloud, bool stealData)
+{
+	if (isLocked())
+	{
+		ccLog::Error("[ccPointCloud::fusion] Cloud is locked");
+		return *this;
+	}
+
+	return append(addedCloud,size(),stealData);
+}
+
+//! Appends the content of an array at the end of another one
+/** If 'steal' is true, the source chunks are moved if possible (i.e. if the
+	source array is not shared and if the destination size is a multiple of
+	the chunks size). Otherwise they are copied.
+**/
+template <int N, class ElementType> static bool AppendArray(GenericChunkedArray<N,ElementType>* dest, GenericChunkedArray<N,ElementType>* src, bool steal)
+{
+	assert(dest && src);
+	if (steal && src->getLinkCount() == 1 && dest->stealChunks(*src))
+		return true;
+	return dest->append(*src);
+}
+
+//! Appends 'count' copies of the same element at the end of an array
+template <int N, class ElementType> static bool AddCopies(GenericChunkedArray<N,ElementType>* array, const ElementType* value, unsigned count)
+{
+	unsigned newCount = array->currentSize()+count;
+	if (newCount > array->capacity() && !array->reserve(newCount))
+		return false;
+	for (unsigned i=0; i<count; ++i)
+		array->addElement(value);
+	return true;
+}
+
+//! Appends 'count' copies of the same element at the end of an array (N=1)
+template <class ElementType> static bool AddCopies(GenericChunkedArray<1,ElementType>* array, const ElementType& value, unsigned count)
+{
+	unsigned newCount = array->currentSize()+count;
+	if (newCount > array->capacity() && !array->reserve(newCount))
+		return false;
+	for (unsigned i=0; i<count; ++i)
+		array->addElement(value);
+	return true;
+}
+
+const ccPointCloud& ccPointCloud::append(ccPointCloud* addedCloud, unsigned pointCountBefore, bool stealData/*=false*/)
 {
 	assert(addedCloud);
 
 	unsigned addedPoints = addedCloud->size();
 
-	if (!reserve(pointCountBefore+addedPoints))
+	//can we move the added cloud data instead of copying it?
+	stealData = (stealData && addedCloud != this && !addedCloud->isLocked());
+	bool steal = (	stealData
+				&&	size() == pointCountBefore
+				&&	(pointCountBefore & ELEMENT_INDEX_BIT_MASK) == 0 );
+
+	//no need to reserve memory if the chunks are moved
+	if (!steal && !reserve(pointCountBefore+addedPoints))
 	{
 		ccLog::Error("[ccPointCloud::append] Not enough memory!");
 		return *this;
@@ -384,8 +563,12 @@ const ccPointCloud& ccPointCloud::append(ccPointCloud* addedCloud, unsigned poin
 		deleteOctree();
 		unallocateVisibilityArray();
 
-		for (unsigned i=0;i<addedPoints;i++)
-			addPoint(*addedCloud->getPoint(i));
+		if (!AppendArray(m_points,addedCloud->m_points,steal))
+		{
+			ccLog::Error("[ccPointCloud::append] Not enough memory!");
+			return *this;
+		}
+		m_validBB = false;
 	}
 
 	//deprecate internal structures
@@ -401,31 +584,41 @@ const ccPointCloud& ccPointCloud::append(ccPointCloud* addedCloud, unsigned poin
 		if (!addedCloud->hasColors())
 		{
 			//we set a white color to new points
-			for (unsigned i=0;i<addedPoints;i++)
-				addRGBColor(ccColor::white);
+			if (!AddCopies<3,colorType>(m_rgbColors,ccColor::white,addedPoints))
+			{
+				ccLog::Warning("[ccPointCloud::fusion] Not enough memory: failed to allocate colors!");
+				unallocateColors();
+				showColors(false);
+			}
 		}
 		else //otherwise
 		{
+			bool importColors = true;
+
 			//if this cloud hadn't any color before
 			if (!hasColors())
 			{
-				//we try to resrve a new array
-				if (reserveTheRGBTable())
-				{
-					for (unsigned i=0;i<pointCountBefore;i++)
-						addRGBColor(ccColor::white);
-				}
-				else
+				if (!m_rgbColors)
 				{
-					ccLog::Warning("[ccPointCloud::fusion] Not enough memory: failed to allocate colors!");
-					showColors(false);
+					m_rgbColors = new ColorsTableType();
+					m_rgbColors->link();
 				}
+
+				//we try to reserve a new array (filled with white)
+				importColors = (	(steal || m_rgbColors->reserve(pointCountBefore+addedPoints))
+								&&	AddCopies<3,colorType>(m_rgbColors,ccColor::white,pointCountBefore) );
 			}
 
 			//we import colors (if necessary)
-			if (hasColors() && m_rgbColors->currentSize() == pointCountBefore)
-				for (unsigned i=0;i<addedPoints;i++)
-					addRGBColor(addedCloud->m_rgbColors->getValue(i));
+			if (importColors && m_rgbColors->currentSize() == pointCountBefore)
+				importColors = AppendArray<3,colorType>(m_rgbColors,addedCloud->m_rgbColors,steal);
+
+			if (!importColors)
+			{
+				ccLog::Warning("[ccPointCloud::fusion] Not enough memory: failed to allocate colors!");
+				unallocateColors();
+				showColors(false);
+			}
 		}
 	}
 
@@ -439,31 +632,41 @@ const ccPointCloud& ccPointCloud::append(ccPointCloud* addedCloud, unsigned poin
 		if (!addedCloud->hasNormals())
 		{
 			//we associate imported points with '0' normals
-			for (unsigned i=0;i<addedPoints;i++)
-				addNormIndex(0);
+			if (!AddCopies<normsType>(m_normals,0,addedPoints))
+			{
+				ccLog::Warning("[ccPointCloud::fusion] Not enough memory: failed to allocate normals!");
+				unallocateNorms();
+				showNormals(false);
+			}
 		}
 		else //otherwise
 		{
+			bool importNormals = true;
+
 			//if this cloud hasn't any normal
 			if (!hasNormals())
 			{
-				//we try to resrve a new array
-				if (reserveTheNormsTable())
+				if (!m_normals)
 				{
-					for (unsigned i=0;i<pointCountBefore;i++)
-						addNorm(0);
-				}
-				else
-				{
-					ccLog::Warning("[ccPointCloud::fusion] Not enough memory: failed to allocate normals!");
-					showNormals(false);
+					m_normals = new NormsIndexesTableType();
+					m_normals->link();
 				}
+
+				//we try to reserve a new array (filled with '0' normals)
+				importNormals = (	(steal || m_normals->reserve(pointCountBefore+addedPoints))
+								&&	AddCopies<normsType>(m_normals,0,pointCountBefore) );
 			}
 
 			//we import normals (if necessary)
-			if (hasNormals() && m_normals->currentSize() == pointCountBefore)
-				for (unsigned i=0;i<addedPoints;i++)
-					addNormIndex(addedCloud->m_normals->getValue(i));
+			if (importNormals && m_normals->currentSize() == pointCountBefore)
+				importNormals = AppendArray<1,normsType>(m_normals,addedCloud->m_normals,steal);
+
+			if (!importNormals)
+			{
+				ccLog::Warning("[ccPointCloud::fusion] Not enough memory: failed to allocate normals!");
+				unallocateNorms();
+				showNormals(false);
+			}
 		}
 	}
 
@@ -477,7 +680,7 @@ const ccPointCloud& ccPointCloud::append(ccPointCloud* addedCloud, unsigned poin
 		//first we fuse the new SF with the existing one
 		for (unsigned k=0;k<newSFCount;++k)
 		{
-			const CCLib::ScalarField* sf = addedCloud->getScalarField((int)k);
+			CCLib::ScalarField* sf = addedCloud->getScalarField((int)k);
 			if (sf)
 			{
 				//does this field already exist (same name)?
@@ -485,11 +688,13 @@ const ccPointCloud& ccPointCloud::append(ccPointCloud* addedCloud, unsigned poin
 				if (sfIdx>=0) //yes
 				{
 					CCLib::ScalarField* sameSF = getScalarField(sfIdx);
-					assert(sameSF && sameSF->capacity()>=pointCountBefore+addedPoints);
+					assert(sameSF);
 					//we fill it with new values (it should have been already 'reserved' (if necessary)
 					if (sameSF->currentSize() == pointCountBefore)
-						for (unsigned i=0; i<addedPoints; i++)
-							sameSF->addElement(sf->getValue(i));
+					{
+						if (!AppendArray<1,ScalarType>(sameSF,sf,steal))
+							ccLog::Warning("[ccPointCloud::fusion] Not enough memory: failed to import the values of scalar field '%s'",sf->getName());
+					}
 					sameSF->computeMinAndMax();
 
 					//flag this SF as 'updated'
@@ -500,11 +705,10 @@ const ccPointCloud& ccPointCloud::append(ccPointCloud* addedCloud, unsigned poin
 				{
 					ccScalarField* newSF = new ccScalarField(sf->getName());
 					//we fill the begining with NaN (as there is no equivalent in the current cloud)
-					if (newSF->resize(pointCountBefore+addedPoints,true,NAN_VALUE))
+					if (	(steal || newSF->reserve(pointCountBefore+addedPoints))
+						&&	AddCopies<ScalarType>(newSF,newSF->NaN(),pointCountBefore)
+						&&	AppendArray<1,ScalarType>(newSF,sf,steal) )
 					{
-						//we copy the new values
-						for (unsigned i=0; i<addedPoints; i++)
-							newSF->setValue(pointCountBefore+i,sf->getValue(i));
 						newSF->computeMinAndMax();
 
 						//add scalar field to this cloud
@@ -532,9 +736,8 @@ const ccPointCloud& ccPointCloud::append(ccPointCloud* addedCloud, unsigned poin
 				if (sf->currentSize() == pointCountBefore)
 				{
 					//we fill the end with NaN (as there is no equivalent in the added cloud)
-					ScalarType NaN = sf->NaN();
-					for (unsigned i=0; i<addedPoints; i++)
-						sf->addElement(NaN);
+					if (!AddCopies<ScalarType>(sf,sf->NaN(),addedPoints))
+						ccLog::Warning("[ccPointCloud::fusion] Not enough memory: failed to resize scalar field '%s'",sf->getName());
 				}
 			}
 		}
@@ -621,6 +824,10 @@ const ccPointCloud& ccPointCloud::append(ccPointCloud* addedCloud, unsigned poin
 		}
 	}
 
+	//the added cloud data may have been (partially) moved
+	if (stealData)
+		addedCloud->clear();
+
 	return *this;
 }
 
@@ -939,6 +1146,12 @@ void ccPointCloud::addRGBColor(colorType r, colorType g, colorType b)
 	m_rgbColors->addElement(C);
 }
 
+bool ccPointCloud::addRGBColors(const colorType* colors, unsigned count)
+{
+	assert(m_rgbColors);
+	return m_rgbColors->addElements(colors,count);
+}
+
 void ccPointCloud::addNorm(PointCoordinateType Nx, PointCoordinateType Ny, PointCoordinateType Nz)
 {
 	PointCoordinateType N[3]={Nx,Ny,Nz};
@@ -956,6 +1169,33 @@ void ccPointCloud::addNormIndex(normsType index)
 	m_normals->addElement(index);
 }
 
+bool ccPointCloud::addNormIndexes(const normsType* indexes, unsigned count)
+{
+	assert(m_normals);
+	return m_normals->addElements(indexes,count);
+}
+
+bool ccPointCloud::addNorms(const PointCoordinateType* normals, unsigned count)
+{
+	assert(m_normals);
+	if (m_normals->currentSize()+count > m_normals->capacity() && !m_normals->reserve(m_normals->currentSize()+count))
+		return false;
+
+	//we compress the normals by small batches
+	static const unsigned BATCH_SIZE = 1024;
+	normsType indexes[BATCH_SIZE];
+	while (count != 0)
+	{
+		unsigned batchCount = std::min<unsigned>(count,BATCH_SIZE);
+		ccNormalVectors::GetNormIndexes(normals,batchCount,indexes);
+		m_normals->addElements(indexes,batchCount); //can't fail (see above)
+		normals += 3*batchCount;
+		count -= batchCount;
+	}
+
+	return true;
+}
+
 void ccPointCloud::addNormAtIndex(const PointCoordinateType* N, unsigned index)
 {
 	assert(m_normals && m_normals->isAllocated());
@@ -1006,6 +1246,19 @@ void ccPointCloud::setNormsTable(NormsIndexesTableType* norms)
 		m_normals->link();
 }
 
+void ccPointCloud::setRGBColorsTable(ColorsTableType* colors)
+{
+	if (m_rgbColors == colors)
+		return;
+
+	if (m_rgbColors)
+		m_rgbColors->release();
+
+	m_rgbColors = colors;
+	if (m_rgbColors)
+		m_rgbColors->link();
+}
+
 bool ccPointCloud::colorize(float r, float g, float b)
 {
 	assert(r >= 0.0f && r <= 1.0f);
@@ -1108,59 +1361,266 @@ void ccPointCloud::applyGLTransformation(const ccGLMatrix& trans)
 	return applyRigidTransformation(trans);
 }
 
+//! Rigid transformation context (see ccPointCloud::applyRigidTransformation)
+struct ccRigidTransformContext
+{
+	//! Transformation
+	const ccGLMatrix* trans;
+	//! Points
+	GenericChunkedArray<3,PointCoordinateType>* points;
+	//! Compressed normals
+	NormsIndexesTableType* normals;
+	//! Normals remapping table (if 0, each normal is recompressed)
+	normsType* normsRemap;
+};
+
+//! Job of a rigid transformation stage (one chunk or one range of elements)
+struct rigidTransformJobDesc
+{
+	//! Chunk index
+	unsigned chunkIndex;
+	//! First element index (chunks or remapping table)
+	unsigned first;
+	//! Last element index (excluded)
+	unsigned last;
+	//! Bounding-box of the transformed points
+	PointCoordinateType bbMin[3];
+	PointCoordinateType bbMax[3];
+};
+
+//! Transforms the points of a chunk (and computes their bounding-box)
+static void TransformPointsChunk(const ccRigidTransformContext& context, rigidTransformJobDesc& job)
+{
+	//matrix coefficients are copied locally so that the compiler can keep them in registers
+	const float* m = context.trans->data();
+	const float r11 = m[0], r21 = m[1], r31 = m[2];
+	const float r12 = m[4], r22 = m[5], r32 = m[6];
+	const float r13 = m[8], r23 = m[9], r33 = m[10];
+	const float tx = m[12], ty = m[13], tz = m[14];
+
+	PointCoordinateType* P = context.points->chunkStartPtr(job.chunkIndex);
+	PointCoordinateType* end = P + 3*(job.last-job.first);
+	if (P == end)
+		return;
+
+	PointCoordinateType minX, minY, minZ, maxX, maxY, maxZ;
+	minX = minY = minZ = std::numeric_limits<PointCoordinateType>::max();
+	maxX = maxY = maxZ = -std::numeric_limits<PointCoordinateType>::max();
+	for (; P != end; P += 3)
+	{
+		const float x = P[0], y = P[1], z = P[2];
+		const PointCoordinateType X = r11*x + r12*y + r13*z + tx;
+		const PointCoordinateType Y = r21*x + r22*y + r23*z + ty;
+		const PointCoordinateType Z = r31*x + r32*y + r33*z + tz;
+		P[0] = X;
+		P[1] = Y;
+		P[2] = Z;
+		minX = std::min(minX,X); maxX = std::max(maxX,X);
+		minY = std::min(minY,Y); maxY = std::max(maxY,Y);
+		minZ = std::min(minZ,Z); maxZ = std::max(maxZ,Z);
+	}
+
+	job.bbMin[0] = minX; job.bbMin[1] = minY; job.bbMin[2] = minZ;
+	job.bbMax[0] = maxX; job.bbMax[1] = maxY; job.bbMax[2] = maxZ;
+}
+
+//! Computes a range of the normals remapping table
+static void BuildNormalsRemapRange(const ccRigidTransformContext& context, rigidTransformJobDesc& job)
+{
+	for (unsigned i=job.first; i<job.last; ++i)
+	{
+		CCVector3 N(ccNormalVectors::GetNormal(i));
+		context.trans->applyRotation(N);
+		context.normsRemap[i] = ccNormalVectors::GetNormIndex(N.u);
+	}
+}
+
+//! Updates the compressed normals of a chunk
+static void RecodeNormalsChunk(const ccRigidTransformContext& context, rigidTransformJobDesc& job)
+{
+	normsType* _normsIndexes = context.normals->chunkStartPtr(job.chunkIndex);
+	unsigned n = job.last-job.first;
+
+	if (context.normsRemap)
+	{
+		//simple gather
+		const normsType* remap = context.normsRemap;
+		for (unsigned i=0; i<n; ++i)
+			_normsIndexes[i] = remap[_normsIndexes[i]];
+	}
+	else
+	{
+		for (unsigned i=0; i<n; ++i)
+		{
+			CCVector3 N(ccNormalVectors::GetNormal(_normsIndexes[i]));
+			context.trans->applyRotation(N);
+			_normsIndexes[i] = ccNormalVectors::GetNormIndex(N.u);
+		}
+	}
+}
+
+//! Rigid transformation stage (applied to one job)
+typedef void (*RigidTransformStageFunc)(const ccRigidTransformContext&, rigidTransformJobDesc&);
+
+#ifdef ENABLE_MT_OCTREE
+
+#include <QtCore/QtCore>
+
+static const ccRigidTransformContext* s_rigidTransformContext_MT = 0;
+static RigidTransformStageFunc s_rigidTransformStage_MT = 0;
+
+void RigidTransformStage_MT(rigidTransformJobDesc& job)
+{
+	s_rigidTransformStage_MT(*s_rigidTransformContext_MT, job);
+}
+
+#endif
+
+//! Applies a rigid transformation stage to all jobs
+static void RunRigidTransformStage(RigidTransformStageFunc stage, const ccRigidTransformContext& context, std::vector<rigidTransformJobDesc>& jobs)
+{
+#ifndef ENABLE_MT_OCTREE
+	for (size_t i=0; i<jobs.size(); ++i)
+		stage(context, jobs[i]);
+#else
+	s_rigidTransformContext_MT = &context;
+	s_rigidTransformStage_MT = stage;
+	QtConcurrent::blockingMap(jobs, RigidTransformStage_MT);
+	s_rigidTransformContext_MT = 0;
+	s_rigidTransformStage_MT = 0;
+#endif
+}
+
+//! Creates one job per chunk (returns false if there's not enough memory)
+template<int N, class ElementType> static bool CreateChunksJobs(const GenericChunkedArray<N,ElementType>* array, unsigned count, std::vector<rigidTransformJobDesc>& jobs)
+{
+	try
+	{
+		jobs.resize(array->chunksCount());
+	}
+	catch(std::bad_alloc)
+	{
+		return false;
+	}
+
+	unsigned first = 0;
+	for (unsigned k=0; k<array->chunksCount(); ++k)
+	{
+		rigidTransformJobDesc& job = jobs[k];
+		job.chunkIndex = k;
+		job.first = std::min(first,count);
+		job.last = std::min(first+array->chunkSize(k),count);
+		first += array->chunkSize(k);
+	}
+
+	return true;
+}
+
+
 void ccPointCloud::applyRigidTransformation(const ccGLMatrix& trans)
 {
-	unsigned i,count=size();
-	for (i=0;i<count;i++)
-		trans.apply(*point(i));
+	unsigned count = size();
 
-	//we must also take care of the normals!
-	if (hasNormals())
+	ccRigidTransformContext context;
+	context.trans = &trans;
+	context.points = m_points;
+	context.normals = (hasNormals() ? m_normals : 0);
+	context.normsRemap = 0;
+
+	//points are transformed chunk by chunk (the bounding-box is updated at the same time)
+	std::vector<rigidTransformJobDesc> jobs;
+	bool validBB = false;
+	if (CreateChunksJobs(m_points,count,jobs))
 	{
-		bool recoded = false;
+		RunRigidTransformStage(TransformPointsChunk,context,jobs);
 
-		//if there is more points than the size of the compressed normals array,
-		//we recompress the array instead of recompressing each normal
-		if (count>ccNormalVectors::GetNumberOfVectors())
+		if (count != 0)
 		{
-			NormsIndexesTableType* newNorms = new NormsIndexesTableType;
-			if (newNorms->reserve(ccNormalVectors::GetNumberOfVectors()))
+			PointCoordinateType* bbMin = m_points->getMin();
+			PointCoordinateType* bbMax = m_points->getMax();
+			for (unsigned j=0; j<3; ++j)
+			{
+				bbMin[j] = std::numeric_limits<PointCoordinateType>::max();
+				bbMax[j] = -std::numeric_limits<PointCoordinateType>::max();
+			}
+			for (size_t k=0; k<jobs.size(); ++k)
 			{
-				for (i=0;i<ccNormalVectors::GetNumberOfVectors();i++)
+				if (jobs[k].first == jobs[k].last)
+					continue;
+				for (unsigned j=0; j<3; ++j)
 				{
-					CCVector3 new_n(ccNormalVectors::GetNormal(i));
-					trans.applyRotation(new_n);
-					normsType newNormIndex = ccNormalVectors::GetNormIndex(new_n.u);
-					newNorms->addElement(newNormIndex);
+					bbMin[j] = std::min(bbMin[j],jobs[k].bbMin[j]);
+					bbMax[j] = std::max(bbMax[j],jobs[k].bbMax[j]);
 				}
+			}
+			validBB = true;
+		}
+	}
+	else
+	{
+		//not enough memory for the jobs: we transform the points one by one
+		for (unsigned i=0; i<count; ++i)
+			trans.apply(*point(i));
+	}
+
+	//we must also take care of the normals!
+	if (context.normals)
+	{
+		//the normals table must be initialized before being used by several threads
+		unsigned normsCount = ccNormalVectors::GetNumberOfVectors();
+
+		//if there is more points than the size of the compressed normals array,
+		//we remap the normals indexes with a table instead of recompressing each normal
+		std::vector<normsType> normsRemap;
+		if (count > normsCount)
+		{
+			std::vector<rigidTransformJobDesc> remapJobs;
+			try
+			{
+				normsRemap.resize(normsCount);
+				remapJobs.resize((normsCount+MAX_NUMBER_OF_ELEMENTS_PER_CHUNK-1)/MAX_NUMBER_OF_ELEMENTS_PER_CHUNK);
+			}
+			catch(std::bad_alloc)
+			{
+				//not enough memory: we'll recompress each normal
+				normsRemap.clear();
+				remapJobs.clear();
+			}
 
-				m_normals->placeIteratorAtBegining();
-				for (i=0;i<count;i++)
+			if (!remapJobs.empty())
+			{
+				for (size_t k=0; k<remapJobs.size(); ++k)
 				{
-					m_normals->setValue(i,newNorms->getValue(m_normals->getCurrentValue()));
-					m_normals->forwardIterator();
+					remapJobs[k].chunkIndex = 0;
+					remapJobs[k].first = static_cast<unsigned>(k)*MAX_NUMBER_OF_ELEMENTS_PER_CHUNK;
+					remapJobs[k].last = std::min(normsCount,remapJobs[k].first+MAX_NUMBER_OF_ELEMENTS_PER_CHUNK);
 				}
-				recoded=true;
+				context.normsRemap = &normsRemap[0];
+				RunRigidTransformStage(BuildNormalsRemapRange,context,remapJobs);
 			}
-			newNorms->clear();
-			newNorms->release();
-			newNorms=0;
 		}
 
-		//if there is less points than the compressed normals array size
-		//(or if there is not enough memory to instantiate the temporary
-		//array), we recompress each normal ...
-		if (!recoded)
+		if (CreateChunksJobs(m_normals,count,jobs))
+		{
+			RunRigidTransformStage(RecodeNormalsChunk,context,jobs);
+		}
+		else
 		{
-			//on recode direct chaque normale
-			m_normals->placeIteratorAtBegining();
-			for (i=0;i<count;i++)
+			//not enough memory for the jobs: we recompress the normals one by one
+			for (unsigned i=0; i<count; ++i)
 			{
-				normsType* _theNormIndex = m_normals->getCurrentValuePtr();
-				CCVector3 new_n(ccNormalVectors::GetNormal(*_theNormIndex));
-				trans.applyRotation(new_n.u);
-				*_theNormIndex = ccNormalVectors::GetNormIndex(new_n.u);
-				m_normals->forwardIterator();
+				normsType normIndex = m_normals->getValue(i);
+				if (context.normsRemap)
+				{
+					normIndex = context.normsRemap[normIndex];
+				}
+				else
+				{
+					CCVector3 new_n(ccNormalVectors::GetNormal(normIndex));
+					trans.applyRotation(new_n.u);
+					normIndex = ccNormalVectors::GetNormIndex(new_n.u);
+				}
+				m_normals->setValue(i,normIndex);
 			}
 		}
 	}
@@ -1168,8 +1628,16 @@ void ccPointCloud::applyRigidTransformation(const ccGLMatrix& trans)
 	//the octree is invalidated by rotation...
 	deleteOctree();
 
-	// ... as the bounding box
-	refreshBB();
+	// ... as the bounding box (unless it has been computed during the transformation)
+	if (validBB)
+	{
+		m_validBB = true;
+		updateModificationTime();
+	}
+	else
+	{
+		refreshBB();
+	}
 }
 
 void ccPointCloud::translate(const CCVector3& T)
@@ -1306,28 +1774,7 @@ void ccPointCloud::getDrawingParameters(glDrawParams& params) const
 //Vertex indexes for OpenGL "arrays" drawing
 static PointCoordinateType s_normBuffer[MAX_NUMBER_OF_ELEMENTS_PER_CHUNK*3];
 static colorType s_rgbBuffer3ub[MAX_NUMBER_OF_ELEMENTS_PER_CHUNK*3];
-static float s_rgbBuffer3f[MAX_NUMBER_OF_ELEMENTS_PER_CHUNK*3];
-
-//helpers (for ColorRamp shader)
-
-inline float GetNormalizedValue(const ScalarType& sfVal, const ccScalarField::Range& displayRange)
-{
-	return static_cast<float>((sfVal-displayRange.start())/displayRange.range());
-}
-
-inline float GetSymmetricalNormalizedValue(const ScalarType& sfVal, const ccScalarField::Range& saturationRange)
-{
-	//normalized sf value
-	ScalarType relativeValue = 0;
-	if (fabs(sfVal) > saturationRange.start()) //we avoid the 'flat' SF case by the way
-	{
-		if (sfVal < 0)
-			relativeValue = (sfVal+saturationRange.start())/saturationRange.max();
-		else
-			relativeValue = (sfVal-saturationRange.start())/saturationRange.max();
-	}
-	return (1.0f+static_cast<float>(relativeValue))/2.0f;	//normalized sf value
-}
+static unsigned short s_indexBuffer[MAX_NUMBER_OF_ELEMENTS_PER_CHUNK];
 
 void ccPointCloud::drawMeOnly(CC_DRAW_CONTEXT& context)
 {
@@ -1422,146 +1869,155 @@ void ccPointCloud::drawMeOnly(CC_DRAW_CONTEXT& context)
 
 		if (!pushPointNames) //standard "full" display
 		{
-			//if some points are hidden (= visibility table instantiated), we can't use display arrays :(
+			//if some points are hidden (= visibility table instantiated), we only draw the visible ones
 			if (isVisibilityTableInstantiated())
 			{
-				glBegin(GL_POINTS);
-
-				for (unsigned j=0;j<numberOfPoints;j+=decimStep)
+				if (updateVisibleIndexes())
 				{
-					//we must test each point visibility
-					if (m_pointsVisibility->getValue(j) == POINT_VISIBLE)
+					glEnableClientState(GL_VERTEX_ARRAY);
+					if (glParams.showSF)
+					{
+						glColorPointer(3,GL_UNSIGNED_BYTE,0,s_rgbBuffer3ub);
+						glEnableClientState(GL_COLOR_ARRAY);
+					}
+					else if (glParams.showColors)
+					{
+						glEnableClientState(GL_COLOR_ARRAY);
+					}
+					if (glParams.showNorms)
+					{
+						glNormalPointer(GL_FLOAT,0,s_normBuffer);
+						glEnableClientState(GL_NORMAL_ARRAY);
+					}
+
+					unsigned k,chunks = m_points->chunksCount();
+					for (k=0;k<chunks;++k)
 					{
+						const unsigned short* _indexes = &m_visibleIndexes[0] + m_visibleIndexesOffsets[k];
+						unsigned indexCount = m_visibleIndexesOffsets[k+1] - m_visibleIndexesOffsets[k];
+						if (indexCount == 0)
+							continue;
+
+						//L.O.D.: we only keep the visible points that would have been displayed anyway
+						if (decimStep > 1)
+						{
+							unsigned chunkStart = k*MAX_NUMBER_OF_ELEMENTS_PER_CHUNK;
+							unsigned short* _decimIndexes = s_indexBuffer;
+							for (unsigned j=0;j<indexCount;++j)
+								if ((chunkStart + _indexes[j]) % decimStep == 0)
+									*_decimIndexes++ = _indexes[j];
+							_indexes = s_indexBuffer;
+							indexCount = static_cast<unsigned>(_decimIndexes - s_indexBuffer);
+							if (indexCount == 0)
+								continue;
+						}
+
+						//colors and normals are only computed for the visible points
 						if (glParams.showSF)
 						{
-							assert(j<m_currentDisplayedScalarField->currentSize());
-							const colorType* col = m_currentDisplayedScalarField->getValueColor(j);
-							//we force display of points hidden because of their scalar field value
-							//to be sure that the user don't miss them (during manual segmentation for instance)
-							glColor3ubv(col ? col : ccColor::lightGrey);
+							const ScalarType* _sf = m_currentDisplayedScalarField->chunkStartPtr(k);
+							for (unsigned j=0;j<indexCount;++j)
+							{
+								unsigned short index = _indexes[j];
+								const colorType* col = m_currentDisplayedScalarField->getColor(_sf[index]);
+								//we force display of points hidden because of their scalar field value
+								//to be sure that the user don't miss them (during manual segmentation for instance)
+								if (!col)
+									col = ccColor::lightGrey;
+								colorType* _sfColor = s_rgbBuffer3ub + 3*index;
+								_sfColor[0] = col[0];
+								_sfColor[1] = col[1];
+								_sfColor[2] = col[2];
+							}
 						}
 						else if (glParams.showColors)
 						{
-							glColor3ubv(m_rgbColors->getValue(j));
+							glColorPointer(3,GL_UNSIGNED_BYTE,0,m_rgbColors->chunkStartPtr(k));
 						}
+
 						if (glParams.showNorms)
 						{
-							glNormal3fv(compressedNormals->getNormal(m_normals->getValue(j)));
+							const normsType* _normalsIndexes = m_normals->chunkStartPtr(k);
+							for (unsigned j=0;j<indexCount;++j)
+							{
+								unsigned short index = _indexes[j];
+								const PointCoordinateType* N = compressedNormals->getNormal(_normalsIndexes[index]);
+								PointCoordinateType* _normal = s_normBuffer + 3*index;
+								_normal[0] = N[0];
+								_normal[1] = N[1];
+								_normal[2] = N[2];
+							}
 						}
-						glVertex3fv(m_points->getValue(j));
+
+						glVertexPointer(3,GL_FLOAT,0,m_points->chunkStartPtr(k));
+						glDrawElements(GL_POINTS,indexCount,GL_UNSIGNED_SHORT,_indexes);
 					}
+
+					if (glParams.showNorms)
+						glDisableClientState(GL_NORMAL_ARRAY);
+					if (glParams.showSF || glParams.showColors)
+						glDisableClientState(GL_COLOR_ARRAY);
+					glDisableClientState(GL_VERTEX_ARRAY);
 				}
+				else //not enough memory: we must test each point visibility (slow)
+				{
+					glBegin(GL_POINTS);
 
-				glEnd();
+					for (unsigned j=0;j<numberOfPoints;j+=decimStep)
+					{
+						//we must test each point visibility
+						if (m_pointsVisibility->getValue(j) == POINT_VISIBLE)
+						{
+							if (glParams.showSF)
+							{
+								assert(j<m_currentDisplayedScalarField->currentSize());
+								const colorType* col = m_currentDisplayedScalarField->getValueColor(j);
+								//we force display of points hidden because of their scalar field value
+								//to be sure that the user don't miss them (during manual segmentation for instance)
+								glColor3ubv(col ? col : ccColor::lightGrey);
+							}
+							else if (glParams.showColors)
+							{
+								glColor3ubv(m_rgbColors->getValue(j));
+							}
+							if (glParams.showNorms)
+							{
+								glNormal3fv(compressedNormals->getNormal(m_normals->getValue(j)));
+							}
+							glVertex3fv(m_points->getValue(j));
+						}
+					}
+
+					glEnd();
+				}
 			}
 			else if (glParams.showSF) //no visibility table enabled + scalar field
 			{
 				assert(m_currentDisplayedScalarField);
-				const ccScalarField::Range& sfDisplayRange = m_currentDisplayedScalarField->displayRange();
-				const ccScalarField::Range& sfSaturationRange = m_currentDisplayedScalarField->saturationRange();
-
-				//the fact that NaN values SHOULD be hidden, doesn't mean that we ACTUALLY hide points...
-				bool hiddenPoints = (	!m_currentDisplayedScalarField->areNaNValuesShownInGrey()
-					&& ( sfDisplayRange.stop() <= sfDisplayRange.max() || sfDisplayRange.start() >= sfDisplayRange.min()) );
 
 				//color ramp shader initialization
 				ccColorRampShader* colorRampShader = context.colorRampShader;
-
-				if (m_currentDisplayedScalarField->logScale())
-				{
-					//FIXME: shader doesn't support log scale yet!
-					colorRampShader = 0;
-				}
-
 				if (colorRampShader)
 				{
-					//max available space for frament's shader uniforms
-					GLint maxBytes=0;
-					glGetIntegerv(GL_MAX_FRAGMENT_UNIFORM_COMPONENTS,&maxBytes);
-					GLint maxComponents = (maxBytes>>2)-4; //leave space for the other uniforms!
-					unsigned steps = m_currentDisplayedScalarField->getColorRampSteps();
-					assert(steps!=0);
-
-					if (steps > CC_MAX_SHADER_COLOR_RAMP_SIZE || maxComponents < (GLint)steps)
+					colorRampShader->start();
+					if (!colorRampShader->setup(m_currentDisplayedScalarField))
 					{
-						ccLog::WarningDebug("Color ramp steps exceed shader limits!");
+						//An error occured during shader initialization?
+						ccLog::WarningDebug("Failed to init ColorRamp shader!");
+						colorRampShader->stop();
 						colorRampShader = 0;
 					}
-					else
-					{
-						float sfMinSatRel = 0.0f;
-						float sfMaxSatRel = 1.0f;
-						if (!m_currentDisplayedScalarField->symmetricalScale())
-						{
-							sfMinSatRel = GetNormalizedValue(sfSaturationRange.start(),sfDisplayRange);	//doesn't need to be between 0 and 1!
-							sfMaxSatRel = GetNormalizedValue(sfSaturationRange.stop(),sfDisplayRange);	//doesn't need to be between 0 and 1!
-						}
-						else
-						{
-							//we can only handle 'maximum' saturation
-							sfMinSatRel = GetSymmetricalNormalizedValue(-sfSaturationRange.stop(),sfSaturationRange);
-							sfMaxSatRel = GetSymmetricalNormalizedValue(sfSaturationRange.stop(),sfSaturationRange);
-							//we'll have to handle the 'minimum' saturation manually!
-						}
-
-						const ccColorScale::Shared& colorScale = m_currentDisplayedScalarField->getColorScale();
-						assert(colorScale);
-
-						colorRampShader->start();
-						if (!colorRampShader->setup(sfMinSatRel, sfMaxSatRel, steps, colorScale))
-						{
-							//An error occured during shader initialization?
-							ccLog::WarningDebug("Failed to init ColorRamp shader!");
-							colorRampShader->stop();
-							colorRampShader = 0;
-						}
-						else if (glParams.showNorms)
-						{
-							//we must get rid of lights material (other than ambiant) for the red and green fields
-							glPushAttrib(GL_LIGHTING_BIT);
-
-							//we use the ambiant light to pass the scalar value (and 'grayed' marker) without any
-							//modification from the GPU pipeline, even if normals are enabled!
-							glDisable(GL_COLOR_MATERIAL);
-							glColorMaterial(GL_FRONT_AND_BACK, GL_DIFFUSE);
-							glColorMaterial(GL_FRONT_AND_BACK, GL_AMBIENT);
-							glEnable(GL_COLOR_MATERIAL);
-
-							GLint maxLightCount;
-							glGetIntegerv(GL_MAX_LIGHTS,&maxLightCount);
-							for (int i=0;i<maxLightCount;++i)
-							{
-								if (glIsEnabled(GL_LIGHT0+i))
-								{
-									float diffuse[4],ambiant[4],specular[4];
-
-									glGetLightfv(GL_LIGHT0+i,GL_AMBIENT,ambiant);
-									glGetLightfv(GL_LIGHT0+i,GL_DIFFUSE,diffuse);
-									glGetLightfv(GL_LIGHT0+i,GL_SPECULAR,specular);
-
-									ambiant[0]  = ambiant[1]  = 1.0f;
-									diffuse[0]  = diffuse[1]  = 0.0f;
-									specular[0] = specular[1] = 0.0f;
-
-									glLightfv(GL_LIGHT0+i,GL_DIFFUSE,diffuse);
-									glLightfv(GL_LIGHT0+i,GL_AMBIENT,ambiant);
-									glLightfv(GL_LIGHT0+i,GL_SPECULAR,specular);
-								}
-							}
-						}
-					}
 				}
 
-				//if all points should be displayed (fastest case)
-				if (!hiddenPoints)
+				if (colorRampShader)
 				{
-					glEnableClientState(GL_VERTEX_ARRAY);
-					glEnableClientState(GL_COLOR_ARRAY);
+					//scalar values are directly sent to the shader (as texture coordinates)
+					//so there's no conversion at all on the CPU side (and hidden points are
+					//discarded by the shader). The current color only modulates the lighting.
+					glColor3ubv(ccColor::white);
 
-					if (colorRampShader)
-						glColorPointer(3,GL_FLOAT,0,s_rgbBuffer3f);
-					else
-						glColorPointer(3,GL_UNSIGNED_BYTE,0,s_rgbBuffer3ub);
+					glEnableClientState(GL_VERTEX_ARRAY);
+					glEnableClientState(GL_TEXTURE_COORD_ARRAY);
 
 					if (glParams.showNorms)
 					{
@@ -1574,47 +2030,6 @@ void ccPointCloud::drawMeOnly(CC_DRAW_CONTEXT& context)
 					{
 						unsigned chunkSize = m_points->chunkSize(k);
 
-						//Scalar field colors
-						ScalarType* _sf = m_currentDisplayedScalarField->chunkStartPtr(k);
-						if (colorRampShader)
-						{
-							float* _sfColors = s_rgbBuffer3f;
-							if (!m_currentDisplayedScalarField->symmetricalScale())
-							{
-								for (unsigned j=0;j<chunkSize;j+=decimStep,_sf+=decimStep,_sfColors+=3)
-								{
-									bool valid = sfDisplayRange.isInRange(*_sf);							//NaN values are also rejected!
-									_sfColors[0] = GetNormalizedValue(*_sf,sfDisplayRange);					//normalized sf value
-									_sfColors[1] = valid ? 1.0f : 0.0f;										//flag: whether point is grayed out or not
-									_sfColors[2] = 1.0f;													//reference value (to get the true lighting value)
-								}
-							}
-							else //symmetrical scale
-							{
-								//we must handle the values between -minSat et +minSat 'manually'
-								for (unsigned j=0;j<chunkSize;j+=decimStep,_sf+=decimStep,_sfColors+=3)
-								{
-									bool valid = sfDisplayRange.isInRange(*_sf);							//NaN values are also rejected!
-									_sfColors[0] = GetSymmetricalNormalizedValue(*_sf,sfSaturationRange);	//normalized sf value
-									_sfColors[1] = valid ? 1.0f : 0.0f;										//flag: whether point is grayed out or not
-									_sfColors[2] = 1.0f;													//reference value (to get the true lighting value)
-								}
-							}
-						}
-						else
-						{
-							colorType* _sfColors = s_rgbBuffer3ub;
-							for (unsigned j=0;j<chunkSize;j+=decimStep,_sf+=decimStep)
-							{
-								//we need to convert scalar value to color into a temporary structure
-								const colorType* col = m_currentDisplayedScalarField->getColor(*_sf);
-								assert(col);
-								*_sfColors++ = *col++;
-								*_sfColors++ = *col++;
-								*_sfColors++ = *col++;
-							}
-						}
-
 						//normals
 						if (glParams.showNorms)
 						{
@@ -1632,6 +2047,7 @@ void ccPointCloud::drawMeOnly(CC_DRAW_CONTEXT& context)
 						if (decimStep > 1)
 							chunkSize = (unsigned)floor((float)chunkSize/(float)decimStep);
 
+						glTexCoordPointer(1,GL_FLOAT,decimStep*sizeof(ScalarType),m_currentDisplayedScalarField->chunkStartPtr(k));
 						glVertexPointer(3,GL_FLOAT,decimStep*3*sizeof(PointCoordinateType),m_points->chunkStartPtr(k));
 						glDrawArrays(GL_POINTS,0,chunkSize);
 					}
@@ -1639,115 +2055,96 @@ void ccPointCloud::drawMeOnly(CC_DRAW_CONTEXT& context)
 					if (glParams.showNorms)
 						glDisableClientState(GL_NORMAL_ARRAY);
 
+					glDisableClientState(GL_TEXTURE_COORD_ARRAY);
 					glDisableClientState(GL_VERTEX_ARRAY);
-					glDisableClientState(GL_COLOR_ARRAY);
+
+					colorRampShader->stop();
 				}
-				else //potentially hidden points
+				else
 				{
-					glBegin(GL_POINTS);
+					const ccScalarField::Range& sfDisplayRange = m_currentDisplayedScalarField->displayRange();
 
-					if (glParams.showNorms) //with normals (slowest case!)
+					//the fact that NaN values SHOULD be hidden, doesn't mean that we ACTUALLY hide points...
+					bool hiddenPoints = (	!m_currentDisplayedScalarField->areNaNValuesShownInGrey()
+						&& ( sfDisplayRange.stop() <= sfDisplayRange.max() || sfDisplayRange.start() >= sfDisplayRange.min()) );
+
+					//if all points should be displayed (fastest case)
+					if (!hiddenPoints)
 					{
-						if (colorRampShader)
+						glEnableClientState(GL_VERTEX_ARRAY);
+						glEnableClientState(GL_COLOR_ARRAY);
+						glColorPointer(3,GL_UNSIGNED_BYTE,0,s_rgbBuffer3ub);
+
+						if (glParams.showNorms)
 						{
-							if (!m_currentDisplayedScalarField->symmetricalScale())
-							{
-								for (unsigned j=0;j<numberOfPoints;j+=decimStep)
-								{
-									assert(j<m_currentDisplayedScalarField->currentSize());
-									const ScalarType sf = m_currentDisplayedScalarField->getValue(j);
-									if (sfDisplayRange.isInRange(sf)) //NaN values are rejected
-									{
-										glColor3f(GetNormalizedValue(sf,sfDisplayRange),1.0f,1.0f);
-										glNormal3fv(compressedNormals->getNormal(m_normals->getValue(j)));
-										glVertex3fv(m_points->getValue(j));
-									}
-								}
-							}
-							else
-							{
-								for (unsigned j=0;j<numberOfPoints;j+=decimStep)
-								{
-									assert(j<m_currentDisplayedScalarField->currentSize());
-									const ScalarType sf = m_currentDisplayedScalarField->getValue(j);
-									if (sfDisplayRange.isInRange(sf)) //NaN values are rejected
-									{
-										glColor3f(GetSymmetricalNormalizedValue(sf,sfSaturationRange),1.0f,1.0f);
-										glNormal3fv(compressedNormals->getNormal(m_normals->getValue(j)));
-										glVertex3fv(m_points->getValue(j));
-									}
-								}
-							}
+							glNormalPointer(GL_FLOAT,0,s_normBuffer);
+							glEnableClientState(GL_NORMAL_ARRAY);
 						}
-						else
-						{
-							for (unsigned j=0;j<numberOfPoints;j+=decimStep)
-							{
-								assert(j<m_currentDisplayedScalarField->currentSize());
-								const colorType* col = m_currentDisplayedScalarField->getValueColor(j);
-								if (col)
-								{
-									glColor3ubv(col);
-									glNormal3fv(compressedNormals->getNormal(m_normals->getValue(j)));
-									glVertex3fv(m_points->getValue(j));
-								}
-							}
-						}
-					}
-					else //potentially hidden points without normals (a bit faster)
-					{
-						if (colorRampShader)
+
+						unsigned k,chunks = m_points->chunksCount();
+						for (k=0;k<chunks;++k)
 						{
-							if (!m_currentDisplayedScalarField->symmetricalScale())
+							unsigned chunkSize = m_points->chunkSize(k);
+
+							//Scalar field colors
+							ScalarType* _sf = m_currentDisplayedScalarField->chunkStartPtr(k);
+							colorType* _sfColors = s_rgbBuffer3ub;
+							for (unsigned j=0;j<chunkSize;j+=decimStep,_sf+=decimStep)
 							{
-								for (unsigned j=0;j<numberOfPoints;j+=decimStep)
-								{
-									assert(j<m_currentDisplayedScalarField->currentSize());
-									const ScalarType sf = m_currentDisplayedScalarField->getValue(j);
-									if (sfDisplayRange.isInRange(sf)) //NaN values are rejected
-									{
-										glColor3f(GetNormalizedValue(sf,sfDisplayRange),1.0f,1.0f);
-										glVertex3fv(m_points->getValue(j));
-									}
-								}
+								//we need to convert scalar value to color into a temporary structure
+								const colorType* col = m_currentDisplayedScalarField->getColor(*_sf);
+								assert(col);
+								*_sfColors++ = *col++;
+								*_sfColors++ = *col++;
+								*_sfColors++ = *col++;
 							}
-							else
+
+							//normals
+							if (glParams.showNorms)
 							{
-								for (unsigned j=0;j<numberOfPoints;j+=decimStep)
+								PointCoordinateType* _normals = s_normBuffer;
+								const normsType* _normalsIndexes = m_normals->chunkStartPtr(k);
+								for (unsigned j=0;j<chunkSize;j+=decimStep,_normalsIndexes+=decimStep)
 								{
-									assert(j<m_currentDisplayedScalarField->currentSize());
-									const ScalarType sf = m_currentDisplayedScalarField->getValue(j);
-									if (sfDisplayRange.isInRange(sf)) //NaN values are rejected
-									{
-										glColor3f(GetSymmetricalNormalizedValue(sf,sfSaturationRange),1.0f,1.0f);
-										glVertex3fv(m_points->getValue(j));
-									}
+									const PointCoordinateType* N = compressedNormals->getNormal(*_normalsIndexes);
+									*(_normals)++ = *(N)++;
+									*(_normals)++ = *(N)++;
+									*(_normals)++ = *(N)++;
 								}
 							}
+
+							if (decimStep > 1)
+								chunkSize = (unsigned)floor((float)chunkSize/(float)decimStep);
+
+							glVertexPointer(3,GL_FLOAT,decimStep*3*sizeof(PointCoordinateType),m_points->chunkStartPtr(k));
+							glDrawArrays(GL_POINTS,0,chunkSize);
 						}
-						else
+
+						if (glParams.showNorms)
+							glDisableClientState(GL_NORMAL_ARRAY);
+
+						glDisableClientState(GL_VERTEX_ARRAY);
+						glDisableClientState(GL_COLOR_ARRAY);
+					}
+					else //potentially hidden points
+					{
+						glBegin(GL_POINTS);
+
+						for (unsigned j=0;j<numberOfPoints;j+=decimStep)
 						{
-							for (unsigned j=0;j<numberOfPoints;j+=decimStep)
+							assert(j<m_currentDisplayedScalarField->currentSize());
+							const colorType* col = m_currentDisplayedScalarField->getValueColor(j);
+							if (col)
 							{
-								assert(j<m_currentDisplayedScalarField->currentSize());
-								const colorType* col = m_currentDisplayedScalarField->getValueColor(j);
-								if (col)
-								{
-									glColor3ubv(col);
-									glVertex3fv(m_points->getValue(j));
-								}
+								glColor3ubv(col);
+								if (glParams.showNorms)
+									glNormal3fv(compressedNormals->getNormal(m_normals->getValue(j)));
+								glVertex3fv(m_points->getValue(j));
 							}
 						}
-					}
-					glEnd();
-				}
-
-				if (colorRampShader)
-				{
-					colorRampShader->stop();
 
-					if (glParams.showNorms)
-						glPopAttrib(); //GL_LIGHTING_BIT
+						glEnd();
+					}
 				}
 			}
 			else if (glParams.showNorms) //no visibility table enabled, no scalar field + normals
@@ -1967,6 +2364,141 @@ void ccPointCloud::hidePointsByScalarValue(ScalarType minVal, ScalarType maxVal)
 		if (val<minVal || val>maxVal || val != val) //handle NaN values!
 			m_pointsVisibility->setValue(i,POINT_HIDDEN);
 	}
+	notifyVisibilityChanged();
+}
+
+void ccPointCloud::notifyVisibilityChanged()
+{
+	m_visibleIndexesValid = false;
+}
+
+//! Visible points of one chunk (see ccPointCloud::updateVisibleIndexes)
+struct visibleIndexesJobDesc
+{
+	//! Chunk visibility table
+	const uchar* visibility;
+	//! Number of points in the chunk
+	unsigned count;
+	//! Output indexes (0 for the counting pass)
+	unsigned short* indexes;
+	//! Number of visible points
+	unsigned visibleCount;
+};
+
+//! Counts (or lists if job.indexes is not null) the visible points of a chunk
+static void ProcessVisiblePoints(visibleIndexesJobDesc& job)
+{
+	unsigned visibleCount = 0;
+	if (job.indexes)
+	{
+		for (unsigned i=0; i<job.count; ++i)
+			if (job.visibility[i] == POINT_VISIBLE)
+				job.indexes[visibleCount++] = static_cast<unsigned short>(i);
+		assert(visibleCount == job.visibleCount);
+	}
+	else
+	{
+		for (unsigned i=0; i<job.count; ++i)
+			if (job.visibility[i] == POINT_VISIBLE)
+				++visibleCount;
+	}
+	job.visibleCount = visibleCount;
+}
+
+#ifdef ENABLE_MT_OCTREE
+
+#include <QtCore/QtCore>
+
+void ProcessVisiblePoints_MT(visibleIndexesJobDesc& job)
+{
+	ProcessVisiblePoints(job);
+}
+
+#endif
+
+//! Applies ProcessVisiblePoints to all chunks
+static void RunVisiblePointsJobs(std::vector<visibleIndexesJobDesc>& jobs)
+{
+#ifndef ENABLE_MT_OCTREE
+	for (size_t k=0; k<jobs.size(); ++k)
+		ProcessVisiblePoints(jobs[k]);
+#else
+	QtConcurrent::blockingMap(jobs, ProcessVisiblePoints_MT);
+#endif
+}
+
+bool ccPointCloud::updateVisibleIndexes()
+{
+	assert(isVisibilityTableInstantiated());
+
+	unsigned count = size();
+	unsigned chunks = m_points->chunksCount();
+	if (	m_visibleIndexesValid
+		&&	m_visibleIndexesPointCount == count
+		&&	m_visibleIndexesOffsets.size() == static_cast<size_t>(chunks)+1 )
+		return true;
+
+	//indexes are stored on 16 bits (relatively to each chunk)
+	assert(MAX_NUMBER_OF_ELEMENTS_PER_CHUNK <= (1<<16));
+
+	m_visibleIndexesValid = false;
+	if (m_pointsVisibility->currentSize() != count || m_pointsVisibility->chunksCount() < chunks)
+		return false;
+
+	std::vector<visibleIndexesJobDesc> jobs;
+	try
+	{
+		jobs.resize(chunks);
+		m_visibleIndexesOffsets.resize(chunks+1);
+	}
+	catch(std::bad_alloc)
+	{
+		//not enough memory
+		return false;
+	}
+
+	//first pass: we count the visible points of each chunk
+	unsigned first = 0;
+	for (unsigned k=0; k<chunks; ++k)
+	{
+		visibleIndexesJobDesc& job = jobs[k];
+		job.visibility = m_pointsVisibility->chunkStartPtr(k);
+		job.count = std::min(m_points->chunkSize(k),count-std::min(first,count));
+		job.indexes = 0;
+		job.visibleCount = 0;
+		first += m_points->chunkSize(k);
+	}
+	RunVisiblePointsJobs(jobs);
+
+	unsigned visibleCount = 0;
+	for (unsigned k=0; k<chunks; ++k)
+	{
+		m_visibleIndexesOffsets[k] = visibleCount;
+		visibleCount += jobs[k].visibleCount;
+	}
+	m_visibleIndexesOffsets[chunks] = visibleCount;
+
+	try
+	{
+		//we keep at least one element so that the buffer is always valid
+		m_visibleIndexes.resize(std::max(visibleCount,1u));
+	}
+	catch(std::bad_alloc)
+	{
+		//not enough memory
+		m_visibleIndexes.clear();
+		return false;
+	}
+
+	//second pass: we list the visible points of each chunk
+	for (unsigned k=0; k<chunks; ++k)
+		jobs[k].indexes = &m_visibleIndexes[0] + m_visibleIndexesOffsets[k];
+	RunVisiblePointsJobs(jobs);
+
+	m_visibleIndexesValid = true;
+	m_visibleIndexesPointCount = count;
+
+	return true;
 }
 
 ccGenericPointCloud* ccPointCloud::createNewCloudFromVisibilitySelection(bool removeSelectedPoints)
@@ -30,6 +30,9 @@
 
 #include "ccGenericPointCloud.h"
 
+//system
+#include <vector>
+
 class ccPointCloud;
 class ccScalarField;
 
@@ -142,6 +145,18 @@ public:
     **/
 	const ccPointCloud& operator +=(ccPointCloud*);
 
+	//! Fuses another cloud with this one
+	/** Same as operator+=, but the data of the added cloud can be moved
+		instead of copied (see GenericChunkedArray::stealChunks). This is
+		only possible if the size of this cloud is a multiple of the chunks
+		size (e.g. if it's empty), otherwise the data is copied. In any case,
+		if 'stealData' is true, the added cloud is emptied afterwards (its
+		arrays shouldn't be shared with other entities).
+		\param cloud cloud to add
+		\param stealData whether the added cloud data can be moved (i.e. if it's not needed anymore)
+	**/
+	const ccPointCloud& merge(ccPointCloud* cloud, bool stealData);
+
 	/***************************************************
 				Features deletion/clearing
 	***************************************************/
@@ -317,6 +332,23 @@ public:
     **/
 	void addNorm(const PointCoordinateType* N);
 
+	//! Pushes several compressed normal vectors at once
+	/** Normals must be enabled. The normals array is enlarged if necessary.
+		\param indexes compressed normal vectors
+		\param count number of normals
+		\return false if there's not enough memory
+	**/
+	bool addNormIndexes(const normsType* indexes, unsigned count);
+
+	//! Pushes several normal vectors at once
+	/** Normals must be enabled. The normals array is enlarged if necessary.
+		Normals are compressed by batches (see ccNormalVectors::GetNormIndexes).
+		\param normals normal vectors (count x 3 values)
+		\param count number of normals
+		\return false if there's not enough memory
+	**/
+	bool addNorms(const PointCoordinateType* normals, unsigned count);
+
 	//! Adds a normal vector to the one at a specific index
 	/** The resulting sum is automatically normalized and compressed.
         \param N normal vector to add (size: 3)
@@ -327,6 +359,9 @@ public:
 	//! Sets the (compressed) normals table
 	void setNormsTable(NormsIndexesTableType* norms);
 
+	//! Sets the RGB colors table
+	void setRGBColorsTable(ColorsTableType* colors);
+
 	//! Converts normals to RGB colors
 	/** See ccNormalVectors::ConvertNormalToRGB
 		\return success
@@ -345,6 +380,14 @@ public:
 	**/
 	void addRGBColor(const colorType* C);
 
+	//! Pushes several RGB colors at once
+	/** Colors must be enabled. The colors array is enlarged if necessary.
+		\param colors RGB colors (count x 3 values)
+		\param count number of colors
+		\return false if there's not enough memory
+	**/
+	bool addRGBColors(const colorType* colors, unsigned count);
+
 	//! Pushes a grey color on stack
 	/** Shortcut: color is converted to RGB=(g,g,g).
         \param g grey component
@@ -462,10 +505,24 @@ public:
 	//! Returns pointer on compressed normals indexes table
 	NormsIndexesTableType* normals() const {return m_normals;}
 
+	//inherited from ccGenericPointCloud
+	virtual void notifyVisibilityChanged();
+
 protected:
 
+	//! Updates the indexes of the visible points (if necessary)
+	/** See m_visibleIndexes. Indexes are computed in parallel (if
+		ENABLE_MT_OCTREE is defined).
+		\return false if there's not enough memory
+	**/
+	bool updateVisibleIndexes();
+
 	//! Appends a cloud to this one
-	const ccPointCloud& append(ccPointCloud* cloud, unsigned pointCountBefore);
+	/** \param cloud cloud to append
+		\param pointCountBefore number of points of this cloud before the fusion
+		\param stealData whether the chunks of 'cloud' can be moved instead of copied (see ccPointCloud::merge)
+	**/
+	const ccPointCloud& append(ccPointCloud* cloud, unsigned pointCountBefore, bool stealData=false);
 
     //inherited from ccHObject
 	virtual void drawMeOnly(CC_DRAW_CONTEXT& context);
@@ -488,6 +545,18 @@ protected:
 	//! Currently displayed scalar field index
 	int m_currentDisplayedScalarFieldIndex;
 
+	//! Indexes of the visible points (see visibility array)
+	/** Indexes are relative to the start of each chunk (so that they can be
+		directly used with glDrawElements).
+	**/
+	std::vector<unsigned short> m_visibleIndexes;
+	//! Position of each chunk first index in m_visibleIndexes (+ total count)
+	std::vector<unsigned> m_visibleIndexesOffsets;
+	//! Whether m_visibleIndexes is up to date
+	bool m_visibleIndexesValid;
+	//! Number of points when m_visibleIndexes was computed
+	unsigned m_visibleIndexesPointCount;
+
 private:
 
     //! Inits default parameters
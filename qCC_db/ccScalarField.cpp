@@ -189,6 +189,18 @@ void ccScalarField::computeMinAndMax()
 	updateSaturationBounds();
 }
 
+void ccScalarField::setMinAndMax(ScalarType minVal, ScalarType maxVal)
+{
+	m_minVal = minVal;
+	m_maxVal = maxVal;
+
+	m_displayRange.setBounds(m_minVal,m_maxVal);
+	//the histogram would require a full scan
+	m_histogram.clear();
+
+	updateSaturationBounds();
+}
+
 void ccScalarField::updateSaturationBounds()
 {
 	if (!m_colorScale || m_colorScale->isRelative()) //Relative scale (default)
@@ -174,6 +174,12 @@ public:
 	//inherited
 	virtual void computeMinAndMax();
 
+	//! Sets the min and max values without scanning the field
+	/** The values must be the actual boundaries of the field (e.g. saved
+		along with it). The histogram is not computed.
+	**/
+	void setMinAndMax(ScalarType minVal, ScalarType maxVal);
+
 	//! Returns associated color scale
 	inline const ccColorScale::Shared& getColorScale() const { return m_colorScale; }
 
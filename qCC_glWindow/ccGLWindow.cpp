@@ -320,8 +320,7 @@ void ccGLWindow::initializeGL()
 			else
 			{
 				ccColorRampShader* colorRampShader = new ccColorRampShader();
-				std::string shadersPath = ccGLWindow::getShadersPath();
-				if (!colorRampShader->loadProgram(0,(shadersPath+"/ColorRamp/color_ramp.frag").c_str()))
+				if (!colorRampShader->init())
 				{
 					ccLog::Warning("[3D View %i] Failed to load color ramp shader!",m_uniqueID);
 					params.colorScaleShaderSupported = false;